@@ -0,0 +1,489 @@
+#ifndef BCG_BINARY_FORMAT_HPP
+#define BCG_BINARY_FORMAT_HPP
+
+#include "io/io_status.hpp"
+#include "transforms/matrix/matrix.hpp"
+#include "transforms/point.hpp"
+
+#include <cstdint>
+#include <cstring>
+#include <fstream>
+#include <limits>
+#include <string>
+#include <vector>
+
+#if defined(__unix__) || defined(__APPLE__)
+#define BCG_HAS_MMAP 1
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#else
+#define BCG_HAS_MMAP 0
+#endif
+
+namespace bcg
+{
+    //////////////////////////////////////////////////////////////////////////////////////////////////
+    // binary_header
+    //////////////////////////////////////////////////////////////////////////////////////////////////
+
+    enum class binary_elem_type : std::uint8_t
+    {
+        unknown = 0,
+        float32 = 1,
+        float64 = 2,
+        int32 = 3,
+        uint32 = 4,
+        int64 = 5,
+        uint64 = 6
+    };
+
+    enum class binary_layout : std::uint8_t
+    {
+        unknown = 0,
+        point_xyz = 1,         // 3 elements per point
+        point_xyzw = 2,        // 4 elements per point, 16-byte records for float
+        matrix_row_major = 3   // rows * cols elements per matrix
+    };
+
+    template<typename elem_type> struct binary_elem_traits { static const binary_elem_type code = binary_elem_type::unknown; };
+    template<> struct binary_elem_traits<float> { static const binary_elem_type code = binary_elem_type::float32; };
+    template<> struct binary_elem_traits<double> { static const binary_elem_type code = binary_elem_type::float64; };
+    template<> struct binary_elem_traits<std::int32_t> { static const binary_elem_type code = binary_elem_type::int32; };
+    template<> struct binary_elem_traits<std::uint32_t> { static const binary_elem_type code = binary_elem_type::uint32; };
+    template<> struct binary_elem_traits<std::int64_t> { static const binary_elem_type code = binary_elem_type::int64; };
+    template<> struct binary_elem_traits<std::uint64_t> { static const binary_elem_type code = binary_elem_type::uint64; };
+
+    // Fixed 64-byte header. The payload starts at data_offset, a multiple of binary_alignment, so a
+    // page-aligned mapping gives an aligned payload. Readers accept any minor version of their
+    // major version.
+    struct binary_header
+    {
+        static const std::uint16_t current_major = 1;
+        static const std::uint16_t current_minor = 0;
+        static const std::uint32_t byte_order_mark = 0x01020304;
+
+        char magic[4] = { 'B', 'C', 'G', 'B' };
+        std::uint16_t version_major = current_major;
+        std::uint16_t version_minor = current_minor;
+        std::uint32_t byte_order = byte_order_mark;
+        binary_elem_type elem_type = binary_elem_type::unknown;
+        binary_layout layout = binary_layout::unknown;
+        std::uint16_t reserved0 = 0;
+        std::uint32_t rows = 0;          // elements per record: 3 or 4 for points, matrix rows
+        std::uint32_t cols = 0;          // 1 for points, matrix columns
+        std::uint64_t record_count = 0;  // points or matrices
+        std::uint64_t data_offset = 0;
+        std::uint64_t data_size = 0;     // payload bytes
+        std::uint8_t reserved1[16] = {};
+
+        size_t elem_size() const;
+        size_t elems_per_record() const { return size_t(rows) * cols; }
+    };
+
+    const size_t binary_alignment = 64;
+
+    //////////////////////////////////////////////////////////////////////////////////////////////////
+    // mapped_file
+    //////////////////////////////////////////////////////////////////////////////////////////////////
+
+    // Read-only view of a whole file: memory-mapped where mmap is available, read into memory
+    // otherwise.
+    class mapped_file
+    {
+    public:
+        mapped_file() = default;
+        mapped_file(const mapped_file&) = delete;
+        mapped_file& operator =(const mapped_file&) = delete;
+        mapped_file(mapped_file&& other);
+        mapped_file& operator =(mapped_file&& other);
+        ~mapped_file();
+
+    public:
+        io_status open(const std::string& path);
+        void close();
+
+        bool is_open() const { return _is_open; }
+        const unsigned char* data() const { return _data; }
+        size_t size() const { return _size; }
+        bool is_mapped() const { return _is_mapped; }
+
+    private:
+        const unsigned char* _data = nullptr;
+        size_t _size = 0;
+        bool _is_open = false;
+        bool _is_mapped = false;
+        std::vector<unsigned char> _buffer; // fallback storage
+    };
+
+    //////////////////////////////////////////////////////////////////////////////////////////////////
+    // typed views
+    //////////////////////////////////////////////////////////////////////////////////////////////////
+
+    // zero-copy view of a point file, coordinates are read straight from the mapping
+    template<typename elem_type=float>
+    class point_file_view
+    {
+    public:
+        io_status open(const std::string& path);
+        void close() { _file.close(); _count = 0; _stride = 0; _elems = nullptr; }
+
+        size_t size() const { return _count; }
+        // elements per point, 3 or 4
+        size_t stride() const { return _stride; }
+        const elem_type* data() const { return _elems; }
+        const elem_type* coords(size_t idx) const { return _elems + idx * _stride; }
+        point get(size_t idx) const;
+        const binary_header& header() const { return _header; }
+        bool is_mapped() const { return _file.is_mapped(); }
+
+    private:
+        mapped_file _file;
+        binary_header _header;
+        const elem_type* _elems = nullptr;
+        size_t _count = 0;
+        size_t _stride = 0;
+    };
+
+    // zero-copy view of an array of row_count x col_count matrices
+    template<size_t row_count, size_t col_count=row_count, typename elem_type=double>
+    class matrix_file_view
+    {
+    public:
+        io_status open(const std::string& path);
+        void close() { _file.close(); _count = 0; _elems = nullptr; }
+
+        size_t size() const { return _count; }
+        const elem_type* data() const { return _elems; }
+        // row-major cells of matrix [idx]
+        const elem_type* cells(size_t idx) const { return _elems + idx * row_count * col_count; }
+        matrix<row_count, col_count, elem_type> get(size_t idx) const;
+        const binary_header& header() const { return _header; }
+
+    private:
+        mapped_file _file;
+        binary_header _header;
+        const elem_type* _elems = nullptr;
+        size_t _count = 0;
+    };
+
+    //////////////////////////////////////////////////////////////////////////////////////////////////
+    // writers
+    //////////////////////////////////////////////////////////////////////////////////////////////////
+
+    // coords hold [components] elements per point (3 for xyz, 4 for xyzw)
+    template<typename elem_type>
+    io_status write_point_file(const std::string& path, const elem_type* coords, size_t point_count,
+                               size_t components = 3);
+    io_status write_point_file(const std::string& path, const std::vector<point>& points,
+                               binary_layout layout = binary_layout::point_xyz);
+
+    template<size_t row_count, size_t col_count, typename elem_type>
+    io_status write_matrix_file(const std::string& path, const std::vector<matrix<row_count, col_count, elem_type>>& matrices);
+    // cells hold row_count * col_count row-major elements per matrix
+    template<typename elem_type>
+    io_status write_matrix_file(const std::string& path, const elem_type* cells, size_t matrix_count,
+                                size_t row_count, size_t col_count);
+
+    // reads and validates only the header
+    io_status read_binary_header(const std::string& path, binary_header& out_header);
+
+    //////////////////////////////////////////////////////////////////////////////////////////////////
+    // binary_header implementation
+    //////////////////////////////////////////////////////////////////////////////////////////////////
+
+    inline size_t binary_header::elem_size() const
+    {
+        switch (elem_type)
+        {
+            case binary_elem_type::float32:
+            case binary_elem_type::int32:
+            case binary_elem_type::uint32:
+                return 4;
+            case binary_elem_type::float64:
+            case binary_elem_type::int64:
+            case binary_elem_type::uint64:
+                return 8;
+            default:
+                return 0;
+        }
+    }
+
+    namespace binary_detail
+    {
+        static_assert(sizeof(binary_header) == 64, "binary_header must stay 64 bytes");
+
+        // a * b, false when it doesn't fit in 64 bits
+        inline bool checked_multiply(std::uint64_t a, std::uint64_t b, std::uint64_t& product)
+        {
+            if (a != 0 && b > std::numeric_limits<std::uint64_t>::max() / a) return false;
+            product = a * b;
+            return true;
+        }
+
+        // Every size is checked without wrapping, a crafted header could otherwise pass and send the
+        // views past the end of the mapping.
+        inline io_status validate(const binary_header& header, size_t file_size)
+        {
+            if (std::memcmp(header.magic, "BCGB", 4) != 0) return io_status::bad_magic;
+            if (header.byte_order != binary_header::byte_order_mark) return io_status::foreign_byte_order;
+            if (header.version_major != binary_header::current_major) return io_status::unsupported_version;
+            if (header.elem_size() == 0) return io_status::type_mismatch;
+            // the views cast the payload to elem_type in place
+            if (header.data_offset % binary_alignment != 0) return io_status::parse_failed;
+            std::uint64_t record_size = 0, data_size = 0;
+            if (!checked_multiply(std::uint64_t(header.rows) * header.cols, header.elem_size(), record_size) ||
+                !checked_multiply(header.record_count, record_size, data_size) || header.data_size != data_size ||
+                header.data_offset < sizeof(binary_header) || header.data_offset > file_size ||
+                header.data_size > file_size - header.data_offset) {
+                return io_status::truncated;
+            }
+            return io_status::ok;
+        }
+
+        // fill in data_offset and data_size from record_count, write the header and its padding
+        inline void write_header(std::ostream& out, binary_header& header)
+        {
+            header.data_offset = (sizeof(binary_header) + binary_alignment - 1) / binary_alignment * binary_alignment;
+            header.data_size = header.record_count * header.elems_per_record() * header.elem_size();
+            out.write(reinterpret_cast<const char*>(&header), sizeof(header));
+            static const char padding[binary_alignment] = {};
+            out.write(padding, static_cast<std::streamsize>(header.data_offset - sizeof(header)));
+        }
+
+        inline io_status write_file(const std::string& path, binary_header header, const void* payload)
+        {
+            std::ofstream out(path, std::ios::binary | std::ios::trunc);
+            if (!out) return io_status::open_failed;
+            write_header(out, header);
+            out.write(static_cast<const char*>(payload), static_cast<std::streamsize>(header.data_size));
+            return out ? io_status::ok : io_status::write_failed;
+        }
+
+        inline io_status open_view(mapped_file& file, const std::string& path, binary_header& header)
+        {
+            io_status status = file.open(path);
+            if (status != io_status::ok) return status;
+            if (file.size() < sizeof(binary_header)) {
+                file.close();
+                return io_status::truncated;
+            }
+            std::memcpy(&header, file.data(), sizeof(binary_header));
+            status = validate(header, file.size());
+            if (status != io_status::ok) file.close();
+            return status;
+        }
+    }
+
+    //////////////////////////////////////////////////////////////////////////////////////////////////
+    // mapped_file implementation
+    //////////////////////////////////////////////////////////////////////////////////////////////////
+
+    inline mapped_file::mapped_file(mapped_file&& other)
+    {
+        *this = std::move(other);
+    }
+
+    inline mapped_file& mapped_file::operator =(mapped_file&& other)
+    {
+        if (this == &other) return *this;
+        close();
+        _buffer.swap(other._buffer);
+        _data = other._is_mapped ? other._data : (_buffer.empty() ? nullptr : _buffer.data());
+        _size = other._size;
+        _is_open = other._is_open;
+        _is_mapped = other._is_mapped;
+        other._data = nullptr;
+        other._size = 0;
+        other._is_open = false;
+        other._is_mapped = false;
+        return *this;
+    }
+
+    inline mapped_file::~mapped_file()
+    {
+        close();
+    }
+
+    inline io_status mapped_file::open(const std::string& path)
+    {
+        close();
+#if BCG_HAS_MMAP
+        int fd = ::open(path.c_str(), O_RDONLY);
+        if (fd < 0) return io_status::open_failed;
+        struct stat st;
+        if (::fstat(fd, &st) != 0) {
+            ::close(fd);
+            return io_status::read_failed;
+        }
+        _size = static_cast<size_t>(st.st_size);
+        if (_size > 0) {
+            void* addr = ::mmap(nullptr, _size, PROT_READ, MAP_PRIVATE, fd, 0);
+            if (addr == MAP_FAILED) {
+                ::close(fd);
+                _size = 0;
+                return io_status::read_failed;
+            }
+            _data = static_cast<const unsigned char*>(addr);
+            _is_mapped = true;
+        }
+        // the mapping stays valid after the descriptor is closed
+        ::close(fd);
+#else
+        std::ifstream in(path, std::ios::binary | std::ios::ate);
+        if (!in) return io_status::open_failed;
+        _size = static_cast<size_t>(in.tellg());
+        _buffer.resize(_size);
+        in.seekg(0);
+        if (_size > 0 && !in.read(reinterpret_cast<char*>(_buffer.data()), static_cast<std::streamsize>(_size))) {
+            _buffer.clear();
+            _size = 0;
+            return io_status::read_failed;
+        }
+        _data = _buffer.empty() ? nullptr : _buffer.data();
+#endif
+        _is_open = true;
+        return io_status::ok;
+    }
+
+    inline void mapped_file::close()
+    {
+#if BCG_HAS_MMAP
+        if (_is_mapped && _data != nullptr) {
+            ::munmap(const_cast<unsigned char*>(_data), _size);
+        }
+#endif
+        std::vector<unsigned char>().swap(_buffer);
+        _data = nullptr;
+        _size = 0;
+        _is_open = false;
+        _is_mapped = false;
+    }
+
+    //////////////////////////////////////////////////////////////////////////////////////////////////
+    // typed views implementation
+    //////////////////////////////////////////////////////////////////////////////////////////////////
+
+    template<typename elem_type>
+    io_status point_file_view<elem_type>::open(const std::string& path)
+    {
+        close();
+        io_status status = binary_detail::open_view(_file, path, _header);
+        if (status != io_status::ok) return status;
+        bool xyz = _header.layout == binary_layout::point_xyz && _header.rows == 3;
+        bool xyzw = _header.layout == binary_layout::point_xyzw && _header.rows == 4;
+        if (_header.elem_type != binary_elem_traits<elem_type>::code || !(xyz || xyzw) || _header.cols != 1) {
+            _file.close();
+            return io_status::type_mismatch;
+        }
+        _elems = reinterpret_cast<const elem_type*>(_file.data() + _header.data_offset);
+        _count = static_cast<size_t>(_header.record_count);
+        _stride = _header.rows;
+        return io_status::ok;
+    }
+
+    template<typename elem_type>
+    point point_file_view<elem_type>::get(size_t idx) const
+    {
+        const elem_type* p = coords(idx);
+        return point(static_cast<float>(p[0]), static_cast<float>(p[1]), static_cast<float>(p[2]));
+    }
+
+    template<size_t row_count, size_t col_count, typename elem_type>
+    io_status matrix_file_view<row_count, col_count, elem_type>::open(const std::string& path)
+    {
+        close();
+        io_status status = binary_detail::open_view(_file, path, _header);
+        if (status != io_status::ok) return status;
+        if (_header.elem_type != binary_elem_traits<elem_type>::code ||
+            _header.layout != binary_layout::matrix_row_major ||
+            _header.rows != row_count || _header.cols != col_count) {
+            _file.close();
+            return io_status::type_mismatch;
+        }
+        _elems = reinterpret_cast<const elem_type*>(_file.data() + _header.data_offset);
+        _count = static_cast<size_t>(_header.record_count);
+        return io_status::ok;
+    }
+
+    template<size_t row_count, size_t col_count, typename elem_type>
+    matrix<row_count, col_count, elem_type> matrix_file_view<row_count, col_count, elem_type>::get(size_t idx) const
+    {
+        std::array<elem_type, row_count * col_count> elems;
+        std::memcpy(elems.data(), cells(idx), sizeof(elem_type) * row_count * col_count);
+        return matrix<row_count, col_count, elem_type>(elems);
+    }
+
+    //////////////////////////////////////////////////////////////////////////////////////////////////
+    // writers implementation
+    //////////////////////////////////////////////////////////////////////////////////////////////////
+
+    template<typename elem_type>
+    io_status write_point_file(const std::string& path, const elem_type* coords, size_t point_count,
+                               size_t components)
+    {
+        if (components != 3 && components != 4) return io_status::type_mismatch;
+        binary_header header;
+        header.elem_type = binary_elem_traits<elem_type>::code;
+        header.layout = components == 3 ? binary_layout::point_xyz : binary_layout::point_xyzw;
+        header.rows = static_cast<std::uint32_t>(components);
+        header.cols = 1;
+        header.record_count = point_count;
+        return binary_detail::write_file(path, header, coords);
+    }
+
+    inline io_status write_point_file(const std::string& path, const std::vector<point>& points, binary_layout layout)
+    {
+        size_t components = layout == binary_layout::point_xyzw ? 4 : 3;
+        std::vector<float> coords(points.size() * components);
+        for (size_t i = 0; i < points.size(); ++i) {
+            const b_vector<4, float>& p = points[i].data();
+            for (size_t c = 0; c < components; ++c) {
+                coords[i * components + c] = p[c];
+            }
+        }
+        return write_point_file(path, coords.data(), points.size(), components);
+    }
+
+    template<size_t row_count, size_t col_count, typename elem_type>
+    io_status write_matrix_file(const std::string& path, const std::vector<matrix<row_count, col_count, elem_type>>& matrices)
+    {
+        std::vector<elem_type> cells(matrices.size() * row_count * col_count);
+        for (size_t i = 0; i < matrices.size(); ++i) {
+            for (size_t row_idx = 0; row_idx < row_count; ++row_idx) {
+                const b_vector<col_count, elem_type>& row = matrices[i].get_row(row_idx);
+                for (size_t col_idx = 0; col_idx < col_count; ++col_idx) {
+                    cells[(i * row_count + row_idx) * col_count + col_idx] = row[col_idx];
+                }
+            }
+        }
+        return write_matrix_file(path, cells.data(), matrices.size(), row_count, col_count);
+    }
+
+    template<typename elem_type>
+    io_status write_matrix_file(const std::string& path, const elem_type* cells, size_t matrix_count,
+                                size_t row_count, size_t col_count)
+    {
+        binary_header header;
+        header.elem_type = binary_elem_traits<elem_type>::code;
+        header.layout = binary_layout::matrix_row_major;
+        header.rows = static_cast<std::uint32_t>(row_count);
+        header.cols = static_cast<std::uint32_t>(col_count);
+        header.record_count = matrix_count;
+        return binary_detail::write_file(path, header, cells);
+    }
+
+    inline io_status read_binary_header(const std::string& path, binary_header& out_header)
+    {
+        std::ifstream in(path, std::ios::binary | std::ios::ate);
+        if (!in) return io_status::open_failed;
+        size_t file_size = static_cast<size_t>(in.tellg());
+        if (file_size < sizeof(binary_header)) return io_status::truncated;
+        in.seekg(0);
+        if (!in.read(reinterpret_cast<char*>(&out_header), sizeof(binary_header))) return io_status::read_failed;
+        return binary_detail::validate(out_header, file_size);
+    }
+}
+
+#endif // BCG_BINARY_FORMAT_HPP
@@ -0,0 +1,43 @@
+#ifndef BCG_IO_STATUS_HPP
+#define BCG_IO_STATUS_HPP
+
+namespace bcg
+{
+    //////////////////////////////////////////////////////////////////////////////////////////////////
+    // io_status
+    //////////////////////////////////////////////////////////////////////////////////////////////////
+
+    enum class io_status
+    {
+        ok,
+        open_failed,
+        read_failed,
+        write_failed,
+        bad_magic,
+        unsupported_version,
+        foreign_byte_order,
+        type_mismatch,
+        truncated,
+        parse_failed
+    };
+
+    inline const char* to_string(io_status status)
+    {
+        switch (status)
+        {
+            case io_status::ok: return "ok";
+            case io_status::open_failed: return "open failed";
+            case io_status::read_failed: return "read failed";
+            case io_status::write_failed: return "write failed";
+            case io_status::bad_magic: return "bad magic";
+            case io_status::unsupported_version: return "unsupported version";
+            case io_status::foreign_byte_order: return "foreign byte order";
+            case io_status::type_mismatch: return "type mismatch";
+            case io_status::truncated: return "truncated";
+            case io_status::parse_failed: return "parse failed";
+        }
+        return "unknown";
+    }
+}
+
+#endif // BCG_IO_STATUS_HPP
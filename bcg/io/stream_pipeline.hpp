@@ -0,0 +1,346 @@
+#ifndef BCG_STREAM_PIPELINE_HPP
+#define BCG_STREAM_PIPELINE_HPP
+
+#include "io/binary_format.hpp"
+#include "transforms/matrix/matrix.hpp"
+#include "transforms/matrix/packed_matrix.hpp"
+#include "transforms/translation.hpp"
+#include "utils/parallel.hpp"
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+#include <cstring>
+#include <fstream>
+#include <functional>
+#include <string>
+#include <thread>
+#include <vector>
+
+namespace bcg
+{
+    //////////////////////////////////////////////////////////////////////////////////////////////////
+    // stream_pipeline
+    //////////////////////////////////////////////////////////////////////////////////////////////////
+
+    struct stream_pipeline_options
+    {
+        // bytes for all chunk buffers together, this is the whole working set of a run
+        size_t memory_budget = size_t(64) << 20;
+        // preferred size of one chunk, small enough to keep the stages overlapping and in cache
+        size_t chunk_bytes = size_t(1) << 20;
+        // with 3 buffers reading, processing and writing all overlap, 2 is classic double buffering
+        size_t buffer_count = 3;
+        // threads of the processing stage, 0 means all hardware threads
+        size_t thread_count = 0;
+    };
+
+    struct stream_pipeline_stats
+    {
+        std::uint64_t points_read = 0;
+        std::uint64_t points_written = 0;
+        size_t chunk_count = 0;
+        size_t chunk_points = 0;
+        size_t buffer_bytes = 0;
+        double seconds = 0;
+    };
+
+    // Out-of-core point processing: streams a binary point file (see binary_format.hpp) through a
+    // list of steps in fixed-size chunks and writes the surviving points to another point file.
+    // A reader thread, the processing stage and a writer thread pass chunk buffers around, so disk
+    // reads and writes overlap the compute.
+    class stream_pipeline
+    {
+    public:
+        // in-place stage over [count] points of [stride] floats, called concurrently on disjoint ranges
+        typedef std::function<void(float* coords, size_t count, size_t stride)> stage_type;
+        // keeps the point when it returns true
+        typedef std::function<bool(const float* coords)> filter_type;
+
+        explicit stream_pipeline(const stream_pipeline_options& options = stream_pipeline_options());
+
+    public:
+        // consecutive transforms are folded into one matrix. xyzw records get the full 4x4 with w as
+        // the homogeneous coordinate; xyz records are points with w = 1 and are divided by the
+        // resulting w when the bottom row is not (0, 0, 0, 1)
+        stream_pipeline& transform(const matrix<4, 4, float>& trans);
+        stream_pipeline& transform(const packed_matrix4<float>& trans);
+        stream_pipeline& transform(const translation& trans);
+        stream_pipeline& stage(const stage_type& fn);
+        stream_pipeline& filter(const filter_type& fn);
+
+        io_status run(const std::string& in_path, const std::string& out_path,
+                      stream_pipeline_stats* out_stats = nullptr) const;
+
+        const stream_pipeline_options& options() const { return _options; }
+        size_t step_count() const { return _steps.size(); }
+
+    private:
+        struct step
+        {
+            enum kind_type { transform_step, stage_step, filter_step } kind;
+            packed_matrix4<float> trans;
+            // bottom row is (0, 0, 0, 1), xyz records skip the divide
+            bool affine;
+            stage_type stage;
+            filter_type filter;
+        };
+
+        struct chunk
+        {
+            std::vector<float> coords;
+            size_t count = 0;
+        };
+
+        // runs every step over points [first, last) of a chunk, returns how many points survive;
+        // survivors are compacted to the front of the range
+        size_t process_range(float* coords, size_t first, size_t last, size_t stride) const;
+        size_t process_chunk(chunk& c, size_t stride) const;
+
+    private:
+        stream_pipeline_options _options;
+        std::vector<step> _steps;
+    };
+
+    //////////////////////////////////////////////////////////////////////////////////////////////////
+    // stream_pipeline implementation
+    //////////////////////////////////////////////////////////////////////////////////////////////////
+
+    inline stream_pipeline::stream_pipeline(const stream_pipeline_options& options)
+        : _options(options)
+    {
+        if (_options.buffer_count < 2) _options.buffer_count = 2;
+    }
+
+    inline stream_pipeline& stream_pipeline::transform(const matrix<4, 4, float>& trans)
+    {
+        return transform(packed_matrix4<float>(trans));
+    }
+
+    inline stream_pipeline& stream_pipeline::transform(const packed_matrix4<float>& trans)
+    {
+        if (!_steps.empty() && _steps.back().kind == step::transform_step) {
+            _steps.back().trans = trans * _steps.back().trans;
+        }
+        else {
+            step s;
+            s.kind = step::transform_step;
+            _steps.push_back(s);
+            _steps.back().trans = trans;
+        }
+        const float* m = _steps.back().trans.m;
+        _steps.back().affine = m[12] == 0 && m[13] == 0 && m[14] == 0 && m[15] == 1;
+        return *this;
+    }
+
+    inline stream_pipeline& stream_pipeline::transform(const translation& trans)
+    {
+        return transform(trans.to_matrix());
+    }
+
+    inline stream_pipeline& stream_pipeline::stage(const stage_type& fn)
+    {
+        step s;
+        s.kind = step::stage_step;
+        s.stage = fn;
+        _steps.push_back(s);
+        return *this;
+    }
+
+    inline stream_pipeline& stream_pipeline::filter(const filter_type& fn)
+    {
+        step s;
+        s.kind = step::filter_step;
+        s.filter = fn;
+        _steps.push_back(s);
+        return *this;
+    }
+
+    inline size_t stream_pipeline::process_range(float* coords, size_t first, size_t last, size_t stride) const
+    {
+        for (const step& s : _steps) {
+            float* begin = coords + first * stride;
+            size_t count = last - first;
+            switch (s.kind) {
+                case step::transform_step: {
+                    const float* m = s.trans.m;
+                    if (stride >= 4) {
+                        for (size_t i = 0; i < count; ++i) {
+                            float* p = begin + i * stride;
+                            float x = p[0], y = p[1], z = p[2], w = p[3];
+                            p[0] = m[0] * x + m[1] * y + m[2] * z + m[3] * w;
+                            p[1] = m[4] * x + m[5] * y + m[6] * z + m[7] * w;
+                            p[2] = m[8] * x + m[9] * y + m[10] * z + m[11] * w;
+                            p[3] = m[12] * x + m[13] * y + m[14] * z + m[15] * w;
+                        }
+                    }
+                    else if (s.affine) {
+                        for (size_t i = 0; i < count; ++i) {
+                            float* p = begin + i * stride;
+                            float x = p[0], y = p[1], z = p[2];
+                            p[0] = m[0] * x + m[1] * y + m[2] * z + m[3];
+                            p[1] = m[4] * x + m[5] * y + m[6] * z + m[7];
+                            p[2] = m[8] * x + m[9] * y + m[10] * z + m[11];
+                        }
+                    }
+                    else {
+                        for (size_t i = 0; i < count; ++i) {
+                            float* p = begin + i * stride;
+                            float x = p[0], y = p[1], z = p[2];
+                            float inv_w = 1.0f / (m[12] * x + m[13] * y + m[14] * z + m[15]);
+                            p[0] = (m[0] * x + m[1] * y + m[2] * z + m[3]) * inv_w;
+                            p[1] = (m[4] * x + m[5] * y + m[6] * z + m[7]) * inv_w;
+                            p[2] = (m[8] * x + m[9] * y + m[10] * z + m[11]) * inv_w;
+                        }
+                    }
+                    break;
+                }
+                case step::stage_step:
+                    s.stage(begin, count, stride);
+                    break;
+                case step::filter_step: {
+                    size_t kept = 0;
+                    for (size_t i = 0; i < count; ++i) {
+                        const float* p = begin + i * stride;
+                        if (!s.filter(p)) continue;
+                        if (kept != i) std::memcpy(begin + kept * stride, p, sizeof(float) * stride);
+                        ++kept;
+                    }
+                    last = first + kept;
+                    break;
+                }
+            }
+        }
+        return last - first;
+    }
+
+    inline size_t stream_pipeline::process_chunk(chunk& c, size_t stride) const
+    {
+        const size_t grain = 1 << 14;
+        size_t workers = resolve_thread_count(c.count, _options.thread_count, grain);
+        std::vector<size_t> range_first(workers, 0), range_kept(workers, 0);
+        float* coords = c.coords.data();
+        parallel_partition(0, c.count, [&](size_t t, size_t first, size_t last) {
+            range_first[t] = first;
+            range_kept[t] = process_range(coords, first, last, stride);
+        }, workers, grain);
+
+        // close the gaps filters left between the thread ranges
+        size_t total = range_kept[0];
+        for (size_t t = 1; t < workers; ++t) {
+            if (range_first[t] != total && range_kept[t] > 0) {
+                std::memmove(coords + total * stride, coords + range_first[t] * stride,
+                             sizeof(float) * stride * range_kept[t]);
+            }
+            total += range_kept[t];
+        }
+        return total;
+    }
+
+    inline io_status stream_pipeline::run(const std::string& in_path, const std::string& out_path,
+                                          stream_pipeline_stats* out_stats) const
+    {
+        auto start = std::chrono::steady_clock::now();
+
+        binary_header in_header;
+        io_status status = read_binary_header(in_path, in_header);
+        if (status != io_status::ok) return status;
+        if (in_header.elem_type != binary_elem_type::float32 ||
+            (in_header.layout != binary_layout::point_xyz && in_header.layout != binary_layout::point_xyzw)) {
+            return io_status::type_mismatch;
+        }
+
+        std::ifstream in(in_path, std::ios::binary);
+        if (!in) return io_status::open_failed;
+        in.seekg(static_cast<std::streamoff>(in_header.data_offset));
+        std::ofstream out(out_path, std::ios::binary | std::ios::trunc);
+        if (!out) return io_status::open_failed;
+
+        // the count is patched once the filters have run
+        binary_header out_header = in_header;
+        out_header.record_count = 0;
+        binary_detail::write_header(out, out_header);
+
+        const size_t stride = in_header.rows;
+        const size_t record_bytes = sizeof(float) * stride;
+        const size_t buffer_count = _options.buffer_count;
+        const size_t buffer_bytes = std::min(_options.chunk_bytes, _options.memory_budget / buffer_count);
+        const size_t chunk_points = std::max<size_t>(1, buffer_bytes / record_bytes);
+
+        std::vector<chunk> chunks(buffer_count);
+        for (chunk& c : chunks) c.coords.resize(chunk_points * stride);
+
+        const size_t end_of_stream = size_t(-1);
+        blocking_queue<size_t> free_chunks, read_chunks, processed_chunks;
+        for (size_t i = 0; i < buffer_count; ++i) free_chunks.push(i);
+
+        std::atomic<bool> read_failed(false), write_failed(false);
+        std::uint64_t points_read = 0, points_written = 0;
+        size_t chunk_count = 0;
+
+        std::thread reader([&]() {
+            std::uint64_t remaining = in_header.record_count;
+            while (remaining > 0 && !write_failed) {
+                size_t idx = free_chunks.pop();
+                chunk& c = chunks[idx];
+                c.count = static_cast<size_t>(std::min<std::uint64_t>(remaining, chunk_points));
+                if (!in.read(reinterpret_cast<char*>(c.coords.data()), static_cast<std::streamsize>(c.count * record_bytes))) {
+                    read_failed = true;
+                    free_chunks.push(idx);
+                    break;
+                }
+                points_read += c.count;
+                remaining -= c.count;
+                read_chunks.push(idx);
+            }
+            read_chunks.push(end_of_stream);
+        });
+
+        std::thread writer([&]() {
+            for (;;) {
+                size_t idx = processed_chunks.pop();
+                if (idx == end_of_stream) return;
+                const chunk& c = chunks[idx];
+                if (!write_failed && c.count > 0) {
+                    out.write(reinterpret_cast<const char*>(c.coords.data()), static_cast<std::streamsize>(c.count * record_bytes));
+                    if (!out) write_failed = true;
+                    points_written += c.count;
+                }
+                free_chunks.push(idx);
+            }
+        });
+
+        for (;;) {
+            size_t idx = read_chunks.pop();
+            if (idx == end_of_stream) break;
+            chunks[idx].count = process_chunk(chunks[idx], stride);
+            ++chunk_count;
+            processed_chunks.push(idx);
+        }
+        processed_chunks.push(end_of_stream);
+        reader.join();
+        writer.join();
+
+        if (read_failed) return io_status::truncated;
+        if (write_failed) return io_status::write_failed;
+
+        out_header.record_count = points_written;
+        out.seekp(0);
+        binary_detail::write_header(out, out_header);
+        out.flush();
+        if (!out) return io_status::write_failed;
+
+        if (out_stats != nullptr) {
+            out_stats->points_read = points_read;
+            out_stats->points_written = points_written;
+            out_stats->chunk_count = chunk_count;
+            out_stats->chunk_points = chunk_points;
+            out_stats->buffer_bytes = buffer_count * chunk_points * record_bytes;
+            out_stats->seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+        }
+        return io_status::ok;
+    }
+}
+
+#endif // BCG_STREAM_PIPELINE_HPP
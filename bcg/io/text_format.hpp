@@ -0,0 +1,788 @@
+#ifndef BCG_TEXT_FORMAT_HPP
+#define BCG_TEXT_FORMAT_HPP
+
+#include "io/binary_format.hpp"
+#include "transforms/point.hpp"
+#include "utils/parallel.hpp"
+
+#include <algorithm>
+#include <atomic>
+#include <cmath>
+#include <cstdint>
+#include <cstdlib>
+#include <cstring>
+#include <fstream>
+#include <string>
+#include <vector>
+
+namespace bcg
+{
+    //////////////////////////////////////////////////////////////////////////////////////////////////
+    // number conversion
+    //////////////////////////////////////////////////////////////////////////////////////////////////
+
+    // Like std::from_chars: parse a number at the start of [first, last), return the end of the
+    // number, or first when there is none. No locale, no leading whitespace.
+    inline const char* parse_float(const char* first, const char* last, float& value);
+    inline const char* parse_uint(const char* first, const char* last, std::uint64_t& value);
+    inline const char* parse_int(const char* first, const char* last, std::int64_t& value);
+
+    // Like std::to_chars: write [value] at out and return the end, no terminating zero. Floats use
+    // [digits] significant digits, 9 round-trips every float. At most 24 chars are written.
+    inline char* format_float(float value, char* out, int digits = 9);
+    inline char* format_uint(std::uint64_t value, char* out);
+
+    //////////////////////////////////////////////////////////////////////////////////////////////////
+    // text formats
+    //////////////////////////////////////////////////////////////////////////////////////////////////
+
+    struct text_write_options
+    {
+        // significant digits of coordinates, 9 round-trips floats and 7 is usually plenty
+        int float_digits = 9;
+        size_t thread_count = 0;
+    };
+
+    // XYZ: one point per line as "x y z", extra columns are ignored, '#' starts a comment line.
+    inline io_status read_xyz(const std::string& path, std::vector<float>& out_coords, size_t thread_count = 0);
+    inline io_status write_xyz(const std::string& path, const float* coords, size_t point_count,
+                               const text_write_options& options = text_write_options());
+    inline io_status write_xyz(const std::string& path, const std::vector<point>& points,
+                               const text_write_options& options = text_write_options());
+
+    // OBJ: "v" positions and "f" faces (v, v/vt, v//vn, v/vt/vn, negative indices), polygons are
+    // fan-triangulated, every other statement is skipped. Triangles index from 0.
+    inline io_status read_obj(const std::string& path, std::vector<float>& out_positions,
+                              std::vector<std::uint32_t>& out_triangles, size_t thread_count = 0);
+    inline io_status write_obj(const std::string& path, const float* positions, size_t vertex_count,
+                               const std::uint32_t* triangles, size_t triangle_count,
+                               const text_write_options& options = text_write_options());
+
+    // ASCII PLY: x, y, z of the vertex element and the vertex_indices list of the face element,
+    // other properties and elements are skipped, wherever they are declared. Binary PLY reports
+    // type_mismatch.
+    inline io_status read_ply(const std::string& path, std::vector<float>& out_positions,
+                              std::vector<std::uint32_t>& out_triangles, size_t thread_count = 0);
+    inline io_status write_ply(const std::string& path, const float* positions, size_t vertex_count,
+                               const std::uint32_t* triangles, size_t triangle_count,
+                               const text_write_options& options = text_write_options());
+
+    //////////////////////////////////////////////////////////////////////////////////////////////////
+    // number conversion implementation
+    //////////////////////////////////////////////////////////////////////////////////////////////////
+
+    namespace text_detail
+    {
+        // powers of ten that are exact in a double
+        inline double exact_pow10(int e)
+        {
+            static const double table[] = {
+                1e0, 1e1, 1e2, 1e3, 1e4, 1e5, 1e6, 1e7, 1e8, 1e9, 1e10, 1e11,
+                1e12, 1e13, 1e14, 1e15, 1e16, 1e17, 1e18, 1e19, 1e20, 1e21, 1e22
+            };
+            return e <= 22 ? table[e] : std::pow(10.0, e);
+        }
+
+        inline double scale_pow10(double v, int e)
+        {
+            return e >= 0 ? v * exact_pow10(e) : v / exact_pow10(-e);
+        }
+
+        inline bool is_digit(char c) { return c >= '0' && c <= '9'; }
+        inline bool is_blank(char c) { return c == ' ' || c == '\t' || c == '\r' || c == ','; }
+
+        inline const char* skip_blanks(const char* p, const char* last)
+        {
+            while (p < last && is_blank(*p)) ++p;
+            return p;
+        }
+
+        inline const char* next_line(const char* p, const char* last)
+        {
+            const void* nl = std::memchr(p, '\n', static_cast<size_t>(last - p));
+            return nl == nullptr ? last : static_cast<const char*>(nl) + 1;
+        }
+
+        // nan, inf and friends are rare enough for strtof
+        inline const char* parse_special(const char* first, const char* last, float& value)
+        {
+            char buffer[32];
+            size_t len = std::min<size_t>(static_cast<size_t>(last - first), sizeof(buffer) - 1);
+            std::memcpy(buffer, first, len);
+            buffer[len] = '\0';
+            char* end = nullptr;
+            float v = std::strtof(buffer, &end);
+            if (end == buffer) return first;
+            value = v;
+            return first + (end - buffer);
+        }
+    }
+
+    inline const char* parse_float(const char* first, const char* last, float& value)
+    {
+        using namespace text_detail;
+        const char* p = first;
+        bool negative = false;
+        if (p < last && (*p == '-' || *p == '+')) {
+            negative = (*p == '-');
+            ++p;
+        }
+        if (p < last && !is_digit(*p) && *p != '.') return parse_special(first, last, value);
+
+        // up to 19 significant digits fit the mantissa, the rest only shifts the exponent
+        std::uint64_t mantissa = 0;
+        int digit_count = 0, exponent = 0;
+        bool any_digit = false;
+        for (; p < last && is_digit(*p); ++p) {
+            any_digit = true;
+            if (digit_count < 19) {
+                mantissa = mantissa * 10 + std::uint64_t(*p - '0');
+                if (mantissa != 0) ++digit_count;
+            }
+            else {
+                ++exponent;
+            }
+        }
+        if (p < last && *p == '.') {
+            for (++p; p < last && is_digit(*p); ++p) {
+                any_digit = true;
+                if (digit_count < 19) {
+                    mantissa = mantissa * 10 + std::uint64_t(*p - '0');
+                    if (mantissa != 0) ++digit_count;
+                    --exponent;
+                }
+            }
+        }
+        if (!any_digit) return first;
+
+        if (p < last && (*p == 'e' || *p == 'E')) {
+            const char* q = p + 1;
+            bool negative_exp = false;
+            if (q < last && (*q == '-' || *q == '+')) {
+                negative_exp = (*q == '-');
+                ++q;
+            }
+            if (q < last && is_digit(*q)) {
+                int e = 0;
+                for (; q < last && is_digit(*q); ++q) {
+                    if (e < 10000) e = e * 10 + (*q - '0');
+                }
+                exponent += negative_exp ? -e : e;
+                p = q;
+            }
+        }
+
+        double v = static_cast<double>(mantissa);
+        if (mantissa != 0 && exponent != 0) {
+            // below 1e-308 a double underflows while the float result would be a denormal or 0
+            v = exponent < -300 ? scale_pow10(scale_pow10(v, -300), exponent + 300) : scale_pow10(v, exponent);
+        }
+        value = static_cast<float>(negative ? -v : v);
+        return p;
+    }
+
+    inline const char* parse_uint(const char* first, const char* last, std::uint64_t& value)
+    {
+        const char* p = first;
+        std::uint64_t v = 0;
+        for (; p < last && text_detail::is_digit(*p); ++p) {
+            v = v * 10 + std::uint64_t(*p - '0');
+        }
+        if (p == first) return first;
+        value = v;
+        return p;
+    }
+
+    inline const char* parse_int(const char* first, const char* last, std::int64_t& value)
+    {
+        const char* p = first;
+        bool negative = false;
+        if (p < last && (*p == '-' || *p == '+')) {
+            negative = (*p == '-');
+            ++p;
+        }
+        std::uint64_t magnitude = 0;
+        const char* end = parse_uint(p, last, magnitude);
+        if (end == p) return first;
+        value = negative ? -static_cast<std::int64_t>(magnitude) : static_cast<std::int64_t>(magnitude);
+        return end;
+    }
+
+    inline char* format_uint(std::uint64_t value, char* out)
+    {
+        char digits[20];
+        int count = 0;
+        do {
+            digits[count++] = char('0' + value % 10);
+            value /= 10;
+        } while (value != 0);
+        while (count > 0) *out++ = digits[--count];
+        return out;
+    }
+
+    inline char* format_float(float value, char* out, int digits)
+    {
+        using namespace text_detail;
+        if (std::isnan(value)) {
+            std::memcpy(out, "nan", 3);
+            return out + 3;
+        }
+        if (value < 0) *out++ = '-';
+        if (std::isinf(value)) {
+            std::memcpy(out, "inf", 3);
+            return out + 3;
+        }
+        if (value == 0) {
+            *out++ = '0';
+            return out;
+        }
+        digits = std::max(1, std::min(digits, 17));
+
+        // digits-digit integer mantissa m and decimal exponent e with |value| ~ m * 10^(e - digits + 1)
+        double magnitude = std::fabs(static_cast<double>(value));
+        int e = static_cast<int>(std::floor(std::log10(magnitude)));
+        const std::uint64_t upper = static_cast<std::uint64_t>(exact_pow10(digits));
+        std::uint64_t m = 0;
+        for (int attempt = 0; attempt < 3; ++attempt) {
+            m = static_cast<std::uint64_t>(scale_pow10(magnitude, digits - 1 - e) + 0.5);
+            if (m >= upper) ++e;
+            else if (m < upper / 10) --e;
+            else break;
+        }
+        if (m >= upper) m = upper / 10;
+
+        char mantissa[20];
+        for (int i = digits - 1; i >= 0; --i) {
+            mantissa[i] = char('0' + m % 10);
+            m /= 10;
+        }
+        int length = digits;
+        while (length > 1 && mantissa[length - 1] == '0') --length;
+
+        if (e >= digits || e < -5) {
+            // scientific, d.ddde-xx
+            *out++ = mantissa[0];
+            if (length > 1) {
+                *out++ = '.';
+                std::memcpy(out, mantissa + 1, static_cast<size_t>(length - 1));
+                out += length - 1;
+            }
+            *out++ = 'e';
+            *out++ = e < 0 ? '-' : '+';
+            int abs_e = e < 0 ? -e : e;
+            if (abs_e < 10) *out++ = '0';
+            return format_uint(static_cast<std::uint64_t>(abs_e), out);
+        }
+        if (e < 0) {
+            *out++ = '0';
+            *out++ = '.';
+            for (int i = -1; i > e; --i) *out++ = '0';
+            std::memcpy(out, mantissa, static_cast<size_t>(length));
+            return out + length;
+        }
+        for (int i = 0; i <= e; ++i) *out++ = i < length ? mantissa[i] : '0';
+        if (length > e + 1) {
+            *out++ = '.';
+            std::memcpy(out, mantissa + e + 1, static_cast<size_t>(length - e - 1));
+            out += length - e - 1;
+        }
+        return out;
+    }
+
+    //////////////////////////////////////////////////////////////////////////////////////////////////
+    // text formats implementation
+    //////////////////////////////////////////////////////////////////////////////////////////////////
+
+    namespace text_detail
+    {
+        // split [begin, end) into line-aligned chunks, chunk c is [bounds[c], bounds[c + 1])
+        inline std::vector<const char*> split_lines(const char* begin, const char* end, size_t thread_count)
+        {
+            const size_t min_chunk_bytes = size_t(1) << 20;
+            size_t total = static_cast<size_t>(end - begin);
+            size_t workers = resolve_thread_count(total, thread_count, min_chunk_bytes);
+            // a few chunks per worker even out lines of different cost
+            size_t target = std::max(min_chunk_bytes, total / (workers * 4) + 1);
+
+            std::vector<const char*> bounds(1, begin);
+            while (bounds.back() < end) {
+                const char* p = bounds.back() + std::min(target, static_cast<size_t>(end - bounds.back()));
+                bounds.push_back(p < end ? next_line(p - 1, end) : end);
+            }
+            return bounds;
+        }
+
+        // run fn(chunk_idx, first, last) over the chunks in parallel; callers keep one result per
+        // chunk and concatenate them in chunk order, which is the file order
+        template<typename func_type>
+        void parse_chunks(const std::vector<const char*>& bounds, size_t thread_count, func_type fn)
+        {
+            size_t chunk_count = bounds.size() - 1;
+            parallel_for(0, chunk_count, [&](size_t first, size_t last) {
+                for (size_t c = first; c < last; ++c) fn(c, bounds[c], bounds[c + 1]);
+            }, thread_count, 1);
+        }
+
+        // Format [count] records with fn(record_idx, out) -> end, at most [max_record_chars] each.
+        // Blocks of records are formatted in parallel and written in order with one call per block.
+        template<typename func_type>
+        io_status write_records(std::ofstream& out, size_t count, size_t max_record_chars, size_t thread_count,
+                                func_type fn)
+        {
+            const size_t block_records = 1 << 15;
+            size_t block_count = (count + block_records - 1) / block_records;
+            size_t workers = resolve_thread_count(block_count, thread_count, 1);
+            std::vector<std::vector<char>> buffers(workers, std::vector<char>(block_records * max_record_chars));
+            std::vector<size_t> lengths(workers);
+
+            for (size_t group = 0; group < block_count; group += workers) {
+                size_t group_size = std::min(workers, block_count - group);
+                parallel_for(0, group_size, [&](size_t first, size_t last) {
+                    for (size_t b = first; b < last; ++b) {
+                        size_t record_first = (group + b) * block_records;
+                        size_t record_last = std::min(count, record_first + block_records);
+                        char* begin = buffers[b].data();
+                        char* p = begin;
+                        for (size_t i = record_first; i < record_last; ++i) p = fn(i, p);
+                        lengths[b] = static_cast<size_t>(p - begin);
+                    }
+                }, group_size, 1);
+                for (size_t b = 0; b < group_size; ++b) {
+                    out.write(buffers[b].data(), static_cast<std::streamsize>(lengths[b]));
+                }
+            }
+            return out ? io_status::ok : io_status::write_failed;
+        }
+
+        inline char* format_point(const float* p, char* out, int digits)
+        {
+            out = format_float(p[0], out, digits);
+            *out++ = ' ';
+            out = format_float(p[1], out, digits);
+            *out++ = ' ';
+            out = format_float(p[2], out, digits);
+            return out;
+        }
+
+        inline char* format_triangle(const std::uint32_t* t, char* out, std::uint32_t base)
+        {
+            out = format_uint(std::uint64_t(t[0]) + base, out);
+            *out++ = ' ';
+            out = format_uint(std::uint64_t(t[1]) + base, out);
+            *out++ = ' ';
+            out = format_uint(std::uint64_t(t[2]) + base, out);
+            return out;
+        }
+
+        // chunk parsers collect their own arrays, which are concatenated in chunk order
+        struct mesh_chunk
+        {
+            std::vector<float> positions;
+            std::vector<std::int64_t> triangles;
+            // slots of triangles holding chunk-local vertex numbers (OBJ negative indices)
+            std::vector<size_t> relative_slots;
+        };
+
+        inline io_status merge_mesh_chunks(std::vector<mesh_chunk>& chunks, std::vector<float>& out_positions,
+                                           std::vector<std::uint32_t>& out_triangles)
+        {
+            size_t position_total = 0, triangle_total = 0;
+            for (const mesh_chunk& c : chunks) {
+                position_total += c.positions.size();
+                triangle_total += c.triangles.size();
+            }
+            out_positions.clear();
+            out_positions.reserve(position_total);
+            out_triangles.clear();
+            out_triangles.reserve(triangle_total);
+
+            const std::int64_t vertex_count = static_cast<std::int64_t>(position_total / 3);
+            std::int64_t vertex_base = 0;
+            for (mesh_chunk& c : chunks) {
+                for (size_t slot : c.relative_slots) c.triangles[slot] += vertex_base;
+                for (std::int64_t idx : c.triangles) {
+                    if (idx < 0 || idx >= vertex_count) return io_status::parse_failed;
+                    out_triangles.push_back(static_cast<std::uint32_t>(idx));
+                }
+                out_positions.insert(out_positions.end(), c.positions.begin(), c.positions.end());
+                vertex_base += static_cast<std::int64_t>(c.positions.size() / 3);
+                std::vector<float>().swap(c.positions);
+                std::vector<std::int64_t>().swap(c.triangles);
+            }
+            return io_status::ok;
+        }
+
+        inline bool starts_with_word(const char* p, const char* last, const char* word)
+        {
+            size_t len = std::strlen(word);
+            if (static_cast<size_t>(last - p) < len || std::memcmp(p, word, len) != 0) return false;
+            return p + len == last || is_blank(p[len]) || p[len] == '\n';
+        }
+    }
+
+    inline io_status read_xyz(const std::string& path, std::vector<float>& out_coords, size_t thread_count)
+    {
+        using namespace text_detail;
+        mapped_file file;
+        io_status status = file.open(path);
+        if (status != io_status::ok) return status;
+        const char* begin = reinterpret_cast<const char*>(file.data());
+        const char* end = begin + file.size();
+
+        std::vector<const char*> bounds = split_lines(begin, end, thread_count);
+        std::vector<std::vector<float>> chunks(bounds.size() - 1);
+        std::atomic<bool> failed(false);
+        parse_chunks(bounds, thread_count, [&](size_t c, const char* first, const char* last) {
+            std::vector<float>& coords = chunks[c];
+            coords.reserve(static_cast<size_t>(last - first) / 8);
+            for (const char* line = first; line < last; line = next_line(line, last)) {
+                const char* p = skip_blanks(line, last);
+                if (p == last || *p == '\n' || *p == '#') continue;
+                for (size_t d = 0; d < 3; ++d) {
+                    float v;
+                    const char* q = parse_float(p, last, v);
+                    if (q == p) {
+                        failed = true;
+                        return;
+                    }
+                    coords.push_back(v);
+                    p = skip_blanks(q, last);
+                }
+            }
+        });
+        if (failed) return io_status::parse_failed;
+
+        size_t total = 0;
+        for (const auto& chunk : chunks) total += chunk.size();
+        out_coords.clear();
+        out_coords.reserve(total);
+        for (const auto& chunk : chunks) {
+            out_coords.insert(out_coords.end(), chunk.begin(), chunk.end());
+        }
+        return io_status::ok;
+    }
+
+    inline io_status write_xyz(const std::string& path, const float* coords, size_t point_count,
+                               const text_write_options& options)
+    {
+        std::ofstream out(path, std::ios::binary | std::ios::trunc);
+        if (!out) return io_status::open_failed;
+        int digits = options.float_digits;
+        return text_detail::write_records(out, point_count, 3 * 25 + 1, options.thread_count,
+                                          [&](size_t i, char* p) {
+            p = text_detail::format_point(coords + i * 3, p, digits);
+            *p++ = '\n';
+            return p;
+        });
+    }
+
+    inline io_status write_xyz(const std::string& path, const std::vector<point>& points,
+                               const text_write_options& options)
+    {
+        std::vector<float> coords(points.size() * 3);
+        for (size_t i = 0; i < points.size(); ++i) {
+            const b_vector<4, float>& p = points[i].data();
+            coords[i * 3 + 0] = p[0];
+            coords[i * 3 + 1] = p[1];
+            coords[i * 3 + 2] = p[2];
+        }
+        return write_xyz(path, coords.data(), points.size(), options);
+    }
+
+    inline io_status read_obj(const std::string& path, std::vector<float>& out_positions,
+                              std::vector<std::uint32_t>& out_triangles, size_t thread_count)
+    {
+        using namespace text_detail;
+        mapped_file file;
+        io_status status = file.open(path);
+        if (status != io_status::ok) return status;
+        const char* begin = reinterpret_cast<const char*>(file.data());
+        const char* end = begin + file.size();
+
+        std::vector<const char*> bounds = split_lines(begin, end, thread_count);
+        std::vector<mesh_chunk> chunks(bounds.size() - 1);
+        std::atomic<bool> failed(false);
+        parse_chunks(bounds, thread_count, [&](size_t c, const char* first, const char* last) {
+            mesh_chunk& chunk = chunks[c];
+            std::vector<std::int64_t> polygon;
+            std::vector<bool> polygon_relative;
+            for (const char* line = first; line < last; line = next_line(line, last)) {
+                const char* p = skip_blanks(line, last);
+                if (starts_with_word(p, last, "v")) {
+                    p = skip_blanks(p + 1, last);
+                    for (size_t d = 0; d < 3; ++d) {
+                        float v;
+                        const char* q = parse_float(p, last, v);
+                        if (q == p) {
+                            failed = true;
+                            return;
+                        }
+                        chunk.positions.push_back(v);
+                        p = skip_blanks(q, last);
+                    }
+                }
+                else if (starts_with_word(p, last, "f")) {
+                    p = skip_blanks(p + 1, last);
+                    polygon.clear();
+                    polygon_relative.clear();
+                    std::int64_t local_count = static_cast<std::int64_t>(chunk.positions.size() / 3);
+                    while (p < last && *p != '\n') {
+                        std::int64_t idx = 0;
+                        const char* q = parse_int(p, last, idx);
+                        if (q == p || idx == 0) {
+                            failed = true;
+                            return;
+                        }
+                        // negative indices count back from the last vertex read so far
+                        polygon.push_back(idx > 0 ? idx - 1 : local_count + idx);
+                        polygon_relative.push_back(idx < 0);
+                        // skip texture and normal references
+                        while (q < last && !is_blank(*q) && *q != '\n') ++q;
+                        p = skip_blanks(q, last);
+                    }
+                    for (size_t i = 1; i + 1 < polygon.size(); ++i) {
+                        const size_t corners[3] = { 0, i, i + 1 };
+                        for (size_t corner : corners) {
+                            if (polygon_relative[corner]) chunk.relative_slots.push_back(chunk.triangles.size());
+                            chunk.triangles.push_back(polygon[corner]);
+                        }
+                    }
+                }
+            }
+        });
+        if (failed) return io_status::parse_failed;
+        return merge_mesh_chunks(chunks, out_positions, out_triangles);
+    }
+
+    inline io_status write_obj(const std::string& path, const float* positions, size_t vertex_count,
+                               const std::uint32_t* triangles, size_t triangle_count,
+                               const text_write_options& options)
+    {
+        std::ofstream out(path, std::ios::binary | std::ios::trunc);
+        if (!out) return io_status::open_failed;
+        int digits = options.float_digits;
+        io_status status = text_detail::write_records(out, vertex_count, 3 * 25 + 3, options.thread_count,
+                                                      [&](size_t i, char* p) {
+            *p++ = 'v';
+            *p++ = ' ';
+            p = text_detail::format_point(positions + i * 3, p, digits);
+            *p++ = '\n';
+            return p;
+        });
+        if (status != io_status::ok) return status;
+        return text_detail::write_records(out, triangle_count, 3 * 21 + 3, options.thread_count,
+                                          [&](size_t i, char* p) {
+            *p++ = 'f';
+            *p++ = ' ';
+            p = text_detail::format_triangle(triangles + i * 3, p, 1);
+            *p++ = '\n';
+            return p;
+        });
+    }
+
+    inline io_status read_ply(const std::string& path, std::vector<float>& out_positions,
+                              std::vector<std::uint32_t>& out_triangles, size_t thread_count)
+    {
+        using namespace text_detail;
+        mapped_file file;
+        io_status status = file.open(path);
+        if (status != io_status::ok) return status;
+        const char* begin = reinterpret_cast<const char*>(file.data());
+        const char* end = begin + file.size();
+
+        struct property
+        {
+            std::string name;
+            bool is_list;
+        };
+        struct element
+        {
+            std::string name;
+            size_t count;
+            std::vector<property> properties;
+        };
+        std::vector<element> elements;
+
+        // header
+        const char* p = begin;
+        if (!starts_with_word(p, end, "ply")) return io_status::bad_magic;
+        bool ascii = false, header_done = false;
+        for (p = next_line(p, end); p < end && !header_done; p = next_line(p, end)) {
+            const char* line_end = next_line(p, end);
+            // words split on the same blanks as the body, so tabs and repeated spaces are fine
+            std::vector<std::string> words;
+            for (const char* q = skip_blanks(p, line_end); q < line_end && *q != '\n'; q = skip_blanks(q, line_end)) {
+                const char* word_end = q;
+                while (word_end < line_end && *word_end != '\n' && !is_blank(*word_end)) ++word_end;
+                words.push_back(std::string(q, word_end));
+                q = word_end;
+            }
+            if (words.empty() || words[0] == "comment" || words[0] == "obj_info") continue;
+            if (words[0] == "format") {
+                ascii = words.size() > 1 && words[1] == "ascii";
+            }
+            else if (words[0] == "element" && words.size() == 3) {
+                std::uint64_t count = 0;
+                parse_uint(words[2].data(), words[2].data() + words[2].size(), count);
+                elements.push_back(element{ words[1], static_cast<size_t>(count), {} });
+            }
+            else if (words[0] == "property" && !elements.empty()) {
+                elements.back().properties.push_back(property{ words.back(), words.size() > 1 && words[1] == "list" });
+            }
+            else if (words[0] == "end_header") {
+                header_done = true;
+            }
+        }
+        if (!header_done) return io_status::parse_failed;
+        if (!ascii) return io_status::type_mismatch;
+
+        std::vector<mesh_chunk> vertex_chunks, face_chunks;
+        std::atomic<bool> failed(false);
+        for (const element& elem : elements) {
+            // line-aligned section of this element
+            const char* section_begin = p;
+            for (size_t i = 0; i < elem.count; ++i) {
+                if (p == end) return io_status::truncated;
+                p = next_line(p, end);
+            }
+            const char* section_end = p;
+            std::vector<const char*> bounds = split_lines(section_begin, section_end, thread_count);
+
+            if (elem.name == "vertex") {
+                size_t coord_slot[3] = { size_t(-1), size_t(-1), size_t(-1) };
+                for (size_t i = 0; i < elem.properties.size(); ++i) {
+                    if (elem.properties[i].name == "x") coord_slot[0] = i;
+                    if (elem.properties[i].name == "y") coord_slot[1] = i;
+                    if (elem.properties[i].name == "z") coord_slot[2] = i;
+                }
+                if (coord_slot[0] == size_t(-1) || coord_slot[1] == size_t(-1) || coord_slot[2] == size_t(-1)) {
+                    return io_status::type_mismatch;
+                }
+                size_t property_count = elem.properties.size();
+                vertex_chunks.resize(bounds.size() - 1);
+                parse_chunks(bounds, thread_count, [&](size_t c, const char* first, const char* last) {
+                    std::vector<float>& positions = vertex_chunks[c].positions;
+                    for (const char* line = first; line < last; line = next_line(line, last)) {
+                        const char* q = skip_blanks(line, last);
+                        float xyz[3] = {};
+                        for (size_t prop = 0; prop < property_count; ++prop) {
+                            float v = 0;
+                            const char* r = parse_float(q, last, v);
+                            if (r == q) {
+                                failed = true;
+                                return;
+                            }
+                            for (size_t d = 0; d < 3; ++d) {
+                                if (coord_slot[d] == prop) xyz[d] = v;
+                            }
+                            q = skip_blanks(r, last);
+                        }
+                        positions.insert(positions.end(), xyz, xyz + 3);
+                    }
+                });
+            }
+            else if (elem.name == "face") {
+                // the corner list may follow other properties, which are skipped token by token
+                size_t index_slot = size_t(-1);
+                for (size_t i = 0; i < elem.properties.size(); ++i) {
+                    const property& prop = elem.properties[i];
+                    if (prop.is_list && (prop.name == "vertex_indices" || prop.name == "vertex_index")) {
+                        index_slot = i;
+                        break;
+                    }
+                }
+                if (index_slot == size_t(-1)) continue;
+                face_chunks.resize(bounds.size() - 1);
+                parse_chunks(bounds, thread_count, [&](size_t c, const char* first, const char* last) {
+                    std::vector<std::int64_t>& triangles = face_chunks[c].triangles;
+                    std::vector<std::int64_t> polygon;
+                    for (const char* line = first; line < last; line = next_line(line, last)) {
+                        const char* q = skip_blanks(line, last);
+                        for (size_t prop = 0; prop < index_slot; ++prop) {
+                            std::uint64_t value_count = 1;
+                            if (elem.properties[prop].is_list) {
+                                const char* r = parse_uint(q, last, value_count);
+                                if (r == q) {
+                                    failed = true;
+                                    return;
+                                }
+                                q = skip_blanks(r, last);
+                            }
+                            for (std::uint64_t i = 0; i < value_count; ++i) {
+                                float skipped = 0;
+                                const char* r = parse_float(q, last, skipped);
+                                if (r == q) {
+                                    failed = true;
+                                    return;
+                                }
+                                q = skip_blanks(r, last);
+                            }
+                        }
+                        std::uint64_t corner_count = 0;
+                        const char* corners = parse_uint(q, last, corner_count);
+                        if (corners == q) {
+                            failed = true;
+                            return;
+                        }
+                        q = skip_blanks(corners, last);
+                        polygon.clear();
+                        for (std::uint64_t i = 0; i < corner_count; ++i) {
+                            std::int64_t idx = 0;
+                            const char* r = parse_int(q, last, idx);
+                            if (r == q) {
+                                failed = true;
+                                return;
+                            }
+                            polygon.push_back(idx);
+                            q = skip_blanks(r, last);
+                        }
+                        for (size_t i = 1; i + 1 < polygon.size(); ++i) {
+                            triangles.push_back(polygon[0]);
+                            triangles.push_back(polygon[i]);
+                            triangles.push_back(polygon[i + 1]);
+                        }
+                    }
+                });
+            }
+        }
+        if (failed) return io_status::parse_failed;
+
+        // PLY indices are global, so face chunks simply follow the vertex chunks
+        vertex_chunks.insert(vertex_chunks.end(), face_chunks.begin(), face_chunks.end());
+        return merge_mesh_chunks(vertex_chunks, out_positions, out_triangles);
+    }
+
+    inline io_status write_ply(const std::string& path, const float* positions, size_t vertex_count,
+                               const std::uint32_t* triangles, size_t triangle_count,
+                               const text_write_options& options)
+    {
+        std::ofstream out(path, std::ios::binary | std::ios::trunc);
+        if (!out) return io_status::open_failed;
+        std::string header = "ply\nformat ascii 1.0\nelement vertex " + std::to_string(vertex_count) +
+                             "\nproperty float x\nproperty float y\nproperty float z\n";
+        if (triangle_count > 0) {
+            header += "element face " + std::to_string(triangle_count) + "\nproperty list uchar int vertex_indices\n";
+        }
+        header += "end_header\n";
+        out.write(header.data(), static_cast<std::streamsize>(header.size()));
+
+        int digits = options.float_digits;
+        io_status status = text_detail::write_records(out, vertex_count, 3 * 25 + 1, options.thread_count,
+                                                      [&](size_t i, char* p) {
+            p = text_detail::format_point(positions + i * 3, p, digits);
+            *p++ = '\n';
+            return p;
+        });
+        if (status != io_status::ok) return status;
+        return text_detail::write_records(out, triangle_count, 3 * 21 + 3, options.thread_count,
+                                          [&](size_t i, char* p) {
+            *p++ = '3';
+            *p++ = ' ';
+            p = text_detail::format_triangle(triangles + i * 3, p, 0);
+            *p++ = '\n';
+            return p;
+        });
+    }
+}
+
+#endif // BCG_TEXT_FORMAT_HPP
@@ -0,0 +1,299 @@
+#ifndef BCG_HALF_EDGE_MESH_HPP
+#define BCG_HALF_EDGE_MESH_HPP
+
+#include "mesh/mesh.hpp"
+#include "spatial/space_filling_curve.hpp"
+#include "transforms/point.hpp"
+#include "utils/parallel.hpp"
+
+#include <atomic>
+#include <cstdint>
+#include <vector>
+
+namespace bcg
+{
+    //////////////////////////////////////////////////////////////////////////////////////////////////
+    // half_edge_mesh
+    //////////////////////////////////////////////////////////////////////////////////////////////////
+
+    // Triangle half-edge mesh with 32-bit handles. The half-edges of face f are 3f, 3f + 1 and
+    // 3f + 2, so next, prev and face are arithmetic and only the head vertex and the twin of each
+    // half-edge are stored. Boundary half-edges have no twin (invalid_index). Edges shared by more
+    // than two faces, or by two faces of opposite winding, are left without twins and counted as
+    // non-manifold.
+    class half_edge_mesh
+    {
+    public:
+        typedef std::uint32_t index_type;
+        enum : index_type { invalid_index = 0xffffffff };
+
+        half_edge_mesh() = default;
+        half_edge_mesh(const std::vector<point>& vertices, const std::vector<index_type>& triangles,
+                       size_t thread_count = 0);
+        half_edge_mesh(const float* positions, size_t vertex_count, const index_type* triangles,
+                       size_t triangle_count, size_t thread_count = 0);
+        explicit half_edge_mesh(const mesh& src, size_t thread_count = 0);
+
+        void build(const float* positions, size_t vertex_count, const index_type* triangles,
+                   size_t triangle_count, size_t thread_count = 0);
+
+    public:
+        size_t vertex_count() const { return _x.size(); }
+        size_t face_count() const { return _to_vertex.size() / 3; }
+        size_t half_edge_count() const { return _to_vertex.size(); }
+        size_t non_manifold_edge_count() const { return _non_manifold_edge_count; }
+
+        // half-edge topology
+        index_type next(index_type h) const { return h % 3 == 2 ? h - 2 : h + 1; }
+        index_type prev(index_type h) const { return h % 3 == 0 ? h + 2 : h - 1; }
+        index_type twin(index_type h) const { return _twin[h]; }
+        index_type face(index_type h) const { return h / 3; }
+        index_type to_vertex(index_type h) const { return _to_vertex[h]; }
+        index_type from_vertex(index_type h) const { return _to_vertex[prev(h)]; }
+        index_type face_half_edge(index_type f) const { return f * 3; }
+        // an outgoing half-edge, the boundary one for boundary vertices, invalid for isolated ones
+        index_type vertex_half_edge(index_type v) const { return _vertex_half_edge[v]; }
+
+        bool is_boundary_half_edge(index_type h) const { return _twin[h] == invalid_index; }
+        bool is_boundary_vertex(index_type v) const;
+
+        // one-ring iteration, counter-clockwise from vertex_half_edge(v)
+        template<typename func_type> void for_each_outgoing(index_type v, func_type fn) const;
+        template<typename func_type> void for_each_neighbour(index_type v, func_type fn) const;
+        template<typename func_type> void for_each_face(index_type v, func_type fn) const;
+        size_t valence(index_type v) const;
+
+        // Neighbours of every vertex in one array (out_neighbours[out_offsets[v]..out_offsets[v + 1]]),
+        // for repeated sweeps such as smoothing that should stream through memory.
+        void one_rings(std::vector<index_type>& out_offsets, std::vector<index_type>& out_neighbours,
+                       size_t thread_count = 0) const;
+
+        // positions
+        float* x() { return _x.data(); }
+        float* y() { return _y.data(); }
+        float* z() { return _z.data(); }
+        const float* x() const { return _x.data(); }
+        const float* y() const { return _y.data(); }
+        const float* z() const { return _z.data(); }
+        point position(index_type v) const { return point(_x[v], _y[v], _z[v]); }
+        void set_position(index_type v, const point& p);
+
+        // back to flat buffers
+        void to_buffers(std::vector<float>& out_positions, std::vector<index_type>& out_triangles) const;
+        mesh to_mesh() const;
+
+    private:
+        std::vector<float> _x, _y, _z;
+        std::vector<index_type> _to_vertex;
+        std::vector<index_type> _twin;
+        std::vector<index_type> _vertex_half_edge;
+        size_t _non_manifold_edge_count = 0;
+    };
+
+    //////////////////////////////////////////////////////////////////////////////////////////////////
+    // half_edge_mesh implementation
+    //////////////////////////////////////////////////////////////////////////////////////////////////
+
+    inline half_edge_mesh::half_edge_mesh(const std::vector<point>& vertices, const std::vector<index_type>& triangles,
+                                          size_t thread_count)
+    {
+        std::vector<float> positions(vertices.size() * 3);
+        for (size_t i = 0; i < vertices.size(); ++i) {
+            const b_vector<4, float>& p = vertices[i].data();
+            positions[i * 3 + 0] = p[0];
+            positions[i * 3 + 1] = p[1];
+            positions[i * 3 + 2] = p[2];
+        }
+        build(positions.data(), vertices.size(), triangles.data(), triangles.size() / 3, thread_count);
+    }
+
+    inline half_edge_mesh::half_edge_mesh(const float* positions, size_t vertex_count, const index_type* triangles,
+                                          size_t triangle_count, size_t thread_count)
+    {
+        build(positions, vertex_count, triangles, triangle_count, thread_count);
+    }
+
+    inline half_edge_mesh::half_edge_mesh(const mesh& src, size_t thread_count)
+    {
+        std::vector<float> positions = src.packed_positions();
+        build(positions.data(), src.vertex_count(), src.indices(), src.triangle_count(), thread_count);
+    }
+
+    inline void half_edge_mesh::build(const float* positions, size_t vertex_count, const index_type* triangles,
+                                      size_t triangle_count, size_t thread_count)
+    {
+        const size_t grain = 1 << 14;
+        const index_type none = invalid_index;
+        size_t half_edge_total = triangle_count * 3;
+
+        _x.resize(vertex_count);
+        _y.resize(vertex_count);
+        _z.resize(vertex_count);
+        for (size_t i = 0; i < vertex_count; ++i) {
+            _x[i] = positions[i * 3 + 0];
+            _y[i] = positions[i * 3 + 1];
+            _z[i] = positions[i * 3 + 2];
+        }
+        _to_vertex.assign(half_edge_total, none);
+        _twin.assign(half_edge_total, none);
+
+        // key every half-edge by its undirected edge, equal keys end up adjacent after sorting
+        std::vector<std::uint64_t> keys(half_edge_total);
+        std::vector<std::uint32_t> order(half_edge_total);
+        parallel_for(0, half_edge_total, [&](size_t first, size_t last) {
+            for (size_t h = first; h < last; ++h) {
+                index_type from = triangles[h], to = triangles[h % 3 == 2 ? h - 2 : h + 1];
+                _to_vertex[h] = to;
+                std::uint64_t lo = std::min(from, to), hi = std::max(from, to);
+                keys[h] = (lo << 32) | hi;
+                order[h] = static_cast<std::uint32_t>(h);
+            }
+        }, thread_count, grain);
+        parallel_radix_sort(keys, order, thread_count);
+
+        // pair each run of equal keys
+        std::atomic<size_t> non_manifold(0);
+        parallel_for(0, half_edge_total, [&](size_t first, size_t last) {
+            size_t local_non_manifold = 0;
+            for (size_t i = first; i < last; ++i) {
+                if (i > 0 && keys[i] == keys[i - 1]) continue;
+                size_t run = 1;
+                while (i + run < half_edge_total && keys[i + run] == keys[i]) ++run;
+                if (run == 1) continue;
+                index_type a = order[i], b = order[i + 1];
+                if (run == 2 && _to_vertex[a] != _to_vertex[b]) {
+                    _twin[a] = b;
+                    _twin[b] = a;
+                }
+                else {
+                    ++local_non_manifold;
+                }
+            }
+            non_manifold += local_non_manifold;
+        }, thread_count, grain);
+        _non_manifold_edge_count = non_manifold;
+
+        // an outgoing half-edge per vertex, boundary ones first and then the smallest handle, so
+        // the choice does not depend on the threads
+        std::vector<std::atomic<index_type>> best(vertex_count);
+        for (auto& slot : best) slot.store(none, std::memory_order_relaxed);
+        parallel_for(0, half_edge_total, [&](size_t first, size_t last) {
+            for (size_t h = first; h < last; ++h) {
+                index_type v = _to_vertex[h % 3 == 0 ? h + 2 : h - 1];
+                index_type rank = (_twin[h] == invalid_index ? 0 : 0x80000000u) | static_cast<index_type>(h);
+                index_type current = best[v].load(std::memory_order_relaxed);
+                while (rank < current && !best[v].compare_exchange_weak(current, rank, std::memory_order_relaxed)) {}
+            }
+        }, thread_count, grain);
+        _vertex_half_edge.resize(vertex_count);
+        for (size_t v = 0; v < vertex_count; ++v) {
+            index_type rank = best[v].load(std::memory_order_relaxed);
+            _vertex_half_edge[v] = rank == invalid_index ? invalid_index : (rank & 0x7fffffffu);
+        }
+    }
+
+    inline bool half_edge_mesh::is_boundary_vertex(index_type v) const
+    {
+        index_type h = _vertex_half_edge[v];
+        return h == invalid_index || _twin[h] == invalid_index;
+    }
+
+    template<typename func_type>
+    void half_edge_mesh::for_each_outgoing(index_type v, func_type fn) const
+    {
+        index_type start = _vertex_half_edge[v];
+        if (start == invalid_index) return;
+        index_type h = start;
+        do {
+            fn(h);
+            h = _twin[prev(h)];
+        } while (h != invalid_index && h != start);
+    }
+
+    template<typename func_type>
+    void half_edge_mesh::for_each_neighbour(index_type v, func_type fn) const
+    {
+        index_type start = _vertex_half_edge[v];
+        if (start == invalid_index) return;
+        index_type h = start;
+        for (;;) {
+            fn(_to_vertex[h]);
+            index_type incoming = prev(h);
+            h = _twin[incoming];
+            if (h == invalid_index) {
+                // open fan: the last neighbour is only reachable through the incoming half-edge
+                fn(_to_vertex[prev(incoming)]);
+                return;
+            }
+            if (h == start) return;
+        }
+    }
+
+    template<typename func_type>
+    void half_edge_mesh::for_each_face(index_type v, func_type fn) const
+    {
+        for_each_outgoing(v, [&](index_type h) { fn(face(h)); });
+    }
+
+    inline size_t half_edge_mesh::valence(index_type v) const
+    {
+        size_t count = 0;
+        for_each_neighbour(v, [&](index_type) { ++count; });
+        return count;
+    }
+
+    inline void half_edge_mesh::one_rings(std::vector<index_type>& out_offsets, std::vector<index_type>& out_neighbours,
+                                          size_t thread_count) const
+    {
+        const size_t grain = 1 << 12;
+        size_t n = vertex_count();
+        out_offsets.assign(n + 1, 0);
+        parallel_for(0, n, [&](size_t first, size_t last) {
+            for (size_t v = first; v < last; ++v) out_offsets[v + 1] = static_cast<index_type>(valence(static_cast<index_type>(v)));
+        }, thread_count, grain);
+        for (size_t v = 0; v < n; ++v) out_offsets[v + 1] += out_offsets[v];
+
+        out_neighbours.resize(out_offsets[n]);
+        parallel_for(0, n, [&](size_t first, size_t last) {
+            for (size_t v = first; v < last; ++v) {
+                index_type* out = &out_neighbours[0] + out_offsets[v];
+                for_each_neighbour(static_cast<index_type>(v), [&](index_type u) { *out++ = u; });
+            }
+        }, thread_count, grain);
+    }
+
+    inline void half_edge_mesh::set_position(index_type v, const point& p)
+    {
+        const b_vector<4, float>& data = p.data();
+        _x[v] = data[0];
+        _y[v] = data[1];
+        _z[v] = data[2];
+    }
+
+    inline void half_edge_mesh::to_buffers(std::vector<float>& out_positions, std::vector<index_type>& out_triangles) const
+    {
+        out_positions.resize(vertex_count() * 3);
+        for (size_t v = 0; v < vertex_count(); ++v) {
+            out_positions[v * 3 + 0] = _x[v];
+            out_positions[v * 3 + 1] = _y[v];
+            out_positions[v * 3 + 2] = _z[v];
+        }
+        // the head of half-edge 3f + 2 is the first corner of face f
+        out_triangles.resize(half_edge_count());
+        for (size_t f = 0; f < face_count(); ++f) {
+            out_triangles[f * 3 + 0] = _to_vertex[f * 3 + 2];
+            out_triangles[f * 3 + 1] = _to_vertex[f * 3 + 0];
+            out_triangles[f * 3 + 2] = _to_vertex[f * 3 + 1];
+        }
+    }
+
+    inline mesh half_edge_mesh::to_mesh() const
+    {
+        std::vector<float> positions;
+        std::vector<index_type> triangles;
+        to_buffers(positions, triangles);
+        return mesh(positions.data(), vertex_count(), triangles.data(), face_count());
+    }
+}
+
+#endif // BCG_HALF_EDGE_MESH_HPP
@@ -0,0 +1,380 @@
+#ifndef BCG_MESH_HPP
+#define BCG_MESH_HPP
+
+#include "spatial/aabb.hpp"
+#include "transforms/matrix/matrix.hpp"
+#include "transforms/matrix/packed_matrix.hpp"
+#include "transforms/point.hpp"
+#include "transforms/translation.hpp"
+#include "transforms/vector.hpp"
+#include "utils/parallel.hpp"
+
+#include <atomic>
+#include <cmath>
+#include <cstdint>
+#include <cstring>
+#include <vector>
+
+namespace bcg
+{
+    //////////////////////////////////////////////////////////////////////////////////////////////////
+    // mesh
+    //////////////////////////////////////////////////////////////////////////////////////////////////
+
+    // Indexed triangle mesh. Positions and normals are stored as separate x, y, z arrays so batched
+    // kernels run straight down them; triangles are 3 vertex indices each.
+    class mesh
+    {
+    public:
+        typedef std::uint32_t index_type;
+        enum : index_type { invalid_index = 0xffffffff };
+
+        mesh() = default;
+        // packed xyz positions and 3 indices per triangle
+        mesh(const float* positions, size_t vertex_count, const index_type* indices, size_t triangle_count);
+
+        // Weld a triangle soup (3 packed xyz corners per triangle) into a shared-vertex mesh.
+        // Corners whose positions fall in the same cell of a grid with spacing [weld_epsilon] become
+        // one vertex (0 welds bitwise-equal positions only), vertices keep the order of their first
+        // corner and triangles that collapse are dropped.
+        static mesh from_triangle_soup(const float* corners, size_t triangle_count, float weld_epsilon = 0,
+                                       size_t thread_count = 0);
+
+    public:
+        size_t vertex_count() const { return _x.size(); }
+        size_t triangle_count() const { return _indices.size() / 3; }
+        bool has_normals() const { return !_nx.empty(); }
+
+        float* x() { return _x.data(); }
+        float* y() { return _y.data(); }
+        float* z() { return _z.data(); }
+        const float* x() const { return _x.data(); }
+        const float* y() const { return _y.data(); }
+        const float* z() const { return _z.data(); }
+        float* nx() { return _nx.data(); }
+        float* ny() { return _ny.data(); }
+        float* nz() { return _nz.data(); }
+        const float* nx() const { return _nx.data(); }
+        const float* ny() const { return _ny.data(); }
+        const float* nz() const { return _nz.data(); }
+        index_type* indices() { return _indices.data(); }
+        const index_type* indices() const { return _indices.data(); }
+
+        point position(size_t idx) const { return point(_x[idx], _y[idx], _z[idx]); }
+        void set_position(size_t idx, const point& p);
+        vector normal(size_t idx) const { return vector(_nx[idx], _ny[idx], _nz[idx]); }
+
+        // packed xyz positions, e.g. for writers and spatial indices
+        std::vector<float> packed_positions() const;
+        aabb bounds() const;
+
+        // area-weighted vertex normals
+        void compute_normals(size_t thread_count = 0);
+
+        // Transform positions in place, and normals by the inverse-transpose of the upper-left 3x3
+        // (then renormalised). The normal matrix is computed once per call, not per vertex.
+        void transform(const packed_matrix4<float>& trans, size_t thread_count = 0);
+        void transform(const matrix<4, 4, float>& trans, size_t thread_count = 0);
+        void transform(const translation& trans, size_t thread_count = 0);
+
+        // weld vertices of this mesh as from_triangle_soup does, returns the number removed
+        size_t weld(float weld_epsilon = 0, size_t thread_count = 0);
+
+    private:
+        std::vector<float> _x, _y, _z;
+        std::vector<float> _nx, _ny, _nz;
+        std::vector<index_type> _indices;
+    };
+
+    // Map each of [count] packed xyz positions to a welded vertex: out_remap[i] is the vertex of
+    // position i and out_representatives[v] the first position of vertex v. Positions hash into a
+    // shared open-addressing table filled by all threads with atomic compare-and-swap; the result
+    // does not depend on the thread count.
+    inline void weld_positions(const float* coords, size_t count, float weld_epsilon,
+                               std::vector<mesh::index_type>& out_remap,
+                               std::vector<mesh::index_type>& out_representatives, size_t thread_count = 0);
+
+    //////////////////////////////////////////////////////////////////////////////////////////////////
+    // mesh implementation
+    //////////////////////////////////////////////////////////////////////////////////////////////////
+
+    namespace mesh_detail
+    {
+        const size_t grain_size = 1 << 14;
+
+        inline std::uint64_t mix(std::uint64_t h)
+        {
+            h ^= h >> 33;
+            h *= 0xff51afd7ed558ccdull;
+            h ^= h >> 33;
+            h *= 0xc4ceb9fe1a85ec53ull;
+            h ^= h >> 33;
+            return h;
+        }
+
+        // grid cell of a coordinate, or its bit pattern when welding exact positions
+        inline std::int64_t weld_key(float value, float inv_epsilon)
+        {
+            if (inv_epsilon > 0) return static_cast<std::int64_t>(std::floor(static_cast<double>(value) * inv_epsilon));
+            if (value == 0) value = 0; // -0 welds with +0
+            std::uint32_t bits;
+            std::memcpy(&bits, &value, sizeof(bits));
+            return bits;
+        }
+    }
+
+    inline mesh::mesh(const float* positions, size_t vertex_count, const index_type* indices, size_t triangle_count)
+        : _x(vertex_count), _y(vertex_count), _z(vertex_count), _indices(indices, indices + triangle_count * 3)
+    {
+        for (size_t i = 0; i < vertex_count; ++i) {
+            _x[i] = positions[i * 3 + 0];
+            _y[i] = positions[i * 3 + 1];
+            _z[i] = positions[i * 3 + 2];
+        }
+    }
+
+    inline mesh mesh::from_triangle_soup(const float* corners, size_t triangle_count, float weld_epsilon,
+                                         size_t thread_count)
+    {
+        std::vector<index_type> remap, representatives;
+        weld_positions(corners, triangle_count * 3, weld_epsilon, remap, representatives, thread_count);
+
+        mesh result;
+        size_t vertex_count = representatives.size();
+        result._x.resize(vertex_count);
+        result._y.resize(vertex_count);
+        result._z.resize(vertex_count);
+        for (size_t v = 0; v < vertex_count; ++v) {
+            const float* p = corners + size_t(representatives[v]) * 3;
+            result._x[v] = p[0];
+            result._y[v] = p[1];
+            result._z[v] = p[2];
+        }
+        result._indices.reserve(triangle_count * 3);
+        for (size_t t = 0; t < triangle_count; ++t) {
+            index_type a = remap[t * 3], b = remap[t * 3 + 1], c = remap[t * 3 + 2];
+            if (a == b || b == c || c == a) continue;
+            result._indices.push_back(a);
+            result._indices.push_back(b);
+            result._indices.push_back(c);
+        }
+        return result;
+    }
+
+    inline void mesh::set_position(size_t idx, const point& p)
+    {
+        const b_vector<4, float>& data = p.data();
+        _x[idx] = data[0];
+        _y[idx] = data[1];
+        _z[idx] = data[2];
+    }
+
+    inline std::vector<float> mesh::packed_positions() const
+    {
+        std::vector<float> coords(vertex_count() * 3);
+        for (size_t i = 0; i < vertex_count(); ++i) {
+            coords[i * 3 + 0] = _x[i];
+            coords[i * 3 + 1] = _y[i];
+            coords[i * 3 + 2] = _z[i];
+        }
+        return coords;
+    }
+
+    inline aabb mesh::bounds() const
+    {
+        aabb box;
+        for (size_t i = 0; i < vertex_count(); ++i) {
+            float p[3] = { _x[i], _y[i], _z[i] };
+            box.expand(p);
+        }
+        return box;
+    }
+
+    inline void mesh::compute_normals(size_t thread_count)
+    {
+        size_t n = vertex_count();
+        _nx.assign(n, 0.0f);
+        _ny.assign(n, 0.0f);
+        _nz.assign(n, 0.0f);
+
+        // the cross product of two edges is the face normal scaled by twice the area
+        for (size_t t = 0; t < triangle_count(); ++t) {
+            index_type a = _indices[t * 3], b = _indices[t * 3 + 1], c = _indices[t * 3 + 2];
+            float e1[3] = { _x[b] - _x[a], _y[b] - _y[a], _z[b] - _z[a] };
+            float e2[3] = { _x[c] - _x[a], _y[c] - _y[a], _z[c] - _z[a] };
+            float fx = e1[1] * e2[2] - e1[2] * e2[1];
+            float fy = e1[2] * e2[0] - e1[0] * e2[2];
+            float fz = e1[0] * e2[1] - e1[1] * e2[0];
+            const index_type corners[3] = { a, b, c };
+            for (index_type v : corners) {
+                _nx[v] += fx;
+                _ny[v] += fy;
+                _nz[v] += fz;
+            }
+        }
+
+        parallel_for(0, n, [&](size_t first, size_t last) {
+            for (size_t i = first; i < last; ++i) {
+                float len = std::sqrt(_nx[i] * _nx[i] + _ny[i] * _ny[i] + _nz[i] * _nz[i]);
+                float inv = len > 0 ? 1.0f / len : 0.0f;
+                _nx[i] *= inv;
+                _ny[i] *= inv;
+                _nz[i] *= inv;
+            }
+        }, thread_count, mesh_detail::grain_size);
+    }
+
+    inline void mesh::transform(const packed_matrix4<float>& trans, size_t thread_count)
+    {
+        const float* m = trans.m;
+        float nm[9];
+        trans.normal_matrix(nm);
+        bool with_normals = has_normals();
+
+        parallel_for(0, vertex_count(), [&](size_t first, size_t last) {
+            float* x = _x.data();
+            float* y = _y.data();
+            float* z = _z.data();
+            for (size_t i = first; i < last; ++i) {
+                float px = x[i], py = y[i], pz = z[i];
+                x[i] = m[0] * px + m[1] * py + m[2] * pz + m[3];
+                y[i] = m[4] * px + m[5] * py + m[6] * pz + m[7];
+                z[i] = m[8] * px + m[9] * py + m[10] * pz + m[11];
+            }
+            if (!with_normals) return;
+            float* nx = _nx.data();
+            float* ny = _ny.data();
+            float* nz = _nz.data();
+            for (size_t i = first; i < last; ++i) {
+                float vx = nx[i], vy = ny[i], vz = nz[i];
+                float tx = nm[0] * vx + nm[1] * vy + nm[2] * vz;
+                float ty = nm[3] * vx + nm[4] * vy + nm[5] * vz;
+                float tz = nm[6] * vx + nm[7] * vy + nm[8] * vz;
+                float len2 = tx * tx + ty * ty + tz * tz;
+                float inv = len2 > 0 ? 1.0f / std::sqrt(len2) : 0.0f;
+                nx[i] = tx * inv;
+                ny[i] = ty * inv;
+                nz[i] = tz * inv;
+            }
+        }, thread_count, mesh_detail::grain_size);
+    }
+
+    inline void mesh::transform(const matrix<4, 4, float>& trans, size_t thread_count)
+    {
+        transform(packed_matrix4<float>(trans), thread_count);
+    }
+
+    inline void mesh::transform(const translation& trans, size_t thread_count)
+    {
+        transform(packed_matrix4<float>(trans.to_matrix()), thread_count);
+    }
+
+    inline size_t mesh::weld(float weld_epsilon, size_t thread_count)
+    {
+        std::vector<float> coords = packed_positions();
+        std::vector<index_type> remap, representatives;
+        weld_positions(coords.data(), vertex_count(), weld_epsilon, remap, representatives, thread_count);
+        size_t removed = vertex_count() - representatives.size();
+        if (removed == 0) return 0;
+
+        auto gather = [&](std::vector<float>& attribute) {
+            if (attribute.empty()) return;
+            std::vector<float> welded(representatives.size());
+            for (size_t v = 0; v < representatives.size(); ++v) welded[v] = attribute[representatives[v]];
+            attribute.swap(welded);
+        };
+        gather(_x); gather(_y); gather(_z);
+        gather(_nx); gather(_ny); gather(_nz);
+
+        std::vector<index_type> indices;
+        indices.reserve(_indices.size());
+        for (size_t t = 0; t < triangle_count(); ++t) {
+            index_type a = remap[_indices[t * 3]], b = remap[_indices[t * 3 + 1]], c = remap[_indices[t * 3 + 2]];
+            if (a == b || b == c || c == a) continue;
+            indices.push_back(a);
+            indices.push_back(b);
+            indices.push_back(c);
+        }
+        _indices.swap(indices);
+        return removed;
+    }
+
+    inline void weld_positions(const float* coords, size_t count, float weld_epsilon,
+                               std::vector<mesh::index_type>& out_remap,
+                               std::vector<mesh::index_type>& out_representatives, size_t thread_count)
+    {
+        using namespace mesh_detail;
+        typedef mesh::index_type index_type;
+        const index_type empty_slot = mesh::invalid_index;
+        float inv_epsilon = weld_epsilon > 0 ? 1.0f / weld_epsilon : 0.0f;
+
+        std::vector<std::int64_t> keys(count * 3);
+        std::vector<std::uint64_t> hashes(count);
+        parallel_for(0, count, [&](size_t first, size_t last) {
+            for (size_t i = first; i < last; ++i) {
+                std::uint64_t h = 0;
+                for (size_t d = 0; d < 3; ++d) {
+                    keys[i * 3 + d] = weld_key(coords[i * 3 + d], inv_epsilon);
+                    h = mix(h ^ static_cast<std::uint64_t>(keys[i * 3 + d]));
+                }
+                hashes[i] = h;
+            }
+        }, thread_count, grain_size);
+
+        size_t capacity = 16;
+        while (capacity < count * 2) capacity <<= 1;
+        std::vector<std::atomic<index_type>> table(capacity);
+        for (auto& slot : table) slot.store(empty_slot, std::memory_order_relaxed);
+
+        auto same_key = [&](size_t a, size_t b) {
+            return keys[a * 3] == keys[b * 3] && keys[a * 3 + 1] == keys[b * 3 + 1] && keys[a * 3 + 2] == keys[b * 3 + 2];
+        };
+
+        // every slot ends up holding the smallest position index with its key, whatever the
+        // interleaving of the threads
+        parallel_for(0, count, [&](size_t first, size_t last) {
+            for (size_t i = first; i < last; ++i) {
+                index_type id = static_cast<index_type>(i);
+                for (size_t slot = hashes[i] & (capacity - 1);; slot = (slot + 1) & (capacity - 1)) {
+                    index_type current = table[slot].load(std::memory_order_acquire);
+                    bool placed = false;
+                    while (current == empty_slot || (same_key(current, i) && id < current)) {
+                        if (table[slot].compare_exchange_weak(current, id, std::memory_order_acq_rel)) {
+                            placed = true;
+                            break;
+                        }
+                    }
+                    if (placed || same_key(current, i)) break;
+                }
+            }
+        }, thread_count, grain_size);
+
+        std::vector<index_type> first_of(count);
+        parallel_for(0, count, [&](size_t first, size_t last) {
+            for (size_t i = first; i < last; ++i) {
+                for (size_t slot = hashes[i] & (capacity - 1);; slot = (slot + 1) & (capacity - 1)) {
+                    index_type current = table[slot].load(std::memory_order_relaxed);
+                    if (same_key(current, i)) {
+                        first_of[i] = current;
+                        break;
+                    }
+                }
+            }
+        }, thread_count, grain_size);
+
+        // number the vertices in order of their first position
+        out_remap.resize(count);
+        out_representatives.clear();
+        for (size_t i = 0; i < count; ++i) {
+            if (first_of[i] == i) {
+                out_remap[i] = static_cast<index_type>(out_representatives.size());
+                out_representatives.push_back(static_cast<index_type>(i));
+            }
+            else {
+                out_remap[i] = out_remap[first_of[i]];
+            }
+        }
+    }
+}
+
+#endif // BCG_MESH_HPP
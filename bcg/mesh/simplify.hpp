@@ -0,0 +1,623 @@
+#ifndef BCG_SIMPLIFY_HPP
+#define BCG_SIMPLIFY_HPP
+
+#include "mesh/half_edge_mesh.hpp"
+#include "mesh/mesh.hpp"
+#include "spatial/space_filling_curve.hpp"
+#include "transforms/matrix/matrix.hpp"
+#include "utils/parallel.hpp"
+
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <cstdint>
+#include <limits>
+#include <queue>
+#include <vector>
+
+namespace bcg
+{
+    //////////////////////////////////////////////////////////////////////////////////////////////////
+    // quadric
+    //////////////////////////////////////////////////////////////////////////////////////////////////
+
+    // Garland-Heckbert error quadric. The symmetric 4x4 matrix is packed as its upper triangle,
+    // row by row (a00 a01 a02 a03 a11 a12 a13 a22 a23 a33), 10 doubles instead of 16.
+    class quadric
+    {
+    public:
+        quadric(); // zero quadric
+        explicit quadric(const matrix<4, 4, double>& m); // reads the upper triangle
+
+        // squared distance to the plane ax + by + cz + d = 0 (unit normal), times [weight]
+        static quadric from_plane(double a, double b, double c, double d, double weight = 1);
+
+    public:
+        quadric& operator +=(const quadric& r_quadric);
+        quadric operator +(const quadric& r_quadric) const;
+        quadric operator *(double lambda) const;
+
+        // v^T Q v for v = (x, y, z, 1)
+        double evaluate(double x, double y, double z) const;
+        // Position minimising the error, from the upper-left 3x3 block. Returns false when that
+        // block is close to singular (flat or straight neighbourhoods) and leaves out unchanged.
+        bool minimiser(double* out3) const;
+
+        matrix<4, 4, double> to_matrix() const;
+        const double* data() const { return _q; }
+
+    private:
+        double _q[10];
+    };
+
+    //////////////////////////////////////////////////////////////////////////////////////////////////
+    // simplify
+    //////////////////////////////////////////////////////////////////////////////////////////////////
+
+    struct simplify_options
+    {
+        // stop once the mesh has at most this many triangles
+        size_t target_triangle_count = 0;
+        // or once the cheapest collapse would cost more than this
+        double max_error = std::numeric_limits<double>::max();
+        // boundary edges get perpendicular planes of this weight so open borders stay in place
+        bool preserve_boundary = true;
+        double boundary_weight = 1000;
+        // With more than 1 partition, vertices are split into spatially coherent blocks along the
+        // Morton curve and the blocks are decimated in parallel first, each by its share of the
+        // collapses. Vertices next to another block are left alone until a final serial pass.
+        size_t partition_count = 1;
+        // threads of the build and the partitioned phase, 0 means all hardware threads
+        size_t thread_count = 0;
+    };
+
+    struct simplify_stats
+    {
+        size_t triangles_before = 0;
+        size_t triangles_after = 0;
+        size_t collapse_count = 0;
+        // collapses done by the partitioned phase, the rest are serial
+        size_t parallel_collapse_count = 0;
+        // collapses refused because they would flip a face or break manifoldness
+        size_t rejected_count = 0;
+        double seconds = 0;
+    };
+
+    // Decimate [src] by edge collapses in order of increasing quadric error. Each collapse moves
+    // the surviving vertex to the minimiser of the summed quadrics (or the best of the endpoints
+    // and the midpoint when that is not unique).
+    inline mesh simplify(const mesh& src, const simplify_options& options, simplify_stats* stats = nullptr);
+
+    //////////////////////////////////////////////////////////////////////////////////////////////////
+    // quadric implementation
+    //////////////////////////////////////////////////////////////////////////////////////////////////
+
+    inline quadric::quadric()
+    {
+        for (size_t i = 0; i < 10; ++i) _q[i] = 0;
+    }
+
+    inline quadric::quadric(const matrix<4, 4, double>& m)
+    {
+        size_t k = 0;
+        for (size_t i = 0; i < 4; ++i) {
+            for (size_t j = i; j < 4; ++j) _q[k++] = m[i][j];
+        }
+    }
+
+    inline quadric quadric::from_plane(double a, double b, double c, double d, double weight)
+    {
+        quadric plane;
+        double* q = plane._q;
+        q[0] = weight * a * a; q[1] = weight * a * b; q[2] = weight * a * c; q[3] = weight * a * d;
+        q[4] = weight * b * b; q[5] = weight * b * c; q[6] = weight * b * d;
+        q[7] = weight * c * c; q[8] = weight * c * d;
+        q[9] = weight * d * d;
+        return plane;
+    }
+
+    inline quadric& quadric::operator +=(const quadric& r_quadric)
+    {
+        for (size_t i = 0; i < 10; ++i) _q[i] += r_quadric._q[i];
+        return *this;
+    }
+
+    inline quadric quadric::operator +(const quadric& r_quadric) const
+    {
+        quadric sum = *this;
+        return sum += r_quadric;
+    }
+
+    inline quadric quadric::operator *(double lambda) const
+    {
+        quadric product;
+        for (size_t i = 0; i < 10; ++i) product._q[i] = lambda * _q[i];
+        return product;
+    }
+
+    inline double quadric::evaluate(double x, double y, double z) const
+    {
+        const double* q = _q;
+        return x * (q[0] * x + 2 * (q[1] * y + q[2] * z + q[3])) +
+               y * (q[4] * y + 2 * (q[5] * z + q[6])) +
+               z * (q[7] * z + 2 * q[8]) + q[9];
+    }
+
+    inline bool quadric::minimiser(double* out3) const
+    {
+        // Cramer's rule on A v = -b, the cofactors are reused for the determinant
+        const double* q = _q;
+        double c00 = q[4] * q[7] - q[5] * q[5];
+        double c01 = q[2] * q[5] - q[1] * q[7];
+        double c02 = q[1] * q[5] - q[2] * q[4];
+        double c11 = q[0] * q[7] - q[2] * q[2];
+        double c12 = q[1] * q[2] - q[0] * q[5];
+        double c22 = q[0] * q[4] - q[1] * q[1];
+        double det = q[0] * c00 + q[1] * c01 + q[2] * c02;
+        double scale = q[0] + q[4] + q[7];
+        if (!(std::fabs(det) > 1e-9 * scale * scale * scale)) return false;
+
+        double inv = -1 / det;
+        out3[0] = inv * (c00 * q[3] + c01 * q[6] + c02 * q[8]);
+        out3[1] = inv * (c01 * q[3] + c11 * q[6] + c12 * q[8]);
+        out3[2] = inv * (c02 * q[3] + c12 * q[6] + c22 * q[8]);
+        return true;
+    }
+
+    inline matrix<4, 4, double> quadric::to_matrix() const
+    {
+        matrix<4, 4, double> m;
+        size_t k = 0;
+        for (size_t i = 0; i < 4; ++i) {
+            for (size_t j = i; j < 4; ++j) {
+                m[i][j] = _q[k];
+                m[j][i] = _q[k];
+                ++k;
+            }
+        }
+        return m;
+    }
+
+    //////////////////////////////////////////////////////////////////////////////////////////////////
+    // simplify implementation
+    //////////////////////////////////////////////////////////////////////////////////////////////////
+
+    namespace simplify_detail
+    {
+        typedef mesh::index_type index_type;
+
+        // owner of vertices next to another partition, and the partition of the serial pass
+        const std::int32_t no_partition = -1;
+        // faces turning by more than about 78 degrees in a collapse count as flipped
+        const double min_normal_cosine = 0.2;
+
+        // 20 bytes, the heap holds several entries per edge and is the hottest memory of a run;
+        // the collapse position is recomputed when an entry comes out
+        struct collapse_candidate
+        {
+            float cost;
+            index_type a, b;
+            std::uint32_t stamp_a, stamp_b;
+
+            // std::priority_queue is a max-heap, the cheapest collapse has to come out first
+            bool operator <(const collapse_candidate& r_candidate) const { return cost > r_candidate.cost; }
+        };
+
+        class decimator
+        {
+        public:
+            decimator(const mesh& src, const simplify_options& options);
+
+            // Collapse edges whose endpoints are both owned by [part] (any live vertex for
+            // no_partition) until [budget] faces are gone, returns the number of collapses.
+            size_t run(std::int32_t part, const std::vector<index_type>& seeds, size_t budget, double max_error,
+                       size_t& removed_faces, size_t& rejected);
+
+            void partition(size_t partition_count, size_t thread_count,
+                           std::vector<std::vector<index_type>>& out_seeds, std::vector<size_t>& out_face_counts);
+            size_t face_count() const { return _face_count; }
+            mesh result() const;
+
+        private:
+            bool eligible(index_type v, std::int32_t part) const
+            {
+                return !_removed[v] && (part == no_partition || _owner[v] == part);
+            }
+            void gather_neighbours(index_type v, std::vector<index_type>& out) const;
+            // cost of collapsing a-b and the position it collapses to
+            double evaluate(index_type a, index_type b, double* out_position) const;
+            void push_candidate(std::priority_queue<collapse_candidate>& heap, index_type a, index_type b) const;
+            bool try_collapse(index_type a, index_type b, const double* p, std::vector<index_type>& scratch_a,
+                              std::vector<index_type>& scratch_b, size_t& removed_faces);
+
+        private:
+            std::vector<double> _x, _y, _z;
+            std::vector<quadric> _quadrics;
+            std::vector<index_type> _triangles;
+            std::vector<std::uint8_t> _face_alive;
+            std::vector<std::vector<index_type>> _vertex_faces;
+            std::vector<std::uint32_t> _stamps;
+            std::vector<std::uint8_t> _removed;
+            std::vector<std::uint8_t> _boundary;
+            std::vector<std::int32_t> _owner;
+            size_t _face_count = 0;
+        };
+
+        inline decimator::decimator(const mesh& src, const simplify_options& options)
+        {
+            const size_t grain = 1 << 12;
+            size_t n = src.vertex_count();
+            size_t face_total = src.triangle_count();
+            _face_count = face_total;
+            _x.assign(src.x(), src.x() + n);
+            _y.assign(src.y(), src.y() + n);
+            _z.assign(src.z(), src.z() + n);
+            _triangles.assign(src.indices(), src.indices() + face_total * 3);
+            _face_alive.assign(face_total, 1);
+            _stamps.assign(n, 0);
+            _removed.assign(n, 0);
+            _boundary.assign(n, 0);
+            _owner.assign(n, no_partition);
+
+            std::vector<index_type> valences(n, 0);
+            for (size_t i = 0; i < face_total * 3; ++i) ++valences[_triangles[i]];
+            _vertex_faces.resize(n);
+            for (size_t v = 0; v < n; ++v) {
+                _vertex_faces[v].reserve(valences[v]);
+                if (valences[v] == 0) _removed[v] = 1;
+            }
+            for (size_t i = 0; i < face_total * 3; ++i) {
+                _vertex_faces[_triangles[i]].push_back(static_cast<index_type>(i / 3));
+            }
+
+            // unit plane and area of every face
+            std::vector<double> planes(face_total * 5);
+            parallel_for(0, face_total, [&](size_t first, size_t last) {
+                for (size_t f = first; f < last; ++f) {
+                    const index_type* t = &_triangles[f * 3];
+                    double ux = _x[t[1]] - _x[t[0]], uy = _y[t[1]] - _y[t[0]], uz = _z[t[1]] - _z[t[0]];
+                    double vx = _x[t[2]] - _x[t[0]], vy = _y[t[2]] - _y[t[0]], vz = _z[t[2]] - _z[t[0]];
+                    double nx = uy * vz - uz * vy, ny = uz * vx - ux * vz, nz = ux * vy - uy * vx;
+                    double length = std::sqrt(nx * nx + ny * ny + nz * nz);
+                    double* plane = &planes[f * 5];
+                    if (length == 0) {
+                        for (size_t k = 0; k < 5; ++k) plane[k] = 0;
+                        continue;
+                    }
+                    plane[0] = nx / length;
+                    plane[1] = ny / length;
+                    plane[2] = nz / length;
+                    plane[3] = -(plane[0] * _x[t[0]] + plane[1] * _y[t[0]] + plane[2] * _z[t[0]]);
+                    plane[4] = length / 2;
+                }
+            }, options.thread_count, grain);
+
+            // area-weighted sum over the faces of each vertex
+            _quadrics.resize(n);
+            parallel_for(0, n, [&](size_t first, size_t last) {
+                for (size_t v = first; v < last; ++v) {
+                    quadric sum;
+                    for (index_type f : _vertex_faces[v]) {
+                        const double* plane = &planes[f * 5];
+                        sum += quadric::from_plane(plane[0], plane[1], plane[2], plane[3], plane[4]);
+                    }
+                    _quadrics[v] = sum;
+                }
+            }, options.thread_count, grain);
+
+            // boundary edges add the plane through them perpendicular to their face
+            std::vector<float> positions = src.packed_positions();
+            half_edge_mesh topology(positions.data(), n, src.indices(), face_total, options.thread_count);
+            for (index_type h = 0; h < topology.half_edge_count(); ++h) {
+                if (!topology.is_boundary_half_edge(h)) continue;
+                index_type u = topology.from_vertex(h), w = topology.to_vertex(h);
+                _boundary[u] = _boundary[w] = 1;
+                if (!options.preserve_boundary) continue;
+
+                const double* plane = &planes[topology.face(h) * 5];
+                double ex = _x[w] - _x[u], ey = _y[w] - _y[u], ez = _z[w] - _z[u];
+                double px = ey * plane[2] - ez * plane[1];
+                double py = ez * plane[0] - ex * plane[2];
+                double pz = ex * plane[1] - ey * plane[0];
+                double length = std::sqrt(px * px + py * py + pz * pz);
+                if (length == 0) continue;
+                px /= length; py /= length; pz /= length;
+                double d = -(px * _x[u] + py * _y[u] + pz * _z[u]);
+                quadric border = quadric::from_plane(px, py, pz, d, options.boundary_weight * (ex * ex + ey * ey + ez * ez));
+                _quadrics[u] += border;
+                _quadrics[w] += border;
+            }
+        }
+
+        inline void decimator::partition(size_t partition_count, size_t thread_count,
+                                         std::vector<std::vector<index_type>>& out_seeds,
+                                         std::vector<size_t>& out_face_counts)
+        {
+            size_t n = _x.size();
+            std::vector<float> positions(n * 3);
+            for (size_t v = 0; v < n; ++v) {
+                positions[v * 3 + 0] = static_cast<float>(_x[v]);
+                positions[v * 3 + 1] = static_cast<float>(_y[v]);
+                positions[v * 3 + 2] = static_cast<float>(_z[v]);
+            }
+            std::vector<std::uint32_t> order = spatial_order(positions.data(), n, curve_type::morton, thread_count);
+            for (size_t i = 0; i < n; ++i) {
+                _owner[order[i]] = static_cast<std::int32_t>(i * partition_count / n);
+            }
+
+            // faces across partitions lock all their vertices, so two partitions never touch the
+            // same face, vertex or face list
+            std::vector<std::uint8_t> locked(n, 0);
+            out_face_counts.assign(partition_count, 0);
+            for (size_t f = 0; f < _face_alive.size(); ++f) {
+                const index_type* t = &_triangles[f * 3];
+                if (_owner[t[0]] != _owner[t[1]] || _owner[t[0]] != _owner[t[2]]) {
+                    locked[t[0]] = locked[t[1]] = locked[t[2]] = 1;
+                }
+                else {
+                    ++out_face_counts[_owner[t[0]]];
+                }
+            }
+            out_seeds.assign(partition_count, std::vector<index_type>());
+            for (size_t i = 0; i < n; ++i) {
+                index_type v = order[i];
+                if (locked[v]) _owner[v] = no_partition;
+                else out_seeds[i * partition_count / n].push_back(v);
+            }
+        }
+
+        inline void decimator::gather_neighbours(index_type v, std::vector<index_type>& out) const
+        {
+            out.clear();
+            for (index_type f : _vertex_faces[v]) {
+                if (!_face_alive[f]) continue;
+                for (size_t k = 0; k < 3; ++k) {
+                    index_type u = _triangles[f * 3 + k];
+                    if (u != v) out.push_back(u);
+                }
+            }
+            std::sort(out.begin(), out.end());
+            out.erase(std::unique(out.begin(), out.end()), out.end());
+        }
+
+        inline double decimator::evaluate(index_type a, index_type b, double* out_position) const
+        {
+            quadric sum = _quadrics[a] + _quadrics[b];
+            if (sum.minimiser(out_position)) {
+                return std::max(0.0, sum.evaluate(out_position[0], out_position[1], out_position[2]));
+            }
+            double choices[3][3] = {
+                { _x[a], _y[a], _z[a] },
+                { _x[b], _y[b], _z[b] },
+                { (_x[a] + _x[b]) / 2, (_y[a] + _y[b]) / 2, (_z[a] + _z[b]) / 2 }
+            };
+            double best = std::numeric_limits<double>::max();
+            for (size_t i = 0; i < 3; ++i) {
+                double cost = sum.evaluate(choices[i][0], choices[i][1], choices[i][2]);
+                if (cost < best) {
+                    best = cost;
+                    for (size_t d = 0; d < 3; ++d) out_position[d] = choices[i][d];
+                }
+            }
+            return std::max(0.0, best);
+        }
+
+        inline void decimator::push_candidate(std::priority_queue<collapse_candidate>& heap, index_type a,
+                                              index_type b) const
+        {
+            double position[3];
+            collapse_candidate candidate;
+            candidate.cost = static_cast<float>(evaluate(a, b, position));
+            candidate.a = a;
+            candidate.b = b;
+            candidate.stamp_a = _stamps[a];
+            candidate.stamp_b = _stamps[b];
+            heap.push(candidate);
+        }
+
+        inline bool decimator::try_collapse(index_type a, index_type b, const double* p,
+                                            std::vector<index_type>& scratch_a, std::vector<index_type>& scratch_b,
+                                            size_t& removed_faces)
+        {
+
+            // link condition: the endpoints may only share the vertices opposite the edge
+            size_t shared_faces = 0, face_total = 0;
+            for (index_type f : _vertex_faces[a]) {
+                const index_type* t = &_triangles[f * 3];
+                if (!_face_alive[f]) continue;
+                ++face_total;
+                if (t[0] == b || t[1] == b || t[2] == b) ++shared_faces;
+            }
+            for (index_type f : _vertex_faces[b]) face_total += _face_alive[f];
+            if (shared_faces == 0 || shared_faces > 2) return false;
+            // a lone triangle or a closed pair would vanish altogether
+            if (face_total <= 2 * shared_faces) return false;
+            if (_boundary[a] && _boundary[b] && shared_faces != 1) return false;
+            gather_neighbours(a, scratch_a);
+            gather_neighbours(b, scratch_b);
+            size_t common = 0;
+            for (size_t i = 0, j = 0; i < scratch_a.size() && j < scratch_b.size();) {
+                if (scratch_a[i] < scratch_b[j]) ++i;
+                else if (scratch_b[j] < scratch_a[i]) ++j;
+                else { ++common; ++i; ++j; }
+            }
+            if (common != shared_faces) return false;
+
+            // no remaining face may flip or degenerate
+            for (size_t side = 0; side < 2; ++side) {
+                index_type moved = side == 0 ? a : b, other = side == 0 ? b : a;
+                for (index_type f : _vertex_faces[moved]) {
+                    const index_type* t = &_triangles[f * 3];
+                    if (!_face_alive[f] || t[0] == other || t[1] == other || t[2] == other) continue;
+                    double before[3][3], after[3][3];
+                    for (size_t k = 0; k < 3; ++k) {
+                        before[k][0] = after[k][0] = _x[t[k]];
+                        before[k][1] = after[k][1] = _y[t[k]];
+                        before[k][2] = after[k][2] = _z[t[k]];
+                        if (t[k] == moved) {
+                            after[k][0] = p[0]; after[k][1] = p[1]; after[k][2] = p[2];
+                        }
+                    }
+                    double n0[3], n1[3];
+                    for (size_t pass = 0; pass < 2; ++pass) {
+                        double (*c)[3] = pass == 0 ? before : after;
+                        double* normal = pass == 0 ? n0 : n1;
+                        double u[3] = { c[1][0] - c[0][0], c[1][1] - c[0][1], c[1][2] - c[0][2] };
+                        double w[3] = { c[2][0] - c[0][0], c[2][1] - c[0][1], c[2][2] - c[0][2] };
+                        normal[0] = u[1] * w[2] - u[2] * w[1];
+                        normal[1] = u[2] * w[0] - u[0] * w[2];
+                        normal[2] = u[0] * w[1] - u[1] * w[0];
+                    }
+                    double dot = n0[0] * n1[0] + n0[1] * n1[1] + n0[2] * n1[2];
+                    double lengths = std::sqrt((n0[0] * n0[0] + n0[1] * n0[1] + n0[2] * n0[2]) *
+                                               (n1[0] * n1[0] + n1[1] * n1[1] + n1[2] * n1[2]));
+                    if (dot <= min_normal_cosine * lengths) return false;
+                }
+            }
+
+            // b merges into a
+            _x[a] = p[0]; _y[a] = p[1]; _z[a] = p[2];
+            _quadrics[a] += _quadrics[b];
+            _boundary[a] = _boundary[a] | _boundary[b];
+            for (index_type f : _vertex_faces[b]) {
+                if (!_face_alive[f]) continue;
+                index_type* t = &_triangles[f * 3];
+                if (t[0] == a || t[1] == a || t[2] == a) {
+                    _face_alive[f] = 0;
+                    ++removed_faces;
+                    continue;
+                }
+                for (size_t k = 0; k < 3; ++k) {
+                    if (t[k] == b) t[k] = a;
+                }
+                _vertex_faces[a].push_back(f);
+            }
+            std::vector<index_type>& faces = _vertex_faces[a];
+            faces.erase(std::remove_if(faces.begin(), faces.end(), [&](index_type f) { return !_face_alive[f]; }),
+                        faces.end());
+            std::vector<index_type>().swap(_vertex_faces[b]);
+            _removed[b] = 1;
+            ++_stamps[a];
+            ++_stamps[b];
+            return true;
+        }
+
+        inline size_t decimator::run(std::int32_t part, const std::vector<index_type>& seeds, size_t budget,
+                                     double max_error, size_t& removed_faces, size_t& rejected)
+        {
+            std::vector<index_type> scratch_a, scratch_b;
+            std::priority_queue<collapse_candidate> heap;
+            for (index_type v : seeds) {
+                if (!eligible(v, part)) continue;
+                gather_neighbours(v, scratch_a);
+                for (index_type u : scratch_a) {
+                    if (u > v && eligible(u, part)) push_candidate(heap, v, u);
+                }
+            }
+
+            size_t collapse_count = 0;
+            size_t removed = 0;
+            double position[3];
+            while (removed < budget && !heap.empty()) {
+                collapse_candidate candidate = heap.top();
+                heap.pop();
+                if (candidate.cost > max_error) break;
+                // stale entries: an endpoint moved or went away since this one was pushed
+                index_type a = candidate.a, b = candidate.b;
+                if (_removed[a] || _removed[b] || _stamps[a] != candidate.stamp_a || _stamps[b] != candidate.stamp_b) {
+                    continue;
+                }
+                evaluate(a, b, position);
+                if (!try_collapse(a, b, position, scratch_a, scratch_b, removed)) {
+                    ++rejected;
+                    continue;
+                }
+                ++collapse_count;
+
+                gather_neighbours(a, scratch_a);
+                for (index_type u : scratch_a) {
+                    if (eligible(u, part)) push_candidate(heap, a, u);
+                }
+            }
+            removed_faces += removed;
+            return collapse_count;
+        }
+
+        inline mesh decimator::result() const
+        {
+            const index_type none = mesh::invalid_index;
+            size_t n = _x.size();
+            std::vector<index_type> remap(n, none);
+            std::vector<float> positions;
+            std::vector<index_type> triangles;
+            for (size_t f = 0; f < _face_alive.size(); ++f) {
+                if (!_face_alive[f]) continue;
+                for (size_t k = 0; k < 3; ++k) {
+                    index_type v = _triangles[f * 3 + k];
+                    if (remap[v] == none) {
+                        remap[v] = static_cast<index_type>(positions.size() / 3);
+                        positions.push_back(static_cast<float>(_x[v]));
+                        positions.push_back(static_cast<float>(_y[v]));
+                        positions.push_back(static_cast<float>(_z[v]));
+                    }
+                    triangles.push_back(remap[v]);
+                }
+            }
+            return mesh(positions.data(), positions.size() / 3, triangles.data(), triangles.size() / 3);
+        }
+    }
+
+    inline mesh simplify(const mesh& src, const simplify_options& options, simplify_stats* stats)
+    {
+        auto start = std::chrono::steady_clock::now();
+        simplify_detail::decimator engine(src, options);
+        size_t face_count = engine.face_count();
+        size_t target = options.target_triangle_count;
+        size_t removed_faces = 0, collapse_count = 0, parallel_collapse_count = 0, rejected = 0;
+
+        if (options.partition_count > 1 && face_count > target && src.vertex_count() > options.partition_count) {
+            std::vector<std::vector<mesh::index_type>> seeds;
+            std::vector<size_t> part_faces;
+            engine.partition(options.partition_count, options.thread_count, seeds, part_faces);
+
+            // each partition removes its share of the faces, the serial pass makes up the rest
+            size_t to_remove = face_count - target;
+            std::vector<size_t> part_removed(options.partition_count, 0), part_collapses(options.partition_count, 0),
+                                part_rejected(options.partition_count, 0);
+            parallel_for(0, options.partition_count, [&](size_t first, size_t last) {
+                for (size_t p = first; p < last; ++p) {
+                    size_t budget = static_cast<size_t>(double(to_remove) * part_faces[p] / face_count);
+                    part_collapses[p] = engine.run(static_cast<std::int32_t>(p), seeds[p], budget, options.max_error,
+                                                   part_removed[p], part_rejected[p]);
+                }
+            }, options.thread_count, 1);
+            for (size_t p = 0; p < options.partition_count; ++p) {
+                removed_faces += part_removed[p];
+                parallel_collapse_count += part_collapses[p];
+                rejected += part_rejected[p];
+            }
+        }
+        collapse_count = parallel_collapse_count;
+
+        if (face_count - removed_faces > target) {
+            std::vector<mesh::index_type> all(src.vertex_count());
+            for (size_t v = 0; v < all.size(); ++v) all[v] = static_cast<mesh::index_type>(v);
+            collapse_count += engine.run(simplify_detail::no_partition, all, face_count - removed_faces - target,
+                                         options.max_error, removed_faces, rejected);
+        }
+
+        mesh simplified = engine.result();
+        if (src.has_normals()) simplified.compute_normals(options.thread_count);
+        if (stats) {
+            stats->triangles_before = face_count;
+            stats->triangles_after = simplified.triangle_count();
+            stats->collapse_count = collapse_count;
+            stats->parallel_collapse_count = parallel_collapse_count;
+            stats->rejected_count = rejected;
+            stats->seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+        }
+        return simplified;
+    }
+}
+
+#endif // BCG_SIMPLIFY_HPP
@@ -0,0 +1,306 @@
+#ifndef BCG_SKINNING_HPP
+#define BCG_SKINNING_HPP
+
+#include "mesh/mesh.hpp"
+#include "transforms/matrix/matrix.hpp"
+#include "transforms/matrix/packed_matrix.hpp"
+#include "utils/parallel.hpp"
+
+#include <algorithm>
+#include <cmath>
+#include <cstdint>
+#include <vector>
+
+namespace bcg
+{
+    //////////////////////////////////////////////////////////////////////////////////////////////////
+    // skin
+    //////////////////////////////////////////////////////////////////////////////////////////////////
+
+    // A bind-pose mesh with up to skin::influence_count weighted bones per vertex, deformed by a
+    // palette of bone matrices (bone world * inverse bind, one per bone). Vertices are handled 8 at
+    // a time: each lane's weighted matrix is blended from the palette, then applied down the SoA
+    // position and normal arrays. The deformed vertices are written straight into the output mesh,
+    // the bind pose is never touched.
+    class skin
+    {
+    public:
+        typedef std::uint16_t bone_index_type;
+
+        static const size_t influence_count = 4;
+
+    public:
+        skin() = default;
+        // [bone_indices] and [bone_weights] hold influence_count entries per vertex; weights are
+        // normalised here, unused slots have weight 0, and a vertex without any weight follows
+        // its first bone
+        skin(const mesh& bind_pose, const bone_index_type* bone_indices, const float* bone_weights);
+
+    public:
+        size_t vertex_count() const { return _bind_pose.vertex_count(); }
+        // palettes need at least this many bones
+        size_t bone_count() const { return _bone_count; }
+        const mesh& bind_pose() const { return _bind_pose; }
+
+        // Linear blend skinning: every vertex goes through the weighted sum of its bone matrices,
+        // normals through the cofactors of that sum (renormalised). [out] becomes a copy of the
+        // bind pose first if it has a different vertex count. False if the palette is too short.
+        bool apply_linear(const packed_matrix4<float>* palette, size_t palette_size, mesh& out,
+                          size_t thread_count = 0) const;
+        bool apply_linear(const matrix<4, 4, float>* palette, size_t palette_size, mesh& out,
+                          size_t thread_count = 0) const;
+
+        // Dual quaternion skinning: the bones are blended as unit dual quaternions, which keeps
+        // volume where linear blending collapses (twisting joints). The palette must be rigid
+        // (rotation and translation); scale is lost in the conversion.
+        bool apply_dual_quaternion(const packed_matrix4<float>* palette, size_t palette_size, mesh& out,
+                                   size_t thread_count = 0) const;
+
+    private:
+        mesh _bind_pose;
+        std::vector<bone_index_type> _bone_indices;
+        std::vector<float> _bone_weights;
+        size_t _bone_count = 0;
+    };
+
+    //////////////////////////////////////////////////////////////////////////////////////////////////
+    // skin implementation
+    //////////////////////////////////////////////////////////////////////////////////////////////////
+
+    namespace skinning_detail
+    {
+        const size_t lane_count = 8;
+        const size_t grain_size = 1 << 13;
+
+        // unit dual quaternion of a rigid transform, real part (w, x, y, z) then dual part
+        struct dual_quaternion
+        {
+            float q[8];
+        };
+
+        inline dual_quaternion to_dual_quaternion(const packed_matrix4<float>& t)
+        {
+            const float* m = t.m;
+            float w, x, y, z;
+            // largest of the four diagonal combinations keeps the square root well away from 0
+            float trace = m[0] + m[5] + m[10];
+            if (trace > 0) {
+                float s = 2 * std::sqrt(trace + 1);
+                w = s / 4; x = (m[9] - m[6]) / s; y = (m[2] - m[8]) / s; z = (m[4] - m[1]) / s;
+            }
+            else if (m[0] > m[5] && m[0] > m[10]) {
+                float s = 2 * std::sqrt(1 + m[0] - m[5] - m[10]);
+                w = (m[9] - m[6]) / s; x = s / 4; y = (m[1] + m[4]) / s; z = (m[2] + m[8]) / s;
+            }
+            else if (m[5] > m[10]) {
+                float s = 2 * std::sqrt(1 + m[5] - m[0] - m[10]);
+                w = (m[2] - m[8]) / s; x = (m[1] + m[4]) / s; y = s / 4; z = (m[6] + m[9]) / s;
+            }
+            else {
+                float s = 2 * std::sqrt(1 + m[10] - m[0] - m[5]);
+                w = (m[4] - m[1]) / s; x = (m[2] + m[8]) / s; y = (m[6] + m[9]) / s; z = s / 4;
+            }
+            float inv = 1 / std::sqrt(w * w + x * x + y * y + z * z);
+            w *= inv; x *= inv; y *= inv; z *= inv;
+
+            // dual part (0, t) r / 2
+            float tx = m[3], ty = m[7], tz = m[11];
+            dual_quaternion dq;
+            dq.q[0] = w; dq.q[1] = x; dq.q[2] = y; dq.q[3] = z;
+            dq.q[4] = -0.5f * (tx * x + ty * y + tz * z);
+            dq.q[5] = 0.5f * (w * tx + ty * z - tz * y);
+            dq.q[6] = 0.5f * (w * ty + tz * x - tx * z);
+            dq.q[7] = 0.5f * (w * tz + tx * y - ty * x);
+            return dq;
+        }
+
+        // the 3x4 rows of each lane's blended matrix, [count] lanes
+        inline void blend_matrices(const packed_matrix4<float>* palette, const skin::bone_index_type* indices,
+                                   const float* weights, size_t count, float out[12][lane_count])
+        {
+            for (size_t e = 0; e < 12; ++e) {
+                for (size_t l = 0; l < lane_count; ++l) out[e][l] = 0;
+            }
+            for (size_t l = 0; l < count; ++l) {
+                // summed along the contiguous palette rows, then transposed into the lane
+                float sum[12] = {};
+                for (size_t k = 0; k < skin::influence_count; ++k) {
+                    float w = weights[l * skin::influence_count + k];
+                    const float* b = palette[indices[l * skin::influence_count + k]].m;
+                    for (size_t e = 0; e < 12; ++e) sum[e] += w * b[e];
+                }
+                for (size_t e = 0; e < 12; ++e) out[e][l] = sum[e];
+            }
+        }
+
+        // each lane's blended dual quaternion turned back into 3x4 rows
+        inline void blend_dual_quaternions(const dual_quaternion* palette, const skin::bone_index_type* indices,
+                                           const float* weights, size_t count, float out[12][lane_count])
+        {
+            float q[8][lane_count];
+            for (size_t e = 0; e < 8; ++e) {
+                for (size_t l = 0; l < lane_count; ++l) q[e][l] = 0;
+            }
+            for (size_t l = 0; l < count; ++l) {
+                const float* pivot = palette[indices[l * skin::influence_count]].q;
+                float sum[8] = {};
+                for (size_t k = 0; k < skin::influence_count; ++k) {
+                    float w = weights[l * skin::influence_count + k];
+                    const float* b = palette[indices[l * skin::influence_count + k]].q;
+                    // q and -q are the same rotation, blend along the shorter arc from the first bone
+                    if (b[0] * pivot[0] + b[1] * pivot[1] + b[2] * pivot[2] + b[3] * pivot[3] < 0) w = -w;
+                    for (size_t e = 0; e < 8; ++e) sum[e] += w * b[e];
+                }
+                for (size_t e = 0; e < 8; ++e) q[e][l] = sum[e];
+            }
+            for (size_t l = 0; l < lane_count; ++l) {
+                float len2 = q[0][l] * q[0][l] + q[1][l] * q[1][l] + q[2][l] * q[2][l] + q[3][l] * q[3][l];
+                float inv = len2 > 0 ? 1 / std::sqrt(len2) : 0.0f;
+                float w = q[0][l] * inv, x = q[1][l] * inv, y = q[2][l] * inv, z = q[3][l] * inv;
+                float dw = q[4][l] * inv, dx = q[5][l] * inv, dy = q[6][l] * inv, dz = q[7][l] * inv;
+                out[0][l] = 1 - 2 * (y * y + z * z); out[1][l] = 2 * (x * y - w * z); out[2][l] = 2 * (x * z + w * y);
+                out[4][l] = 2 * (x * y + w * z); out[5][l] = 1 - 2 * (x * x + z * z); out[6][l] = 2 * (y * z - w * x);
+                out[8][l] = 2 * (x * z - w * y); out[9][l] = 2 * (y * z + w * x); out[10][l] = 1 - 2 * (x * x + y * y);
+                // translation 2 vec(d conj(r))
+                out[3][l] = 2 * (w * dx - dw * x + y * dz - z * dy);
+                out[7][l] = 2 * (w * dy - dw * y + z * dx - x * dz);
+                out[11][l] = 2 * (w * dz - dw * z + x * dy - y * dx);
+            }
+        }
+
+        // positions (and normals, through the cofactors) of [count] vertices from the lanes' rows
+        inline void apply_rows(const float m[12][lane_count], size_t count, const float* x, const float* y,
+                               const float* z, float* out_x, float* out_y, float* out_z, const float* nx,
+                               const float* ny, const float* nz, float* out_nx, float* out_ny, float* out_nz)
+        {
+            for (size_t l = 0; l < count; ++l) {
+                float px = x[l], py = y[l], pz = z[l];
+                out_x[l] = m[0][l] * px + m[1][l] * py + m[2][l] * pz + m[3][l];
+                out_y[l] = m[4][l] * px + m[5][l] * py + m[6][l] * pz + m[7][l];
+                out_z[l] = m[8][l] * px + m[9][l] * py + m[10][l] * pz + m[11][l];
+            }
+            if (nx == nullptr) return;
+            for (size_t l = 0; l < count; ++l) {
+                float c0 = m[5][l] * m[10][l] - m[6][l] * m[9][l];
+                float c1 = m[6][l] * m[8][l] - m[4][l] * m[10][l];
+                float c2 = m[4][l] * m[9][l] - m[5][l] * m[8][l];
+                float c3 = m[2][l] * m[9][l] - m[1][l] * m[10][l];
+                float c4 = m[0][l] * m[10][l] - m[2][l] * m[8][l];
+                float c5 = m[1][l] * m[8][l] - m[0][l] * m[9][l];
+                float c6 = m[1][l] * m[6][l] - m[2][l] * m[5][l];
+                float c7 = m[2][l] * m[4][l] - m[0][l] * m[6][l];
+                float c8 = m[0][l] * m[5][l] - m[1][l] * m[4][l];
+                float vx = nx[l], vy = ny[l], vz = nz[l];
+                float tx = c0 * vx + c1 * vy + c2 * vz;
+                float ty = c3 * vx + c4 * vy + c5 * vz;
+                float tz = c6 * vx + c7 * vy + c8 * vz;
+                // a mirroring blend flips the cofactors, keep the normal on the same side
+                float det = m[0][l] * c0 + m[1][l] * c1 + m[2][l] * c2;
+                float len2 = tx * tx + ty * ty + tz * tz;
+                float inv = len2 > 0 ? 1 / std::sqrt(len2) : 0.0f;
+                if (det < 0) inv = -inv;
+                out_nx[l] = tx * inv;
+                out_ny[l] = ty * inv;
+                out_nz[l] = tz * inv;
+            }
+        }
+
+        // runs blend(first, count, rows) over lane blocks of every vertex and applies the rows
+        template<typename blend_type>
+        void skin_vertices(const mesh& bind_pose, mesh& out, blend_type blend, size_t thread_count)
+        {
+            bool with_normals = bind_pose.has_normals() && out.has_normals();
+            parallel_for(0, bind_pose.vertex_count(), [&](size_t first, size_t last) {
+                float rows[12][lane_count];
+                for (size_t v = first; v < last; v += lane_count) {
+                    size_t count = std::min(lane_count, last - v);
+                    blend(v, count, rows);
+                    apply_rows(rows, count, bind_pose.x() + v, bind_pose.y() + v, bind_pose.z() + v,
+                               out.x() + v, out.y() + v, out.z() + v,
+                               with_normals ? bind_pose.nx() + v : nullptr, with_normals ? bind_pose.ny() + v : nullptr,
+                               with_normals ? bind_pose.nz() + v : nullptr, with_normals ? out.nx() + v : nullptr,
+                               with_normals ? out.ny() + v : nullptr, with_normals ? out.nz() + v : nullptr);
+                }
+            }, thread_count, grain_size);
+        }
+    }
+
+    inline skin::skin(const mesh& bind_pose, const bone_index_type* bone_indices, const float* bone_weights)
+        : _bind_pose(bind_pose),
+          _bone_indices(bone_indices, bone_indices + bind_pose.vertex_count() * influence_count),
+          _bone_weights(bone_weights, bone_weights + bind_pose.vertex_count() * influence_count)
+    {
+        for (size_t v = 0; v < vertex_count(); ++v) {
+            float* w = &_bone_weights[v * influence_count];
+            bone_index_type* b = &_bone_indices[v * influence_count];
+            float sum = 0;
+            size_t first_used = influence_count;
+            for (size_t k = 0; k < influence_count; ++k) {
+                if (!(w[k] > 0)) w[k] = 0;
+                if (w[k] > 0 && first_used == influence_count) first_used = k;
+                sum += w[k];
+            }
+            if (sum > 0) {
+                for (size_t k = 0; k < influence_count; ++k) w[k] /= sum;
+            }
+            else {
+                w[0] = 1;
+                first_used = 0;
+            }
+            // unused slots point at a used bone, the kernels blend all slots without branching
+            // and the dual quaternion blend takes its hemisphere from slot 0
+            for (size_t k = 0; k < influence_count; ++k) {
+                if (w[k] == 0) b[k] = b[first_used];
+            }
+            if (w[0] == 0) {
+                std::swap(w[0], w[first_used]);
+                std::swap(b[0], b[first_used]);
+            }
+            for (size_t k = 0; k < influence_count; ++k) _bone_count = std::max<size_t>(_bone_count, size_t(b[k]) + 1);
+        }
+    }
+
+    inline bool skin::apply_linear(const packed_matrix4<float>* palette, size_t palette_size, mesh& out,
+                                   size_t thread_count) const
+    {
+        using namespace skinning_detail;
+        if (palette_size < _bone_count) return false;
+        if (out.vertex_count() != vertex_count()) out = _bind_pose;
+
+        const bone_index_type* indices = _bone_indices.data();
+        const float* weights = _bone_weights.data();
+        skin_vertices(_bind_pose, out, [&](size_t first, size_t count, float rows[12][lane_count]) {
+            blend_matrices(palette, indices + first * influence_count, weights + first * influence_count, count, rows);
+        }, thread_count);
+        return true;
+    }
+
+    inline bool skin::apply_linear(const matrix<4, 4, float>* palette, size_t palette_size, mesh& out,
+                                   size_t thread_count) const
+    {
+        std::vector<packed_matrix4<float>> packed(palette, palette + palette_size);
+        return apply_linear(packed.data(), palette_size, out, thread_count);
+    }
+
+    inline bool skin::apply_dual_quaternion(const packed_matrix4<float>* palette, size_t palette_size, mesh& out,
+                                            size_t thread_count) const
+    {
+        using namespace skinning_detail;
+        if (palette_size < _bone_count) return false;
+        if (out.vertex_count() != vertex_count()) out = _bind_pose;
+
+        // once per bone, not per vertex
+        std::vector<dual_quaternion> quaternions(palette_size);
+        for (size_t b = 0; b < palette_size; ++b) quaternions[b] = to_dual_quaternion(palette[b]);
+
+        const bone_index_type* indices = _bone_indices.data();
+        const float* weights = _bone_weights.data();
+        skin_vertices(_bind_pose, out, [&](size_t first, size_t count, float rows[12][lane_count]) {
+            blend_dual_quaternions(quaternions.data(), indices + first * influence_count,
+                                   weights + first * influence_count, count, rows);
+        }, thread_count);
+        return true;
+    }
+}
+
+#endif // BCG_SKINNING_HPP
@@ -0,0 +1,309 @@
+#ifndef BCG_PARTICLE_SYSTEM_HPP
+#define BCG_PARTICLE_SYSTEM_HPP
+
+#include "transforms/point.hpp"
+#include "transforms/vector.hpp"
+#include "utils/parallel.hpp"
+
+#include <algorithm>
+#include <cmath>
+#include <vector>
+
+namespace bcg
+{
+    //////////////////////////////////////////////////////////////////////////////////////////////////
+    // particle_system
+    //////////////////////////////////////////////////////////////////////////////////////////////////
+
+    enum class particle_integrator
+    {
+        // x += v dt, then v += a dt
+        euler,
+        // v += a dt, then x += v dt (symplectic, the usual choice)
+        semi_implicit_euler,
+        // x += (x - x_previous) + a dt^2, velocities follow from the positions; positions moved by
+        // constraints between steps carry their velocity with them. Assumes a constant dt.
+        verlet
+    };
+
+    // Acceleration is force * inverse mass + gravity. Velocities are damped by (1 - damping dt)
+    // per step. Forces are zeroed by the step that consumes them unless [keep_forces] is set.
+    struct particle_step_options
+    {
+        particle_integrator integrator = particle_integrator::semi_implicit_euler;
+        float gravity[3] = { 0, 0, 0 };
+        float damping = 0;
+        bool keep_forces = false;
+        size_t thread_count = 0;
+    };
+
+    // Particles as separate arrays per component (positions, velocities, force accumulators, inverse
+    // masses), so one step is a single fused pass per particle block with no per-particle vector
+    // temporaries. An inverse mass of 0 pins a particle in place.
+    class particle_system
+    {
+    public:
+        particle_system() = default;
+
+        // returns the index of the new particle
+        size_t add(const point& position, const vector& velocity, float inverse_mass = 1);
+        void reserve(size_t capacity);
+        void clear();
+
+    public:
+        size_t size() const { return _x.size(); }
+
+        float* x() { return _x.data(); }
+        float* y() { return _y.data(); }
+        float* z() { return _z.data(); }
+        const float* x() const { return _x.data(); }
+        const float* y() const { return _y.data(); }
+        const float* z() const { return _z.data(); }
+        float* vx() { return _vx.data(); }
+        float* vy() { return _vy.data(); }
+        float* vz() { return _vz.data(); }
+        const float* vx() const { return _vx.data(); }
+        const float* vy() const { return _vy.data(); }
+        const float* vz() const { return _vz.data(); }
+        float* fx() { return _fx.data(); }
+        float* fy() { return _fy.data(); }
+        float* fz() { return _fz.data(); }
+        const float* fx() const { return _fx.data(); }
+        const float* fy() const { return _fy.data(); }
+        const float* fz() const { return _fz.data(); }
+        float* inverse_masses() { return _inverse_mass.data(); }
+        const float* inverse_masses() const { return _inverse_mass.data(); }
+
+        point position(size_t idx) const { return point(_x[idx], _y[idx], _z[idx]); }
+        vector velocity(size_t idx) const { return vector(_vx[idx], _vy[idx], _vz[idx]); }
+
+    public:
+        // force accumulators
+        void add_force(size_t idx, float fx, float fy, float fz);
+        // -k v on every particle
+        void apply_drag(float k, size_t thread_count = 0);
+        // pull of [strength] / (d^2 + softening^2) towards [center] on every particle
+        void apply_attractor(const float* center, float strength, float softening, size_t thread_count = 0);
+        void clear_forces(size_t thread_count = 0);
+
+        // advance every particle by [dt]
+        void step(float dt, const particle_step_options& options = particle_step_options());
+
+    private:
+        std::vector<float> _x, _y, _z;
+        std::vector<float> _vx, _vy, _vz;
+        std::vector<float> _fx, _fy, _fz;
+        std::vector<float> _inverse_mass;
+        // positions of the previous verlet step, only valid while [_verlet_primed]
+        std::vector<float> _px, _py, _pz;
+        bool _verlet_primed = false;
+    };
+
+    //////////////////////////////////////////////////////////////////////////////////////////////////
+    // particle_system implementation
+    //////////////////////////////////////////////////////////////////////////////////////////////////
+
+    namespace particle_detail
+    {
+        const size_t lane_count = 8;
+        const size_t grain_size = 1 << 14;
+
+        // the arrays of one step, copied so the kernels see plain local pointers
+        struct step_arrays
+        {
+            float* x; float* y; float* z;
+            float* vx; float* vy; float* vz;
+            float* fx; float* fy; float* fz;
+            const float* inverse_mass;
+            float* px; float* py; float* pz;
+        };
+
+        // One block of at most lane_count particles: loaded into locals, integrated, stored. Keeping
+        // the arithmetic on locals lets it vectorise without proving that a dozen arrays don't alias.
+        inline void step_block(const step_arrays& a, size_t first, size_t count, float dt,
+                               const particle_step_options& options)
+        {
+            float x[3][lane_count] = {}, v[3][lane_count] = {}, f[3][lane_count] = {}, w[lane_count] = {};
+            float* pos[3] = { a.x, a.y, a.z };
+            float* vel[3] = { a.vx, a.vy, a.vz };
+            float* force[3] = { a.fx, a.fy, a.fz };
+            for (size_t d = 0; d < 3; ++d) {
+                for (size_t l = 0; l < count; ++l) {
+                    x[d][l] = pos[d][first + l];
+                    v[d][l] = vel[d][first + l];
+                    f[d][l] = force[d][first + l];
+                }
+            }
+            for (size_t l = 0; l < count; ++l) w[l] = a.inverse_mass[first + l];
+
+            float keep = std::max(0.0f, 1 - options.damping * dt);
+            float acc[3][lane_count];
+            for (size_t d = 0; d < 3; ++d) {
+                float g = options.gravity[d];
+                // pinned particles don't move at all
+                for (size_t l = 0; l < lane_count; ++l) {
+                    acc[d][l] = w[l] > 0 ? f[d][l] * w[l] + g : 0.0f;
+                    v[d][l] = w[l] > 0 ? v[d][l] : 0.0f;
+                }
+            }
+
+            switch (options.integrator) {
+            case particle_integrator::euler:
+                for (size_t d = 0; d < 3; ++d) {
+                    for (size_t l = 0; l < lane_count; ++l) {
+                        x[d][l] += v[d][l] * dt;
+                        v[d][l] = (v[d][l] + acc[d][l] * dt) * keep;
+                    }
+                }
+                break;
+            case particle_integrator::semi_implicit_euler:
+                for (size_t d = 0; d < 3; ++d) {
+                    for (size_t l = 0; l < lane_count; ++l) {
+                        v[d][l] = (v[d][l] + acc[d][l] * dt) * keep;
+                        x[d][l] += v[d][l] * dt;
+                    }
+                }
+                break;
+            case particle_integrator::verlet: {
+                float* previous[3] = { a.px, a.py, a.pz };
+                float p[3][lane_count] = {};
+                for (size_t d = 0; d < 3; ++d) {
+                    for (size_t l = 0; l < count; ++l) p[d][l] = previous[d][first + l];
+                }
+                float inv_dt = dt > 0 ? 1 / dt : 0.0f;
+                for (size_t d = 0; d < 3; ++d) {
+                    for (size_t l = 0; l < lane_count; ++l) {
+                        float next = x[d][l] + (x[d][l] - p[d][l]) * keep + acc[d][l] * dt * dt;
+                        next = w[l] > 0 ? next : x[d][l];
+                        p[d][l] = x[d][l];
+                        v[d][l] = (next - x[d][l]) * inv_dt;
+                        x[d][l] = next;
+                    }
+                }
+                for (size_t d = 0; d < 3; ++d) {
+                    for (size_t l = 0; l < count; ++l) previous[d][first + l] = p[d][l];
+                }
+                break;
+            }
+            }
+
+            for (size_t d = 0; d < 3; ++d) {
+                for (size_t l = 0; l < count; ++l) {
+                    pos[d][first + l] = x[d][l];
+                    vel[d][first + l] = v[d][l];
+                }
+                if (!options.keep_forces) std::fill(force[d] + first, force[d] + first + count, 0.0f);
+            }
+        }
+    }
+
+    inline size_t particle_system::add(const point& position, const vector& velocity, float inverse_mass)
+    {
+        const b_vector<4, float>& p = position.data();
+        const b_vector<4, float>& v = velocity.data();
+        _x.push_back(p[0]);
+        _y.push_back(p[1]);
+        _z.push_back(p[2]);
+        _vx.push_back(v[0]);
+        _vy.push_back(v[1]);
+        _vz.push_back(v[2]);
+        _fx.push_back(0);
+        _fy.push_back(0);
+        _fz.push_back(0);
+        _inverse_mass.push_back(inverse_mass);
+        _verlet_primed = false;
+        return _x.size() - 1;
+    }
+
+    inline void particle_system::reserve(size_t capacity)
+    {
+        std::vector<float>* arrays[] = { &_x, &_y, &_z, &_vx, &_vy, &_vz, &_fx, &_fy, &_fz, &_inverse_mass };
+        for (std::vector<float>* a : arrays) a->reserve(capacity);
+    }
+
+    inline void particle_system::clear()
+    {
+        std::vector<float>* arrays[] = { &_x, &_y, &_z, &_vx, &_vy, &_vz, &_fx, &_fy, &_fz, &_inverse_mass,
+                                         &_px, &_py, &_pz };
+        for (std::vector<float>* a : arrays) a->clear();
+        _verlet_primed = false;
+    }
+
+    inline void particle_system::add_force(size_t idx, float fx, float fy, float fz)
+    {
+        _fx[idx] += fx;
+        _fy[idx] += fy;
+        _fz[idx] += fz;
+    }
+
+    inline void particle_system::apply_drag(float k, size_t thread_count)
+    {
+        parallel_for(0, size(), [&](size_t first, size_t last) {
+            float* fx = _fx.data(); float* fy = _fy.data(); float* fz = _fz.data();
+            const float* vx = _vx.data(); const float* vy = _vy.data(); const float* vz = _vz.data();
+            for (size_t i = first; i < last; ++i) {
+                fx[i] -= k * vx[i];
+                fy[i] -= k * vy[i];
+                fz[i] -= k * vz[i];
+            }
+        }, thread_count, particle_detail::grain_size);
+    }
+
+    inline void particle_system::apply_attractor(const float* center, float strength, float softening,
+                                                 size_t thread_count)
+    {
+        float cx = center[0], cy = center[1], cz = center[2], soft2 = softening * softening;
+        parallel_for(0, size(), [&](size_t first, size_t last) {
+            float* fx = _fx.data(); float* fy = _fy.data(); float* fz = _fz.data();
+            const float* x = _x.data(); const float* y = _y.data(); const float* z = _z.data();
+            for (size_t i = first; i < last; ++i) {
+                float dx = cx - x[i], dy = cy - y[i], dz = cz - z[i];
+                float d2 = dx * dx + dy * dy + dz * dz + soft2;
+                // strength / d2 along the unit direction
+                float s = strength / (d2 * std::sqrt(d2));
+                fx[i] += dx * s;
+                fy[i] += dy * s;
+                fz[i] += dz * s;
+            }
+        }, thread_count, particle_detail::grain_size);
+    }
+
+    inline void particle_system::clear_forces(size_t thread_count)
+    {
+        parallel_for(0, size(), [&](size_t first, size_t last) {
+            std::fill(_fx.begin() + first, _fx.begin() + last, 0.0f);
+            std::fill(_fy.begin() + first, _fy.begin() + last, 0.0f);
+            std::fill(_fz.begin() + first, _fz.begin() + last, 0.0f);
+        }, thread_count, particle_detail::grain_size);
+    }
+
+    inline void particle_system::step(float dt, const particle_step_options& options)
+    {
+        using namespace particle_detail;
+        bool verlet = options.integrator == particle_integrator::verlet;
+        if (verlet && !_verlet_primed) {
+            // previous positions implied by the current velocities
+            _px.resize(size());
+            _py.resize(size());
+            _pz.resize(size());
+            for (size_t i = 0; i < size(); ++i) {
+                _px[i] = _x[i] - _vx[i] * dt;
+                _py[i] = _y[i] - _vy[i] * dt;
+                _pz[i] = _z[i] - _vz[i] * dt;
+            }
+        }
+        _verlet_primed = verlet;
+
+        step_arrays a = { _x.data(), _y.data(), _z.data(), _vx.data(), _vy.data(), _vz.data(),
+                          _fx.data(), _fy.data(), _fz.data(), _inverse_mass.data(),
+                          _px.data(), _py.data(), _pz.data() };
+        parallel_for(0, size(), [&](size_t first, size_t last) {
+            size_t i = first;
+            // full blocks with a constant count, so the loads and stores vectorise too
+            for (; i + lane_count <= last; i += lane_count) step_block(a, i, lane_count, dt, options);
+            if (i < last) step_block(a, i, last - i, dt, options);
+        }, options.thread_count, grain_size);
+    }
+}
+
+#endif // BCG_PARTICLE_SYSTEM_HPP
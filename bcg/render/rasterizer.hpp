@@ -0,0 +1,614 @@
+#ifndef BCG_RASTERIZER_HPP
+#define BCG_RASTERIZER_HPP
+
+#include "mesh/mesh.hpp"
+#include "transforms/matrix/matrix.hpp"
+#include "transforms/matrix/packed_matrix.hpp"
+#include "utils/parallel.hpp"
+
+#include <algorithm>
+#include <cmath>
+#include <cstdint>
+#include <limits>
+#include <vector>
+
+namespace bcg
+{
+    //////////////////////////////////////////////////////////////////////////////////////////////////
+    // rasterizer
+    //////////////////////////////////////////////////////////////////////////////////////////////////
+
+    // OpenGL-style perspective projection looking down -z: view depths [z_near, z_far] map to
+    // normalized z in [-1, 1], [fov_y] is in radians
+    inline packed_matrix4<float> perspective_projection(float fov_y, float aspect, float z_near, float z_far);
+
+    // Lambert shading of one base color. Vertex normals are used when given (smooth shading),
+    // the face normal otherwise (flat shading); both and the light direction are in the space of
+    // the input positions.
+    struct raster_options
+    {
+        float color[3] = { 1, 1, 1 };
+        // direction the light travels in
+        float light_direction[3] = { 0, 0, -1 };
+        float ambient = 0.2f;
+        // triangles are front-facing when counter-clockwise in normalized device coordinates
+        bool cull_back_faces = true;
+        size_t thread_count = 0;
+    };
+
+    // counts of the last draw
+    struct raster_stats
+    {
+        size_t triangles = 0;
+        // back-facing, outside the frustum, degenerate or between pixel centers
+        size_t culled = 0;
+        // reaching behind the near plane or beyond the guard band, clipped and fanned into triangles
+        size_t clipped = 0;
+        // (triangle, tile) pairs after binning
+        size_t bin_entries = 0;
+        // pixel centers covered, before the depth test
+        size_t fragments = 0;
+    };
+
+    // Tile-based software rasterizer owning a color and a depth buffer.
+    //
+    // A draw transforms, shades, projects and snaps every vertex to 1/256 pixel in one pass, then
+    // sets up triangles in parallel: frustum rejection, exact integer edge functions and binning into
+    // square screen tiles. Only triangles reaching behind the near plane or beyond a guard band of
+    // 16384 pixels around the screen are clipped. Tiles are then rasterized in parallel, 8 pixels of
+    // a row per step: edge functions, depth test and perspective-correct shading as selects over the
+    // lanes. Shared edges follow the top-left rule, so a closed mesh covers every pixel center exactly
+    // once, and each tile draws its triangles in submission order, so the image doesn't depend on
+    // the thread count.
+    //
+    // Pixel (0, 0) is the top-left one and colors are packed 0xAABBGGRR (red in the low byte). The
+    // depth test is less-than on z mapped to [0, 1]; clearing the depth to 1 also drops fragments
+    // beyond the far plane.
+    class rasterizer
+    {
+    public:
+        // [tile_size] is rounded up to a multiple of 8
+        rasterizer(size_t width, size_t height, size_t tile_size = 64);
+
+    public:
+        size_t width() const { return _width; }
+        size_t height() const { return _height; }
+        size_t tile_size() const { return _tile_size; }
+        size_t tile_count() const { return _tiles_x * _tiles_y; }
+        // length of a buffer row, the width rounded up to 8
+        size_t stride() const { return _stride; }
+
+        const std::uint32_t* colors() const { return _color.data(); }
+        const float* depths() const { return _depth.data(); }
+        std::uint32_t color_at(size_t x, size_t y) const { return _color[y * _stride + x]; }
+        float depth_at(size_t x, size_t y) const { return _depth[y * _stride + x]; }
+
+        const raster_stats& stats() const { return _stats; }
+
+    public:
+        void clear(std::uint32_t color = 0xff000000, float depth = 1);
+
+        void draw(const mesh& m, const packed_matrix4<float>& model_view_projection,
+                  const raster_options& options = raster_options());
+        void draw(const mesh& m, const matrix<4, 4, float>& model_view_projection,
+                  const raster_options& options = raster_options());
+        // positions as separate x, y, z arrays, normals likewise or null, 3 indices per triangle
+        void draw(const float* x, const float* y, const float* z, const float* nx, const float* ny,
+                  const float* nz, size_t vertex_count, const std::uint32_t* indices, size_t triangle_count,
+                  const packed_matrix4<float>& model_view_projection,
+                  const raster_options& options = raster_options());
+
+    private:
+        size_t _width, _height, _tile_size, _stride, _tiles_x, _tiles_y;
+        std::vector<std::uint32_t> _color;
+        std::vector<float> _depth;
+        raster_stats _stats;
+        // per-vertex data of the current draw, reused between draws: clip-space positions and
+        // shading intensities, snapped screen positions (x, y pairs), interpolated values (depth,
+        // 1 / w, shade / w triples) and outcodes
+        std::vector<float> _cx, _cy, _cz, _cw, _shade;
+        std::vector<std::int32_t> _screen;
+        std::vector<float> _values;
+        std::vector<std::uint8_t> _codes;
+    };
+
+    //////////////////////////////////////////////////////////////////////////////////////////////////
+    // rasterizer implementation
+    //////////////////////////////////////////////////////////////////////////////////////////////////
+
+    inline packed_matrix4<float> perspective_projection(float fov_y, float aspect, float z_near, float z_far)
+    {
+        packed_matrix4<float> p;
+        float f = 1 / std::tan(fov_y / 2);
+        p(0, 0) = f / aspect;
+        p(1, 1) = f;
+        p(2, 2) = (z_far + z_near) / (z_near - z_far);
+        p(2, 3) = 2 * z_far * z_near / (z_near - z_far);
+        p(3, 2) = -1;
+        p(3, 3) = 0;
+        return p;
+    }
+
+    namespace raster_detail
+    {
+        const size_t lane_count = 8;
+        const size_t grain_size = 1 << 12;
+        // vertices are snapped to 1/256 pixel
+        const int subpixel_bits = 8;
+        // pixels beyond the screen edges a vertex may lie before its triangles are clipped, small
+        // enough that snapped edge functions stay exact in 64-bit integers
+        const float guard_band = 16384;
+        // outcode bit of vertices behind the near plane or beyond the guard band
+        const unsigned clip_bit = 64;
+
+        struct clip_vertex
+        {
+            float x, y, z, w, shade;
+            // input vertex it was copied from, -1 for vertices made by clipping
+            std::int64_t source;
+        };
+
+        // A triangle after setup. Edge i (opposite vertex i) is a x + b y + c of x, y in 1/256 pixels,
+        // exact in integers and positive inside; the interpolated values (depth, 1 / w, shade / w)
+        // are planes through vertex 0 in pixels.
+        struct setup_triangle
+        {
+            std::int32_t a[3], b[3];
+            std::int64_t c[3];
+            // 0 on top-left edges, the smallest positive float elsewhere: w >= bias is inside
+            float bias[3];
+            float x0, y0;
+            // value at vertex 0, d/dx, d/dy
+            float plane[3][3];
+            int min_x, min_y, max_x, max_y;
+        };
+
+        inline float lambert(float nx, float ny, float nz, const raster_options& options)
+        {
+            const float* l = options.light_direction;
+            float len = std::sqrt((nx * nx + ny * ny + nz * nz) * (l[0] * l[0] + l[1] * l[1] + l[2] * l[2]));
+            // a zero normal divides 0 by the smallest float, a select would be put under a branch
+            float dot = nx * l[0] + ny * l[1] + nz * l[2];
+            float facing = -dot / std::max(len, std::numeric_limits<float>::min());
+            return options.ambient + (1 - options.ambient) * std::max(0.0f, facing);
+        }
+
+        // frustum outcode, plus [clip_bit] when the vertex can't be projected as is; [gx] and [gy]
+        // are the guard band in normalized device coordinates
+        inline unsigned outcode(float x, float y, float z, float w, float gx, float gy)
+        {
+            unsigned code = (x < -w ? 1u : 0u) | (x > w ? 2u : 0u) | (y < -w ? 4u : 0u) | (y > w ? 8u : 0u) |
+                            (z < -w ? 16u : 0u) | (z > w ? 32u : 0u);
+            // one compare for the guard band planes, && would branch
+            float outside = std::max(std::max(std::fabs(x) - gx * w, std::fabs(y) - gy * w), -(z + w));
+            return code | (outside > 0 ? clip_bit : 0u) | (w > 0 ? 0u : clip_bit);
+        }
+
+        // snapped screen position and (depth, 1 / w, shade / w) of a vertex with w > 0, garbage
+        // otherwise; outputs are [stride] apart and the code is branch free, so a lane block of
+        // vertices vectorises into planar arrays
+        inline void project(float x, float y, float z, float w, float shade, float width, float height,
+                            std::int32_t* xy, float* values, size_t stride = 1)
+        {
+            float inv_w = 1 / w;
+            float sx = (x * inv_w * 0.5f + 0.5f) * width * float(1 << subpixel_bits) + 0.5f;
+            float sy = (0.5f - y * inv_w * 0.5f) * height * float(1 << subpixel_bits) + 0.5f;
+            // floor as truncation corrected by a compare
+            std::int32_t ix = std::int32_t(sx), iy = std::int32_t(sy);
+            xy[0] = ix - (float(ix) > sx ? 1 : 0);
+            xy[stride] = iy - (float(iy) > sy ? 1 : 0);
+            values[0] = z * inv_w * 0.5f + 0.5f;
+            values[stride] = inv_w;
+            values[2 * stride] = shade * inv_w;
+        }
+
+        inline float plane_distance(const clip_vertex& v, size_t plane, float gx, float gy)
+        {
+            switch (plane) {
+            case 0: return v.z + v.w;
+            case 1: return gx * v.w + v.x;
+            case 2: return gx * v.w - v.x;
+            case 3: return gy * v.w + v.y;
+            default: return gy * v.w - v.y;
+            }
+        }
+
+        // Clips [polygon] (room for 8 vertices) against the near plane and the guard band, returns
+        // its new vertex count. Intersections are computed from the inside vertex, so the two
+        // triangles of a clipped edge get bitwise equal points.
+        inline size_t clip_polygon(clip_vertex* polygon, size_t n, float gx, float gy)
+        {
+            clip_vertex out[8];
+            for (size_t plane = 0; plane < 5 && n > 0; ++plane) {
+                size_t m = 0;
+                for (size_t i = 0; i < n; ++i) {
+                    const clip_vertex& a = polygon[i];
+                    const clip_vertex& b = polygon[(i + 1) % n];
+                    float da = plane_distance(a, plane, gx, gy), db = plane_distance(b, plane, gx, gy);
+                    if (da >= 0) out[m++] = a;
+                    if ((da >= 0) == (db >= 0)) continue;
+                    const clip_vertex& in = da >= 0 ? a : b;
+                    const clip_vertex& off = da >= 0 ? b : a;
+                    float d_in = da >= 0 ? da : db, d_off = da >= 0 ? db : da;
+                    float t = d_in / (d_in - d_off);
+                    out[m++] = clip_vertex{ in.x + t * (off.x - in.x), in.y + t * (off.y - in.y),
+                                            in.z + t * (off.z - in.z), in.w + t * (off.w - in.w),
+                                            in.shade + t * (off.shade - in.shade), -1 };
+                }
+                n = m;
+                std::copy(out, out + n, polygon);
+            }
+            return n;
+        }
+
+        // Bounds and edge functions of a triangle of snapped vertices [xy], false when it is culled.
+        // Everything is exact integer arithmetic, so edges shared by triangles are exact negations
+        // of each other.
+        inline bool cover(const std::int32_t* const* xy, size_t width, size_t height, bool cull_back_faces,
+                          setup_triangle& out)
+        {
+            // pixels whose centers x + 0.5 fall inside the bounds, clamped to the screen (shifts round
+            // towards negative infinity)
+            const std::int32_t half = 1 << (subpixel_bits - 1);
+            std::int32_t min_x = std::min(xy[0][0], std::min(xy[1][0], xy[2][0]));
+            std::int32_t max_x = std::max(xy[0][0], std::max(xy[1][0], xy[2][0]));
+            std::int32_t min_y = std::min(xy[0][1], std::min(xy[1][1], xy[2][1]));
+            std::int32_t max_y = std::max(xy[0][1], std::max(xy[1][1], xy[2][1]));
+            out.min_x = std::max(0, -((half - min_x) >> subpixel_bits));
+            out.min_y = std::max(0, -((half - min_y) >> subpixel_bits));
+            out.max_x = std::min(int(width) - 1, (max_x - half) >> subpixel_bits);
+            out.max_y = std::min(int(height) - 1, (max_y - half) >> subpixel_bits);
+            if (out.min_x > out.max_x || out.min_y > out.max_y) return false;
+
+            std::int64_t x[3], y[3];
+            for (size_t i = 0; i < 3; ++i) {
+                x[i] = xy[i][0];
+                y[i] = xy[i][1];
+            }
+            // edge function of 0 -> 1 at vertex 2; the screen flips y, so it is positive for triangles
+            // clockwise in device coordinates, the back faces
+            std::int64_t area = (x[1] - x[0]) * (y[2] - y[0]) - (x[2] - x[0]) * (y[1] - y[0]);
+            if (area == 0 || (cull_back_faces && area > 0)) return false;
+
+            std::int64_t sign = area > 0 ? 1 : -1;
+            for (size_t i = 0; i < 3; ++i) {
+                size_t j = (i + 1) % 3, k = (i + 2) % 3;
+                // the edge from j to k, negated for front faces so the inside stays positive
+                std::int64_t a = sign * (y[j] - y[k]), b = sign * (x[k] - x[j]);
+                out.a[i] = std::int32_t(a);
+                out.b[i] = std::int32_t(b);
+                out.c[i] = sign * (x[j] * y[k] - x[k] * y[j]);
+                bool top_left = a > 0 || (a == 0 && b > 0);
+                out.bias[i] = top_left ? 0.0f : std::numeric_limits<float>::denorm_min();
+            }
+            return true;
+        }
+
+        // planes through the (depth, 1 / w, shade / w) [values] of a triangle that passed cover(),
+        // shade / w scaled by [shade]
+        inline void interpolate(const std::int32_t* const* xy, const float* const* values, float shade,
+                                setup_triangle& out)
+        {
+            const double scale = 1.0 / (1 << subpixel_bits);
+            double x0 = xy[0][0] * scale, y0 = xy[0][1] * scale;
+            double dx1 = xy[1][0] * scale - x0, dy1 = xy[1][1] * scale - y0;
+            double dx2 = xy[2][0] * scale - x0, dy2 = xy[2][1] * scale - y0;
+            double inv_area = 1 / (dx1 * dy2 - dx2 * dy1);
+            out.x0 = float(x0);
+            out.y0 = float(y0);
+            for (size_t p = 0; p < 3; ++p) {
+                double s = p == 2 ? shade : 1;
+                double v0 = values[0][p] * s;
+                double d1 = values[1][p] * s - v0, d2 = values[2][p] * s - v0;
+                out.plane[p][0] = float(v0);
+                out.plane[p][1] = float((d1 * dy2 - d2 * dy1) * inv_area);
+                out.plane[p][2] = float((d2 * dx1 - d1 * dx2) * inv_area);
+            }
+        }
+
+        // Rows [y_begin, y_end) and columns [x_begin, x_end) of one triangle inside one tile. The edge
+        // functions and planes are rebased on the tile corner, exactly for the edges, so the lanes
+        // work on small offsets. Returns the number of covered pixel centers.
+        inline size_t draw_span(const setup_triangle& t, size_t tile_x, size_t tile_y, int x_begin, int x_end,
+                                int y_begin, int y_end, const raster_options& options, float* depth,
+                                std::uint32_t* color, size_t stride)
+        {
+            const float scale = 1.0f / (1 << subpixel_bits);
+            const double c_scale = 1.0 / (1 << 2 * subpixel_bits);
+            std::int64_t ox = std::int64_t(tile_x) << subpixel_bits, oy = std::int64_t(tile_y) << subpixel_bits;
+            float ea[3], eb[3], ec[3], bias[3];
+            for (size_t i = 0; i < 3; ++i) {
+                ea[i] = float(t.a[i]) * scale;
+                eb[i] = float(t.b[i]) * scale;
+                ec[i] = float(double(t.c[i] + t.a[i] * ox + t.b[i] * oy) * c_scale);
+                bias[i] = t.bias[i];
+            }
+            float pa[3], pb[3], pc[3];
+            for (size_t p = 0; p < 3; ++p) {
+                pa[p] = t.plane[p][1];
+                pb[p] = t.plane[p][2];
+                pc[p] = float(double(t.plane[p][0]) + double(t.plane[p][1]) * (double(tile_x) - t.x0) +
+                              double(t.plane[p][2]) * (double(tile_y) - t.y0));
+            }
+            float red = options.color[0] * 255, green = options.color[1] * 255, blue = options.color[2] * 255;
+
+            // blocks of 8 start on a multiple of 8 from the tile corner, so they never leave the row
+            int block_begin = int(tile_x) + ((x_begin - int(tile_x)) & ~int(lane_count - 1));
+            size_t covered = 0;
+            for (int y = y_begin; y < y_end; ++y) {
+                float ly = float(y - int(tile_y)) + 0.5f;
+                float* depth_row = depth + size_t(y) * stride;
+                std::uint32_t* color_row = color + size_t(y) * stride;
+                for (int x = block_begin; x < x_end; x += int(lane_count)) {
+                    float d[lane_count];
+                    std::uint32_t c[lane_count];
+                    std::copy(depth_row + x, depth_row + x + lane_count, d);
+                    std::copy(color_row + x, color_row + x + lane_count, c);
+                    float lx0 = float(x - int(tile_x)) + 0.5f;
+                    int count = 0;
+                    // an int lane index, its conversion to float vectorises where size_t's doesn't
+                    for (int l = 0; l < int(lane_count); ++l) {
+                        float lx = lx0 + float(l);
+                        float w0 = ea[0] * lx + eb[0] * ly + ec[0] - bias[0];
+                        float w1 = ea[1] * lx + eb[1] * ly + ec[1] - bias[1];
+                        float w2 = ea[2] * lx + eb[2] * ly + ec[2] - bias[2];
+                        int xl = x + l;
+                        // int masks combined with &, since && would branch and stop vectorisation
+                        int inside = (w0 >= 0 ? -1 : 0) & (w1 >= 0 ? -1 : 0) & (w2 >= 0 ? -1 : 0) &
+                                     (xl >= x_begin ? -1 : 0) & (xl < x_end ? -1 : 0);
+                        float z = pa[0] * lx + pb[0] * ly + pc[0];
+                        float inv_w = pa[1] * lx + pb[1] * ly + pc[1];
+                        float shade = (pa[2] * lx + pb[2] * ly + pc[2]) / inv_w;
+                        shade = std::max(0.0f, std::min(shade, 1.0f));
+                        std::uint32_t rgba = 0xff000000u | std::uint32_t(int(red * shade + 0.5f)) |
+                                             std::uint32_t(int(green * shade + 0.5f)) << 8 |
+                                             std::uint32_t(int(blue * shade + 0.5f)) << 16;
+                        int pass = inside & (z < d[l] ? -1 : 0);
+                        count -= inside;
+                        d[l] = pass ? z : d[l];
+                        // blended with the mask rather than selected, a select would let the compiler
+                        // move the shading under a branch
+                        c[l] = (rgba & std::uint32_t(pass)) | (c[l] & ~std::uint32_t(pass));
+                    }
+                    covered += size_t(count);
+                    std::copy(d, d + lane_count, depth_row + x);
+                    std::copy(c, c + lane_count, color_row + x);
+                }
+            }
+            return covered;
+        }
+    }
+
+    inline rasterizer::rasterizer(size_t width, size_t height, size_t tile_size)
+        : _width(width), _height(height)
+    {
+        using namespace raster_detail;
+        _tile_size = std::max(lane_count, (tile_size + lane_count - 1) / lane_count * lane_count);
+        _stride = (width + lane_count - 1) / lane_count * lane_count;
+        _tiles_x = (width + _tile_size - 1) / _tile_size;
+        _tiles_y = (height + _tile_size - 1) / _tile_size;
+        // the last tile column may reach past the stride, so rows are padded to whole tiles
+        _stride = std::max(_stride, _tiles_x * _tile_size);
+        _color.resize(_stride * height);
+        _depth.resize(_stride * height);
+        clear();
+    }
+
+    inline void rasterizer::clear(std::uint32_t color, float depth)
+    {
+        std::fill(_color.begin(), _color.end(), color);
+        std::fill(_depth.begin(), _depth.end(), depth);
+    }
+
+    inline void rasterizer::draw(const mesh& m, const packed_matrix4<float>& model_view_projection,
+                                 const raster_options& options)
+    {
+        bool normals = m.has_normals();
+        draw(m.x(), m.y(), m.z(), normals ? m.nx() : nullptr, normals ? m.ny() : nullptr,
+             normals ? m.nz() : nullptr, m.vertex_count(), m.indices(), m.triangle_count(), model_view_projection,
+             options);
+    }
+
+    inline void rasterizer::draw(const mesh& m, const matrix<4, 4, float>& model_view_projection,
+                                 const raster_options& options)
+    {
+        draw(m, packed_matrix4<float>(model_view_projection), options);
+    }
+
+    inline void rasterizer::draw(const float* x, const float* y, const float* z, const float* nx, const float* ny,
+                                 const float* nz, size_t vertex_count, const std::uint32_t* indices,
+                                 size_t triangle_count, const packed_matrix4<float>& model_view_projection,
+                                 const raster_options& options)
+    {
+        using namespace raster_detail;
+        _stats = raster_stats();
+        _stats.triangles = triangle_count;
+        if (triangle_count == 0 || _width == 0 || _height == 0) return;
+
+        // vertex stage: clip space, shading, outcodes and, for vertices inside the guard band, the
+        // snapped screen positions every triangle sharing them reuses
+        _cx.resize(vertex_count);
+        _cy.resize(vertex_count);
+        _cz.resize(vertex_count);
+        _cw.resize(vertex_count);
+        _shade.resize(vertex_count);
+        _screen.resize(vertex_count * 2);
+        _values.resize(vertex_count * 3);
+        _codes.resize(vertex_count);
+        const float gx = 2 * guard_band / float(_width), gy = 2 * guard_band / float(_height);
+        parallel_for(0, vertex_count, [&](size_t first, size_t last) {
+            // a local copy, the output stores could otherwise alias the matrix
+            float m[16];
+            std::copy(model_view_projection.m, model_view_projection.m + 16, m);
+            float band_x = gx, band_y = gy;
+            float width = float(_width), height = float(_height);
+            // a lane block is computed into locals, then copied out; the tail block reads zeros
+            for (size_t i = first; i < last; i += lane_count) {
+                size_t count = std::min(lane_count, last - i);
+                float px[lane_count] = {}, py[lane_count] = {}, pz[lane_count] = {};
+                std::copy(x + i, x + i + count, px);
+                std::copy(y + i, y + i + count, py);
+                std::copy(z + i, z + i + count, pz);
+                float cx[lane_count], cy[lane_count], cz[lane_count], cw[lane_count], shade[lane_count];
+                for (int l = 0; l < int(lane_count); ++l) {
+                    cx[l] = m[0] * px[l] + m[1] * py[l] + m[2] * pz[l] + m[3];
+                    cy[l] = m[4] * px[l] + m[5] * py[l] + m[6] * pz[l] + m[7];
+                    cz[l] = m[8] * px[l] + m[9] * py[l] + m[10] * pz[l] + m[11];
+                    cw[l] = m[12] * px[l] + m[13] * py[l] + m[14] * pz[l] + m[15];
+                }
+                // without normals the face shade is applied in setup
+                std::fill(shade, shade + lane_count, 1.0f);
+                if (nx) {
+                    for (size_t l = 0; l < count; ++l) shade[l] = lambert(nx[i + l], ny[i + l], nz[i + l], options);
+                }
+                unsigned codes[lane_count];
+                std::int32_t screen[lane_count * 2];
+                float values[lane_count * 3];
+                // separate loops, together they don't vectorise
+                for (int l = 0; l < int(lane_count); ++l) {
+                    codes[l] = outcode(cx[l], cy[l], cz[l], cw[l], band_x, band_y);
+                }
+                for (int l = 0; l < int(lane_count); ++l) {
+                    project(cx[l], cy[l], cz[l], cw[l], shade[l], width, height, screen + l, values + l, lane_count);
+                }
+                std::copy(cx, cx + count, _cx.begin() + i);
+                std::copy(cy, cy + count, _cy.begin() + i);
+                std::copy(cz, cz + count, _cz.begin() + i);
+                std::copy(cw, cw + count, _cw.begin() + i);
+                std::copy(shade, shade + count, _shade.begin() + i);
+                std::copy(codes, codes + count, _codes.begin() + i);
+                for (size_t l = 0; l < count; ++l) {
+                    for (size_t c = 0; c < 2; ++c) _screen[(i + l) * 2 + c] = screen[c * lane_count + l];
+                    for (size_t c = 0; c < 3; ++c) _values[(i + l) * 3 + c] = values[c * lane_count + l];
+                }
+            }
+        }, options.thread_count, grain_size);
+
+        // setup and binning, one contiguous range of triangles per thread so each tile can
+        // walk the bins in submission order
+        size_t tile_count = this->tile_count();
+        size_t worker_count = resolve_thread_count(triangle_count, options.thread_count, grain_size);
+        std::vector<std::vector<setup_triangle>> triangles(worker_count);
+        std::vector<std::vector<std::vector<std::uint32_t>>> bins(
+            worker_count, std::vector<std::vector<std::uint32_t>>(tile_count));
+        std::vector<raster_stats> partial(worker_count);
+        parallel_partition(0, triangle_count, [&](size_t thread_idx, size_t first, size_t last) {
+            std::vector<setup_triangle>& own = triangles[thread_idx];
+            std::vector<std::vector<std::uint32_t>>& own_bins = bins[thread_idx];
+            raster_stats& counts = partial[thread_idx];
+            const std::uint8_t* codes = _codes.data();
+            const std::int32_t* screen = _screen.data();
+            const float* values = _values.data();
+
+            auto face_shade = [&](const std::uint32_t* tri) {
+                if (nx) return 1.0f;
+                float e1[3] = { x[tri[1]] - x[tri[0]], y[tri[1]] - y[tri[0]], z[tri[1]] - z[tri[0]] };
+                float e2[3] = { x[tri[2]] - x[tri[0]], y[tri[2]] - y[tri[0]], z[tri[2]] - z[tri[0]] };
+                return lambert(e1[1] * e2[2] - e1[2] * e2[1], e1[2] * e2[0] - e1[0] * e2[2],
+                               e1[0] * e2[1] - e1[1] * e2[0], options);
+            };
+            auto bin = [&](const setup_triangle& s) {
+                std::uint32_t idx = std::uint32_t(own.size());
+                own.push_back(s);
+                for (size_t ty = size_t(s.min_y) / _tile_size; ty <= size_t(s.max_y) / _tile_size; ++ty) {
+                    for (size_t tx = size_t(s.min_x) / _tile_size; tx <= size_t(s.max_x) / _tile_size; ++tx) {
+                        own_bins[ty * _tiles_x + tx].push_back(idx);
+                        ++counts.bin_entries;
+                    }
+                }
+            };
+
+            for (size_t t = first; t < last; ++t) {
+                const std::uint32_t* tri = indices + t * 3;
+                unsigned c0 = codes[tri[0]], c1 = codes[tri[1]], c2 = codes[tri[2]];
+                // all three beyond one plane of the frustum
+                if (c0 & c1 & c2 & 0x3f) {
+                    ++counts.culled;
+                    continue;
+                }
+
+                setup_triangle s;
+                if (!((c0 | c1 | c2) & clip_bit)) {
+                    const std::int32_t* xy[3] = { screen + tri[0] * 2, screen + tri[1] * 2, screen + tri[2] * 2 };
+                    if (!cover(xy, _width, _height, options.cull_back_faces, s)) {
+                        ++counts.culled;
+                        continue;
+                    }
+                    const float* v[3] = { values + tri[0] * 3, values + tri[1] * 3, values + tri[2] * 3 };
+                    interpolate(xy, v, face_shade(tri), s);
+                    bin(s);
+                    continue;
+                }
+
+                // clipped to the near plane and the guard band, then fanned; vertices that were
+                // projected in the vertex stage are reused so shared edges stay bitwise equal
+                ++counts.clipped;
+                clip_vertex polygon[8];
+                for (size_t i = 0; i < 3; ++i) {
+                    std::uint32_t k = tri[i];
+                    polygon[i] = clip_vertex{ _cx[k], _cy[k], _cz[k], _cw[k], _shade[k], std::int64_t(k) };
+                }
+                size_t corners = clip_polygon(polygon, 3, gx, gy);
+                std::int32_t own_screen[8][2];
+                float own_values[8][3];
+                bool projected[8];
+                for (size_t i = 0; i < corners; ++i) {
+                    const clip_vertex& v = polygon[i];
+                    projected[i] = v.w > 0;
+                    if (v.source >= 0 && !(codes[v.source] & clip_bit)) {
+                        std::copy(screen + v.source * 2, screen + v.source * 2 + 2, own_screen[i]);
+                        std::copy(values + v.source * 3, values + v.source * 3 + 3, own_values[i]);
+                    }
+                    else if (projected[i]) {
+                        project(v.x, v.y, v.z, v.w, v.shade, float(_width), float(_height), own_screen[i],
+                                own_values[i]);
+                    }
+                }
+                bool kept = false;
+                float shade = face_shade(tri);
+                for (size_t fan = 1; fan + 1 < corners; ++fan) {
+                    size_t corner[3] = { 0, fan, fan + 1 };
+                    if (!projected[0] || !projected[fan] || !projected[fan + 1]) continue;
+                    const std::int32_t* xy[3];
+                    const float* v[3];
+                    for (size_t i = 0; i < 3; ++i) {
+                        xy[i] = own_screen[corner[i]];
+                        v[i] = own_values[corner[i]];
+                    }
+                    if (!cover(xy, _width, _height, options.cull_back_faces, s)) continue;
+                    interpolate(xy, v, shade, s);
+                    bin(s);
+                    kept = true;
+                }
+                if (!kept) ++counts.culled;
+            }
+        }, options.thread_count, grain_size);
+        for (const raster_stats& counts : partial) {
+            _stats.culled += counts.culled;
+            _stats.clipped += counts.clipped;
+            _stats.bin_entries += counts.bin_entries;
+        }
+
+        // tiles
+        std::vector<size_t> fragments(tile_count, 0);
+        parallel_for(0, tile_count, [&](size_t first, size_t last) {
+            for (size_t tile = first; tile < last; ++tile) {
+                size_t tile_x = tile % _tiles_x * _tile_size, tile_y = tile / _tiles_x * _tile_size;
+                int tile_x_end = int(std::min(tile_x + _tile_size, _width));
+                int tile_y_end = int(std::min(tile_y + _tile_size, _height));
+                for (size_t thread_idx = 0; thread_idx < worker_count; ++thread_idx) {
+                    for (std::uint32_t idx : bins[thread_idx][tile]) {
+                        const setup_triangle& t = triangles[thread_idx][idx];
+                        int x_begin = std::max(t.min_x, int(tile_x)), x_end = std::min(t.max_x + 1, tile_x_end);
+                        int y_begin = std::max(t.min_y, int(tile_y)), y_end = std::min(t.max_y + 1, tile_y_end);
+                        fragments[tile] += draw_span(t, tile_x, tile_y, x_begin, x_end, y_begin, y_end, options,
+                                                     _depth.data(), _color.data(), _stride);
+                    }
+                }
+            }
+        }, options.thread_count, 1);
+        for (size_t count : fragments) _stats.fragments += count;
+    }
+}
+
+#endif // BCG_RASTERIZER_HPP
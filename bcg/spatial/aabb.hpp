@@ -0,0 +1,159 @@
+#ifndef BCG_AABB_HPP
+#define BCG_AABB_HPP
+
+#include "transforms/matrix/packed_matrix.hpp"
+#include "transforms/point.hpp"
+
+#include <algorithm>
+#include <iostream>
+#include <limits>
+
+namespace bcg
+{
+    //////////////////////////////////////////////////////////////////////////////////////////////////
+    // aabb (axis-aligned bounding box)
+    //////////////////////////////////////////////////////////////////////////////////////////////////
+
+    struct aabb
+    {
+        // an empty box has lower > upper, so expanding it by anything gives that thing's box
+        float lower[3] = {
+            std::numeric_limits<float>::max(),
+            std::numeric_limits<float>::max(),
+            std::numeric_limits<float>::max()
+        };
+        float upper[3] = {
+            -std::numeric_limits<float>::max(),
+            -std::numeric_limits<float>::max(),
+            -std::numeric_limits<float>::max()
+        };
+
+        aabb() = default;
+        aabb(float lx, float ly, float lz, float ux, float uy, float uz);
+
+        void expand(const float* coords);
+        void expand(const point& p);
+        void expand(const aabb& box);
+
+        bool is_empty() const;
+        bool contains(const float* coords) const;
+        bool overlaps(const aabb& box) const;
+
+        float extent(size_t axis) const;
+        float center(size_t axis) const;
+        size_t largest_axis() const;
+        float surface_area() const;
+
+        friend std::ostream& operator <<(std::ostream& out, const aabb& box);
+    };
+
+    // box around the affine image of [box] (Arvo's method), an empty box stays empty
+    inline aabb transform_bounds(const aabb& box, const packed_matrix4<float>& trans);
+
+    //////////////////////////////////////////////////////////////////////////////////////////////////
+    // aabb implementation
+    //////////////////////////////////////////////////////////////////////////////////////////////////
+
+    inline aabb::aabb(float lx, float ly, float lz, float ux, float uy, float uz)
+    {
+        lower[0] = lx; lower[1] = ly; lower[2] = lz;
+        upper[0] = ux; upper[1] = uy; upper[2] = uz;
+    }
+
+    inline void aabb::expand(const float* coords)
+    {
+        for (size_t d = 0; d < 3; ++d) {
+            lower[d] = std::min(lower[d], coords[d]);
+            upper[d] = std::max(upper[d], coords[d]);
+        }
+    }
+
+    inline void aabb::expand(const point& p)
+    {
+        const b_vector<4, float>& data = p.data();
+        float coords[3] = { data[0], data[1], data[2] };
+        expand(coords);
+    }
+
+    inline void aabb::expand(const aabb& box)
+    {
+        for (size_t d = 0; d < 3; ++d) {
+            lower[d] = std::min(lower[d], box.lower[d]);
+            upper[d] = std::max(upper[d], box.upper[d]);
+        }
+    }
+
+    inline bool aabb::is_empty() const
+    {
+        return lower[0] > upper[0] || lower[1] > upper[1] || lower[2] > upper[2];
+    }
+
+    inline bool aabb::contains(const float* coords) const
+    {
+        return coords[0] >= lower[0] && coords[0] <= upper[0] &&
+               coords[1] >= lower[1] && coords[1] <= upper[1] &&
+               coords[2] >= lower[2] && coords[2] <= upper[2];
+    }
+
+    inline bool aabb::overlaps(const aabb& box) const
+    {
+        return lower[0] <= box.upper[0] && upper[0] >= box.lower[0] &&
+               lower[1] <= box.upper[1] && upper[1] >= box.lower[1] &&
+               lower[2] <= box.upper[2] && upper[2] >= box.lower[2];
+    }
+
+    inline float aabb::extent(size_t axis) const
+    {
+        return is_empty() ? 0.0f : upper[axis] - lower[axis];
+    }
+
+    inline float aabb::center(size_t axis) const
+    {
+        return 0.5f * (lower[axis] + upper[axis]);
+    }
+
+    inline size_t aabb::largest_axis() const
+    {
+        size_t axis = 0;
+        for (size_t d = 1; d < 3; ++d) {
+            if (extent(d) > extent(axis)) axis = d;
+        }
+        return axis;
+    }
+
+    inline float aabb::surface_area() const
+    {
+        if (is_empty()) return 0.0f;
+        float dx = upper[0] - lower[0];
+        float dy = upper[1] - lower[1];
+        float dz = upper[2] - lower[2];
+        return 2.0f * (dx * dy + dy * dz + dz * dx);
+    }
+
+    inline aabb transform_bounds(const aabb& box, const packed_matrix4<float>& trans)
+    {
+        if (box.is_empty()) return box;
+        aabb result;
+        for (size_t row_idx = 0; row_idx < 3; ++row_idx) {
+            float lo = trans(row_idx, 3), hi = trans(row_idx, 3);
+            for (size_t col_idx = 0; col_idx < 3; ++col_idx) {
+                float a = trans(row_idx, col_idx) * box.lower[col_idx];
+                float b = trans(row_idx, col_idx) * box.upper[col_idx];
+                lo += std::min(a, b);
+                hi += std::max(a, b);
+            }
+            result.lower[row_idx] = lo;
+            result.upper[row_idx] = hi;
+        }
+        return result;
+    }
+
+    inline std::ostream& operator <<(std::ostream& out, const aabb& box)
+    {
+        out << "{ lower: [" << box.lower[0] << ", " << box.lower[1] << ", " << box.lower[2] << "]"
+            << " upper: [" << box.upper[0] << ", " << box.upper[1] << ", " << box.upper[2] << "] }";
+        return out;
+    }
+}
+
+#endif // BCG_AABB_HPP
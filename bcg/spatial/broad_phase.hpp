@@ -0,0 +1,392 @@
+#ifndef BCG_BROAD_PHASE_HPP
+#define BCG_BROAD_PHASE_HPP
+
+#include "spatial/aabb.hpp"
+#include "spatial/space_filling_curve.hpp"
+#include "transforms/point.hpp"
+#include "utils/parallel.hpp"
+
+#include <algorithm>
+#include <cmath>
+#include <cstdint>
+#include <vector>
+
+namespace bcg
+{
+    //////////////////////////////////////////////////////////////////////////////////////////////////
+    // broad phase
+    //////////////////////////////////////////////////////////////////////////////////////////////////
+
+    // two overlapping boxes, first < second
+    struct collision_pair
+    {
+        std::uint32_t first;
+        std::uint32_t second;
+
+        bool operator <(const collision_pair& p) const { return first < p.first || (first == p.first && second < p.second); }
+        bool operator ==(const collision_pair& p) const { return first == p.first && second == p.second; }
+    };
+
+    // a box of [half_extent] around every point
+    inline void boxes_around_points(const point* centers, size_t count, float half_extent, aabb* out_boxes,
+                                    size_t thread_count = 0);
+
+    struct sweep_and_prune_stats
+    {
+        size_t swaps = 0;
+        size_t full_sorts = 0;
+        size_t overlap_tests = 0;
+    };
+
+    // Sweep and prune along one axis. The boxes stay sorted between updates, so when they only move
+    // a little the next update re-sorts the previous order with a few insertion sort swaps instead of
+    // sorting from scratch. The axis is the one the box centers spread along most; it only changes
+    // (with a full sort) when another axis clearly wins. The sweep itself runs in parallel blocks.
+    class sweep_and_prune
+    {
+    public:
+        typedef std::uint32_t index_type;
+
+    public:
+        sweep_and_prune() = default;
+
+        // [boxes] are indexed the same way on every update; a different count starts over
+        void update(const aabb* boxes, size_t count, size_t thread_count = 0);
+        // forget the order kept from the last update
+        void reset();
+
+        const std::vector<collision_pair>& pairs() const { return _pairs; }
+        size_t axis() const { return _axis; }
+        // counters of the last update
+        const sweep_and_prune_stats& stats() const { return _stats; }
+
+    private:
+        std::vector<index_type> _order;
+        std::vector<float> _keys;
+        // bounds in sweep order
+        std::vector<float> _lower[3];
+        std::vector<float> _upper[3];
+        size_t _axis = 0;
+        std::vector<collision_pair> _pairs;
+        sweep_and_prune_stats _stats;
+    };
+
+    struct spatial_hash_stats
+    {
+        float cell_size = 0;
+        size_t cell_entries = 0;
+        size_t occupied_cells = 0;
+        size_t overlap_tests = 0;
+    };
+
+    // Uniform grid over unbounded space: every box is entered into each cell it touches under a
+    // 64-bit key (the Morton code of the cell coordinates, wrapped to 21 bits per axis, so far-apart
+    // cells may share a key), entries are radix sorted by key and boxes sharing a key are tested
+    // against each other. A pair is reported only from the cell holding the lower corner of the
+    // boxes' intersection, so pairs sharing several cells come out once. Nothing is kept between
+    // updates, which suits scenes where boxes jump around.
+    class spatial_hash_grid
+    {
+    public:
+        typedef std::uint32_t index_type;
+
+    public:
+        // a [cell_size] of 0 picks twice the mean largest box extent on every update
+        explicit spatial_hash_grid(float cell_size = 0) : _cell_size(cell_size) {}
+
+        void update(const aabb* boxes, size_t count, size_t thread_count = 0);
+
+        const std::vector<collision_pair>& pairs() const { return _pairs; }
+        const spatial_hash_stats& stats() const { return _stats; }
+
+    private:
+        float _cell_size;
+        std::vector<collision_pair> _pairs;
+        spatial_hash_stats _stats;
+    };
+
+    //////////////////////////////////////////////////////////////////////////////////////////////////
+    // broad phase implementation
+    //////////////////////////////////////////////////////////////////////////////////////////////////
+
+    namespace broad_phase_detail
+    {
+        const size_t lane_count = 8;
+        const size_t grain_size = 1024;
+        // an insertion sort doing more swaps than this many per box gives way to a full sort
+        const size_t max_swaps_per_box = 8;
+        // another axis must spread this much wider before the sweep axis changes
+        const float axis_switch_ratio = 1.5f;
+
+        inline collision_pair make_pair(std::uint32_t a, std::uint32_t b)
+        {
+            collision_pair p;
+            p.first = std::min(a, b);
+            p.second = std::max(a, b);
+            return p;
+        }
+
+        // the per-block pair lists joined in block order, so the result does not depend on threads
+        inline void concatenate(std::vector<std::vector<collision_pair>>& blocks, std::vector<collision_pair>& out)
+        {
+            size_t total = 0;
+            for (const std::vector<collision_pair>& b : blocks) total += b.size();
+            out.clear();
+            out.reserve(total);
+            for (const std::vector<collision_pair>& b : blocks) out.insert(out.end(), b.begin(), b.end());
+        }
+
+        inline std::int64_t cell_coord(float v, float inv_cell_size)
+        {
+            return std::int64_t(std::floor(v * inv_cell_size));
+        }
+
+        inline std::uint64_t cell_key(std::int64_t x, std::int64_t y, std::int64_t z)
+        {
+            const std::int64_t mask = (std::int64_t(1) << curve_bits) - 1;
+            return morton_encode(std::uint32_t(x & mask), std::uint32_t(y & mask), std::uint32_t(z & mask));
+        }
+    }
+
+    inline void boxes_around_points(const point* centers, size_t count, float half_extent, aabb* out_boxes,
+                                    size_t thread_count)
+    {
+        parallel_for(0, count, [&](size_t first, size_t last) {
+            for (size_t i = first; i < last; ++i) {
+                const b_vector<4, float>& c = centers[i].data();
+                out_boxes[i] = aabb(c[0] - half_extent, c[1] - half_extent, c[2] - half_extent,
+                                    c[0] + half_extent, c[1] + half_extent, c[2] + half_extent);
+            }
+        }, thread_count, 1 << 14);
+    }
+
+    inline void sweep_and_prune::reset()
+    {
+        _order.clear();
+        _keys.clear();
+        _axis = 0;
+    }
+
+    inline void sweep_and_prune::update(const aabb* boxes, size_t count, size_t thread_count)
+    {
+        using namespace broad_phase_detail;
+        _stats = sweep_and_prune_stats();
+
+        // sweep along the axis the centers spread along most
+        double sum[3] = {}, sum2[3] = {};
+        for (size_t i = 0; i < count; ++i) {
+            for (size_t d = 0; d < 3; ++d) {
+                double c = 0.5 * (double(boxes[i].lower[d]) + boxes[i].upper[d]);
+                sum[d] += c;
+                sum2[d] += c * c;
+            }
+        }
+        double variance[3];
+        for (size_t d = 0; d < 3; ++d) variance[d] = count > 0 ? sum2[d] / count - sum[d] * sum[d] / count / count : 0;
+        size_t widest = size_t(std::max_element(variance, variance + 3) - variance);
+        bool full_sort = _order.size() != count;
+        if (widest != _axis && (full_sort || variance[widest] > axis_switch_ratio * variance[_axis])) {
+            _axis = widest;
+            full_sort = true;
+        }
+
+        if (full_sort) {
+            _order.resize(count);
+            for (size_t i = 0; i < count; ++i) _order[i] = index_type(i);
+        }
+        _keys.resize(count);
+        for (size_t i = 0; i < count; ++i) _keys[i] = boxes[_order[i]].lower[_axis];
+
+        // insertion sort of last update's order, nearly sorted when the boxes moved a little
+        if (!full_sort) {
+            size_t swap_budget = max_swaps_per_box * count;
+            for (size_t i = 1; i < count && !full_sort; ++i) {
+                float key = _keys[i];
+                index_type idx = _order[i];
+                size_t j = i;
+                for (; j > 0 && _keys[j - 1] > key; --j) {
+                    _keys[j] = _keys[j - 1];
+                    _order[j] = _order[j - 1];
+                }
+                _keys[j] = key;
+                _order[j] = idx;
+                _stats.swaps += i - j;
+                full_sort = _stats.swaps > swap_budget;
+            }
+        }
+        if (full_sort) {
+            std::vector<std::pair<float, index_type>> keyed(count);
+            for (size_t i = 0; i < count; ++i) keyed[i] = std::make_pair(_keys[i], _order[i]);
+            std::sort(keyed.begin(), keyed.end());
+            for (size_t i = 0; i < count; ++i) {
+                _keys[i] = keyed[i].first;
+                _order[i] = keyed[i].second;
+            }
+            _stats.full_sorts = 1;
+        }
+
+        // bounds in sweep order, so the sweep reads them contiguously
+        for (size_t d = 0; d < 3; ++d) {
+            _lower[d].resize(count);
+            _upper[d].resize(count);
+        }
+        parallel_for(0, count, [&](size_t first, size_t last) {
+            for (size_t i = first; i < last; ++i) {
+                const aabb& box = boxes[_order[i]];
+                for (size_t d = 0; d < 3; ++d) {
+                    _lower[d][i] = box.lower[d];
+                    _upper[d][i] = box.upper[d];
+                }
+            }
+        }, thread_count, 1 << 14);
+
+        size_t a0 = _axis, a1 = (_axis + 1) % 3, a2 = (_axis + 2) % 3;
+        std::vector<std::vector<collision_pair>> blocks((count + grain_size - 1) / grain_size);
+        std::vector<size_t> tests(blocks.size(), 0);
+        parallel_for(0, count, [&](size_t first, size_t last) {
+            std::vector<collision_pair>& out = blocks[first / grain_size];
+            const float* lo0 = _lower[a0].data();
+            const float* lo1 = _lower[a1].data();
+            const float* lo2 = _lower[a2].data();
+            const float* hi0 = _upper[a0].data();
+            const float* hi1 = _upper[a1].data();
+            const float* hi2 = _upper[a2].data();
+            size_t tested = 0;
+            for (size_t i = first; i < last; ++i) {
+                float hi = hi0[i], l1 = lo1[i], h1 = hi1[i], l2 = lo2[i], h2 = hi2[i];
+                // -1 when box m overlaps box i; ints rather than bools keep the lane loop vectorised
+                auto overlap_mask = [&](size_t m) -> int {
+                    return (lo0[m] <= hi ? -1 : 0) & (l1 <= hi1[m] ? -1 : 0) & (h1 >= lo1[m] ? -1 : 0) &
+                           (l2 <= hi2[m] ? -1 : 0) & (h2 >= lo2[m] ? -1 : 0);
+                };
+                // lane blocks tested without branches while the block starts inside the sweep interval
+                for (size_t j = i + 1; j < count && lo0[j] <= hi; j += lane_count) {
+                    size_t lanes = std::min(lane_count, count - j);
+                    int hit[lane_count] = {};
+                    int any = 0;
+                    if (lanes == lane_count) {
+                        for (size_t k = 0; k < lane_count; ++k) {
+                            hit[k] = overlap_mask(j + k);
+                            any |= hit[k];
+                        }
+                    }
+                    else {
+                        for (size_t k = 0; k < lanes; ++k) {
+                            hit[k] = overlap_mask(j + k);
+                            any |= hit[k];
+                        }
+                    }
+                    tested += lanes;
+                    // most blocks hit nothing
+                    if (!any) continue;
+                    for (size_t k = 0; k < lanes; ++k) {
+                        if (hit[k]) out.push_back(make_pair(_order[i], _order[j + k]));
+                    }
+                }
+            }
+            tests[first / grain_size] = tested;
+        }, thread_count, grain_size);
+        for (size_t t : tests) _stats.overlap_tests += t;
+        concatenate(blocks, _pairs);
+    }
+
+    inline void spatial_hash_grid::update(const aabb* boxes, size_t count, size_t thread_count)
+    {
+        using namespace broad_phase_detail;
+        _stats = spatial_hash_stats();
+        _pairs.clear();
+        if (count == 0) return;
+
+        float cell_size = _cell_size;
+        if (cell_size <= 0) {
+            double extent = 0;
+            for (size_t i = 0; i < count; ++i) {
+                extent += std::max(boxes[i].extent(0), std::max(boxes[i].extent(1), boxes[i].extent(2)));
+            }
+            cell_size = float(2 * extent / count);
+            if (!(cell_size > 0)) cell_size = 1;
+        }
+        float inv_cell_size = 1 / cell_size;
+        _stats.cell_size = cell_size;
+
+        // cells per box, then one (key, box) entry per cell
+        std::vector<size_t> offsets(count + 1, 0);
+        parallel_for(0, count, [&](size_t first, size_t last) {
+            for (size_t i = first; i < last; ++i) {
+                size_t cells = 1;
+                for (size_t d = 0; d < 3; ++d) {
+                    cells *= size_t(cell_coord(boxes[i].upper[d], inv_cell_size) -
+                                    cell_coord(boxes[i].lower[d], inv_cell_size) + 1);
+                }
+                offsets[i + 1] = cells;
+            }
+        }, thread_count, 1 << 14);
+        for (size_t i = 0; i < count; ++i) offsets[i + 1] += offsets[i];
+        size_t entry_count = offsets[count];
+        std::vector<std::uint64_t> keys(entry_count);
+        std::vector<std::uint32_t> entries(entry_count);
+        parallel_for(0, count, [&](size_t first, size_t last) {
+            for (size_t i = first; i < last; ++i) {
+                std::int64_t lo[3], hi[3];
+                for (size_t d = 0; d < 3; ++d) {
+                    lo[d] = cell_coord(boxes[i].lower[d], inv_cell_size);
+                    hi[d] = cell_coord(boxes[i].upper[d], inv_cell_size);
+                }
+                size_t e = offsets[i];
+                for (std::int64_t z = lo[2]; z <= hi[2]; ++z) {
+                    for (std::int64_t y = lo[1]; y <= hi[1]; ++y) {
+                        for (std::int64_t x = lo[0]; x <= hi[0]; ++x) {
+                            keys[e] = cell_key(x, y, z);
+                            entries[e] = std::uint32_t(i);
+                            ++e;
+                        }
+                    }
+                }
+            }
+        }, thread_count, 1 << 12);
+        _stats.cell_entries = entry_count;
+        // stable, so within a cell the boxes stay in index order
+        parallel_radix_sort(keys, entries, thread_count);
+
+        std::vector<size_t> runs;
+        for (size_t e = 0; e < entry_count; ++e) {
+            if (e == 0 || keys[e] != keys[e - 1]) runs.push_back(e);
+        }
+        _stats.occupied_cells = runs.size();
+        runs.push_back(entry_count);
+
+        size_t run_count = _stats.occupied_cells;
+        const size_t run_grain = 256;
+        std::vector<std::vector<collision_pair>> blocks((run_count + run_grain - 1) / run_grain);
+        std::vector<size_t> tests(blocks.size(), 0);
+        parallel_for(0, run_count, [&](size_t first, size_t last) {
+            std::vector<collision_pair>& out = blocks[first / run_grain];
+            size_t tested = 0;
+            for (size_t r = first; r < last; ++r) {
+                std::uint64_t key = keys[runs[r]];
+                for (size_t a = runs[r]; a < runs[r + 1]; ++a) {
+                    // a box wrapped onto the same key twice
+                    if (a > runs[r] && entries[a] == entries[a - 1]) continue;
+                    const aabb& box_a = boxes[entries[a]];
+                    for (size_t b = a + 1; b < runs[r + 1]; ++b) {
+                        if (entries[b] == entries[b - 1]) continue;
+                        const aabb& box_b = boxes[entries[b]];
+                        ++tested;
+                        if (!box_a.overlaps(box_b)) continue;
+                        // only the cell of the intersection's lower corner reports the pair
+                        std::int64_t c[3];
+                        for (size_t d = 0; d < 3; ++d) {
+                            c[d] = cell_coord(std::max(box_a.lower[d], box_b.lower[d]), inv_cell_size);
+                        }
+                        if (cell_key(c[0], c[1], c[2]) == key) out.push_back(make_pair(entries[a], entries[b]));
+                    }
+                }
+            }
+            tests[first / run_grain] = tested;
+        }, thread_count, run_grain);
+        for (size_t t : tests) _stats.overlap_tests += t;
+        concatenate(blocks, _pairs);
+    }
+}
+
+#endif // BCG_BROAD_PHASE_HPP
@@ -0,0 +1,663 @@
+#ifndef BCG_BVH_HPP
+#define BCG_BVH_HPP
+
+#include "spatial/aabb.hpp"
+#include "transforms/point.hpp"
+#include "transforms/vector.hpp"
+#include "utils/parallel.hpp"
+
+#include <algorithm>
+#include <atomic>
+#include <cmath>
+#include <cstdint>
+#include <limits>
+#include <vector>
+
+namespace bcg
+{
+    //////////////////////////////////////////////////////////////////////////////////////////////////
+    // ray & ray_hit
+    //////////////////////////////////////////////////////////////////////////////////////////////////
+
+    struct ray
+    {
+        float origin[3] = { 0, 0, 0 };
+        float direction[3] = { 0, 0, 1 };
+        float t_min = 0;
+        float t_max = std::numeric_limits<float>::max();
+    };
+
+    inline ray make_ray(const point& origin, const vector& direction,
+                        float t_min = 0, float t_max = std::numeric_limits<float>::max())
+    {
+        ray r;
+        for (size_t d = 0; d < 3; ++d) {
+            r.origin[d] = origin.data()[d];
+            r.direction[d] = direction.data()[d];
+        }
+        r.t_min = t_min;
+        r.t_max = t_max;
+        return r;
+    }
+
+    struct ray_hit
+    {
+        float t = std::numeric_limits<float>::max();
+        float u = 0; // barycentric weight of the second vertex
+        float v = 0; // barycentric weight of the third vertex
+        std::uint32_t triangle = std::numeric_limits<std::uint32_t>::max();
+
+        bool is_hit() const { return triangle != std::numeric_limits<std::uint32_t>::max(); }
+    };
+
+    //////////////////////////////////////////////////////////////////////////////////////////////////
+    // bvh (bounding volume hierarchy over triangles)
+    //////////////////////////////////////////////////////////////////////////////////////////////////
+
+    // Binary BVH built with binned SAH and stored flat: the children of an inner node always sit
+    // next to each other, so a node only records the index of its first child. Triangles are kept in
+    // leaf order as (v0, e1, e2) so a leaf is one contiguous read.
+    //
+    // The *_stream queries sort the rays into coherent packets of packet_size lanes. Every per-lane
+    // step is a branch-free loop over fixed-size arrays, which optimising compilers turn into SIMD
+    // code. Single ray queries use a plain scalar traversal.
+    class bvh
+    {
+    public:
+        typedef std::uint32_t index_type;
+
+        enum : index_type { invalid_index = std::numeric_limits<index_type>::max() };
+        static const size_t packet_size = 8;
+        static const size_t bin_count = 16;
+        static const size_t max_leaf_size = 8;
+
+    public:
+        bvh() = default;
+        // indexed triangles: 3 vertex indices per triangle
+        bvh(const std::vector<point>& vertices, const std::vector<index_type>& indices, size_t thread_count = 0);
+        ~bvh() = default;
+
+    public:
+        void build(const std::vector<point>& vertices, const std::vector<index_type>& indices,
+                   size_t thread_count = 0);
+        // triangle soup: 3 consecutive points per triangle
+        void build(const std::vector<point>& triangle_soup, size_t thread_count = 0);
+        // positions are packed as x0, y0, z0, x1, y1, z1, ...
+        void build(const float* positions, const index_type* indices, size_t triangle_count,
+                   size_t thread_count = 0);
+
+        // single ray queries
+        ray_hit intersect(const ray& r) const;
+        bool occluded(const ray& r) const;
+
+        // ray streams, split into packets and across threads (0 means all hardware threads)
+        void intersect_stream(const ray* rays, size_t ray_count, ray_hit* out_hits, size_t thread_count = 0) const;
+        void occluded_stream(const ray* rays, size_t ray_count, std::uint8_t* out_occluded,
+                             size_t thread_count = 0) const;
+
+    public:
+        size_t triangle_count() const;
+        size_t node_count() const;
+        aabb bounds() const;
+
+    private:
+        struct node
+        {
+            float lower[3];
+            index_type first; // first child for inner nodes, first triangle slot for leaves
+            float upper[3];
+            index_type count; // 0 for inner nodes
+        };
+
+        struct build_state
+        {
+            const float* positions;
+            const index_type* indices;
+            std::vector<aabb> boxes;
+            std::vector<float> centroids;
+            std::atomic<index_type> node_counter;
+        };
+
+        struct packet
+        {
+            float ox[packet_size], oy[packet_size], oz[packet_size];
+            float dx[packet_size], dy[packet_size], dz[packet_size];
+            float idx[packet_size], idy[packet_size], idz[packet_size];
+            float t_min[packet_size], t_max[packet_size];
+            float u[packet_size], v[packet_size];
+            index_type tri[packet_size];
+            int active[packet_size];
+        };
+
+        static const size_t max_stack_depth = 128;
+        // below this depth nodes are split at the centroid median, which bounds the tree depth
+        static const size_t max_sah_depth = 48;
+
+        void build_node(build_state& state, index_type node_idx, index_type first, index_type last,
+                        size_t depth, size_t spawn_depth);
+        void make_leaf(index_type node_idx, index_type first, index_type last);
+
+        void traverse_single(const ray& r, ray_hit& hit, bool any_hit) const;
+
+        // ray order that groups rays of similar direction and origin into the same packets
+        void sort_for_coherence(const ray* rays, size_t ray_count, std::vector<index_type>& order) const;
+        void load_packet(packet& pk, const ray* rays, const index_type* order, size_t count) const;
+        // lane mask of rays in the packet that may hit the box of [nd]
+        bool packet_hits_node(const packet& pk, const node& nd, int* lane_mask) const;
+        // test every triangle of a leaf against the masked lanes, returns true if any lane got a hit
+        bool packet_intersect_leaf(packet& pk, const node& nd, const int* lane_mask, bool any_hit) const;
+        void traverse_packet(packet& pk, bool any_hit) const;
+
+    private:
+        std::vector<node> _nodes;
+        std::vector<std::uint8_t> _split_axes; // per inner node
+        std::vector<index_type> _slots;        // original triangle index per leaf slot
+        std::vector<float> _triangles;         // v0, e1, e2 (9 floats) per leaf slot
+    };
+
+    //////////////////////////////////////////////////////////////////////////////////////////////////
+    // bvh implementation
+    //////////////////////////////////////////////////////////////////////////////////////////////////
+
+    inline bvh::bvh(const std::vector<point>& vertices, const std::vector<index_type>& indices, size_t thread_count)
+    {
+        build(vertices, indices, thread_count);
+    }
+
+    inline void bvh::build(const std::vector<point>& vertices, const std::vector<index_type>& indices,
+                           size_t thread_count)
+    {
+        std::vector<float> positions(vertices.size() * 3);
+        for (size_t i = 0; i < vertices.size(); ++i) {
+            for (size_t d = 0; d < 3; ++d) {
+                positions[i * 3 + d] = vertices[i].data()[d];
+            }
+        }
+        build(positions.data(), indices.data(), indices.size() / 3, thread_count);
+    }
+
+    inline void bvh::build(const std::vector<point>& triangle_soup, size_t thread_count)
+    {
+        std::vector<index_type> indices(triangle_soup.size() - triangle_soup.size() % 3);
+        for (size_t i = 0; i < indices.size(); ++i) {
+            indices[i] = static_cast<index_type>(i);
+        }
+        build(triangle_soup, indices, thread_count);
+    }
+
+    inline void bvh::build(const float* positions, const index_type* indices, size_t triangle_count,
+                           size_t thread_count)
+    {
+        _nodes.clear();
+        _split_axes.clear();
+        _slots.resize(triangle_count);
+        _triangles.resize(triangle_count * 9);
+        if (triangle_count == 0) return;
+
+        build_state state;
+        state.positions = positions;
+        state.indices = indices;
+        state.boxes.resize(triangle_count);
+        state.centroids.resize(triangle_count * 3);
+        state.node_counter = 1;
+
+        parallel_for(0, triangle_count, [&](size_t first, size_t last) {
+            for (size_t t = first; t < last; ++t) {
+                aabb box;
+                for (size_t c = 0; c < 3; ++c) {
+                    box.expand(positions + size_t(indices[t * 3 + c]) * 3);
+                }
+                state.boxes[t] = box;
+                for (size_t d = 0; d < 3; ++d) {
+                    state.centroids[t * 3 + d] = box.center(d);
+                }
+                _slots[t] = static_cast<index_type>(t);
+            }
+        }, thread_count, 1 << 14);
+
+        // a binary tree with at least one triangle per leaf has at most 2n - 1 nodes
+        _nodes.resize(2 * triangle_count - 1);
+        _split_axes.assign(2 * triangle_count - 1, 0);
+
+        size_t workers = resolve_thread_count(triangle_count, thread_count, 1 << 12);
+        size_t spawn_depth = 0;
+        while ((size_t(1) << spawn_depth) < workers) ++spawn_depth;
+
+        build_node(state, 0, 0, static_cast<index_type>(triangle_count), 0, spawn_depth);
+
+        _nodes.resize(state.node_counter);
+        _split_axes.resize(state.node_counter);
+
+        // store the triangles in leaf order
+        parallel_for(0, triangle_count, [&](size_t first, size_t last) {
+            for (size_t slot = first; slot < last; ++slot) {
+                size_t t = _slots[slot];
+                const float* v0 = positions + size_t(indices[t * 3 + 0]) * 3;
+                const float* v1 = positions + size_t(indices[t * 3 + 1]) * 3;
+                const float* v2 = positions + size_t(indices[t * 3 + 2]) * 3;
+                float* dst = &_triangles[slot * 9];
+                for (size_t d = 0; d < 3; ++d) {
+                    dst[d] = v0[d];
+                    dst[3 + d] = v1[d] - v0[d];
+                    dst[6 + d] = v2[d] - v0[d];
+                }
+            }
+        }, thread_count, 1 << 14);
+    }
+
+    inline void bvh::make_leaf(index_type node_idx, index_type first, index_type last)
+    {
+        _nodes[node_idx].first = first;
+        _nodes[node_idx].count = last - first;
+    }
+
+    inline void bvh::build_node(build_state& state, index_type node_idx, index_type first, index_type last,
+                                size_t depth, size_t spawn_depth)
+    {
+        aabb box, centroid_box;
+        for (index_type i = first; i < last; ++i) {
+            box.expand(state.boxes[_slots[i]]);
+            centroid_box.expand(&state.centroids[size_t(_slots[i]) * 3]);
+        }
+        node& nd = _nodes[node_idx];
+        for (size_t d = 0; d < 3; ++d) {
+            nd.lower[d] = box.lower[d];
+            nd.upper[d] = box.upper[d];
+        }
+
+        index_type count = last - first;
+        if (count <= 2) {
+            make_leaf(node_idx, first, last);
+            return;
+        }
+
+        // binned SAH over all three axes
+        size_t best_axis = 0;
+        size_t best_split = 0; // bins [0, best_split) go left
+        float best_cost = std::numeric_limits<float>::max();
+        for (size_t axis = 0; axis < 3 && depth < max_sah_depth; ++axis) {
+            float extent = centroid_box.extent(axis);
+            if (extent <= 0) continue;
+            float scale = bin_count / extent;
+
+            aabb bin_boxes[bin_count];
+            index_type bin_counts[bin_count] = {};
+            for (index_type i = first; i < last; ++i) {
+                index_type t = _slots[i];
+                size_t b = std::min(bin_count - 1, static_cast<size_t>(
+                    (state.centroids[size_t(t) * 3 + axis] - centroid_box.lower[axis]) * scale));
+                ++bin_counts[b];
+                bin_boxes[b].expand(state.boxes[t]);
+            }
+
+            // sweep from the right to get the area and count of every right part
+            float right_area[bin_count];
+            index_type right_count[bin_count];
+            aabb acc;
+            index_type acc_count = 0;
+            for (size_t b = bin_count - 1; b > 0; --b) {
+                acc.expand(bin_boxes[b]);
+                acc_count += bin_counts[b];
+                right_area[b] = acc.surface_area();
+                right_count[b] = acc_count;
+            }
+            acc = aabb();
+            acc_count = 0;
+            for (size_t split = 1; split < bin_count; ++split) {
+                acc.expand(bin_boxes[split - 1]);
+                acc_count += bin_counts[split - 1];
+                if (acc_count == 0 || right_count[split] == 0) continue;
+                float cost = acc.surface_area() * acc_count + right_area[split] * right_count[split];
+                if (cost < best_cost) {
+                    best_cost = cost;
+                    best_axis = axis;
+                    best_split = split;
+                }
+            }
+        }
+
+        index_type mid;
+        float leaf_cost = box.surface_area() * count;
+        if (best_split == 0) {
+            // all centroids coincide or the tree is too deep, split at the median
+            if (count <= max_leaf_size) {
+                make_leaf(node_idx, first, last);
+                return;
+            }
+            best_axis = centroid_box.largest_axis();
+            mid = first + count / 2;
+            const std::vector<float>& centroids = state.centroids;
+            std::nth_element(_slots.begin() + first, _slots.begin() + mid, _slots.begin() + last,
+                [&](index_type a, index_type b) {
+                    return centroids[size_t(a) * 3 + best_axis] < centroids[size_t(b) * 3 + best_axis];
+                });
+        }
+        else {
+            // traversal costs about as much as one triangle test
+            if (best_cost + box.surface_area() >= leaf_cost && count <= max_leaf_size) {
+                make_leaf(node_idx, first, last);
+                return;
+            }
+            float lower = centroid_box.lower[best_axis];
+            float scale = bin_count / centroid_box.extent(best_axis);
+            const std::vector<float>& centroids = state.centroids;
+            mid = static_cast<index_type>(std::partition(_slots.begin() + first, _slots.begin() + last,
+                [&](index_type t) {
+                    size_t b = std::min(bin_count - 1, static_cast<size_t>(
+                        (centroids[size_t(t) * 3 + best_axis] - lower) * scale));
+                    return b < best_split;
+                }) - _slots.begin());
+            if (mid == first || mid == last) mid = first + count / 2;
+        }
+
+        index_type left = state.node_counter.fetch_add(2);
+        nd.first = left;
+        nd.count = 0;
+        _split_axes[node_idx] = static_cast<std::uint8_t>(best_axis);
+
+        bool spawn = spawn_depth > 0 && count > (1 << 12);
+        size_t child_spawn_depth = spawn_depth > 0 ? spawn_depth - 1 : 0;
+        parallel_invoke(
+            [&]() { build_node(state, left + 1, mid, last, depth + 1, child_spawn_depth); },
+            [&]() { build_node(state, left, first, mid, depth + 1, child_spawn_depth); },
+            spawn);
+    }
+
+    inline ray_hit bvh::intersect(const ray& r) const
+    {
+        ray_hit hit;
+        traverse_single(r, hit, false);
+        return hit;
+    }
+
+    inline bool bvh::occluded(const ray& r) const
+    {
+        ray_hit hit;
+        traverse_single(r, hit, true);
+        return hit.is_hit();
+    }
+
+    inline void bvh::traverse_single(const ray& r, ray_hit& hit, bool any_hit) const
+    {
+        if (_nodes.empty()) return;
+
+        const float* o = r.origin;
+        const float* d = r.direction;
+        float inv_d[3] = { 1.0f / d[0], 1.0f / d[1], 1.0f / d[2] };
+        float t_max = r.t_max;
+
+        index_type stack[max_stack_depth];
+        size_t top = 0;
+        stack[top++] = 0;
+
+        while (top > 0) {
+            index_type node_idx = stack[--top];
+            const node& nd = _nodes[node_idx];
+
+            float t_near = r.t_min, t_far = t_max;
+            for (size_t a = 0; a < 3; ++a) {
+                float t0 = (nd.lower[a] - o[a]) * inv_d[a];
+                float t1 = (nd.upper[a] - o[a]) * inv_d[a];
+                t_near = std::max(t_near, std::min(t0, t1));
+                t_far = std::min(t_far, std::max(t0, t1));
+            }
+            if (t_near > t_far) continue;
+
+            if (nd.count == 0) {
+                if (d[_split_axes[node_idx]] >= 0) {
+                    stack[top++] = nd.first + 1;
+                    stack[top++] = nd.first;
+                }
+                else {
+                    stack[top++] = nd.first;
+                    stack[top++] = nd.first + 1;
+                }
+                continue;
+            }
+
+            for (index_type slot = nd.first; slot < nd.first + nd.count; ++slot) {
+                const float* tri = &_triangles[size_t(slot) * 9];
+                const float* e1 = tri + 3;
+                const float* e2 = tri + 6;
+                float p[3] = { d[1] * e2[2] - d[2] * e2[1], d[2] * e2[0] - d[0] * e2[2], d[0] * e2[1] - d[1] * e2[0] };
+                float det = e1[0] * p[0] + e1[1] * p[1] + e1[2] * p[2];
+                if (std::fabs(det) <= 1e-12f) continue;
+                float inv_det = 1.0f / det;
+                float s[3] = { o[0] - tri[0], o[1] - tri[1], o[2] - tri[2] };
+                float u = (s[0] * p[0] + s[1] * p[1] + s[2] * p[2]) * inv_det;
+                if (u < 0 || u > 1) continue;
+                float q[3] = { s[1] * e1[2] - s[2] * e1[1], s[2] * e1[0] - s[0] * e1[2], s[0] * e1[1] - s[1] * e1[0] };
+                float v = (d[0] * q[0] + d[1] * q[1] + d[2] * q[2]) * inv_det;
+                if (v < 0 || u + v > 1) continue;
+                float t = (e2[0] * q[0] + e2[1] * q[1] + e2[2] * q[2]) * inv_det;
+                if (t < r.t_min || t >= t_max) continue;
+
+                t_max = t;
+                hit.t = t;
+                hit.u = u;
+                hit.v = v;
+                hit.triangle = _slots[slot];
+                if (any_hit) return;
+            }
+        }
+    }
+
+    inline void bvh::sort_for_coherence(const ray* rays, size_t ray_count, std::vector<index_type>& order) const
+    {
+        // key: direction octant, then coarse direction, then coarse origin inside the scene bounds
+        aabb scene = bounds();
+        std::vector<std::pair<std::uint32_t, index_type>> keyed(ray_count);
+        for (size_t i = 0; i < ray_count; ++i) {
+            const ray& r = rays[i];
+            float len = std::sqrt(r.direction[0] * r.direction[0] + r.direction[1] * r.direction[1] +
+                                  r.direction[2] * r.direction[2]);
+            std::uint32_t key = 0;
+            for (size_t a = 0; a < 3; ++a) {
+                key = (key << 1) | (r.direction[a] < 0 ? 1u : 0u);
+            }
+            for (size_t a = 0; a < 3; ++a) {
+                float unit = len > 0 ? std::fabs(r.direction[a]) / len : 0.0f;
+                key = (key << 5) | std::min(31u, static_cast<std::uint32_t>(unit * 32));
+            }
+            for (size_t a = 0; a < 3; ++a) {
+                float extent = scene.extent(a);
+                float rel = extent > 0 ? (r.origin[a] - scene.lower[a]) / extent : 0.0f;
+                rel = std::max(0.0f, std::min(rel, 1.0f));
+                key = (key << 4) | std::min(15u, static_cast<std::uint32_t>(rel * 16));
+            }
+            keyed[i] = std::make_pair(key, static_cast<index_type>(i));
+        }
+        std::sort(keyed.begin(), keyed.end());
+        order.resize(ray_count);
+        for (size_t i = 0; i < ray_count; ++i) {
+            order[i] = keyed[i].second;
+        }
+    }
+
+    inline void bvh::load_packet(packet& pk, const ray* rays, const index_type* order, size_t count) const
+    {
+        for (size_t l = 0; l < packet_size; ++l) {
+            const ray& r = rays[order[l < count ? l : 0]];
+            pk.ox[l] = r.origin[0];
+            pk.oy[l] = r.origin[1];
+            pk.oz[l] = r.origin[2];
+            pk.dx[l] = r.direction[0];
+            pk.dy[l] = r.direction[1];
+            pk.dz[l] = r.direction[2];
+            pk.idx[l] = 1.0f / r.direction[0];
+            pk.idy[l] = 1.0f / r.direction[1];
+            pk.idz[l] = 1.0f / r.direction[2];
+            pk.t_min[l] = r.t_min;
+            // padding lanes get an empty interval and never hit anything
+            pk.t_max[l] = l < count ? r.t_max : -std::numeric_limits<float>::max();
+            pk.u[l] = pk.v[l] = 0;
+            pk.tri[l] = invalid_index;
+            pk.active[l] = l < count ? 1 : 0;
+        }
+    }
+
+    inline bool bvh::packet_hits_node(const packet& pk, const node& nd, int* lane_mask) const
+    {
+        int any = 0;
+        for (size_t l = 0; l < packet_size; ++l) {
+            float tx0 = (nd.lower[0] - pk.ox[l]) * pk.idx[l];
+            float tx1 = (nd.upper[0] - pk.ox[l]) * pk.idx[l];
+            float ty0 = (nd.lower[1] - pk.oy[l]) * pk.idy[l];
+            float ty1 = (nd.upper[1] - pk.oy[l]) * pk.idy[l];
+            float tz0 = (nd.lower[2] - pk.oz[l]) * pk.idz[l];
+            float tz1 = (nd.upper[2] - pk.oz[l]) * pk.idz[l];
+            float t_near = std::max(std::max(std::min(tx0, tx1), std::min(ty0, ty1)),
+                                    std::max(std::min(tz0, tz1), pk.t_min[l]));
+            float t_far = std::min(std::min(std::max(tx0, tx1), std::max(ty0, ty1)),
+                                   std::min(std::max(tz0, tz1), pk.t_max[l]));
+            lane_mask[l] = (t_near <= t_far) & pk.active[l];
+            any |= lane_mask[l];
+        }
+        return any != 0;
+    }
+
+    inline bool bvh::packet_intersect_leaf(packet& pk, const node& nd, const int* lane_mask, bool any_hit) const
+    {
+        int any = 0;
+        for (index_type slot = nd.first; slot < nd.first + nd.count; ++slot) {
+            const float* tri = &_triangles[size_t(slot) * 9];
+            const float v0x = tri[0], v0y = tri[1], v0z = tri[2];
+            const float e1x = tri[3], e1y = tri[4], e1z = tri[5];
+            const float e2x = tri[6], e2y = tri[7], e2z = tri[8];
+            const index_type original = _slots[slot];
+
+            // Moeller-Trumbore, one ray per lane
+            for (size_t l = 0; l < packet_size; ++l) {
+                float px = pk.dy[l] * e2z - pk.dz[l] * e2y;
+                float py = pk.dz[l] * e2x - pk.dx[l] * e2z;
+                float pz = pk.dx[l] * e2y - pk.dy[l] * e2x;
+                float det = e1x * px + e1y * py + e1z * pz;
+                float inv_det = 1.0f / det;
+                float tx = pk.ox[l] - v0x, ty = pk.oy[l] - v0y, tz = pk.oz[l] - v0z;
+                float u = (tx * px + ty * py + tz * pz) * inv_det;
+                float qx = ty * e1z - tz * e1y;
+                float qy = tz * e1x - tx * e1z;
+                float qz = tx * e1y - ty * e1x;
+                float v = (pk.dx[l] * qx + pk.dy[l] * qy + pk.dz[l] * qz) * inv_det;
+                float t = (e2x * qx + e2y * qy + e2z * qz) * inv_det;
+
+                int hit = lane_mask[l] & (std::fabs(det) > 1e-12f) & (u >= 0) & (v >= 0) & (u + v <= 1) &
+                          (t >= pk.t_min[l]) & (t < pk.t_max[l]);
+                pk.t_max[l] = hit ? t : pk.t_max[l];
+                pk.u[l] = hit ? u : pk.u[l];
+                pk.v[l] = hit ? v : pk.v[l];
+                pk.tri[l] = hit ? original : pk.tri[l];
+                if (any_hit) pk.active[l] &= !hit;
+                any |= hit;
+            }
+        }
+        return any != 0;
+    }
+
+    inline void bvh::traverse_packet(packet& pk, bool any_hit) const
+    {
+        if (_nodes.empty()) return;
+
+        // near child first, ordered by the direction of the first active lane
+        size_t lead = 0;
+        while (lead < packet_size && !pk.active[lead]) ++lead;
+        if (lead == packet_size) return;
+        float lead_dir[3] = { pk.dx[lead], pk.dy[lead], pk.dz[lead] };
+
+        index_type stack[max_stack_depth];
+        size_t top = 0;
+        stack[top++] = 0;
+        int lane_mask[packet_size];
+
+        while (top > 0) {
+            const node& nd = _nodes[stack[--top]];
+            if (!packet_hits_node(pk, nd, lane_mask)) continue;
+
+            if (nd.count > 0) {
+                if (packet_intersect_leaf(pk, nd, lane_mask, any_hit) && any_hit) {
+                    int alive = 0;
+                    for (size_t l = 0; l < packet_size; ++l) alive |= pk.active[l];
+                    if (!alive) return;
+                }
+                continue;
+            }
+
+            index_type node_idx = static_cast<index_type>(&nd - &_nodes[0]);
+            if (lead_dir[_split_axes[node_idx]] >= 0) {
+                stack[top++] = nd.first + 1;
+                stack[top++] = nd.first;
+            }
+            else {
+                stack[top++] = nd.first;
+                stack[top++] = nd.first + 1;
+            }
+        }
+    }
+
+    inline void bvh::intersect_stream(const ray* rays, size_t ray_count, ray_hit* out_hits, size_t thread_count) const
+    {
+        std::vector<index_type> order;
+        sort_for_coherence(rays, ray_count, order);
+
+        size_t packet_count = (ray_count + packet_size - 1) / packet_size;
+        parallel_for(0, packet_count, [&](size_t first, size_t last) {
+            packet pk;
+            for (size_t p = first; p < last; ++p) {
+                size_t base = p * packet_size;
+                size_t count = ray_count - base < packet_size ? ray_count - base : size_t(packet_size);
+                load_packet(pk, rays, &order[base], count);
+                traverse_packet(pk, false);
+                for (size_t l = 0; l < count; ++l) {
+                    ray_hit& hit = out_hits[order[base + l]];
+                    hit = ray_hit();
+                    if (pk.tri[l] != invalid_index) {
+                        hit.t = pk.t_max[l];
+                        hit.u = pk.u[l];
+                        hit.v = pk.v[l];
+                        hit.triangle = pk.tri[l];
+                    }
+                }
+            }
+        }, thread_count, 16);
+    }
+
+    inline void bvh::occluded_stream(const ray* rays, size_t ray_count, std::uint8_t* out_occluded,
+                                     size_t thread_count) const
+    {
+        std::vector<index_type> order;
+        sort_for_coherence(rays, ray_count, order);
+
+        size_t packet_count = (ray_count + packet_size - 1) / packet_size;
+        parallel_for(0, packet_count, [&](size_t first, size_t last) {
+            packet pk;
+            for (size_t p = first; p < last; ++p) {
+                size_t base = p * packet_size;
+                size_t count = ray_count - base < packet_size ? ray_count - base : size_t(packet_size);
+                load_packet(pk, rays, &order[base], count);
+                traverse_packet(pk, true);
+                for (size_t l = 0; l < count; ++l) {
+                    out_occluded[order[base + l]] = pk.tri[l] != invalid_index ? 1 : 0;
+                }
+            }
+        }, thread_count, 16);
+    }
+
+    inline size_t bvh::triangle_count() const
+    {
+        return _slots.size();
+    }
+
+    inline size_t bvh::node_count() const
+    {
+        return _nodes.size();
+    }
+
+    inline aabb bvh::bounds() const
+    {
+        if (_nodes.empty()) return aabb();
+        const node& root = _nodes[0];
+        return aabb(root.lower[0], root.lower[1], root.lower[2], root.upper[0], root.upper[1], root.upper[2]);
+    }
+}
+
+#endif // BCG_BVH_HPP
@@ -0,0 +1,464 @@
+#ifndef BCG_COMPACT_POINTS_HPP
+#define BCG_COMPACT_POINTS_HPP
+
+#include "spatial/aabb.hpp"
+#include "transforms/matrix/packed_matrix.hpp"
+#include "transforms/point.hpp"
+#include "utils/parallel.hpp"
+
+#include <algorithm>
+#include <cfloat>
+#include <cmath>
+#include <cstdint>
+#include <cstring>
+#include <vector>
+
+namespace bcg
+{
+    //////////////////////////////////////////////////////////////////////////////////////////////////
+    // half precision
+    //////////////////////////////////////////////////////////////////////////////////////////////////
+
+    // IEEE binary16 conversion with round to nearest even, overflow gives inf and nan stays nan
+    inline std::uint16_t float_to_half(float value);
+    inline float half_to_float(std::uint16_t bits);
+
+    // largest finite half
+    const float half_max = 65504.0f;
+
+    //////////////////////////////////////////////////////////////////////////////////////////////////
+    // compact point buffers
+    //////////////////////////////////////////////////////////////////////////////////////////////////
+
+    // Points quantised to 16 bits per axis on a grid spanning [bounds], 6 bytes per point.
+    // The grid step along an axis is extent / 65535, so a decoded coordinate is within
+    // max_error(axis) = step / 2 (plus float rounding) of the encoded one. Coordinates outside the
+    // bounds are clamped to them.
+    class quantized_point_buffer
+    {
+    public:
+        static const std::uint32_t max_code = 65535;
+
+        quantized_point_buffer() = default;
+        explicit quantized_point_buffer(const aabb& bounds, size_t point_count = 0);
+
+        // quantise packed xyz coordinates inside their own bounding box
+        static quantized_point_buffer from_coords(const float* coords, size_t point_count, size_t thread_count = 0);
+
+    public:
+        void resize(size_t point_count) { _codes.resize(point_count * 3); }
+        size_t size() const { return _codes.size() / 3; }
+        size_t byte_size() const { return _codes.size() * sizeof(std::uint16_t); }
+        const std::uint16_t* data() const { return _codes.data(); }
+
+        const aabb& bounds() const { return _bounds; }
+        float step(size_t axis) const { return _step[axis]; }
+        float max_error(size_t axis) const;
+
+        // lane kernels over points [first, first + count), coordinates split by axis
+        void encode(size_t first, size_t count, const float* x, const float* y, const float* z);
+        void decode(size_t first, size_t count, float* x, float* y, float* z) const;
+
+        // whole-buffer conversion from and to packed xyz coordinates
+        void encode(const float* coords, size_t point_count, size_t thread_count = 0);
+        void decode(float* coords, size_t thread_count = 0) const;
+        point get(size_t idx) const;
+
+        // empty buffer whose grid covers the image of this one under [trans]
+        quantized_point_buffer transformed_layout(const packed_matrix4<float>& trans) const;
+
+    private:
+        aabb _bounds;
+        float _step[3] = { 0, 0, 0 };
+        float _inv_step[3] = { 0, 0, 0 };
+        std::vector<std::uint16_t> _codes;
+    };
+
+    // Points as fp16 offsets from an origin, 6 bytes per point. A decoded coordinate is within
+    // max_error(offset) = max(|offset| / 2048, 2^-25) of the encoded one, where offset is its
+    // distance from the origin along that axis. Offsets beyond +-65504 are clamped, so keep the
+    // origin near the data (e.g. the centre of a tile).
+    class half_point_buffer
+    {
+    public:
+        half_point_buffer() = default;
+        explicit half_point_buffer(const float* origin, size_t point_count = 0);
+
+        // origin at the centre of the coordinates' bounding box
+        static half_point_buffer from_coords(const float* coords, size_t point_count, size_t thread_count = 0);
+
+    public:
+        void resize(size_t point_count) { _halves.resize(point_count * 3); }
+        size_t size() const { return _halves.size() / 3; }
+        size_t byte_size() const { return _halves.size() * sizeof(std::uint16_t); }
+        const std::uint16_t* data() const { return _halves.data(); }
+
+        const float* origin() const { return _origin; }
+        static float max_error(float offset);
+
+        void encode(size_t first, size_t count, const float* x, const float* y, const float* z);
+        void decode(size_t first, size_t count, float* x, float* y, float* z) const;
+
+        void encode(const float* coords, size_t point_count, size_t thread_count = 0);
+        void decode(float* coords, size_t thread_count = 0) const;
+        point get(size_t idx) const;
+
+        // empty buffer whose origin is the image of this one's under [trans]
+        half_point_buffer transformed_layout(const packed_matrix4<float>& trans) const;
+
+    private:
+        float _origin[3] = { 0, 0, 0 };
+        std::vector<std::uint16_t> _halves;
+    };
+
+    // Decode, transform and encode in one pass over blocks of points, without a float copy of the
+    // buffer. [out] must already have its grid or origin; it is resized to in.size(). Per axis i
+    // the error against the float path is at most sum_j |trans(i, j)| * in_error_j + out_error_i.
+    template<typename in_buffer_type, typename out_buffer_type>
+    void transform_compact(const in_buffer_type& in, const packed_matrix4<float>& trans, out_buffer_type& out,
+                           size_t thread_count = 0);
+    // same, into a buffer of the same kind laid out by in.transformed_layout(trans)
+    template<typename buffer_type>
+    buffer_type transform_compact(const buffer_type& in, const packed_matrix4<float>& trans, size_t thread_count = 0);
+
+    // decode and transform into packed xyz floats
+    template<typename buffer_type>
+    void decode_transform(const buffer_type& in, const packed_matrix4<float>& trans, float* out_coords,
+                          size_t thread_count = 0);
+
+    //////////////////////////////////////////////////////////////////////////////////////////////////
+    // half precision implementation
+    //////////////////////////////////////////////////////////////////////////////////////////////////
+
+    namespace compact_detail
+    {
+        // points decoded at a time, lanes of this size stay in L1
+        const size_t block_size = 64;
+        const size_t grain_size = 1 << 14;
+
+        inline std::uint32_t float_bits(float value)
+        {
+            std::uint32_t bits;
+            std::memcpy(&bits, &value, sizeof(bits));
+            return bits;
+        }
+
+        inline float bits_float(std::uint32_t bits)
+        {
+            float value;
+            std::memcpy(&value, &bits, sizeof(value));
+            return value;
+        }
+    }
+
+    inline std::uint16_t float_to_half(float value)
+    {
+        using namespace compact_detail;
+        const std::uint32_t f32_infinity = 255u << 23;
+        const std::uint32_t f16_overflow = (127u + 16) << 23;
+        const std::uint32_t denormal_magic = ((127u - 15) + (23 - 10) + 1) << 23;
+
+        std::uint32_t bits = float_bits(value);
+        std::uint32_t sign = bits & 0x80000000u;
+        bits ^= sign;
+
+        std::uint32_t half;
+        if (bits >= f16_overflow) {
+            half = bits > f32_infinity ? 0x7e00 : 0x7c00;
+        }
+        else if (bits < (113u << 23)) {
+            // half denormals: let the float adder do the rounding
+            half = float_bits(bits_float(bits) + bits_float(denormal_magic)) - denormal_magic;
+        }
+        else {
+            std::uint32_t mantissa_odd = (bits >> 13) & 1;
+            bits += ((15u - 127) << 23) + 0xfff;
+            bits += mantissa_odd;
+            half = bits >> 13;
+        }
+        return static_cast<std::uint16_t>(half | (sign >> 16));
+    }
+
+    inline float half_to_float(std::uint16_t half)
+    {
+        using namespace compact_detail;
+        const std::uint32_t shifted_exp = 0x7c00u << 13;
+        const float magic = bits_float(113u << 23);
+
+        std::uint32_t bits = (std::uint32_t(half) & 0x7fff) << 13;
+        std::uint32_t exp = bits & shifted_exp;
+        bits += (127u - 15) << 23;
+        if (exp == shifted_exp) {
+            bits += (128u - 16) << 23;
+        }
+        else if (exp == 0) {
+            bits += 1u << 23;
+            bits = float_bits(bits_float(bits) - magic);
+        }
+        return bits_float(bits | ((std::uint32_t(half) & 0x8000) << 16));
+    }
+
+    //////////////////////////////////////////////////////////////////////////////////////////////////
+    // compact point buffers implementation
+    //////////////////////////////////////////////////////////////////////////////////////////////////
+
+    namespace compact_detail
+    {
+        // split packed xyz into lanes, run fn(first, count, x, y, z) per block in parallel
+        template<typename func_type>
+        void for_each_block(size_t point_count, size_t thread_count, func_type fn)
+        {
+            parallel_for(0, point_count, [&](size_t first, size_t last) {
+                float x[block_size], y[block_size], z[block_size];
+                for (size_t block = first; block < last; block += block_size) {
+                    fn(block, std::min(block_size, last - block), x, y, z);
+                }
+            }, thread_count, grain_size);
+        }
+
+        inline aabb bounds_of(const float* coords, size_t point_count)
+        {
+            aabb bounds;
+            for (size_t i = 0; i < point_count; ++i) bounds.expand(coords + i * 3);
+            return bounds;
+        }
+    }
+
+    inline quantized_point_buffer::quantized_point_buffer(const aabb& bounds, size_t point_count)
+        : _bounds(bounds)
+    {
+        for (size_t d = 0; d < 3; ++d) {
+            float extent = bounds.extent(d);
+            _step[d] = extent / max_code;
+            _inv_step[d] = extent > 0 ? max_code / extent : 0.0f;
+        }
+        resize(point_count);
+    }
+
+    inline quantized_point_buffer quantized_point_buffer::from_coords(const float* coords, size_t point_count,
+                                                                      size_t thread_count)
+    {
+        quantized_point_buffer buffer(compact_detail::bounds_of(coords, point_count));
+        buffer.encode(coords, point_count, thread_count);
+        return buffer;
+    }
+
+    inline float quantized_point_buffer::max_error(size_t axis) const
+    {
+        float magnitude = std::max(std::fabs(_bounds.lower[axis]), std::fabs(_bounds.upper[axis]));
+        return 0.5f * _step[axis] + 2 * FLT_EPSILON * magnitude;
+    }
+
+    inline void quantized_point_buffer::encode(size_t first, size_t count, const float* x, const float* y,
+                                               const float* z)
+    {
+        const float* lanes[3] = { x, y, z };
+        std::uint16_t* codes = &_codes[first * 3];
+        const float top = static_cast<float>(max_code);
+        for (size_t d = 0; d < 3; ++d) {
+            const float* lane = lanes[d];
+            float lower = _bounds.lower[d], inv_step = _inv_step[d];
+            for (size_t i = 0; i < count; ++i) {
+                float q = (lane[i] - lower) * inv_step + 0.5f;
+                q = std::max(0.0f, std::min(q, top));
+                codes[i * 3 + d] = static_cast<std::uint16_t>(q);
+            }
+        }
+    }
+
+    inline void quantized_point_buffer::decode(size_t first, size_t count, float* x, float* y, float* z) const
+    {
+        float* lanes[3] = { x, y, z };
+        const std::uint16_t* codes = &_codes[first * 3];
+        for (size_t d = 0; d < 3; ++d) {
+            float* lane = lanes[d];
+            float lower = _bounds.lower[d], step = _step[d];
+            for (size_t i = 0; i < count; ++i) {
+                lane[i] = lower + static_cast<float>(codes[i * 3 + d]) * step;
+            }
+        }
+    }
+
+    inline void quantized_point_buffer::encode(const float* coords, size_t point_count, size_t thread_count)
+    {
+        resize(point_count);
+        compact_detail::for_each_block(point_count, thread_count,
+                                       [&](size_t first, size_t count, float* x, float* y, float* z) {
+            for (size_t i = 0; i < count; ++i) {
+                const float* p = coords + (first + i) * 3;
+                x[i] = p[0]; y[i] = p[1]; z[i] = p[2];
+            }
+            encode(first, count, x, y, z);
+        });
+    }
+
+    inline void quantized_point_buffer::decode(float* coords, size_t thread_count) const
+    {
+        compact_detail::for_each_block(size(), thread_count,
+                                       [&](size_t first, size_t count, float* x, float* y, float* z) {
+            decode(first, count, x, y, z);
+            for (size_t i = 0; i < count; ++i) {
+                float* p = coords + (first + i) * 3;
+                p[0] = x[i]; p[1] = y[i]; p[2] = z[i];
+            }
+        });
+    }
+
+    inline point quantized_point_buffer::get(size_t idx) const
+    {
+        float x, y, z;
+        decode(idx, 1, &x, &y, &z);
+        return point(x, y, z);
+    }
+
+    inline quantized_point_buffer quantized_point_buffer::transformed_layout(const packed_matrix4<float>& trans) const
+    {
+        return quantized_point_buffer(transform_bounds(_bounds, trans));
+    }
+
+    inline half_point_buffer::half_point_buffer(const float* origin, size_t point_count)
+    {
+        std::copy(origin, origin + 3, _origin);
+        resize(point_count);
+    }
+
+    inline half_point_buffer half_point_buffer::from_coords(const float* coords, size_t point_count,
+                                                            size_t thread_count)
+    {
+        aabb bounds = compact_detail::bounds_of(coords, point_count);
+        float origin[3] = { 0, 0, 0 };
+        if (!bounds.is_empty()) {
+            for (size_t d = 0; d < 3; ++d) origin[d] = bounds.center(d);
+        }
+        half_point_buffer buffer(origin);
+        buffer.encode(coords, point_count, thread_count);
+        return buffer;
+    }
+
+    inline float half_point_buffer::max_error(float offset)
+    {
+        return std::max(std::fabs(offset) * (1.0f / 2048), 1.0f / (1 << 25));
+    }
+
+    inline void half_point_buffer::encode(size_t first, size_t count, const float* x, const float* y, const float* z)
+    {
+        const float* lanes[3] = { x, y, z };
+        std::uint16_t* halves = &_halves[first * 3];
+        for (size_t d = 0; d < 3; ++d) {
+            const float* lane = lanes[d];
+            float origin = _origin[d], limit = half_max;
+            for (size_t i = 0; i < count; ++i) {
+                float offset = std::max(-limit, std::min(lane[i] - origin, limit));
+                halves[i * 3 + d] = float_to_half(offset);
+            }
+        }
+    }
+
+    inline void half_point_buffer::decode(size_t first, size_t count, float* x, float* y, float* z) const
+    {
+        float* lanes[3] = { x, y, z };
+        const std::uint16_t* halves = &_halves[first * 3];
+        for (size_t d = 0; d < 3; ++d) {
+            float* lane = lanes[d];
+            float origin = _origin[d];
+            for (size_t i = 0; i < count; ++i) {
+                lane[i] = origin + half_to_float(halves[i * 3 + d]);
+            }
+        }
+    }
+
+    inline void half_point_buffer::encode(const float* coords, size_t point_count, size_t thread_count)
+    {
+        resize(point_count);
+        compact_detail::for_each_block(point_count, thread_count,
+                                       [&](size_t first, size_t count, float* x, float* y, float* z) {
+            for (size_t i = 0; i < count; ++i) {
+                const float* p = coords + (first + i) * 3;
+                x[i] = p[0]; y[i] = p[1]; z[i] = p[2];
+            }
+            encode(first, count, x, y, z);
+        });
+    }
+
+    inline void half_point_buffer::decode(float* coords, size_t thread_count) const
+    {
+        compact_detail::for_each_block(size(), thread_count,
+                                       [&](size_t first, size_t count, float* x, float* y, float* z) {
+            decode(first, count, x, y, z);
+            for (size_t i = 0; i < count; ++i) {
+                float* p = coords + (first + i) * 3;
+                p[0] = x[i]; p[1] = y[i]; p[2] = z[i];
+            }
+        });
+    }
+
+    inline point half_point_buffer::get(size_t idx) const
+    {
+        float x, y, z;
+        decode(idx, 1, &x, &y, &z);
+        return point(x, y, z);
+    }
+
+    inline half_point_buffer half_point_buffer::transformed_layout(const packed_matrix4<float>& trans) const
+    {
+        float origin[3];
+        trans.transform_point(_origin, origin);
+        return half_point_buffer(origin);
+    }
+
+    //////////////////////////////////////////////////////////////////////////////////////////////////
+    // compact kernels implementation
+    //////////////////////////////////////////////////////////////////////////////////////////////////
+
+    namespace compact_detail
+    {
+        inline void transform_lanes(const packed_matrix4<float>& trans, size_t count, float* x, float* y, float* z)
+        {
+            const float* m = trans.m;
+            for (size_t i = 0; i < count; ++i) {
+                float px = x[i], py = y[i], pz = z[i];
+                x[i] = m[0] * px + m[1] * py + m[2] * pz + m[3];
+                y[i] = m[4] * px + m[5] * py + m[6] * pz + m[7];
+                z[i] = m[8] * px + m[9] * py + m[10] * pz + m[11];
+            }
+        }
+    }
+
+    template<typename in_buffer_type, typename out_buffer_type>
+    void transform_compact(const in_buffer_type& in, const packed_matrix4<float>& trans, out_buffer_type& out,
+                           size_t thread_count)
+    {
+        out.resize(in.size());
+        compact_detail::for_each_block(in.size(), thread_count,
+                                       [&](size_t first, size_t count, float* x, float* y, float* z) {
+            in.decode(first, count, x, y, z);
+            compact_detail::transform_lanes(trans, count, x, y, z);
+            out.encode(first, count, x, y, z);
+        });
+    }
+
+    template<typename buffer_type>
+    buffer_type transform_compact(const buffer_type& in, const packed_matrix4<float>& trans, size_t thread_count)
+    {
+        buffer_type out = in.transformed_layout(trans);
+        transform_compact(in, trans, out, thread_count);
+        return out;
+    }
+
+    template<typename buffer_type>
+    void decode_transform(const buffer_type& in, const packed_matrix4<float>& trans, float* out_coords,
+                          size_t thread_count)
+    {
+        compact_detail::for_each_block(in.size(), thread_count,
+                                       [&](size_t first, size_t count, float* x, float* y, float* z) {
+            in.decode(first, count, x, y, z);
+            compact_detail::transform_lanes(trans, count, x, y, z);
+            for (size_t i = 0; i < count; ++i) {
+                float* p = out_coords + (first + i) * 3;
+                p[0] = x[i]; p[1] = y[i]; p[2] = z[i];
+            }
+        });
+    }
+}
+
+#endif // BCG_COMPACT_POINTS_HPP
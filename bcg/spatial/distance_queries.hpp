@@ -0,0 +1,351 @@
+#ifndef BCG_DISTANCE_QUERIES_HPP
+#define BCG_DISTANCE_QUERIES_HPP
+
+#include "spatial/bvh.hpp"
+#include "transforms/point.hpp"
+#include "utils/parallel.hpp"
+
+#include <algorithm>
+#include <cstdint>
+#include <limits>
+#include <vector>
+
+namespace bcg
+{
+    //////////////////////////////////////////////////////////////////////////////////////////////////
+    // primitive sets
+    //////////////////////////////////////////////////////////////////////////////////////////////////
+
+    // Primitives stored one array per coordinate, so the distance kernels below load 8 of them
+    // straight into SIMD lanes.
+    struct segment_set
+    {
+        // start a and end b
+        std::vector<float> ax, ay, az, bx, by, bz;
+
+        size_t size() const { return ax.size(); }
+        void add(const float* a, const float* b);
+        void add(const point& a, const point& b);
+    };
+
+    struct triangle_set
+    {
+        // corners a, b, c
+        std::vector<float> ax, ay, az, bx, by, bz, cx, cy, cz;
+
+        size_t size() const { return ax.size(); }
+        void add(const float* a, const float* b, const float* c);
+        void add(const point& a, const point& b, const point& c);
+        // packed xyz positions and 3 indices per triangle, e.g. a mesh's
+        void add(const float* positions, const std::uint32_t* indices, size_t triangle_count);
+    };
+
+    // planes dot(n, x) = d
+    struct plane_set
+    {
+        std::vector<float> nx, ny, nz, d;
+
+        size_t size() const { return nx.size(); }
+        void add(const float* normal, float offset);
+        // the plane through [p] with [normal]
+        void add(const point& p, const float* normal);
+    };
+
+    //////////////////////////////////////////////////////////////////////////////////////////////////
+    // distance queries
+    //////////////////////////////////////////////////////////////////////////////////////////////////
+
+    // One query against every primitive of a set, 8 primitives per step with the region logic
+    // written as selects instead of branches. Squared distances go to [out_distance2] (one per
+    // primitive); the optional outputs may be null.
+
+    // [out_closest] gets the closest point on each segment, packed xyz
+    inline void point_segment_distances(const float* p, const segment_set& segments, float* out_distance2,
+                                        float* out_closest = nullptr, size_t thread_count = 0);
+    // [out_closest] gets the closest point on each triangle, packed xyz
+    inline void point_triangle_distances(const float* p, const triangle_set& triangles, float* out_distance2,
+                                         float* out_closest = nullptr, size_t thread_count = 0);
+    // query segment [a, b] against every segment; [out_s] and [out_t] get the parameters of the
+    // closest points along the query and along each segment
+    inline void segment_segment_distances(const float* a, const float* b, const segment_set& segments,
+                                          float* out_distance2, float* out_s = nullptr, float* out_t = nullptr,
+                                          size_t thread_count = 0);
+    // ray parameter of the hit with each plane, infinity when parallel or outside [t_min, t_max]
+    inline void ray_plane_intersections(const ray& r, const plane_set& planes, float* out_t,
+                                        size_t thread_count = 0);
+
+    //////////////////////////////////////////////////////////////////////////////////////////////////
+    // primitive sets implementation
+    //////////////////////////////////////////////////////////////////////////////////////////////////
+
+    inline void segment_set::add(const float* a, const float* b)
+    {
+        ax.push_back(a[0]); ay.push_back(a[1]); az.push_back(a[2]);
+        bx.push_back(b[0]); by.push_back(b[1]); bz.push_back(b[2]);
+    }
+
+    inline void segment_set::add(const point& a, const point& b)
+    {
+        float pa[3] = { a.data()[0], a.data()[1], a.data()[2] };
+        float pb[3] = { b.data()[0], b.data()[1], b.data()[2] };
+        add(pa, pb);
+    }
+
+    inline void triangle_set::add(const float* a, const float* b, const float* c)
+    {
+        ax.push_back(a[0]); ay.push_back(a[1]); az.push_back(a[2]);
+        bx.push_back(b[0]); by.push_back(b[1]); bz.push_back(b[2]);
+        cx.push_back(c[0]); cy.push_back(c[1]); cz.push_back(c[2]);
+    }
+
+    inline void triangle_set::add(const point& a, const point& b, const point& c)
+    {
+        float pa[3] = { a.data()[0], a.data()[1], a.data()[2] };
+        float pb[3] = { b.data()[0], b.data()[1], b.data()[2] };
+        float pc[3] = { c.data()[0], c.data()[1], c.data()[2] };
+        add(pa, pb, pc);
+    }
+
+    inline void triangle_set::add(const float* positions, const std::uint32_t* indices, size_t triangle_count)
+    {
+        for (size_t t = 0; t < triangle_count; ++t) {
+            add(positions + indices[t * 3] * 3, positions + indices[t * 3 + 1] * 3, positions + indices[t * 3 + 2] * 3);
+        }
+    }
+
+    inline void plane_set::add(const float* normal, float offset)
+    {
+        nx.push_back(normal[0]);
+        ny.push_back(normal[1]);
+        nz.push_back(normal[2]);
+        d.push_back(offset);
+    }
+
+    inline void plane_set::add(const point& p, const float* normal)
+    {
+        add(normal, normal[0] * p.data()[0] + normal[1] * p.data()[1] + normal[2] * p.data()[2]);
+    }
+
+    //////////////////////////////////////////////////////////////////////////////////////////////////
+    // distance queries implementation
+    //////////////////////////////////////////////////////////////////////////////////////////////////
+
+    namespace distance_detail
+    {
+        const size_t lane_count = 8;
+        const size_t grain_size = 1 << 14;
+
+        // fn(first, count) over lane blocks of [0, n); full blocks pass a constant count so their
+        // loops have a fixed trip count once inlined
+        template<typename func_type>
+        void for_each_block(size_t n, func_type fn, size_t thread_count)
+        {
+            parallel_for(0, n, [&](size_t first, size_t last) {
+                size_t i = first;
+                for (; i + lane_count <= last; i += lane_count) fn(i, lane_count);
+                if (i < last) fn(i, last - i);
+            }, thread_count, grain_size);
+        }
+
+        inline float clamp01(float v)
+        {
+            return std::max(0.0f, std::min(v, 1.0f));
+        }
+
+        // x / y, 0 where y is not positive (as x / infinity: a single select keeps it vectorisable)
+        inline float safe_div(float x, float y)
+        {
+            return x / (y > 0 ? y : std::numeric_limits<float>::infinity());
+        }
+
+        // copy [count] values starting at [first] into a lane array, the rest stay 0
+        inline void load(const std::vector<float>& src, size_t first, size_t count, float* lanes)
+        {
+            for (size_t l = 0; l < count; ++l) lanes[l] = src[first + l];
+        }
+
+        inline void load(const std::vector<float>& x, const std::vector<float>& y, const std::vector<float>& z,
+                         size_t first, size_t count, float (&lanes)[3][lane_count])
+        {
+            load(x, first, count, lanes[0]);
+            load(y, first, count, lanes[1]);
+            load(z, first, count, lanes[2]);
+        }
+
+        inline void store_packed(const float (&v)[3][lane_count], size_t count, float* out)
+        {
+            for (size_t l = 0; l < count; ++l) {
+                out[l * 3] = v[0][l];
+                out[l * 3 + 1] = v[1][l];
+                out[l * 3 + 2] = v[2][l];
+            }
+        }
+    }
+
+    inline void point_segment_distances(const float* p, const segment_set& segments, float* out_distance2,
+                                        float* out_closest, size_t thread_count)
+    {
+        using namespace distance_detail;
+        float px = p[0], py = p[1], pz = p[2];
+        for_each_block(segments.size(), [&](size_t first, size_t count) {
+            float a[3][lane_count] = {}, b[3][lane_count] = {};
+            load(segments.ax, segments.ay, segments.az, first, count, a);
+            load(segments.bx, segments.by, segments.bz, first, count, b);
+            float c[3][lane_count], dist2[lane_count];
+            for (size_t l = 0; l < lane_count; ++l) {
+                float ex = b[0][l] - a[0][l], ey = b[1][l] - a[1][l], ez = b[2][l] - a[2][l];
+                float vx = px - a[0][l], vy = py - a[1][l], vz = pz - a[2][l];
+                float t = clamp01(safe_div(vx * ex + vy * ey + vz * ez, ex * ex + ey * ey + ez * ez));
+                c[0][l] = a[0][l] + t * ex;
+                c[1][l] = a[1][l] + t * ey;
+                c[2][l] = a[2][l] + t * ez;
+                float dx = px - c[0][l], dy = py - c[1][l], dz = pz - c[2][l];
+                dist2[l] = dx * dx + dy * dy + dz * dz;
+            }
+            std::copy(dist2, dist2 + count, out_distance2 + first);
+            if (out_closest) store_packed(c, count, out_closest + first * 3);
+        }, thread_count);
+    }
+
+    inline void point_triangle_distances(const float* p, const triangle_set& triangles, float* out_distance2,
+                                         float* out_closest, size_t thread_count)
+    {
+        using namespace distance_detail;
+        float px = p[0], py = p[1], pz = p[2];
+        const float query[3] = { px, py, pz };
+        for_each_block(triangles.size(), [&](size_t first, size_t count) {
+            float a[3][lane_count] = {}, b[3][lane_count] = {}, c[3][lane_count] = {};
+            load(triangles.ax, triangles.ay, triangles.az, first, count, a);
+            load(triangles.bx, triangles.by, triangles.bz, first, count, b);
+            load(triangles.cx, triangles.cy, triangles.cz, first, count, c);
+            float q[3][lane_count], dist2[lane_count];
+            for (size_t l = 0; l < lane_count; ++l) {
+                float e0[3] = { b[0][l] - a[0][l], b[1][l] - a[1][l], b[2][l] - a[2][l] };
+                float e1[3] = { c[0][l] - a[0][l], c[1][l] - a[1][l], c[2][l] - a[2][l] };
+                float e2[3] = { c[0][l] - b[0][l], c[1][l] - b[1][l], c[2][l] - b[2][l] };
+                float v[3] = { px - a[0][l], py - a[1][l], pz - a[2][l] };
+                float w[3] = { px - b[0][l], py - b[1][l], pz - b[2][l] };
+                float d00 = e0[0] * e0[0] + e0[1] * e0[1] + e0[2] * e0[2];
+                float d01 = e0[0] * e1[0] + e0[1] * e1[1] + e0[2] * e1[2];
+                float d11 = e1[0] * e1[0] + e1[1] * e1[1] + e1[2] * e1[2];
+                float d22 = e2[0] * e2[0] + e2[1] * e2[1] + e2[2] * e2[2];
+                float d20 = v[0] * e0[0] + v[1] * e0[1] + v[2] * e0[2];
+                float d21 = v[0] * e1[0] + v[1] * e1[1] + v[2] * e1[2];
+                float d2w = w[0] * e2[0] + w[1] * e2[1] + w[2] * e2[2];
+
+                // projection into the plane, used when it lands inside a non-degenerate triangle
+                float denom = d00 * d11 - d01 * d01;
+                float u = safe_div(d11 * d20 - d01 * d21, denom);
+                float t = safe_div(d00 * d21 - d01 * d20, denom);
+                // masks combined with & rather than &&, which would branch and stop vectorisation
+                int inside = (denom > 1e-6f * d00 * d11 ? -1 : 0) & (u >= 0 ? -1 : 0) & (t >= 0 ? -1 : 0) &
+                             (u + t <= 1 ? -1 : 0);
+
+                // otherwise the closest of the three edges
+                float t0 = clamp01(safe_div(d20, d00));
+                float t1 = clamp01(safe_div(d21, d11));
+                float t2 = clamp01(safe_div(d2w, d22));
+                float q0[3], q1[3], q2[3], in[3];
+                float s0 = 0, s1 = 0, s2 = 0, in2 = 0;
+                for (size_t d = 0; d < 3; ++d) {
+                    q0[d] = a[d][l] + t0 * e0[d];
+                    q1[d] = a[d][l] + t1 * e1[d];
+                    q2[d] = b[d][l] + t2 * e2[d];
+                    in[d] = a[d][l] + u * e0[d] + t * e1[d];
+                    s0 += (query[d] - q0[d]) * (query[d] - q0[d]);
+                    s1 += (query[d] - q1[d]) * (query[d] - q1[d]);
+                    s2 += (query[d] - q2[d]) * (query[d] - q2[d]);
+                    in2 += (query[d] - in[d]) * (query[d] - in[d]);
+                }
+                float best[3];
+                for (size_t d = 0; d < 3; ++d) best[d] = s0 <= s1 ? q0[d] : q1[d];
+                float best2 = std::min(s0, s1);
+                for (size_t d = 0; d < 3; ++d) best[d] = s2 < best2 ? q2[d] : best[d];
+                best2 = std::min(s2, best2);
+                // the projection is pushed to infinity rather than selected away: a select would let the
+                // compiler compute it under a branch, which it then refuses to vectorise
+                in2 += inside ? 0.0f : std::numeric_limits<float>::infinity();
+                for (size_t d = 0; d < 3; ++d) q[d][l] = in2 < best2 ? in[d] : best[d];
+                dist2[l] = std::min(in2, best2);
+            }
+            std::copy(dist2, dist2 + count, out_distance2 + first);
+            if (out_closest) store_packed(q, count, out_closest + first * 3);
+        }, thread_count);
+    }
+
+    inline void segment_segment_distances(const float* a, const float* b, const segment_set& segments,
+                                          float* out_distance2, float* out_s, float* out_t, size_t thread_count)
+    {
+        using namespace distance_detail;
+        float d1[3] = { b[0] - a[0], b[1] - a[1], b[2] - a[2] };
+        float len1 = d1[0] * d1[0] + d1[1] * d1[1] + d1[2] * d1[2];
+        for_each_block(segments.size(), [&](size_t first, size_t count) {
+            float c[3][lane_count] = {}, e[3][lane_count] = {};
+            load(segments.ax, segments.ay, segments.az, first, count, c);
+            load(segments.bx, segments.by, segments.bz, first, count, e);
+            float s_out[lane_count], t_out[lane_count], dist2[lane_count];
+            for (size_t l = 0; l < lane_count; ++l) {
+                float d2[3] = { e[0][l] - c[0][l], e[1][l] - c[1][l], e[2][l] - c[2][l] };
+                float r[3] = { a[0] - c[0][l], a[1] - c[1][l], a[2] - c[2][l] };
+                float len2 = d2[0] * d2[0] + d2[1] * d2[1] + d2[2] * d2[2];
+                float dd = d1[0] * d2[0] + d1[1] * d2[1] + d1[2] * d2[2];
+                float r1 = d1[0] * r[0] + d1[1] * r[1] + d1[2] * r[2];
+                float r2 = d2[0] * r[0] + d2[1] * r[1] + d2[2] * r[2];
+
+                // closest points of the infinite lines (s = 0 when parallel), then clamped in turn
+                float denom = len1 * len2 - dd * dd;
+                float s = clamp01(safe_div(dd * r2 - r1 * len2, denom));
+                float t = safe_div(dd * s + r2, len2);
+                float s_below = clamp01(safe_div(-r1, len1)), s_above = clamp01(safe_div(dd - r1, len1));
+                s = t < 0 ? s_below : s;
+                s = t > 1 ? s_above : s;
+                t = clamp01(t);
+                // a point-like segment: t = 0; a point-like query: s = 0
+                float t_point = clamp01(safe_div(r2, len2));
+                s = len2 > 0 ? s : s_below;
+                t = len2 > 0 ? t : 0.0f;
+                s = len1 > 0 ? s : 0.0f;
+                t = len1 > 0 ? t : t_point;
+
+                float dist = 0;
+                for (size_t d = 0; d < 3; ++d) {
+                    float diff = (a[d] + s * d1[d]) - (c[d][l] + t * d2[d]);
+                    dist += diff * diff;
+                }
+                s_out[l] = s;
+                t_out[l] = t;
+                dist2[l] = dist;
+            }
+            std::copy(dist2, dist2 + count, out_distance2 + first);
+            if (out_s) std::copy(s_out, s_out + count, out_s + first);
+            if (out_t) std::copy(t_out, t_out + count, out_t + first);
+        }, thread_count);
+    }
+
+    inline void ray_plane_intersections(const ray& r, const plane_set& planes, float* out_t, size_t thread_count)
+    {
+        using namespace distance_detail;
+        float ox = r.origin[0], oy = r.origin[1], oz = r.origin[2];
+        float dx = r.direction[0], dy = r.direction[1], dz = r.direction[2];
+        float t_min = r.t_min, t_max = r.t_max;
+        for_each_block(planes.size(), [&](size_t first, size_t count) {
+            const float miss = std::numeric_limits<float>::infinity();
+            float n[3][lane_count] = {}, d[lane_count] = {};
+            load(planes.nx, planes.ny, planes.nz, first, count, n);
+            load(planes.d, first, count, d);
+            float t_out[lane_count];
+            for (size_t l = 0; l < lane_count; ++l) {
+                float denom = n[0][l] * dx + n[1][l] * dy + n[2][l] * dz;
+                float dist = d[l] - (n[0][l] * ox + n[1][l] * oy + n[2][l] * oz);
+                // parallel planes give an infinite or NaN t, which fails the range check
+                float t = dist / denom;
+                // one compare on the distance outside [t_min, t_max] keeps the select vectorisable
+                float outside = std::max(t_min - t, t - t_max);
+                t_out[l] = outside <= 0 ? t : miss;
+            }
+            std::copy(t_out, t_out + count, out_t + first);
+        }, thread_count);
+    }
+}
+
+#endif // BCG_DISTANCE_QUERIES_HPP
@@ -0,0 +1,331 @@
+#ifndef BCG_ICP_HPP
+#define BCG_ICP_HPP
+
+#include "spatial/kd_tree.hpp"
+#include "spatial/normal_estimation.hpp"
+#include "transforms/matrix/matrix.hpp"
+#include "transforms/matrix/packed_matrix.hpp"
+#include "transforms/matrix/structured_matrix.hpp"
+#include "transforms/matrix/svd.hpp"
+#include "utils/parallel.hpp"
+
+#include <chrono>
+#include <cmath>
+#include <cstddef>
+#include <limits>
+#include <vector>
+
+namespace bcg
+{
+    //////////////////////////////////////////////////////////////////////////////////////////////////
+    // icp_registration
+    //////////////////////////////////////////////////////////////////////////////////////////////////
+
+    enum class icp_metric
+    {
+        // minimises squared point distances, closed-form step through the SVD (Kabsch)
+        point_to_point,
+        // minimises squared distances to the target's tangent planes, linearised 6x6 step;
+        // converges in far fewer iterations on smooth surfaces
+        point_to_plane
+    };
+
+    struct icp_options
+    {
+        icp_metric metric = icp_metric::point_to_point;
+        size_t max_iterations = 50;
+        // stops once an iteration improves the mean squared error by less than this fraction
+        double relative_tolerance = 1e-6;
+        // correspondences farther apart are rejected, 0 keeps them all
+        float max_correspondence_distance = 0;
+        // source points used per iteration, evenly strided, 0 uses all of them
+        size_t max_samples = 0;
+        // 0 means all hardware threads
+        size_t thread_count = 0;
+    };
+
+    struct icp_stats
+    {
+        size_t iterations = 0;
+        size_t correspondence_count = 0;
+        // root mean squared point (or plane) distance of the last iteration's correspondences
+        double rms_error = 0;
+        bool converged = false;
+        double seconds = 0;
+    };
+
+    // Iterative closest point registration against a fixed target cloud. The target's kd_tree is
+    // built once, so many scans can be aligned against it. Each iteration finds the nearest
+    // target point of every (sampled) source point in parallel, accumulates the step's normal
+    // equations in fixed-width lanes, and composes the solved rigid step onto the transform.
+    class icp_registration
+    {
+    public:
+        // coords and normals are packed as x0, y0, z0, x1, ...; without [target_normals] they are
+        // estimated here (see estimate_normals), so align() never writes and may run concurrently
+        icp_registration(const float* target_coords, size_t target_count, const float* target_normals = nullptr,
+                         size_t thread_count = 0);
+
+        // the rigid transform taking [source_coords] onto the target, starting from [initial]
+        matrix<4, 4, double> align(const float* source_coords, size_t source_count,
+                                   const icp_options& options = icp_options(),
+                                   const matrix<4, 4, double>& initial = make_identity_matrix<4, double>(),
+                                   icp_stats* out_stats = nullptr) const;
+
+        size_t size() const { return _tree.size(); }
+        const kd_tree& tree() const { return _tree; }
+
+    private:
+        std::vector<float> _coords;
+        std::vector<float> _normals;
+        kd_tree _tree;
+    };
+
+    //////////////////////////////////////////////////////////////////////////////////////////////////
+    // icp_registration implementation
+    //////////////////////////////////////////////////////////////////////////////////////////////////
+
+    namespace icp_detail
+    {
+        const size_t lanes = 8;
+        // point-to-point: sum p (3), sum q (3), sum q p^T (9), sum |q - p|^2 (1)
+        // point-to-plane: upper A^T A (21), A^T r (6), sum r^2 (1), with a = (p x n, n), r = (q - p) . n
+        const size_t term_count = 28;
+
+        // per-thread sums, each term spread over [lanes] partial sums the compiler keeps in SIMD
+        // registers
+        struct accumulator
+        {
+            double terms[term_count][lanes];
+            size_t count;
+
+            accumulator() : count(0)
+            {
+                for (size_t t = 0; t < term_count; ++t) {
+                    for (size_t l = 0; l < lanes; ++l) terms[t][l] = 0;
+                }
+            }
+
+            double total(size_t t) const
+            {
+                double sum = 0;
+                for (size_t l = 0; l < lanes; ++l) sum += terms[t][l];
+                return sum;
+            }
+        };
+
+        // one lane-wide batch of correspondences, centred; unused lanes are all zero
+        struct batch
+        {
+            float p[3][lanes];
+            float q[3][lanes];
+            float n[3][lanes];
+
+            void clear()
+            {
+                for (size_t d = 0; d < 3; ++d) {
+                    for (size_t l = 0; l < lanes; ++l) p[d][l] = q[d][l] = n[d][l] = 0;
+                }
+            }
+        };
+
+        inline void accumulate_point_to_point(const batch& b, accumulator& acc)
+        {
+            for (size_t l = 0; l < lanes; ++l) {
+                double p0 = b.p[0][l], p1 = b.p[1][l], p2 = b.p[2][l];
+                double q0 = b.q[0][l], q1 = b.q[1][l], q2 = b.q[2][l];
+                acc.terms[0][l] += p0; acc.terms[1][l] += p1; acc.terms[2][l] += p2;
+                acc.terms[3][l] += q0; acc.terms[4][l] += q1; acc.terms[5][l] += q2;
+                acc.terms[6][l] += q0 * p0; acc.terms[7][l] += q0 * p1; acc.terms[8][l] += q0 * p2;
+                acc.terms[9][l] += q1 * p0; acc.terms[10][l] += q1 * p1; acc.terms[11][l] += q1 * p2;
+                acc.terms[12][l] += q2 * p0; acc.terms[13][l] += q2 * p1; acc.terms[14][l] += q2 * p2;
+                double d0 = q0 - p0, d1 = q1 - p1, d2 = q2 - p2;
+                acc.terms[15][l] += d0 * d0 + d1 * d1 + d2 * d2;
+            }
+        }
+
+        inline void accumulate_point_to_plane(const batch& b, accumulator& acc)
+        {
+            for (size_t l = 0; l < lanes; ++l) {
+                double p0 = b.p[0][l], p1 = b.p[1][l], p2 = b.p[2][l];
+                double n0 = b.n[0][l], n1 = b.n[1][l], n2 = b.n[2][l];
+                double a[6] = { p1 * n2 - p2 * n1, p2 * n0 - p0 * n2, p0 * n1 - p1 * n0, n0, n1, n2 };
+                double r = (b.q[0][l] - p0) * n0 + (b.q[1][l] - p1) * n1 + (b.q[2][l] - p2) * n2;
+                size_t t = 0;
+                for (size_t i = 0; i < 6; ++i) {
+                    for (size_t j = i; j < 6; ++j) acc.terms[t++][l] += a[i] * a[j];
+                }
+                for (size_t i = 0; i < 6; ++i) acc.terms[21 + i][l] += a[i] * r;
+                acc.terms[27][l] += r * r;
+            }
+        }
+
+        // rotation by the angle |w| about w, row-major
+        inline void rotation_from_vector(const double* w, double* out)
+        {
+            double angle = std::sqrt(w[0] * w[0] + w[1] * w[1] + w[2] * w[2]);
+            double c = std::cos(angle), s, k;
+            if (angle > 1e-12) {
+                s = std::sin(angle) / angle;
+                k = (1 - c) / (angle * angle);
+            }
+            else {
+                s = 1;
+                k = 0.5;
+            }
+            out[0] = c + k * w[0] * w[0];        out[1] = k * w[0] * w[1] - s * w[2]; out[2] = k * w[0] * w[2] + s * w[1];
+            out[3] = k * w[0] * w[1] + s * w[2]; out[4] = c + k * w[1] * w[1];        out[5] = k * w[1] * w[2] - s * w[0];
+            out[6] = k * w[0] * w[2] - s * w[1]; out[7] = k * w[1] * w[2] + s * w[0]; out[8] = c + k * w[2] * w[2];
+        }
+    }
+
+    inline icp_registration::icp_registration(const float* target_coords, size_t target_count,
+                                              const float* target_normals, size_t thread_count)
+        : _coords(target_coords, target_coords + target_count * 3)
+    {
+        _tree.build(_coords.data(), target_count, thread_count);
+        if (target_normals != nullptr) {
+            _normals.assign(target_normals, target_normals + target_count * 3);
+        }
+        else if (!_tree.empty()) {
+            normal_estimation_options normal_options;
+            normal_options.thread_count = thread_count;
+            _normals.resize(_coords.size());
+            estimate_normals(_tree, _coords.data(), _normals.data(), normal_options);
+        }
+    }
+
+    inline matrix<4, 4, double> icp_registration::align(const float* source_coords, size_t source_count,
+                                                        const icp_options& options, const matrix<4, 4, double>& initial,
+                                                        icp_stats* out_stats) const
+    {
+        using namespace icp_detail;
+        auto start = std::chrono::steady_clock::now();
+        icp_stats stats;
+        packed_matrix4<double> current(initial);
+        bool to_plane = options.metric == icp_metric::point_to_plane;
+
+        size_t stride = 1;
+        if (options.max_samples > 0 && source_count > options.max_samples) {
+            stride = (source_count + options.max_samples - 1) / options.max_samples;
+        }
+        size_t sample_count = (source_count + stride - 1) / stride;
+        float max_d2 = options.max_correspondence_distance > 0
+                           ? options.max_correspondence_distance * options.max_correspondence_distance
+                           : std::numeric_limits<float>::max();
+
+        // sums are taken about the transformed source centroid so large coordinates do not cancel
+        double centre[3] = { 0, 0, 0 };
+        for (size_t s = 0; s < sample_count; ++s) {
+            for (size_t d = 0; d < 3; ++d) centre[d] += source_coords[s * stride * 3 + d];
+        }
+        for (size_t d = 0; d < 3; ++d) centre[d] /= sample_count > 0 ? double(sample_count) : 1.0;
+        current.transform_point(centre, centre);
+
+        size_t worker_count = resolve_thread_count(sample_count, options.thread_count, 4096);
+        std::vector<accumulator> accumulators(worker_count);
+        double previous_mse = std::numeric_limits<double>::max();
+
+        while (stats.iterations < options.max_iterations && !_tree.empty() && sample_count > 0) {
+            ++stats.iterations;
+            for (accumulator& acc : accumulators) acc = accumulator();
+
+            // correspondences in parallel, one accumulator per thread keeps the sums deterministic
+            parallel_partition(0, sample_count, [&](size_t thread_idx, size_t first, size_t last) {
+                accumulator& acc = accumulators[thread_idx];
+                batch b;
+                b.clear();
+                size_t filled = 0;
+                for (size_t s = first; s < last; ++s) {
+                    const float* src = source_coords + s * stride * 3;
+                    double in[3] = { src[0], src[1], src[2] }, moved[3];
+                    current.transform_point(in, moved);
+                    float query[3] = { float(moved[0]), float(moved[1]), float(moved[2]) };
+                    float d2;
+                    kd_tree::index_type nearest = _tree.nearest(query, &d2);
+                    if (d2 > max_d2) continue;
+
+                    const float* target = _coords.data() + size_t(nearest) * 3;
+                    for (size_t d = 0; d < 3; ++d) {
+                        b.p[d][filled] = float(moved[d] - centre[d]);
+                        b.q[d][filled] = float(target[d] - centre[d]);
+                        b.n[d][filled] = to_plane ? _normals[size_t(nearest) * 3 + d] : 0.0f;
+                    }
+                    ++acc.count;
+                    if (++filled == lanes) {
+                        to_plane ? accumulate_point_to_plane(b, acc) : accumulate_point_to_point(b, acc);
+                        b.clear();
+                        filled = 0;
+                    }
+                }
+                if (filled > 0) to_plane ? accumulate_point_to_plane(b, acc) : accumulate_point_to_point(b, acc);
+            }, options.thread_count, 4096);
+
+            double totals[term_count] = {};
+            size_t count = 0;
+            for (const accumulator& acc : accumulators) {
+                for (size_t t = 0; t < term_count; ++t) totals[t] += acc.total(t);
+                count += acc.count;
+            }
+            stats.correspondence_count = count;
+            if (count < (to_plane ? 6u : 3u)) break;
+
+            double mse = totals[to_plane ? 27 : 15] / double(count);
+            stats.rms_error = std::sqrt(mse);
+
+            // the step in centred coordinates, x -> r x + t
+            double r[9], t[3];
+            if (to_plane) {
+                symmetric_matrix<6, double> ata;
+                b_vector<6, double> atr;
+                size_t k = 0;
+                for (size_t i = 0; i < 6; ++i) {
+                    for (size_t j = i; j < 6; ++j) ata.set_cell(i, j, totals[k++]);
+                    atr[i] = totals[21 + i];
+                }
+                b_vector<6, double> x = ata.solve(atr);
+                bool finite = true;
+                for (size_t i = 0; i < 6; ++i) finite = finite && std::isfinite(x[i]);
+                // degenerate geometry (a plane, a cylinder) leaves the step undetermined
+                if (!finite) break;
+                double w[3] = { x[0], x[1], x[2] };
+                rotation_from_vector(w, r);
+                t[0] = x[3]; t[1] = x[4]; t[2] = x[5];
+            }
+            else {
+                double inv = 1.0 / double(count);
+                double mean_p[3] = { totals[0] * inv, totals[1] * inv, totals[2] * inv };
+                double mean_q[3] = { totals[3] * inv, totals[4] * inv, totals[5] * inv };
+                matrix<3, 3, double> h;
+                for (size_t i = 0; i < 3; ++i) {
+                    for (size_t j = 0; j < 3; ++j) h[i][j] = totals[6 + i * 3 + j] - double(count) * mean_q[i] * mean_p[j];
+                }
+                matrix<3, 3, double> rotation = nearest_rotation(h);
+                for (size_t i = 0; i < 3; ++i) {
+                    for (size_t j = 0; j < 3; ++j) r[i * 3 + j] = rotation[i][j];
+                    t[i] = mean_q[i] - (rotation[i][0] * mean_p[0] + rotation[i][1] * mean_p[1] + rotation[i][2] * mean_p[2]);
+                }
+            }
+
+            // back to world coordinates, x -> r (x - c) + t + c, composed onto the transform
+            packed_matrix4<double> step;
+            for (size_t i = 0; i < 3; ++i) {
+                for (size_t j = 0; j < 3; ++j) step(i, j) = r[i * 3 + j];
+                step(i, 3) = t[i] + centre[i] - (r[i * 3] * centre[0] + r[i * 3 + 1] * centre[1] + r[i * 3 + 2] * centre[2]);
+            }
+            current = step * current;
+
+            if (mse == 0 || previous_mse - mse <= options.relative_tolerance * previous_mse) {
+                stats.converged = true;
+                break;
+            }
+            previous_mse = mse;
+        }
+
+        stats.seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+        if (out_stats != nullptr) *out_stats = stats;
+        return current.to_matrix();
+    }
+}
+
+#endif // BCG_ICP_HPP
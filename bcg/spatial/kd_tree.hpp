@@ -0,0 +1,391 @@
+#ifndef BCG_KD_TREE_HPP
+#define BCG_KD_TREE_HPP
+
+#include "transforms/point.hpp"
+#include "utils/parallel.hpp"
+
+#include <algorithm>
+#include <cstdint>
+#include <limits>
+#include <vector>
+
+namespace bcg
+{
+    //////////////////////////////////////////////////////////////////////////////////////////////////
+    // kd_tree
+    //////////////////////////////////////////////////////////////////////////////////////////////////
+
+    // Balanced 3d tree with an implicit layout: the node of a slot range [lo, hi) is the slot in the
+    // middle, its left subtree is [lo, mid) and its right subtree is [mid + 1, hi). Ranges that hold
+    // no more than leaf_size points are buckets and are scanned linearly. Coordinates are stored
+    // interleaved (x, y, z) in tree order, so no child pointers are needed at all.
+    class kd_tree
+    {
+    public:
+        typedef std::uint32_t index_type;
+
+        // an enumerator rather than a static member, so binding it to a reference needs no definition
+        enum : index_type { invalid_index = std::numeric_limits<index_type>::max() };
+        static const size_t default_leaf_size = 8;
+
+    public:
+        kd_tree() = default;
+        explicit kd_tree(const std::vector<point>& points, size_t thread_count = 0,
+                         size_t leaf_size = default_leaf_size);
+        // coords are packed as x0, y0, z0, x1, y1, z1, ...
+        kd_tree(const float* coords, size_t point_count, size_t thread_count = 0,
+                size_t leaf_size = default_leaf_size);
+        ~kd_tree() = default;
+
+    public:
+        void build(const std::vector<point>& points, size_t thread_count = 0, size_t leaf_size = default_leaf_size);
+        void build(const float* coords, size_t point_count, size_t thread_count = 0,
+                   size_t leaf_size = default_leaf_size);
+
+        // k nearest neighbours sorted by distance, returns how many were found (min(k, size()));
+        // out_indices and out_dist2 must hold k entries, unused entries are set to invalid_index
+        size_t knn(const float* query, size_t k, index_type* out_indices, float* out_dist2) const;
+        size_t knn(const point& query, size_t k, index_type* out_indices, float* out_dist2) const;
+
+        // nearest neighbour, invalid_index for an empty tree
+        index_type nearest(const float* query, float* out_dist2 = nullptr) const;
+
+        // all points within radius (inclusive), appended to out_indices in no particular order
+        void radius(const float* query, float r, std::vector<index_type>& out_indices) const;
+        void radius(const point& query, float r, std::vector<index_type>& out_indices) const;
+
+        // batched queries, the query set is split across threads (0 means all hardware threads);
+        // knn results are stored row by row, k entries per query
+        void knn_batch(const std::vector<point>& queries, size_t k,
+                       std::vector<index_type>& out_indices, std::vector<float>& out_dist2,
+                       size_t thread_count = 0) const;
+        void knn_batch(const float* queries, size_t query_count, size_t k,
+                       index_type* out_indices, float* out_dist2, size_t thread_count = 0) const;
+        void radius_batch(const std::vector<point>& queries, float r,
+                          std::vector<std::vector<index_type>>& out_indices, size_t thread_count = 0) const;
+
+    public:
+        size_t size() const;
+        size_t leaf_size() const;
+        bool empty() const;
+
+        // raw access in tree order, slot in [0, size())
+        const float* coords_of_slot(size_t slot) const;
+        index_type index_of_slot(size_t slot) const;
+
+    private:
+        struct search_frame
+        {
+            index_type lo;
+            index_type hi;
+            float bound; // lower bound of the squared distance to this range
+        };
+
+        static const size_t max_stack_depth = 96;
+
+        void build_range(index_type lo, index_type hi, const float* src, size_t spawn_depth);
+
+        template<typename visitor_type>
+        void search(const float* query, visitor_type& visitor) const;
+
+        static float dist2(const float* a, const float* b);
+
+    private:
+        size_t _leaf_size = default_leaf_size;
+        std::vector<float> _coords;          // 3 floats per slot, tree order
+        std::vector<index_type> _indices;    // original point index per slot
+        std::vector<std::uint8_t> _split_dims; // split axis, valid for node slots only
+    };
+
+    //////////////////////////////////////////////////////////////////////////////////////////////////
+    // kd_tree implementation
+    //////////////////////////////////////////////////////////////////////////////////////////////////
+
+    inline kd_tree::kd_tree(const std::vector<point>& points, size_t thread_count, size_t leaf_size)
+    {
+        build(points, thread_count, leaf_size);
+    }
+
+    inline kd_tree::kd_tree(const float* coords, size_t point_count, size_t thread_count, size_t leaf_size)
+    {
+        build(coords, point_count, thread_count, leaf_size);
+    }
+
+    inline void kd_tree::build(const std::vector<point>& points, size_t thread_count, size_t leaf_size)
+    {
+        std::vector<float> packed(points.size() * 3);
+        parallel_for(0, points.size(), [&](size_t first, size_t last) {
+            for (size_t i = first; i < last; ++i) {
+                const b_vector<4, float>& p = points[i].data();
+                packed[i * 3 + 0] = p[0];
+                packed[i * 3 + 1] = p[1];
+                packed[i * 3 + 2] = p[2];
+            }
+        }, thread_count, 1 << 15);
+        build(packed.data(), points.size(), thread_count, leaf_size);
+    }
+
+    inline void kd_tree::build(const float* coords, size_t point_count, size_t thread_count, size_t leaf_size)
+    {
+        _leaf_size = std::max<size_t>(1, leaf_size);
+        _indices.resize(point_count);
+        _split_dims.assign(point_count, 0);
+        for (size_t i = 0; i < point_count; ++i) {
+            _indices[i] = static_cast<index_type>(i);
+        }
+
+        // each level of the first spawn_depth levels forks its right half onto a new thread
+        size_t workers = resolve_thread_count(point_count, thread_count, 1 << 14);
+        size_t spawn_depth = 0;
+        while ((size_t(1) << spawn_depth) < workers) ++spawn_depth;
+
+        build_range(0, static_cast<index_type>(point_count), coords, spawn_depth);
+
+        // gather the coordinates in tree order
+        _coords.resize(point_count * 3);
+        parallel_for(0, point_count, [&](size_t first, size_t last) {
+            for (size_t slot = first; slot < last; ++slot) {
+                const float* p = coords + size_t(_indices[slot]) * 3;
+                _coords[slot * 3 + 0] = p[0];
+                _coords[slot * 3 + 1] = p[1];
+                _coords[slot * 3 + 2] = p[2];
+            }
+        }, thread_count, 1 << 15);
+    }
+
+    inline void kd_tree::build_range(index_type lo, index_type hi, const float* src, size_t spawn_depth)
+    {
+        if (hi - lo <= _leaf_size) return;
+
+        // split along the axis of largest extent
+        float lower[3], upper[3];
+        for (size_t d = 0; d < 3; ++d) {
+            lower[d] = upper[d] = src[size_t(_indices[lo]) * 3 + d];
+        }
+        for (index_type i = lo + 1; i < hi; ++i) {
+            const float* p = src + size_t(_indices[i]) * 3;
+            for (size_t d = 0; d < 3; ++d) {
+                lower[d] = std::min(lower[d], p[d]);
+                upper[d] = std::max(upper[d], p[d]);
+            }
+        }
+        std::uint8_t dim = 0;
+        for (std::uint8_t d = 1; d < 3; ++d) {
+            if (upper[d] - lower[d] > upper[dim] - lower[dim]) dim = d;
+        }
+
+        index_type mid = lo + (hi - lo) / 2;
+        std::nth_element(_indices.begin() + lo, _indices.begin() + mid, _indices.begin() + hi,
+            [src, dim](index_type a, index_type b) {
+                return src[size_t(a) * 3 + dim] < src[size_t(b) * 3 + dim];
+            });
+        _split_dims[mid] = dim;
+
+        parallel_invoke(
+            [&]() { build_range(mid + 1, hi, src, spawn_depth > 0 ? spawn_depth - 1 : 0); },
+            [&]() { build_range(lo, mid, src, spawn_depth > 0 ? spawn_depth - 1 : 0); },
+            spawn_depth > 0);
+    }
+
+    inline float kd_tree::dist2(const float* a, const float* b)
+    {
+        float dx = a[0] - b[0];
+        float dy = a[1] - b[1];
+        float dz = a[2] - b[2];
+        return dx * dx + dy * dy + dz * dz;
+    }
+
+    // visitor_type provides: float bound() const; void visit(index_type slot, float d2);
+    template<typename visitor_type>
+    void kd_tree::search(const float* query, visitor_type& visitor) const
+    {
+        if (_indices.empty()) return;
+
+        search_frame stack[max_stack_depth];
+        size_t top = 0;
+        stack[top++] = { 0, static_cast<index_type>(_indices.size()), 0.0f };
+
+        while (top > 0) {
+            search_frame frame = stack[--top];
+            if (frame.bound > visitor.bound()) continue;
+
+            index_type lo = frame.lo;
+            index_type hi = frame.hi;
+            while (hi - lo > _leaf_size) {
+                index_type mid = lo + (hi - lo) / 2;
+                const float* node = &_coords[size_t(mid) * 3];
+                visitor.visit(mid, dist2(query, node));
+
+                float diff = query[_split_dims[mid]] - node[_split_dims[mid]];
+                float plane_d2 = diff * diff;
+                if (diff < 0) {
+                    if (plane_d2 <= visitor.bound()) stack[top++] = { mid + 1, hi, plane_d2 };
+                    hi = mid;
+                }
+                else {
+                    if (plane_d2 <= visitor.bound()) stack[top++] = { lo, mid, plane_d2 };
+                    lo = mid + 1;
+                }
+            }
+            for (index_type slot = lo; slot < hi; ++slot) {
+                visitor.visit(slot, dist2(query, &_coords[size_t(slot) * 3]));
+            }
+        }
+    }
+
+    namespace kd_tree_detail
+    {
+        // bounded, sorted candidate list for knn queries
+        struct knn_visitor
+        {
+            size_t k;
+            size_t count;
+            kd_tree::index_type* slots;
+            float* dist2s;
+
+            float bound() const
+            {
+                return count < k ? std::numeric_limits<float>::max() : dist2s[k - 1];
+            }
+
+            void visit(kd_tree::index_type slot, float d2)
+            {
+                if (count == k && d2 >= dist2s[k - 1]) return;
+                size_t pos = (count < k) ? count++ : k - 1;
+                while (pos > 0 && dist2s[pos - 1] > d2) {
+                    dist2s[pos] = dist2s[pos - 1];
+                    slots[pos] = slots[pos - 1];
+                    --pos;
+                }
+                dist2s[pos] = d2;
+                slots[pos] = slot;
+            }
+        };
+
+        struct radius_visitor
+        {
+            float r2;
+            std::vector<kd_tree::index_type>* slots;
+
+            float bound() const { return r2; }
+
+            void visit(kd_tree::index_type slot, float d2)
+            {
+                if (d2 <= r2) slots->push_back(slot);
+            }
+        };
+    }
+
+    inline size_t kd_tree::knn(const float* query, size_t k, index_type* out_indices, float* out_dist2) const
+    {
+        if (k == 0) return 0;
+
+        kd_tree_detail::knn_visitor visitor = { k, 0, out_indices, out_dist2 };
+        search(query, visitor);
+
+        for (size_t i = 0; i < visitor.count; ++i) {
+            out_indices[i] = _indices[out_indices[i]];
+        }
+        for (size_t i = visitor.count; i < k; ++i) {
+            out_indices[i] = invalid_index;
+            out_dist2[i] = std::numeric_limits<float>::max();
+        }
+        return visitor.count;
+    }
+
+    inline size_t kd_tree::knn(const point& query, size_t k, index_type* out_indices, float* out_dist2) const
+    {
+        const b_vector<4, float>& q = query.data();
+        float coords[3] = { q[0], q[1], q[2] };
+        return knn(coords, k, out_indices, out_dist2);
+    }
+
+    inline kd_tree::index_type kd_tree::nearest(const float* query, float* out_dist2) const
+    {
+        index_type idx = invalid_index;
+        float d2 = std::numeric_limits<float>::max();
+        knn(query, 1, &idx, &d2);
+        if (out_dist2 != nullptr) *out_dist2 = d2;
+        return idx;
+    }
+
+    inline void kd_tree::radius(const float* query, float r, std::vector<index_type>& out_indices) const
+    {
+        size_t first_new = out_indices.size();
+        kd_tree_detail::radius_visitor visitor = { r * r, &out_indices };
+        search(query, visitor);
+        for (size_t i = first_new; i < out_indices.size(); ++i) {
+            out_indices[i] = _indices[out_indices[i]];
+        }
+    }
+
+    inline void kd_tree::radius(const point& query, float r, std::vector<index_type>& out_indices) const
+    {
+        const b_vector<4, float>& q = query.data();
+        float coords[3] = { q[0], q[1], q[2] };
+        radius(coords, r, out_indices);
+    }
+
+    inline void kd_tree::knn_batch(const std::vector<point>& queries, size_t k,
+                                   std::vector<index_type>& out_indices, std::vector<float>& out_dist2,
+                                   size_t thread_count) const
+    {
+        out_indices.resize(queries.size() * k);
+        out_dist2.resize(queries.size() * k);
+        parallel_for(0, queries.size(), [&](size_t first, size_t last) {
+            for (size_t q = first; q < last; ++q) {
+                knn(queries[q], k, &out_indices[q * k], &out_dist2[q * k]);
+            }
+        }, thread_count, 256);
+    }
+
+    inline void kd_tree::knn_batch(const float* queries, size_t query_count, size_t k,
+                                   index_type* out_indices, float* out_dist2, size_t thread_count) const
+    {
+        parallel_for(0, query_count, [&](size_t first, size_t last) {
+            for (size_t q = first; q < last; ++q) {
+                knn(queries + q * 3, k, out_indices + q * k, out_dist2 + q * k);
+            }
+        }, thread_count, 256);
+    }
+
+    inline void kd_tree::radius_batch(const std::vector<point>& queries, float r,
+                                      std::vector<std::vector<index_type>>& out_indices,
+                                      size_t thread_count) const
+    {
+        out_indices.resize(queries.size());
+        parallel_for(0, queries.size(), [&](size_t first, size_t last) {
+            for (size_t q = first; q < last; ++q) {
+                out_indices[q].clear();
+                radius(queries[q], r, out_indices[q]);
+            }
+        }, thread_count, 256);
+    }
+
+    inline size_t kd_tree::size() const
+    {
+        return _indices.size();
+    }
+
+    inline size_t kd_tree::leaf_size() const
+    {
+        return _leaf_size;
+    }
+
+    inline bool kd_tree::empty() const
+    {
+        return _indices.empty();
+    }
+
+    inline const float* kd_tree::coords_of_slot(size_t slot) const
+    {
+        return &_coords[slot * 3];
+    }
+
+    inline kd_tree::index_type kd_tree::index_of_slot(size_t slot) const
+    {
+        return _indices[slot];
+    }
+}
+
+#endif // BCG_KD_TREE_HPP
@@ -0,0 +1,610 @@
+#ifndef BCG_LOD_OCTREE_HPP
+#define BCG_LOD_OCTREE_HPP
+
+#include "io/io_status.hpp"
+#include "spatial/aabb.hpp"
+#include "transforms/matrix/matrix.hpp"
+#include "transforms/matrix/packed_matrix.hpp"
+#include "transforms/point.hpp"
+
+#include <algorithm>
+#include <cmath>
+#include <cstdint>
+#include <cstdio>
+#include <fstream>
+#include <limits>
+#include <queue>
+#include <string>
+#include <utility>
+#include <vector>
+
+namespace bcg
+{
+    //////////////////////////////////////////////////////////////////////////////////////////////////
+    // lod_octree_options
+    //////////////////////////////////////////////////////////////////////////////////////////////////
+
+    struct lod_octree_options
+    {
+        // overflow points a leaf may hold before it is split
+        size_t leaf_capacity = 32768;
+        // sample cells per axis of every node, a node keeps at most one sample per cell
+        size_t sample_grid = 64;
+        // payload points kept in memory while building, the largest payloads are spilled beyond this;
+        // the occupancy bits of the sample grids count as the points of the same size and are
+        // dropped least recently used first, to be rebuilt from the node's samples
+        size_t max_resident_points = size_t(1) << 22;
+        size_t max_depth = 20;
+        // path prefix of spill files, empty keeps every payload in memory (no memory bound)
+        std::string spill_prefix;
+    };
+
+    //////////////////////////////////////////////////////////////////////////////////////////////////
+    // lod_octree
+    //////////////////////////////////////////////////////////////////////////////////////////////////
+
+    // Additive level-of-detail octree. A point is stored exactly once: at the shallowest node whose
+    // sample cell for it is still free, or in the overflow of the leaf it falls into. Inner nodes
+    // hold a subsample with a spacing of (node extent / sample_grid), so the union of the nodes
+    // picked by select() is a cloud whose density follows the view.
+    //
+    // Points are streamed in with insert(); payloads beyond max_resident_points are appended to spill
+    // files and read back only when a leaf splits or a node is loaded. A failed spill or read is
+    // returned and kept in status(); the build then keeps everything in memory and stops splitting,
+    // so no point is lost.
+    class lod_octree
+    {
+    public:
+        typedef std::uint32_t index_type;
+
+        enum : index_type { invalid_index = std::numeric_limits<index_type>::max() };
+
+        struct node
+        {
+            aabb box;
+            index_type children[8];
+            index_type parent;
+            std::uint32_t depth;
+            float spacing;             // minimum distance between the samples of this node
+            std::uint64_t point_count; // points stored in this node
+            bool is_split;
+
+            bool is_leaf() const { return !is_split; }
+        };
+
+    public:
+        // points outside [bounds] are clamped into the border cells of the root
+        explicit lod_octree(const aabb& bounds, const lod_octree_options& options = lod_octree_options());
+        lod_octree(const lod_octree&) = delete;
+        lod_octree& operator =(const lod_octree&) = delete;
+        ~lod_octree();
+
+    public:
+        // coords are packed as x0, y0, z0, x1, y1, z1, ...; returns status()
+        io_status insert(const float* coords, size_t count);
+        io_status insert(const std::vector<point>& points);
+
+        // drops the build-time sample grids, no more points can be inserted afterwards
+        void finalize();
+
+        // appends the points stored in a node to out_coords (3 floats per point), nothing of a
+        // spill file that can't be read in full
+        io_status load_points(index_type node_idx, std::vector<float>& out_coords) const;
+
+        // Nodes to draw for a view, coarse to fine. A node is refined while its sample spacing
+        // projects to more than max_screen_error pixels; selection stops before point_budget is
+        // exceeded. view_projection maps to OpenGL-style clip space (-w <= x, y, z <= w).
+        void select(const matrix<4, 4, float>& view_projection, float viewport_height, float max_screen_error,
+                    std::uint64_t point_budget, std::vector<index_type>& out_nodes) const;
+
+        // projected sample spacing of a node in pixels, or a negative value when the node is culled
+        float screen_error(index_type node_idx, const matrix<4, 4, float>& view_projection,
+                           float viewport_height) const;
+
+    public:
+        size_t node_count() const;
+        const node& get_node(index_type node_idx) const;
+        std::uint64_t point_count() const;
+        bool is_finalized() const;
+        // first spill or read failure of the build
+        io_status status() const;
+
+        size_t resident_point_count() const;
+        size_t peak_resident_point_count() const;
+        size_t spilled_point_count() const;
+        // sample grids with their occupancy bits in memory
+        size_t resident_grid_count() const;
+        // payload points plus occupancy bits, at their largest during the build
+        size_t peak_resident_bytes() const;
+
+    private:
+        // points of one node, partly in memory and partly appended to a spill file
+        struct payload
+        {
+            std::vector<float> resident;
+            std::uint64_t spilled_count = 0;
+            std::string path;
+        };
+
+        struct node_data
+        {
+            payload samples;
+            payload overflow;
+            // one bit per sample cell, empty while dropped (or before the node is first visited)
+            std::vector<std::uint64_t> occupied_cells;
+            std::uint64_t last_use = 0;
+        };
+
+        index_type make_node(const aabb& box, index_type parent, std::uint32_t depth, float spacing);
+        index_type child_of(index_type node_idx, const float* p);
+        std::uint32_t cell_of(index_type node_idx, const float* p) const;
+        void insert_from(index_type node_idx, const float* p);
+        void split(index_type node_idx);
+        // makes the occupancy bits of a node resident, rebuilding them from its samples
+        void load_grid(index_type node_idx);
+
+        void append(payload& pl, const float* p);
+        io_status read_payload(const payload& pl, std::vector<float>& out_coords) const;
+        void spill(payload& pl);
+        void discard(payload& pl);
+        void fail(io_status status);
+        size_t resident_units() const;
+        void track_peaks();
+        void enforce_budget();
+
+        float projected_error(index_type node_idx, const packed_matrix4<float>& vp, float pixel_scale) const;
+
+    private:
+        lod_octree_options _options;
+        std::vector<node> _nodes;
+        std::vector<node_data> _data;
+        std::uint64_t _point_count = 0;
+        size_t _resident_count = 0;
+        size_t _peak_resident_count = 0;
+        size_t _spilled_count = 0;
+        // words of one sample grid, and the payload points it counts as in the budget
+        size_t _grid_words = 0;
+        size_t _grid_units = 0;
+        size_t _grid_count = 0;
+        size_t _peak_resident_bytes = 0;
+        std::uint64_t _use_clock = 0;
+        io_status _status = io_status::ok;
+        bool _is_finalized = false;
+    };
+
+    //////////////////////////////////////////////////////////////////////////////////////////////////
+    // lod_octree implementation
+    //////////////////////////////////////////////////////////////////////////////////////////////////
+
+    inline lod_octree::lod_octree(const aabb& bounds, const lod_octree_options& options)
+        : _options(options)
+    {
+        _options.sample_grid = std::max<size_t>(1, std::min<size_t>(_options.sample_grid, 1024));
+        _options.leaf_capacity = std::max<size_t>(1, _options.leaf_capacity);
+        size_t cells = _options.sample_grid * _options.sample_grid * _options.sample_grid;
+        _grid_words = (cells + 63) / 64;
+        _grid_units = (_grid_words * sizeof(std::uint64_t) + 3 * sizeof(float) - 1) / (3 * sizeof(float));
+
+        // cubify the bounds so every cell is a cube
+        float size = 0;
+        for (size_t d = 0; d < 3; ++d) {
+            size = std::max(size, bounds.extent(d));
+        }
+        size = size > 0 ? size * 1.0001f : 1.0f;
+        aabb cube;
+        for (size_t d = 0; d < 3; ++d) {
+            float c = bounds.is_empty() ? 0.0f : bounds.center(d);
+            cube.lower[d] = c - size / 2;
+            cube.upper[d] = c + size / 2;
+        }
+        make_node(cube, invalid_index, 0, size / _options.sample_grid);
+    }
+
+    inline lod_octree::~lod_octree()
+    {
+        for (auto& data : _data) {
+            if (data.samples.spilled_count > 0) std::remove(data.samples.path.c_str());
+            if (data.overflow.spilled_count > 0) std::remove(data.overflow.path.c_str());
+        }
+    }
+
+    inline lod_octree::index_type lod_octree::make_node(const aabb& box, index_type parent, std::uint32_t depth,
+                                                        float spacing)
+    {
+        index_type idx = static_cast<index_type>(_nodes.size());
+        node nd;
+        nd.box = box;
+        std::fill(nd.children, nd.children + 8, invalid_index);
+        nd.parent = parent;
+        nd.depth = depth;
+        nd.spacing = spacing;
+        nd.point_count = 0;
+        nd.is_split = false;
+        _nodes.push_back(nd);
+
+        _data.push_back(node_data());
+        if (!_options.spill_prefix.empty()) {
+            std::string base = _options.spill_prefix + "_n" + std::to_string(idx);
+            _data.back().samples.path = base + "_s.bin";
+            _data.back().overflow.path = base + "_o.bin";
+        }
+        return idx;
+    }
+
+    inline lod_octree::index_type lod_octree::child_of(index_type node_idx, const float* p)
+    {
+        size_t octant = 0;
+        for (size_t d = 0; d < 3; ++d) {
+            if (p[d] >= _nodes[node_idx].box.center(d)) octant |= (size_t(1) << d);
+        }
+        if (_nodes[node_idx].children[octant] == invalid_index) {
+            const node& parent = _nodes[node_idx];
+            aabb box;
+            for (size_t d = 0; d < 3; ++d) {
+                bool upper_half = (octant >> d) & 1;
+                box.lower[d] = upper_half ? parent.box.center(d) : parent.box.lower[d];
+                box.upper[d] = upper_half ? parent.box.upper[d] : parent.box.center(d);
+            }
+            index_type child = make_node(box, node_idx, parent.depth + 1, parent.spacing / 2);
+            _nodes[node_idx].children[octant] = child; // make_node may have moved _nodes
+        }
+        return _nodes[node_idx].children[octant];
+    }
+
+    inline io_status lod_octree::insert(const float* coords, size_t count)
+    {
+        if (_is_finalized) return _status;
+        for (size_t i = 0; i < count; ++i) {
+            insert_from(0, coords + i * 3);
+            ++_point_count;
+            if (resident_units() > _options.max_resident_points) enforce_budget();
+        }
+        return _status;
+    }
+
+    inline io_status lod_octree::insert(const std::vector<point>& points)
+    {
+        std::vector<float> coords(points.size() * 3);
+        for (size_t i = 0; i < points.size(); ++i) {
+            const b_vector<4, float>& p = points[i].data();
+            coords[i * 3 + 0] = p[0];
+            coords[i * 3 + 1] = p[1];
+            coords[i * 3 + 2] = p[2];
+        }
+        return insert(coords.data(), points.size());
+    }
+
+    inline std::uint32_t lod_octree::cell_of(index_type node_idx, const float* p) const
+    {
+        const size_t grid = _options.sample_grid;
+        const aabb& box = _nodes[node_idx].box;
+        std::uint32_t cell = 0;
+        for (size_t d = 0; d < 3; ++d) {
+            float rel = (p[d] - box.lower[d]) / (box.upper[d] - box.lower[d]);
+            long c = static_cast<long>(std::floor(rel * grid));
+            c = std::max(0L, std::min(c, static_cast<long>(grid) - 1));
+            cell = cell * static_cast<std::uint32_t>(grid) + static_cast<std::uint32_t>(c);
+        }
+        return cell;
+    }
+
+    inline void lod_octree::insert_from(index_type node_idx, const float* p)
+    {
+        for (;;) {
+            load_grid(node_idx);
+            std::uint32_t cell = cell_of(node_idx, p);
+            std::uint64_t& word = _data[node_idx].occupied_cells[cell / 64];
+            std::uint64_t bit = std::uint64_t(1) << (cell % 64);
+            if (!(word & bit)) {
+                word |= bit;
+                append(_data[node_idx].samples, p);
+                ++_nodes[node_idx].point_count;
+                return;
+            }
+            if (_nodes[node_idx].is_leaf()) {
+                payload& overflow = _data[node_idx].overflow;
+                append(overflow, p);
+                ++_nodes[node_idx].point_count;
+                // after a failure the spill files are left alone, leaves just grow
+                if (overflow.resident.size() / 3 + overflow.spilled_count > _options.leaf_capacity &&
+                    _nodes[node_idx].depth < _options.max_depth && _status == io_status::ok) {
+                    split(node_idx);
+                }
+                return;
+            }
+            node_idx = child_of(node_idx, p);
+        }
+    }
+
+    inline void lod_octree::load_grid(index_type node_idx)
+    {
+        node_data& data = _data[node_idx];
+        data.last_use = ++_use_clock;
+        if (!data.occupied_cells.empty()) return;
+        data.occupied_cells.assign(_grid_words, 0);
+        ++_grid_count;
+        track_peaks();
+
+        std::vector<float> samples;
+        fail(read_payload(data.samples, samples));
+        for (size_t i = 0; i < samples.size(); i += 3) {
+            std::uint32_t cell = cell_of(node_idx, &samples[i]);
+            data.occupied_cells[cell / 64] |= std::uint64_t(1) << (cell % 64);
+        }
+    }
+
+    inline void lod_octree::split(index_type node_idx)
+    {
+        std::vector<float> moved;
+        io_status status = read_payload(_data[node_idx].overflow, moved);
+        if (status != io_status::ok) {
+            // the node stays a leaf holding its overflow
+            fail(status);
+            return;
+        }
+        discard(_data[node_idx].overflow);
+
+        size_t moved_count = moved.size() / 3;
+        _nodes[node_idx].is_split = true;
+        _nodes[node_idx].point_count -= moved_count;
+        for (size_t i = 0; i < moved_count; ++i) {
+            insert_from(child_of(node_idx, &moved[i * 3]), &moved[i * 3]);
+        }
+    }
+
+    inline void lod_octree::append(payload& pl, const float* p)
+    {
+        pl.resident.insert(pl.resident.end(), p, p + 3);
+        ++_resident_count;
+        track_peaks();
+    }
+
+    inline io_status lod_octree::read_payload(const payload& pl, std::vector<float>& out_coords) const
+    {
+        if (pl.spilled_count > 0) {
+            size_t first = out_coords.size();
+            std::ifstream in(pl.path, std::ios::binary);
+            if (!in) return io_status::open_failed;
+            out_coords.resize(first + pl.spilled_count * 3);
+            if (!in.read(reinterpret_cast<char*>(&out_coords[first]),
+                         static_cast<std::streamsize>(pl.spilled_count * 3 * sizeof(float)))) {
+                // a short read would leave zeros behind
+                out_coords.resize(first);
+                return io_status::read_failed;
+            }
+        }
+        out_coords.insert(out_coords.end(), pl.resident.begin(), pl.resident.end());
+        return io_status::ok;
+    }
+
+    inline void lod_octree::spill(payload& pl)
+    {
+        if (pl.resident.empty() || pl.path.empty()) return;
+        std::ofstream out(pl.path, std::ios::binary | std::ios::app);
+        if (!out) {
+            fail(io_status::open_failed);
+            return;
+        }
+        // a partial write only leaves bytes past spilled_count, which are never read
+        out.write(reinterpret_cast<const char*>(pl.resident.data()),
+                  static_cast<std::streamsize>(pl.resident.size() * sizeof(float)));
+        out.close();
+        if (!out) {
+            fail(io_status::write_failed);
+            return;
+        }
+        size_t count = pl.resident.size() / 3;
+        pl.spilled_count += count;
+        _spilled_count += count;
+        _resident_count -= count;
+        std::vector<float>().swap(pl.resident);
+    }
+
+    inline void lod_octree::discard(payload& pl)
+    {
+        if (pl.spilled_count > 0) {
+            std::remove(pl.path.c_str());
+            _spilled_count -= static_cast<size_t>(pl.spilled_count);
+            pl.spilled_count = 0;
+        }
+        _resident_count -= pl.resident.size() / 3;
+        std::vector<float>().swap(pl.resident);
+    }
+
+    inline void lod_octree::fail(io_status status)
+    {
+        if (_status == io_status::ok) _status = status;
+    }
+
+    inline size_t lod_octree::resident_units() const
+    {
+        return _resident_count + _grid_count * _grid_units;
+    }
+
+    inline void lod_octree::track_peaks()
+    {
+        _peak_resident_count = std::max(_peak_resident_count, _resident_count);
+        size_t bytes = _resident_count * 3 * sizeof(float) + _grid_count * _grid_words * sizeof(std::uint64_t);
+        _peak_resident_bytes = std::max(_peak_resident_bytes, bytes);
+    }
+
+    inline void lod_octree::enforce_budget()
+    {
+        if (_options.spill_prefix.empty() || _status != io_status::ok) return;
+
+        // spill the largest resident payloads until half the budget is left
+        std::vector<std::pair<size_t, payload*>> candidates;
+        for (auto& data : _data) {
+            if (!data.samples.resident.empty()) {
+                candidates.push_back(std::make_pair(data.samples.resident.size(), &data.samples));
+            }
+            if (!data.overflow.resident.empty()) {
+                candidates.push_back(std::make_pair(data.overflow.resident.size(), &data.overflow));
+            }
+        }
+        std::sort(candidates.begin(), candidates.end(),
+            [](const std::pair<size_t, payload*>& a, const std::pair<size_t, payload*>& b) {
+                return a.first > b.first;
+            });
+        for (auto& candidate : candidates) {
+            if (resident_units() <= _options.max_resident_points / 2 || _status != io_status::ok) return;
+            spill(*candidate.second);
+        }
+
+        // then the grids, least recently used first; spilled samples make them cheap to rebuild
+        std::vector<std::pair<std::uint64_t, node_data*>> grids;
+        for (auto& data : _data) {
+            if (!data.occupied_cells.empty()) grids.push_back(std::make_pair(data.last_use, &data));
+        }
+        std::sort(grids.begin(), grids.end(),
+            [](const std::pair<std::uint64_t, node_data*>& a, const std::pair<std::uint64_t, node_data*>& b) {
+                return a.first < b.first;
+            });
+        for (auto& grid : grids) {
+            if (resident_units() <= _options.max_resident_points / 2) break;
+            std::vector<std::uint64_t>().swap(grid.second->occupied_cells);
+            --_grid_count;
+        }
+    }
+
+    inline void lod_octree::finalize()
+    {
+        for (auto& data : _data) {
+            std::vector<std::uint64_t>().swap(data.occupied_cells);
+        }
+        _grid_count = 0;
+        _is_finalized = true;
+    }
+
+    inline io_status lod_octree::load_points(index_type node_idx, std::vector<float>& out_coords) const
+    {
+        io_status status = read_payload(_data[node_idx].samples, out_coords);
+        if (status != io_status::ok) return status;
+        return read_payload(_data[node_idx].overflow, out_coords);
+    }
+
+    inline float lod_octree::projected_error(index_type node_idx, const packed_matrix4<float>& vp,
+                                             float pixel_scale) const
+    {
+        const aabb& box = _nodes[node_idx].box;
+        int outside[6] = { 0, 0, 0, 0, 0, 0 };
+        float min_w = std::numeric_limits<float>::max();
+        for (size_t corner = 0; corner < 8; ++corner) {
+            float p[3] = {
+                (corner & 1) ? box.upper[0] : box.lower[0],
+                (corner & 2) ? box.upper[1] : box.lower[1],
+                (corner & 4) ? box.upper[2] : box.lower[2]
+            };
+            float clip[4];
+            vp.transform_homogeneous(p, clip);
+            for (size_t a = 0; a < 3; ++a) {
+                outside[a * 2] += clip[a] < -clip[3];
+                outside[a * 2 + 1] += clip[a] > clip[3];
+            }
+            min_w = std::min(min_w, clip[3]);
+        }
+        for (size_t plane = 0; plane < 6; ++plane) {
+            if (outside[plane] == 8) return -1.0f;
+        }
+        // the box reaches behind the eye, any spacing is too coarse
+        if (min_w <= 1e-6f) return std::numeric_limits<float>::max();
+        return _nodes[node_idx].spacing * pixel_scale / min_w;
+    }
+
+    inline float lod_octree::screen_error(index_type node_idx, const matrix<4, 4, float>& view_projection,
+                                          float viewport_height) const
+    {
+        packed_matrix4<float> vp(view_projection);
+        float pixel_scale = 0.5f * viewport_height * std::sqrt(vp.m[4] * vp.m[4] + vp.m[5] * vp.m[5] + vp.m[6] * vp.m[6]);
+        return projected_error(node_idx, vp, pixel_scale);
+    }
+
+    inline void lod_octree::select(const matrix<4, 4, float>& view_projection, float viewport_height,
+                                   float max_screen_error, std::uint64_t point_budget,
+                                   std::vector<index_type>& out_nodes) const
+    {
+        out_nodes.clear();
+        if (_nodes.empty()) return;
+
+        packed_matrix4<float> vp(view_projection);
+        // pixels per world unit at w = 1, taken from the clip-space y row
+        float pixel_scale = 0.5f * viewport_height * std::sqrt(vp.m[4] * vp.m[4] + vp.m[5] * vp.m[5] + vp.m[6] * vp.m[6]);
+
+        // largest projected error first
+        std::priority_queue<std::pair<float, index_type>> candidates;
+        float root_error = projected_error(0, vp, pixel_scale);
+        if (root_error >= 0) candidates.push(std::make_pair(root_error, index_type(0)));
+
+        std::uint64_t selected_points = 0;
+        while (!candidates.empty()) {
+            float error = candidates.top().first;
+            index_type node_idx = candidates.top().second;
+            candidates.pop();
+
+            const node& nd = _nodes[node_idx];
+            if (selected_points + nd.point_count > point_budget) break;
+            selected_points += nd.point_count;
+            out_nodes.push_back(node_idx);
+
+            if (error <= max_screen_error || nd.is_leaf()) continue;
+            for (size_t octant = 0; octant < 8; ++octant) {
+                index_type child = nd.children[octant];
+                if (child == invalid_index) continue;
+                float child_error = projected_error(child, vp, pixel_scale);
+                if (child_error >= 0) candidates.push(std::make_pair(child_error, child));
+            }
+        }
+    }
+
+    inline size_t lod_octree::node_count() const
+    {
+        return _nodes.size();
+    }
+
+    inline const lod_octree::node& lod_octree::get_node(index_type node_idx) const
+    {
+        return _nodes[node_idx];
+    }
+
+    inline std::uint64_t lod_octree::point_count() const
+    {
+        return _point_count;
+    }
+
+    inline bool lod_octree::is_finalized() const
+    {
+        return _is_finalized;
+    }
+
+    inline io_status lod_octree::status() const
+    {
+        return _status;
+    }
+
+    inline size_t lod_octree::resident_point_count() const
+    {
+        return _resident_count;
+    }
+
+    inline size_t lod_octree::peak_resident_point_count() const
+    {
+        return _peak_resident_count;
+    }
+
+    inline size_t lod_octree::spilled_point_count() const
+    {
+        return _spilled_count;
+    }
+
+    inline size_t lod_octree::resident_grid_count() const
+    {
+        return _grid_count;
+    }
+
+    inline size_t lod_octree::peak_resident_bytes() const
+    {
+        return _peak_resident_bytes;
+    }
+}
+
+#endif // BCG_LOD_OCTREE_HPP
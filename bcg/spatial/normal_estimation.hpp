@@ -0,0 +1,135 @@
+#ifndef BCG_NORMAL_ESTIMATION_HPP
+#define BCG_NORMAL_ESTIMATION_HPP
+
+#include "spatial/kd_tree.hpp"
+#include "transforms/matrix/symmetric_eigen.hpp"
+#include "utils/parallel.hpp"
+
+#include <algorithm>
+#include <atomic>
+#include <cmath>
+#include <cstddef>
+#include <vector>
+
+namespace bcg
+{
+    //////////////////////////////////////////////////////////////////////////////////////////////////
+    // normal estimation
+    //////////////////////////////////////////////////////////////////////////////////////////////////
+
+    struct normal_estimation_options
+    {
+        // the neighbourhood of a point is its neighbour_count nearest points (itself included) or,
+        // when radius > 0, every point within radius
+        size_t neighbour_count = 16;
+        float radius = 0;
+        // PCA leaves the sign open; when set each normal is flipped to face view_point
+        bool orient_to_view_point = false;
+        float view_point[3] = { 0, 0, 0 };
+        // 0 means all hardware threads
+        size_t thread_count = 0;
+    };
+
+    // PCA normals: for every point, the unit eigenvector of the smallest eigenvalue of its
+    // neighbourhood's covariance. [tree] must be built over [coords] (packed x0, y0, z0, x1, ...),
+    // queries run in tree order so neighbouring queries touch the same nodes. [out_normals] gets
+    // three floats per point and [out_curvature], when given, the surface variation
+    // lambda0 / (lambda0 + lambda1 + lambda2), 0 on a plane and 1/3 for isotropic noise.
+    // Points with fewer than three neighbours get a zero normal; returns how many did.
+    inline size_t estimate_normals(const kd_tree& tree, const float* coords, float* out_normals,
+                                   const normal_estimation_options& options = normal_estimation_options(),
+                                   float* out_curvature = nullptr);
+
+    // builds the kd_tree first
+    inline size_t estimate_normals(const float* coords, size_t point_count, float* out_normals,
+                                   const normal_estimation_options& options = normal_estimation_options(),
+                                   float* out_curvature = nullptr);
+
+    //////////////////////////////////////////////////////////////////////////////////////////////////
+    // normal estimation implementation
+    //////////////////////////////////////////////////////////////////////////////////////////////////
+
+    inline size_t estimate_normals(const kd_tree& tree, const float* coords, float* out_normals,
+                                   const normal_estimation_options& options, float* out_curvature)
+    {
+        std::atomic<size_t> degenerate(0);
+        auto fn = [&](size_t first, size_t last) {
+            std::vector<kd_tree::index_type> neighbours;
+            std::vector<float> dist2;
+            if (options.radius <= 0) {
+                neighbours.resize(options.neighbour_count);
+                dist2.resize(options.neighbour_count);
+            }
+            size_t local_degenerate = 0;
+            for (size_t slot = first; slot < last; ++slot) {
+                const float* query = tree.coords_of_slot(slot);
+                size_t idx = tree.index_of_slot(slot);
+                size_t count;
+                if (options.radius > 0) {
+                    neighbours.clear();
+                    tree.radius(query, options.radius, neighbours);
+                    count = neighbours.size();
+                }
+                else {
+                    count = tree.knn(query, options.neighbour_count, neighbours.data(), dist2.data());
+                }
+
+                float* normal = out_normals + idx * 3;
+                if (count < 3) {
+                    normal[0] = normal[1] = normal[2] = 0;
+                    if (out_curvature != nullptr) out_curvature[idx] = 0;
+                    ++local_degenerate;
+                    continue;
+                }
+
+                // covariance about the mean, accumulated relative to the query point so large
+                // coordinates do not cancel
+                double sum[3] = { 0, 0, 0 }, products[6] = { 0, 0, 0, 0, 0, 0 };
+                for (size_t n = 0; n < count; ++n) {
+                    const float* p = coords + size_t(neighbours[n]) * 3;
+                    double dx = double(p[0]) - query[0], dy = double(p[1]) - query[1], dz = double(p[2]) - query[2];
+                    sum[0] += dx; sum[1] += dy; sum[2] += dz;
+                    products[0] += dx * dx; products[1] += dx * dy; products[2] += dx * dz;
+                    products[3] += dy * dy; products[4] += dy * dz; products[5] += dz * dz;
+                }
+                double inv = 1.0 / double(count);
+                double mean[3] = { sum[0] * inv, sum[1] * inv, sum[2] * inv };
+                double covariance[6] = {
+                    products[0] * inv - mean[0] * mean[0], products[1] * inv - mean[0] * mean[1],
+                    products[2] * inv - mean[0] * mean[2], products[3] * inv - mean[1] * mean[1],
+                    products[4] * inv - mean[1] * mean[2], products[5] * inv - mean[2] * mean[2]
+                };
+
+                double values[3], vectors[9];
+                symmetric_eigen_detail::decompose(covariance, values, vectors);
+                double n[3] = { vectors[0], vectors[3], vectors[6] };
+                if (options.orient_to_view_point) {
+                    double to_view = n[0] * (options.view_point[0] - query[0]) + n[1] * (options.view_point[1] - query[1]) +
+                                     n[2] * (options.view_point[2] - query[2]);
+                    if (to_view < 0) {
+                        n[0] = -n[0]; n[1] = -n[1]; n[2] = -n[2];
+                    }
+                }
+                normal[0] = float(n[0]);
+                normal[1] = float(n[1]);
+                normal[2] = float(n[2]);
+                if (out_curvature != nullptr) {
+                    double total = values[0] + values[1] + values[2];
+                    out_curvature[idx] = total > 0 ? float(std::max(0.0, values[0]) / total) : 0.0f;
+                }
+            }
+            degenerate += local_degenerate;
+        };
+        parallel_for(0, tree.size(), fn, options.thread_count, 1024);
+        return degenerate;
+    }
+
+    inline size_t estimate_normals(const float* coords, size_t point_count, float* out_normals,
+                                   const normal_estimation_options& options, float* out_curvature)
+    {
+        kd_tree tree(coords, point_count, options.thread_count);
+        return estimate_normals(tree, coords, out_normals, options, out_curvature);
+    }
+}
+
+#endif // BCG_NORMAL_ESTIMATION_HPP
@@ -0,0 +1,278 @@
+#ifndef BCG_SPACE_FILLING_CURVE_HPP
+#define BCG_SPACE_FILLING_CURVE_HPP
+
+#include "spatial/aabb.hpp"
+#include "transforms/point.hpp"
+#include "utils/parallel.hpp"
+
+#include <algorithm>
+#include <cstdint>
+#include <vector>
+
+namespace bcg
+{
+    //////////////////////////////////////////////////////////////////////////////////////////////////
+    // space filling curves
+    //////////////////////////////////////////////////////////////////////////////////////////////////
+
+    enum class curve_type
+    {
+        morton,
+        hilbert
+    };
+
+    // bits per axis of the curve codes, 3 * 21 = 63 bits fit a 64-bit key
+    const std::uint32_t curve_bits = 21;
+
+    // interleave the low 21 bits of x, y, z as ...z1y1x1z0y0x0
+    inline std::uint64_t morton_encode(std::uint32_t x, std::uint32_t y, std::uint32_t z);
+    // distance along the 3d Hilbert curve of the cell (x, y, z) on a 2^21 grid
+    inline std::uint64_t hilbert_encode(std::uint32_t x, std::uint32_t y, std::uint32_t z);
+
+    // curve code of every point after quantising it inside [bounds]
+    inline void compute_curve_codes(const float* coords, size_t point_count, const aabb& bounds, curve_type curve,
+                                    std::uint64_t* out_codes, size_t thread_count = 0);
+
+    // stable LSD radix sort of keys, indices are permuted along with them
+    inline void parallel_radix_sort(std::vector<std::uint64_t>& keys, std::vector<std::uint32_t>& indices,
+                                    size_t thread_count = 0);
+
+    // Permutation that sorts points along the curve over their bounding box: the point at position i
+    // of the reordered set is the original point order[i]. Apply it to attributes as well.
+    inline std::vector<std::uint32_t> spatial_order(const float* coords, size_t point_count, curve_type curve,
+                                                    size_t thread_count = 0);
+    inline std::vector<std::uint32_t> spatial_order(const std::vector<point>& points, curve_type curve,
+                                                    size_t thread_count = 0);
+
+    // dst[i] = src[order[i]]
+    template<typename elem_type>
+    void apply_permutation(const std::vector<elem_type>& src, const std::vector<std::uint32_t>& order,
+                           std::vector<elem_type>& dst);
+    // same for interleaved records of [stride] elements each, e.g. packed xyz coordinates
+    template<typename elem_type>
+    void apply_permutation(const elem_type* src, size_t stride, const std::vector<std::uint32_t>& order,
+                           elem_type* dst);
+
+    // reorder points in place along the curve, returns the permutation that was applied
+    inline std::vector<std::uint32_t> reorder_points(std::vector<point>& points, curve_type curve,
+                                                     size_t thread_count = 0);
+
+    //////////////////////////////////////////////////////////////////////////////////////////////////
+    // space filling curves implementation
+    //////////////////////////////////////////////////////////////////////////////////////////////////
+
+    namespace curve_detail
+    {
+        // spread the low 21 bits of v so that two zero bits follow each of them
+        inline std::uint64_t spread_bits(std::uint32_t v)
+        {
+            std::uint64_t x = v & 0x1fffff;
+            x = (x | (x << 32)) & 0x001f00000000ffffull;
+            x = (x | (x << 16)) & 0x001f0000ff0000ffull;
+            x = (x | (x << 8)) & 0x100f00f00f00f00full;
+            x = (x | (x << 4)) & 0x10c30c30c30c30c3ull;
+            x = (x | (x << 2)) & 0x1249249249249249ull;
+            return x;
+        }
+    }
+
+    inline std::uint64_t morton_encode(std::uint32_t x, std::uint32_t y, std::uint32_t z)
+    {
+        return curve_detail::spread_bits(x) | (curve_detail::spread_bits(y) << 1) |
+               (curve_detail::spread_bits(z) << 2);
+    }
+
+    inline std::uint64_t hilbert_encode(std::uint32_t x, std::uint32_t y, std::uint32_t z)
+    {
+        // Skilling's axes-to-transpose, then the transposed form is read out as a morton code
+        std::uint32_t coords[3] = { x & 0x1fffff, y & 0x1fffff, z & 0x1fffff };
+        const std::uint32_t top = 1u << (curve_bits - 1);
+
+        for (std::uint32_t q = top; q > 1; q >>= 1) {
+            std::uint32_t p = q - 1;
+            for (size_t i = 0; i < 3; ++i) {
+                if (coords[i] & q) {
+                    coords[0] ^= p;
+                }
+                else {
+                    std::uint32_t t = (coords[0] ^ coords[i]) & p;
+                    coords[0] ^= t;
+                    coords[i] ^= t;
+                }
+            }
+        }
+        coords[1] ^= coords[0];
+        coords[2] ^= coords[1];
+        std::uint32_t t = 0;
+        for (std::uint32_t q = top; q > 1; q >>= 1) {
+            if (coords[2] & q) t ^= q - 1;
+        }
+        for (size_t i = 0; i < 3; ++i) {
+            coords[i] ^= t;
+        }
+
+        // the first axis carries the most significant bit of every triple
+        return morton_encode(coords[2], coords[1], coords[0]);
+    }
+
+    inline void compute_curve_codes(const float* coords, size_t point_count, const aabb& bounds, curve_type curve,
+                                    std::uint64_t* out_codes, size_t thread_count)
+    {
+        const float cells = static_cast<float>(1u << curve_bits);
+        float scale[3];
+        for (size_t d = 0; d < 3; ++d) {
+            float extent = bounds.extent(d);
+            scale[d] = extent > 0 ? cells / extent : 0.0f;
+        }
+
+        parallel_for(0, point_count, [&](size_t first, size_t last) {
+            for (size_t i = first; i < last; ++i) {
+                std::uint32_t q[3];
+                for (size_t d = 0; d < 3; ++d) {
+                    float c = (coords[i * 3 + d] - bounds.lower[d]) * scale[d];
+                    c = std::max(0.0f, std::min(c, cells - 1));
+                    q[d] = static_cast<std::uint32_t>(c);
+                }
+                out_codes[i] = curve == curve_type::morton ? morton_encode(q[0], q[1], q[2])
+                                                           : hilbert_encode(q[0], q[1], q[2]);
+            }
+        }, thread_count, 1 << 14);
+    }
+
+    inline void parallel_radix_sort(std::vector<std::uint64_t>& keys, std::vector<std::uint32_t>& indices,
+                                     size_t thread_count)
+    {
+        // 11-bit digits: six passes cover a 64-bit key
+        const size_t digit_bits = 11;
+        const size_t radix = size_t(1) << digit_bits;
+        const size_t pass_count = (64 + digit_bits - 1) / digit_bits;
+        const size_t grain = 1 << 16;
+        size_t n = keys.size();
+        indices.resize(n);
+        if (n < 2) return;
+
+        std::vector<std::uint64_t> keys_tmp(n);
+        std::vector<std::uint32_t> indices_tmp(n);
+        size_t workers = resolve_thread_count(n, thread_count, grain);
+
+        // histograms[(pass * workers + t) * radix + digit]; with a single worker all passes are
+        // counted in one read of the keys, otherwise each pass recounts its thread ranges
+        std::vector<size_t> histograms(pass_count * workers * radix, 0);
+        if (workers == 1) {
+            for (size_t i = 0; i < n; ++i) {
+                for (size_t pass = 0; pass < pass_count; ++pass) {
+                    ++histograms[pass * radix + ((keys[i] >> (pass * digit_bits)) & (radix - 1))];
+                }
+            }
+        }
+
+        for (size_t pass = 0; pass < pass_count; ++pass) {
+            size_t shift = pass * digit_bits;
+            size_t* pass_histograms = &histograms[pass * workers * radix];
+            if (workers > 1) {
+                // per-thread counts over the same ranges parallel_partition hands out below
+                parallel_partition(0, n, [&](size_t t, size_t first, size_t last) {
+                    size_t* hist = pass_histograms + t * radix;
+                    for (size_t i = first; i < last; ++i) {
+                        ++hist[(keys[i] >> shift) & (radix - 1)];
+                    }
+                }, workers, grain);
+            }
+
+            // skip the pass when every key has the same digit
+            bool trivial = false;
+            for (size_t b = 0; b < radix && !trivial; ++b) {
+                size_t total = 0;
+                for (size_t t = 0; t < workers; ++t) total += pass_histograms[t * radix + b];
+                trivial = (total == n);
+            }
+            if (trivial) continue;
+
+            // exclusive prefix sum, digit-major then thread-major keeps the sort stable
+            size_t offset = 0;
+            for (size_t b = 0; b < radix; ++b) {
+                for (size_t t = 0; t < workers; ++t) {
+                    size_t count = pass_histograms[t * radix + b];
+                    pass_histograms[t * radix + b] = offset;
+                    offset += count;
+                }
+            }
+
+            parallel_partition(0, n, [&](size_t t, size_t first, size_t last) {
+                size_t* next = pass_histograms + t * radix;
+                for (size_t i = first; i < last; ++i) {
+                    size_t dst = next[(keys[i] >> shift) & (radix - 1)]++;
+                    keys_tmp[dst] = keys[i];
+                    indices_tmp[dst] = indices[i];
+                }
+            }, workers, grain);
+
+            keys.swap(keys_tmp);
+            indices.swap(indices_tmp);
+        }
+    }
+
+    inline std::vector<std::uint32_t> spatial_order(const float* coords, size_t point_count, curve_type curve,
+                                                    size_t thread_count)
+    {
+        aabb bounds;
+        for (size_t i = 0; i < point_count; ++i) {
+            bounds.expand(coords + i * 3);
+        }
+
+        std::vector<std::uint64_t> codes(point_count);
+        compute_curve_codes(coords, point_count, bounds, curve, codes.data(), thread_count);
+
+        std::vector<std::uint32_t> order(point_count);
+        for (size_t i = 0; i < point_count; ++i) {
+            order[i] = static_cast<std::uint32_t>(i);
+        }
+        parallel_radix_sort(codes, order, thread_count);
+        return order;
+    }
+
+    inline std::vector<std::uint32_t> spatial_order(const std::vector<point>& points, curve_type curve,
+                                                    size_t thread_count)
+    {
+        std::vector<float> coords(points.size() * 3);
+        for (size_t i = 0; i < points.size(); ++i) {
+            const b_vector<4, float>& p = points[i].data();
+            coords[i * 3 + 0] = p[0];
+            coords[i * 3 + 1] = p[1];
+            coords[i * 3 + 2] = p[2];
+        }
+        return spatial_order(coords.data(), points.size(), curve, thread_count);
+    }
+
+    template<typename elem_type>
+    void apply_permutation(const std::vector<elem_type>& src, const std::vector<std::uint32_t>& order,
+                           std::vector<elem_type>& dst)
+    {
+        dst.clear();
+        dst.reserve(order.size());
+        for (size_t i = 0; i < order.size(); ++i) {
+            dst.push_back(src[order[i]]);
+        }
+    }
+
+    template<typename elem_type>
+    void apply_permutation(const elem_type* src, size_t stride, const std::vector<std::uint32_t>& order,
+                           elem_type* dst)
+    {
+        for (size_t i = 0; i < order.size(); ++i) {
+            std::copy(src + size_t(order[i]) * stride, src + size_t(order[i] + 1) * stride, dst + i * stride);
+        }
+    }
+
+    inline std::vector<std::uint32_t> reorder_points(std::vector<point>& points, curve_type curve,
+                                                     size_t thread_count)
+    {
+        std::vector<std::uint32_t> order = spatial_order(points, curve, thread_count);
+        std::vector<point> reordered;
+        apply_permutation(points, order, reordered);
+        points.swap(reordered);
+        return order;
+    }
+}
+
+#endif // BCG_SPACE_FILLING_CURVE_HPP
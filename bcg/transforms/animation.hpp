@@ -0,0 +1,314 @@
+#ifndef BCG_ANIMATION_HPP
+#define BCG_ANIMATION_HPP
+
+#include "transforms/matrix/matrix.hpp"
+#include "transforms/matrix/packed_matrix.hpp"
+#include "utils/parallel.hpp"
+
+#include <algorithm>
+#include <cmath>
+#include <cstdint>
+#include <vector>
+
+namespace bcg
+{
+    //////////////////////////////////////////////////////////////////////////////////////////////////
+    // keyframe_track
+    //////////////////////////////////////////////////////////////////////////////////////////////////
+
+    // The keys of one animated transform, for building an animation_clip. Each channel has its own
+    // ascending key times; values are xyz for translation and scale, unit quaternions (w, x, y, z)
+    // for rotation. An empty channel stays at identity.
+    struct keyframe_track
+    {
+        std::vector<float> translation_times;
+        std::vector<float> translations;
+        std::vector<float> rotation_times;
+        std::vector<float> rotations;
+        std::vector<float> scale_times;
+        std::vector<float> scales;
+
+        void add_translation(float time, float x, float y, float z);
+        void add_rotation(float time, float w, float x, float y, float z);
+        void add_scale(float time, float x, float y, float z);
+    };
+
+    //////////////////////////////////////////////////////////////////////////////////////////////////
+    // animation_clip
+    //////////////////////////////////////////////////////////////////////////////////////////////////
+
+    // Many keyframe tracks packed into one flat times array and one flat values array per channel,
+    // each track owning a key range, so sampling walks contiguous memory.
+    class animation_clip
+    {
+    public:
+        typedef std::uint32_t index_type;
+
+        enum channel { translation_channel = 0, rotation_channel = 1, scale_channel = 2, channel_count = 3 };
+
+    public:
+        animation_clip();
+
+        // returns the track index, which is also its slot in the sampled output
+        index_type add_track(const keyframe_track& track);
+
+    public:
+        size_t track_count() const { return _key_offsets[0].size() - 1; }
+        // time of the last key of any track
+        float duration() const { return _duration; }
+
+        size_t key_count(index_type track, channel c) const { return _key_offsets[c][track + 1] - _key_offsets[c][track]; }
+        const float* key_times(index_type track, channel c) const { return &_times[c][_key_offsets[c][track]]; }
+        // 3 floats per key, 4 for rotation
+        const float* key_values(index_type track, channel c) const;
+
+    private:
+        std::vector<float> _times[channel_count];
+        std::vector<float> _values[channel_count];
+        std::vector<index_type> _key_offsets[channel_count];
+        float _duration = 0;
+    };
+
+    //////////////////////////////////////////////////////////////////////////////////////////////////
+    // animation_sampler
+    //////////////////////////////////////////////////////////////////////////////////////////////////
+
+    // Samples every track of a clip into local matrices (translation * rotation * scale), e.g. for
+    // transform_hierarchy::set_local. Each track and channel remembers the key it was last sampled
+    // at, so playing forward finds the next keys in constant time; a jump falls back to a binary
+    // search. Tracks are interpolated 8 at a time (lerp for translation and scale, slerp for
+    // rotation) and spread over threads in blocks.
+    class animation_sampler
+    {
+    public:
+        typedef animation_clip::index_type index_type;
+
+    public:
+        animation_sampler() = default;
+
+        // [out_locals] has one matrix per track; [time] is clamped to each channel's keys
+        void sample(const animation_clip& clip, float time, packed_matrix4<float>* out_locals,
+                    size_t thread_count = 0);
+        // forget the cached keys
+        void reset() { _cursors.clear(); }
+
+    private:
+        std::vector<index_type> _cursors;
+    };
+
+    //////////////////////////////////////////////////////////////////////////////////////////////////
+    // keyframe_track implementation
+    //////////////////////////////////////////////////////////////////////////////////////////////////
+
+    inline void keyframe_track::add_translation(float time, float x, float y, float z)
+    {
+        translation_times.push_back(time);
+        translations.push_back(x);
+        translations.push_back(y);
+        translations.push_back(z);
+    }
+
+    inline void keyframe_track::add_rotation(float time, float w, float x, float y, float z)
+    {
+        rotation_times.push_back(time);
+        rotations.push_back(w);
+        rotations.push_back(x);
+        rotations.push_back(y);
+        rotations.push_back(z);
+    }
+
+    inline void keyframe_track::add_scale(float time, float x, float y, float z)
+    {
+        scale_times.push_back(time);
+        scales.push_back(x);
+        scales.push_back(y);
+        scales.push_back(z);
+    }
+
+    //////////////////////////////////////////////////////////////////////////////////////////////////
+    // animation_clip implementation
+    //////////////////////////////////////////////////////////////////////////////////////////////////
+
+    namespace animation_detail
+    {
+        const size_t lane_count = 8;
+        const size_t grain_size = 256;
+        const size_t component_counts[animation_clip::channel_count] = { 3, 4, 3 };
+
+        // key i with times[i] <= time < times[i + 1] (clamped to the first and last pair), tried at
+        // the cached [cursor] and the pair after it before searching
+        inline size_t find_key(const float* times, size_t count, float time, animation_clip::index_type& cursor)
+        {
+            if (count < 2) return 0;
+            size_t last_pair = count - 2;
+            size_t c = std::min<size_t>(cursor, last_pair);
+            if (times[c] <= time || c == 0) {
+                if (c == last_pair || time < times[c + 1]) return c;
+                if (c + 1 == last_pair || time < times[c + 2]) {
+                    cursor = animation_clip::index_type(c + 1);
+                    return c + 1;
+                }
+            }
+            size_t i = size_t(std::upper_bound(times, times + count, time) - times);
+            i = std::min(i == 0 ? 0 : i - 1, last_pair);
+            cursor = animation_clip::index_type(i);
+            return i;
+        }
+
+        // the two keys around [time] and how far between them, the same key twice for 0 or 1 keys
+        inline void key_pair(const animation_clip& clip, animation_clip::index_type track, animation_clip::channel c,
+                             float time, animation_clip::index_type& cursor, const float*& a, const float*& b,
+                             float& factor)
+        {
+            size_t count = clip.key_count(track, c);
+            const float* times = clip.key_times(track, c);
+            const float* values = clip.key_values(track, c);
+            size_t stride = component_counts[c];
+            size_t i = find_key(times, count, time, cursor);
+            a = values + i * stride;
+            if (count < 2) {
+                b = a;
+                factor = 0;
+                return;
+            }
+            b = a + stride;
+            float span = times[i + 1] - times[i];
+            factor = span > 0 ? (time - times[i]) / span : 0.0f;
+            factor = std::min(1.0f, std::max(0.0f, factor));
+        }
+    }
+
+    inline animation_clip::animation_clip()
+    {
+        for (size_t c = 0; c < channel_count; ++c) _key_offsets[c].push_back(0);
+    }
+
+    inline animation_clip::index_type animation_clip::add_track(const keyframe_track& track)
+    {
+        const std::vector<float>* times[channel_count] = {
+            &track.translation_times, &track.rotation_times, &track.scale_times
+        };
+        const std::vector<float>* values[channel_count] = { &track.translations, &track.rotations, &track.scales };
+        // identity key for empty channels
+        const float identity[channel_count][4] = { { 0, 0, 0, 0 }, { 1, 0, 0, 0 }, { 1, 1, 1, 0 } };
+        for (size_t c = 0; c < channel_count; ++c) {
+            size_t stride = animation_detail::component_counts[c];
+            if (times[c]->empty()) {
+                _times[c].push_back(0);
+                _values[c].insert(_values[c].end(), identity[c], identity[c] + stride);
+            }
+            else {
+                _times[c].insert(_times[c].end(), times[c]->begin(), times[c]->end());
+                _values[c].insert(_values[c].end(), values[c]->begin(), values[c]->begin() + times[c]->size() * stride);
+                _duration = std::max(_duration, times[c]->back());
+            }
+            _key_offsets[c].push_back(index_type(_times[c].size()));
+        }
+        return index_type(track_count() - 1);
+    }
+
+    inline const float* animation_clip::key_values(index_type track, channel c) const
+    {
+        return &_values[c][_key_offsets[c][track] * animation_detail::component_counts[c]];
+    }
+
+    //////////////////////////////////////////////////////////////////////////////////////////////////
+    // animation_sampler implementation
+    //////////////////////////////////////////////////////////////////////////////////////////////////
+
+    inline void animation_sampler::sample(const animation_clip& clip, float time, packed_matrix4<float>* out_locals,
+                                          size_t thread_count)
+    {
+        using namespace animation_detail;
+        size_t track_count = clip.track_count();
+        if (_cursors.size() != track_count * animation_clip::channel_count) {
+            _cursors.assign(track_count * animation_clip::channel_count, 0);
+        }
+
+        parallel_for(0, track_count, [&](size_t first, size_t last) {
+            for (size_t block = first; block < last; block += lane_count) {
+                size_t count = std::min(lane_count, last - block);
+
+                // gather the key pairs of the block's tracks into lanes (missing lanes stay identity)
+                float t0[3][lane_count] = {}, t1[3][lane_count] = {}, ft[lane_count] = {};
+                float q0[4][lane_count] = {}, q1[4][lane_count] = {}, fq[lane_count] = {};
+                float s0[3][lane_count] = {}, s1[3][lane_count] = {}, fs[lane_count] = {};
+                for (size_t l = 0; l < count; ++l) {
+                    index_type track = index_type(block + l);
+                    index_type* cursor = &_cursors[track * animation_clip::channel_count];
+                    const float* a;
+                    const float* b;
+                    key_pair(clip, track, animation_clip::translation_channel, time, cursor[0], a, b, ft[l]);
+                    for (size_t d = 0; d < 3; ++d) { t0[d][l] = a[d]; t1[d][l] = b[d]; }
+                    key_pair(clip, track, animation_clip::rotation_channel, time, cursor[1], a, b, fq[l]);
+                    for (size_t d = 0; d < 4; ++d) { q0[d][l] = a[d]; q1[d][l] = b[d]; }
+                    key_pair(clip, track, animation_clip::scale_channel, time, cursor[2], a, b, fs[l]);
+                    for (size_t d = 0; d < 3; ++d) { s0[d][l] = a[d]; s1[d][l] = b[d]; }
+                }
+                for (size_t l = count; l < lane_count; ++l) q0[0][l] = q1[0][l] = 1;
+
+                // lerp
+                float t[3][lane_count], s[3][lane_count];
+                for (size_t d = 0; d < 3; ++d) {
+                    for (size_t l = 0; l < lane_count; ++l) {
+                        t[d][l] = t0[d][l] + (t1[d][l] - t0[d][l]) * ft[l];
+                        s[d][l] = s0[d][l] + (s1[d][l] - s0[d][l]) * fs[l];
+                    }
+                }
+
+                // slerp along the shorter arc, nearly parallel keys are lerped and renormalised
+                float w0[lane_count], w1[lane_count];
+                for (size_t l = 0; l < lane_count; ++l) {
+                    float dot = q0[0][l] * q1[0][l] + q0[1][l] * q1[1][l] + q0[2][l] * q1[2][l] + q0[3][l] * q1[3][l];
+                    float sign = dot < 0 ? -1.0f : 1.0f;
+                    dot *= sign;
+                    float f = fq[l];
+                    if (dot > 0.9995f) {
+                        w0[l] = 1 - f;
+                        w1[l] = f * sign;
+                    }
+                    else {
+                        float theta = std::acos(dot);
+                        float inv_sin = 1 / std::sin(theta);
+                        w0[l] = std::sin((1 - f) * theta) * inv_sin;
+                        w1[l] = std::sin(f * theta) * inv_sin * sign;
+                    }
+                }
+                float q[4][lane_count];
+                for (size_t d = 0; d < 4; ++d) {
+                    for (size_t l = 0; l < lane_count; ++l) q[d][l] = w0[l] * q0[d][l] + w1[l] * q1[d][l];
+                }
+                for (size_t l = 0; l < lane_count; ++l) {
+                    float len2 = q[0][l] * q[0][l] + q[1][l] * q[1][l] + q[2][l] * q[2][l] + q[3][l] * q[3][l];
+                    float inv = len2 > 0 ? 1 / std::sqrt(len2) : 0.0f;
+                    for (size_t d = 0; d < 4; ++d) q[d][l] *= inv;
+                }
+
+                // T * R * S, the columns of R scaled
+                float m[12][lane_count];
+                for (size_t l = 0; l < lane_count; ++l) {
+                    float w = q[0][l], x = q[1][l], y = q[2][l], z = q[3][l];
+                    m[0][l] = (1 - 2 * (y * y + z * z)) * s[0][l];
+                    m[1][l] = 2 * (x * y - w * z) * s[1][l];
+                    m[2][l] = 2 * (x * z + w * y) * s[2][l];
+                    m[3][l] = t[0][l];
+                    m[4][l] = 2 * (x * y + w * z) * s[0][l];
+                    m[5][l] = (1 - 2 * (x * x + z * z)) * s[1][l];
+                    m[6][l] = 2 * (y * z - w * x) * s[2][l];
+                    m[7][l] = t[1][l];
+                    m[8][l] = 2 * (x * z - w * y) * s[0][l];
+                    m[9][l] = 2 * (y * z + w * x) * s[1][l];
+                    m[10][l] = (1 - 2 * (x * x + y * y)) * s[2][l];
+                    m[11][l] = t[2][l];
+                }
+                for (size_t l = 0; l < count; ++l) {
+                    float* out = out_locals[block + l].m;
+                    for (size_t e = 0; e < 12; ++e) out[e] = m[e][l];
+                    out[12] = 0; out[13] = 0; out[14] = 0; out[15] = 1;
+                }
+            }
+        }, thread_count, grain_size);
+    }
+}
+
+#endif // BCG_ANIMATION_HPP
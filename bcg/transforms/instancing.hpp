@@ -0,0 +1,250 @@
+#ifndef BCG_INSTANCING_HPP
+#define BCG_INSTANCING_HPP
+
+#include "spatial/aabb.hpp"
+#include "transforms/matrix/matrix.hpp"
+#include "transforms/matrix/packed_matrix.hpp"
+#include "utils/parallel.hpp"
+
+#include <algorithm>
+#include <limits>
+#include <vector>
+
+namespace bcg
+{
+    //////////////////////////////////////////////////////////////////////////////////////////////////
+    // instancing
+    //////////////////////////////////////////////////////////////////////////////////////////////////
+
+    // N transforms applied to one shared set of M packed xyz points. The work is cut into tiles of
+    // point_tile points by instance_tile instances: a point tile is loaded (as x, y, z arrays) once
+    // and then run through every transform of its instance tile while it is still in cache, instead
+    // of streaming all M points from memory once per instance.
+    struct instancing_options
+    {
+        size_t point_tile = 1024;
+        size_t instance_tile = 64;
+        size_t thread_count = 0;
+    };
+
+    // [out_coords] holds instance_count * point_count packed xyz points, instance after instance
+    inline void transform_instances(const packed_matrix4<float>* transforms, size_t instance_count,
+                                    const float* coords, size_t point_count, float* out_coords,
+                                    const instancing_options& options = instancing_options());
+    inline void transform_instances(const matrix<4, 4, float>* transforms, size_t instance_count,
+                                    const float* coords, size_t point_count, float* out_coords,
+                                    const instancing_options& options = instancing_options());
+
+    // exact bounds of every transformed instance (tighter than transform_bounds() of the point
+    // bounds) without materialising the transformed points
+    inline void instance_bounds(const packed_matrix4<float>* transforms, size_t instance_count,
+                                const float* coords, size_t point_count, aabb* out_bounds,
+                                const instancing_options& options = instancing_options());
+
+    // threads the tiling of [instance_count] x [point_count] runs on, the bound of thread_idx below
+    inline size_t instance_tile_thread_count(size_t instance_count, size_t point_count,
+                                             const instancing_options& options = instancing_options());
+
+    // The tiling for any other reduction: fn(thread_idx, instance, first_point, count, x, y, z)
+    // receives [count] transformed points of [instance] as x, y, z arrays. Calls for one thread
+    // are sequential, so per-thread accumulators need no locks; size them by
+    // instance_tile_thread_count() with the same arguments.
+    template<typename func_type>
+    void for_each_instance_tile(const packed_matrix4<float>* transforms, size_t instance_count,
+                                const float* coords, size_t point_count, func_type fn,
+                                const instancing_options& options = instancing_options());
+
+    //////////////////////////////////////////////////////////////////////////////////////////////////
+    // instancing implementation
+    //////////////////////////////////////////////////////////////////////////////////////////////////
+
+    namespace instancing_detail
+    {
+        const size_t lane_count = 8;
+
+        // number of tile tasks and threads for them, a task is one point tile times one instance tile
+        inline void plan(size_t instance_count, size_t point_count, const instancing_options& options,
+                         size_t& point_tile, size_t& instance_tile, size_t& point_tiles, size_t& instance_tiles)
+        {
+            point_tile = std::max<size_t>(lane_count, options.point_tile / lane_count * lane_count);
+            instance_tile = std::max<size_t>(1, options.instance_tile);
+            point_tiles = (point_count + point_tile - 1) / point_tile;
+            instance_tiles = (instance_count + instance_tile - 1) / instance_tile;
+        }
+
+        // runs task_fn(thread_idx, x, y, z, first_point, count, first_instance, last_instance) with
+        // the point tile already split into x, y, z; consecutive tasks of a thread share a point tile
+        template<typename task_func_type>
+        void run_tiles(size_t instance_count, const float* coords, size_t point_count,
+                       const instancing_options& options, task_func_type task_fn)
+        {
+            size_t point_tile, instance_tile, point_tiles, instance_tiles;
+            plan(instance_count, point_count, options, point_tile, instance_tile, point_tiles, instance_tiles);
+            size_t task_count = point_tiles * instance_tiles;
+
+            parallel_partition(0, task_count, [&](size_t thread_idx, size_t first, size_t last) {
+                std::vector<float> x(point_tile), y(point_tile), z(point_tile);
+                size_t loaded = point_tiles;
+                for (size_t task = first; task < last; ++task) {
+                    size_t tile = task / instance_tiles;
+                    size_t first_point = tile * point_tile;
+                    size_t count = std::min(point_tile, point_count - first_point);
+                    if (tile != loaded) {
+                        const float* p = coords + first_point * 3;
+                        for (size_t l = 0; l < count; ++l) {
+                            x[l] = p[l * 3];
+                            y[l] = p[l * 3 + 1];
+                            z[l] = p[l * 3 + 2];
+                        }
+                        loaded = tile;
+                    }
+                    size_t first_instance = (task % instance_tiles) * instance_tile;
+                    size_t last_instance = std::min(instance_count, first_instance + instance_tile);
+                    task_fn(thread_idx, x.data(), y.data(), z.data(), first_point, count, first_instance,
+                            last_instance);
+                }
+            }, options.thread_count, 1);
+        }
+
+    }
+
+    inline size_t instance_tile_thread_count(size_t instance_count, size_t point_count, const instancing_options& options)
+    {
+        size_t point_tile, instance_tile, point_tiles, instance_tiles;
+        instancing_detail::plan(instance_count, point_count, options, point_tile, instance_tile, point_tiles,
+                                instance_tiles);
+        return resolve_thread_count(point_tiles * instance_tiles, options.thread_count, 1);
+    }
+
+    inline void transform_instances(const packed_matrix4<float>* transforms, size_t instance_count,
+                                    const float* coords, size_t point_count, float* out_coords,
+                                    const instancing_options& options)
+    {
+        using namespace instancing_detail;
+        run_tiles(instance_count, coords, point_count, options,
+                  [&](size_t, const float* x, const float* y, const float* z, size_t first_point, size_t count,
+                      size_t first_instance, size_t last_instance) {
+            for (size_t i = first_instance; i < last_instance; ++i) {
+                // a local copy, the output stores could otherwise alias the matrix
+                float m[12];
+                std::copy(transforms[i].m, transforms[i].m + 12, m);
+                float* out = out_coords + (i * point_count + first_point) * 3;
+                // a lane block is computed into locals, then interleaved into the output
+                size_t l = 0;
+                for (; l + lane_count <= count; l += lane_count) {
+                    float tx[lane_count], ty[lane_count], tz[lane_count];
+                    for (size_t k = 0; k < lane_count; ++k) {
+                        float px = x[l + k], py = y[l + k], pz = z[l + k];
+                        tx[k] = m[0] * px + m[1] * py + m[2] * pz + m[3];
+                        ty[k] = m[4] * px + m[5] * py + m[6] * pz + m[7];
+                        tz[k] = m[8] * px + m[9] * py + m[10] * pz + m[11];
+                    }
+                    for (size_t k = 0; k < lane_count; ++k) {
+                        out[(l + k) * 3] = tx[k];
+                        out[(l + k) * 3 + 1] = ty[k];
+                        out[(l + k) * 3 + 2] = tz[k];
+                    }
+                }
+                for (; l < count; ++l) {
+                    float p[3] = { x[l], y[l], z[l] };
+                    transforms[i].transform_point(p, out + l * 3);
+                }
+            }
+        });
+    }
+
+    inline void transform_instances(const matrix<4, 4, float>* transforms, size_t instance_count,
+                                    const float* coords, size_t point_count, float* out_coords,
+                                    const instancing_options& options)
+    {
+        std::vector<packed_matrix4<float>> packed(transforms, transforms + instance_count);
+        transform_instances(packed.data(), instance_count, coords, point_count, out_coords, options);
+    }
+
+    inline void instance_bounds(const packed_matrix4<float>* transforms, size_t instance_count,
+                                const float* coords, size_t point_count, aabb* out_bounds,
+                                const instancing_options& options)
+    {
+        using namespace instancing_detail;
+        size_t thread_total = instance_tile_thread_count(instance_count, point_count, options);
+        // one partial box per thread and instance, merged at the end
+        std::vector<aabb> partial(thread_total * instance_count);
+        run_tiles(instance_count, coords, point_count, options,
+                  [&](size_t thread_idx, const float* x, const float* y, const float* z, size_t, size_t count,
+                      size_t first_instance, size_t last_instance) {
+            const float big = std::numeric_limits<float>::max();
+            for (size_t i = first_instance; i < last_instance; ++i) {
+                const float* m = transforms[i].m;
+                // min and max per lane, folded once per tile
+                float lo[3][lane_count], hi[3][lane_count];
+                for (size_t l = 0; l < lane_count; ++l) {
+                    for (size_t d = 0; d < 3; ++d) {
+                        lo[d][l] = big;
+                        hi[d][l] = -big;
+                    }
+                }
+                size_t l = 0;
+                for (; l + lane_count <= count; l += lane_count) {
+                    for (size_t k = 0; k < lane_count; ++k) {
+                        float px = x[l + k], py = y[l + k], pz = z[l + k];
+                        float tx = m[0] * px + m[1] * py + m[2] * pz + m[3];
+                        float ty = m[4] * px + m[5] * py + m[6] * pz + m[7];
+                        float tz = m[8] * px + m[9] * py + m[10] * pz + m[11];
+                        lo[0][k] = tx < lo[0][k] ? tx : lo[0][k]; hi[0][k] = tx > hi[0][k] ? tx : hi[0][k];
+                        lo[1][k] = ty < lo[1][k] ? ty : lo[1][k]; hi[1][k] = ty > hi[1][k] ? ty : hi[1][k];
+                        lo[2][k] = tz < lo[2][k] ? tz : lo[2][k]; hi[2][k] = tz > hi[2][k] ? tz : hi[2][k];
+                    }
+                }
+                aabb& box = partial[thread_idx * instance_count + i];
+                for (; l < count; ++l) {
+                    float p[3] = { x[l], y[l], z[l] }, t[3];
+                    transforms[i].transform_point(p, t);
+                    box.expand(t);
+                }
+                for (size_t k = 0; k < lane_count; ++k) {
+                    for (size_t d = 0; d < 3; ++d) {
+                        box.lower[d] = std::min(box.lower[d], lo[d][k]);
+                        box.upper[d] = std::max(box.upper[d], hi[d][k]);
+                    }
+                }
+            }
+        });
+        for (size_t i = 0; i < instance_count; ++i) {
+            out_bounds[i] = aabb();
+            for (size_t t = 0; t < thread_total; ++t) out_bounds[i].expand(partial[t * instance_count + i]);
+        }
+    }
+
+    template<typename func_type>
+    void for_each_instance_tile(const packed_matrix4<float>* transforms, size_t instance_count,
+                                const float* coords, size_t point_count, func_type fn,
+                                const instancing_options& options)
+    {
+        using namespace instancing_detail;
+        size_t point_tile, instance_tile, point_tiles, instance_tiles;
+        plan(instance_count, point_count, options, point_tile, instance_tile, point_tiles, instance_tiles);
+        size_t thread_total = instance_tile_thread_count(instance_count, point_count, options);
+        std::vector<float> transformed(thread_total * point_tile * 3);
+        run_tiles(instance_count, coords, point_count, options,
+                  [&](size_t thread_idx, const float* x, const float* y, const float* z, size_t first_point,
+                      size_t count, size_t first_instance, size_t last_instance) {
+            float* tx = &transformed[thread_idx * point_tile * 3];
+            float* ty = tx + point_tile;
+            float* tz = ty + point_tile;
+            for (size_t i = first_instance; i < last_instance; ++i) {
+                float m[12];
+                std::copy(transforms[i].m, transforms[i].m + 12, m);
+                for (size_t l = 0; l < count; ++l) {
+                    float px = x[l], py = y[l], pz = z[l];
+                    tx[l] = m[0] * px + m[1] * py + m[2] * pz + m[3];
+                    ty[l] = m[4] * px + m[5] * py + m[6] * pz + m[7];
+                    tz[l] = m[8] * px + m[9] * py + m[10] * pz + m[11];
+                }
+                fn(thread_idx, i, first_point, count, static_cast<const float*>(tx), static_cast<const float*>(ty),
+                   static_cast<const float*>(tz));
+            }
+        });
+    }
+}
+
+#endif // BCG_INSTANCING_HPP
@@ -0,0 +1,325 @@
+#ifndef BCG_BATCHED_SOLVER_HPP
+#define BCG_BATCHED_SOLVER_HPP
+
+#include "transforms/b_vector/b_vector.hpp"
+#include "transforms/matrix/matrix.hpp"
+#include "utils/parallel.hpp"
+
+#include <algorithm>
+#include <cassert>
+#include <cmath>
+#include <cstdint>
+#include <limits>
+#include <vector>
+
+namespace bcg
+{
+    //////////////////////////////////////////////////////////////////////////////////////////////////
+    // matrix_batch & vector_batch
+    //////////////////////////////////////////////////////////////////////////////////////////////////
+
+    // Many order x order matrices stored structure-of-arrays: cell (i, j) of every matrix is one
+    // contiguous array, so the same cell of consecutive matrices sits in consecutive lanes.
+    template<size_t order, typename elem_type=float>
+    class matrix_batch
+    {
+    public:
+        explicit matrix_batch(size_t count = 0) { resize(count); }
+
+        void resize(size_t count);
+        size_t size() const { return _count; }
+
+        elem_type* cell(size_t row_idx, size_t col_idx) { return &_cells[(row_idx * order + col_idx) * _count]; }
+        const elem_type* cell(size_t row_idx, size_t col_idx) const { return &_cells[(row_idx * order + col_idx) * _count]; }
+
+        void set(size_t idx, const matrix<order, order, elem_type>& m);
+        matrix<order, order, elem_type> get(size_t idx) const;
+
+    private:
+        std::vector<elem_type> _cells;
+        size_t _count = 0;
+    };
+
+    // Many order-dimensional vectors, component i of every vector is one contiguous array.
+    template<size_t order, typename elem_type=float>
+    class vector_batch
+    {
+    public:
+        explicit vector_batch(size_t count = 0) { resize(count); }
+
+        void resize(size_t count);
+        size_t size() const { return _count; }
+
+        elem_type* component(size_t idx) { return &_components[idx * _count]; }
+        const elem_type* component(size_t idx) const { return &_components[idx * _count]; }
+
+        void set(size_t idx, const b_vector<order, elem_type>& v);
+        b_vector<order, elem_type> get(size_t idx) const;
+
+    private:
+        std::vector<elem_type> _components;
+        size_t _count = 0;
+    };
+
+    //////////////////////////////////////////////////////////////////////////////////////////////////
+    // batched solver
+    //////////////////////////////////////////////////////////////////////////////////////////////////
+
+    enum class solve_method
+    {
+        // LU with partial pivoting, any non-singular matrix
+        lu,
+        // L L^T, symmetric positive definite matrices only (normal equations, covariances,
+        // quadrics), about half the work of LU and no pivoting
+        cholesky
+    };
+
+    // Solve a[s] x[s] = b[s] for every system s, one system per lane of a block of lanes that
+    // the compiler can keep in SIMD registers. A system is rank deficient when a pivot falls
+    // below 16 * order * epsilon times its largest matrix element (or is not positive, for
+    // Cholesky), which also catches systems too ill-conditioned to solve in [elem_type];
+    // its x is set to zero and its index appended to [out_rank_deficient] when given. Returns
+    // the number of rank-deficient systems. [a] and [b] must hold the same number of systems.
+    template<size_t order, typename elem_type>
+    size_t solve_batch(const matrix_batch<order, elem_type>& a, const vector_batch<order, elem_type>& b,
+                       vector_batch<order, elem_type>& x, solve_method method = solve_method::lu,
+                       std::vector<std::uint32_t>* out_rank_deficient = nullptr, size_t thread_count = 0);
+
+    //////////////////////////////////////////////////////////////////////////////////////////////////
+    // matrix_batch & vector_batch implementation
+    //////////////////////////////////////////////////////////////////////////////////////////////////
+
+    template<size_t order, typename elem_type>
+    void matrix_batch<order, elem_type>::resize(size_t count)
+    {
+        // keep every cell array where it was when growing or shrinking
+        std::vector<elem_type> cells(order * order * count, elem_type());
+        size_t kept = std::min(count, _count);
+        for (size_t c = 0; c < order * order; ++c) {
+            for (size_t s = 0; s < kept; ++s) cells[c * count + s] = _cells[c * _count + s];
+        }
+        _cells.swap(cells);
+        _count = count;
+    }
+
+    template<size_t order, typename elem_type>
+    void matrix_batch<order, elem_type>::set(size_t idx, const matrix<order, order, elem_type>& m)
+    {
+        for (size_t i = 0; i < order; ++i) {
+            for (size_t j = 0; j < order; ++j) cell(i, j)[idx] = m[i][j];
+        }
+    }
+
+    template<size_t order, typename elem_type>
+    matrix<order, order, elem_type> matrix_batch<order, elem_type>::get(size_t idx) const
+    {
+        matrix<order, order, elem_type> m;
+        for (size_t i = 0; i < order; ++i) {
+            for (size_t j = 0; j < order; ++j) m[i][j] = cell(i, j)[idx];
+        }
+        return m;
+    }
+
+    template<size_t order, typename elem_type>
+    void vector_batch<order, elem_type>::resize(size_t count)
+    {
+        std::vector<elem_type> components(order * count, elem_type());
+        size_t kept = std::min(count, _count);
+        for (size_t c = 0; c < order; ++c) {
+            for (size_t s = 0; s < kept; ++s) components[c * count + s] = _components[c * _count + s];
+        }
+        _components.swap(components);
+        _count = count;
+    }
+
+    template<size_t order, typename elem_type>
+    void vector_batch<order, elem_type>::set(size_t idx, const b_vector<order, elem_type>& v)
+    {
+        for (size_t i = 0; i < order; ++i) component(i)[idx] = v[i];
+    }
+
+    template<size_t order, typename elem_type>
+    b_vector<order, elem_type> vector_batch<order, elem_type>::get(size_t idx) const
+    {
+        b_vector<order, elem_type> v;
+        for (size_t i = 0; i < order; ++i) v[i] = component(i)[idx];
+        return v;
+    }
+
+    //////////////////////////////////////////////////////////////////////////////////////////////////
+    // batched solver implementation
+    //////////////////////////////////////////////////////////////////////////////////////////////////
+
+    namespace batched_solver_detail
+    {
+        // lanes per block, two 256-bit registers of floats or four of doubles
+        const size_t block_lanes = 16;
+
+        // One block of lanes: the matrices, right-hand sides and flags are copied into small
+        // lane-innermost arrays so every loop below is a straight run over the lanes without
+        // branches (row swaps and rank checks are selects).
+        template<size_t order, typename elem_type>
+        struct lane_block
+        {
+            elem_type m[order * order][block_lanes];
+            elem_type v[order][block_lanes];
+            elem_type tolerance[block_lanes];
+            std::uint8_t deficient[block_lanes];
+
+            void load(const matrix_batch<order, elem_type>& a, const vector_batch<order, elem_type>& b,
+                      size_t first, size_t count)
+            {
+                // lanes past the end of the batch solve the identity
+                for (size_t c = 0; c < order * order; ++c) {
+                    const elem_type* src = a.cell(c / order, c % order) + first;
+                    elem_type pad = c / order == c % order ? elem_type(1) : elem_type(0);
+                    for (size_t l = 0; l < block_lanes; ++l) m[c][l] = l < count ? src[l] : pad;
+                }
+                for (size_t i = 0; i < order; ++i) {
+                    const elem_type* src = b.component(i) + first;
+                    for (size_t l = 0; l < block_lanes; ++l) v[i][l] = l < count ? src[l] : elem_type(0);
+                }
+                for (size_t l = 0; l < block_lanes; ++l) {
+                    elem_type largest = 0;
+                    for (size_t c = 0; c < order * order; ++c) largest = std::max(largest, std::fabs(m[c][l]));
+                    tolerance[l] = elem_type(16 * order) * std::numeric_limits<elem_type>::epsilon() * largest;
+                    deficient[l] = largest == 0;
+                }
+            }
+
+            void store(vector_batch<order, elem_type>& x, size_t first, size_t count) const
+            {
+                for (size_t i = 0; i < order; ++i) {
+                    elem_type* dst = x.component(i) + first;
+                    for (size_t l = 0; l < count; ++l) dst[l] = deficient[l] ? elem_type(0) : v[i][l];
+                }
+            }
+
+            void solve_lu()
+            {
+                elem_type scratch[block_lanes];
+                elem_type divisor[block_lanes];
+                for (size_t k = 0; k < order; ++k) {
+                    // partial pivoting: bring the largest remaining element of column k to row k
+                    for (size_t r = k + 1; r < order; ++r) {
+                        bool swap[block_lanes];
+                        for (size_t l = 0; l < block_lanes; ++l) {
+                            swap[l] = std::fabs(m[r * order + k][l]) > std::fabs(m[k * order + k][l]);
+                        }
+                        for (size_t j = k; j < order; ++j) select_swap(m[k * order + j], m[r * order + j], swap);
+                        select_swap(v[k], v[r], swap);
+                    }
+                    for (size_t l = 0; l < block_lanes; ++l) {
+                        elem_type pivot = m[k * order + k][l];
+                        bool small = !(std::fabs(pivot) > tolerance[l]);
+                        deficient[l] |= small;
+                        divisor[l] = small ? elem_type(1) : pivot;
+                        scratch[l] = small ? elem_type(0) : 1 / pivot;
+                    }
+                    for (size_t r = k + 1; r < order; ++r) {
+                        // divide rather than multiply by the reciprocal so a row equal to the
+                        // pivot row gets a factor of exactly 1 and cancels to exact zeros
+                        elem_type f[block_lanes];
+                        for (size_t l = 0; l < block_lanes; ++l) f[l] = m[r * order + k][l] / divisor[l];
+                        for (size_t j = k + 1; j < order; ++j) {
+                            for (size_t l = 0; l < block_lanes; ++l) m[r * order + j][l] -= f[l] * m[k * order + j][l];
+                        }
+                        for (size_t l = 0; l < block_lanes; ++l) v[r][l] -= f[l] * v[k][l];
+                    }
+                    for (size_t l = 0; l < block_lanes; ++l) m[k * order + k][l] = scratch[l];
+                }
+                // back substitution, the diagonal now holds reciprocal pivots
+                for (size_t k = order; k-- > 0;) {
+                    for (size_t j = k + 1; j < order; ++j) {
+                        for (size_t l = 0; l < block_lanes; ++l) v[k][l] -= m[k * order + j][l] * v[j][l];
+                    }
+                    for (size_t l = 0; l < block_lanes; ++l) v[k][l] *= m[k * order + k][l];
+                }
+            }
+
+            void solve_cholesky()
+            {
+                // lower factor in the lower triangle, reciprocal diagonal on the diagonal
+                for (size_t j = 0; j < order; ++j) {
+                    for (size_t k = 0; k < j; ++k) {
+                        for (size_t l = 0; l < block_lanes; ++l) {
+                            m[j * order + j][l] -= m[j * order + k][l] * m[j * order + k][l];
+                        }
+                    }
+                    for (size_t l = 0; l < block_lanes; ++l) {
+                        elem_type d = m[j * order + j][l];
+                        bool small = !(d > tolerance[l]);
+                        deficient[l] |= small;
+                        m[j * order + j][l] = small ? elem_type(0) : 1 / std::sqrt(d);
+                    }
+                    for (size_t i = j + 1; i < order; ++i) {
+                        for (size_t k = 0; k < j; ++k) {
+                            for (size_t l = 0; l < block_lanes; ++l) {
+                                m[i * order + j][l] -= m[i * order + k][l] * m[j * order + k][l];
+                            }
+                        }
+                        for (size_t l = 0; l < block_lanes; ++l) m[i * order + j][l] *= m[j * order + j][l];
+                    }
+                }
+                // L y = b, then L^T x = y
+                for (size_t i = 0; i < order; ++i) {
+                    for (size_t k = 0; k < i; ++k) {
+                        for (size_t l = 0; l < block_lanes; ++l) v[i][l] -= m[i * order + k][l] * v[k][l];
+                    }
+                    for (size_t l = 0; l < block_lanes; ++l) v[i][l] *= m[i * order + i][l];
+                }
+                for (size_t i = order; i-- > 0;) {
+                    for (size_t k = i + 1; k < order; ++k) {
+                        for (size_t l = 0; l < block_lanes; ++l) v[i][l] -= m[k * order + i][l] * v[k][l];
+                    }
+                    for (size_t l = 0; l < block_lanes; ++l) v[i][l] *= m[i * order + i][l];
+                }
+            }
+
+            static void select_swap(elem_type* top, elem_type* row, const bool* swap)
+            {
+                for (size_t l = 0; l < block_lanes; ++l) {
+                    elem_type t = top[l], r = row[l];
+                    top[l] = swap[l] ? r : t;
+                    row[l] = swap[l] ? t : r;
+                }
+            }
+        };
+    }
+
+    template<size_t order, typename elem_type>
+    size_t solve_batch(const matrix_batch<order, elem_type>& a, const vector_batch<order, elem_type>& b,
+                       vector_batch<order, elem_type>& x, solve_method method,
+                       std::vector<std::uint32_t>* out_rank_deficient, size_t thread_count)
+    {
+        const size_t lanes = batched_solver_detail::block_lanes;
+        size_t n = a.size();
+        assert(b.size() == n);
+        if (x.size() != n) x.resize(n);
+        size_t block_count = (n + lanes - 1) / lanes;
+        std::vector<std::uint8_t> deficient(n, 0);
+
+        parallel_for(0, block_count, [&](size_t first_block, size_t last_block) {
+            batched_solver_detail::lane_block<order, elem_type> block;
+            for (size_t blk = first_block; blk < last_block; ++blk) {
+                size_t first = blk * lanes;
+                size_t count = std::min(lanes, n - first);
+                block.load(a, b, first, count);
+                if (method == solve_method::cholesky) block.solve_cholesky();
+                else block.solve_lu();
+                block.store(x, first, count);
+                for (size_t l = 0; l < count; ++l) deficient[first + l] = block.deficient[l];
+            }
+        }, thread_count, 256);
+
+        size_t deficient_count = 0;
+        for (size_t s = 0; s < n; ++s) {
+            if (!deficient[s]) continue;
+            ++deficient_count;
+            if (out_rank_deficient) out_rank_deficient->push_back(static_cast<std::uint32_t>(s));
+        }
+        return deficient_count;
+    }
+}
+
+#endif // BCG_BATCHED_SOLVER_HPP
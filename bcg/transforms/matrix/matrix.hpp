@@ -9,6 +9,8 @@
 #include <initializer_list>
 #include <iomanip>
 #include <iostream>
+#include <limits>
+#include <memory>
 
 namespace bcg
 {
@@ -16,6 +18,15 @@ namespace bcg
     // matrix
     //////////////////////////////////////////////////////////////////////////////////////////////////
 
+    // how often a matrix's inverse cache answered inverse() and inverse_transpose()
+    struct matrix_cache_stats
+    {
+        size_t hits = 0;
+        size_t misses = 0;
+        // writes that dropped a valid cached inverse
+        size_t invalidations = 0;
+    };
+
     template<size_t row_count, size_t col_count=row_count, typename elem_type=double>
     class matrix
     {
@@ -27,6 +38,9 @@ namespace bcg
         matrix(const matrix<row_count, col_count, elem_type>& m);
         ~matrix() = default;
 
+        // keeps this matrix's inverse caching setting, see set_inverse_caching()
+        matrix<row_count, col_count, elem_type>& operator =(const matrix<row_count, col_count, elem_type>& m);
+
     public:
         // addition & subtraction
         matrix<row_count, col_count, elem_type>
@@ -62,6 +76,8 @@ namespace bcg
 
         // inverse
         matrix<row_count, col_count, elem_type> inverse() const;
+        // (A^-1)^T, for transforming normals
+        matrix<col_count, row_count, elem_type> inverse_transpose() const;
 
         // minor matrix
         matrix<row_count-1, col_count-1, elem_type> minor_matrix(size_t row_idx, size_t col_idx) const;
@@ -102,6 +118,19 @@ namespace bcg
 
         bool is_dirty() const;
 
+        // Memoises inverse() and inverse_transpose() until the next write, for matrices that are
+        // inverted far more often than they change (view, model). Off by default: a cached matrix
+        // carries a heap block and deep-copies it. Turning it on resets the stats.
+        void set_inverse_caching(bool enabled);
+        bool is_inverse_caching() const;
+        // zeros when caching is off
+        matrix_cache_stats inverse_cache_stats() const;
+
+    private:
+        struct inverse_cache;
+
+        void invalidate_inverse_cache();
+
     private:
         bool _is_dirty = false;
         size_t _total_elem_count = {};
@@ -118,6 +147,8 @@ namespace bcg
         mutable bool _is_determinant_updated = false;
         mutable elem_type _determinant = {};
 
+        std::unique_ptr<inverse_cache> _inverse_cache;
+
         int _print_cell_width = 6;
     };
 
@@ -146,6 +177,16 @@ namespace bcg
     // matrix implementation
     //////////////////////////////////////////////////////////////////////////////////////////////////
 
+    template<size_t row_count, size_t col_count, typename elem_type>
+    struct matrix<row_count, col_count, elem_type>::inverse_cache
+    {
+        bool is_inverse_updated = false;
+        matrix<row_count, col_count, elem_type> inverse;
+        bool is_inverse_transpose_updated = false;
+        matrix<col_count, row_count, elem_type> inverse_transpose;
+        matrix_cache_stats stats;
+    };
+
     template<size_t row_count, size_t col_count, typename elem_type>
     matrix<row_count, col_count, elem_type>::matrix()
     {
@@ -219,9 +260,42 @@ namespace bcg
         _trace = m._trace;
         _is_determinant_updated = m._is_determinant_updated;
         _determinant = m._determinant;
+        if (m._inverse_cache) _inverse_cache.reset(new inverse_cache(*m._inverse_cache));
         _print_cell_width = m._print_cell_width;
     }
 
+    template<size_t row_count, size_t col_count, typename elem_type>
+    matrix<row_count, col_count, elem_type>&
+    matrix<row_count, col_count, elem_type>::operator =(const matrix<row_count, col_count, elem_type>& m)
+    {
+        if (this == &m) return *this;
+        _is_dirty = m._is_dirty;
+        _total_elem_count = m._total_elem_count;
+        _is_square = m._is_square;
+        _rows = m._rows;
+        _is_min_elem_updated = m._is_min_elem_updated;
+        _min_elem = m._min_elem;
+        _is_max_elem_updated = m._is_max_elem_updated;
+        _max_elem = m._max_elem;
+        _is_trace_updated = m._is_trace_updated;
+        _trace = m._trace;
+        _is_determinant_updated = m._is_determinant_updated;
+        _determinant = m._determinant;
+        // a cached matrix stays cached when a new value is assigned to it, taking the other
+        // matrix's cached inverse when there is one
+        if (_inverse_cache) {
+            invalidate_inverse_cache();
+            if (m._inverse_cache) {
+                _inverse_cache->is_inverse_updated = m._inverse_cache->is_inverse_updated;
+                _inverse_cache->inverse = m._inverse_cache->inverse;
+                _inverse_cache->is_inverse_transpose_updated = m._inverse_cache->is_inverse_transpose_updated;
+                _inverse_cache->inverse_transpose = m._inverse_cache->inverse_transpose;
+            }
+        }
+        _print_cell_width = m._print_cell_width;
+        return *this;
+    }
+
     template<size_t row_count, size_t col_count, typename elem_type>
     const elem_type& matrix<row_count, col_count, elem_type>::min_elem() const
     {
@@ -306,13 +380,37 @@ namespace bcg
 
             default:
             {
-                // TODO: How to calculate determinant of high order matrix efficiently here?
-                _determinant = {};
-//                // expand in first column
-//                for (size_t i = 0; i < row_count; ++i) {
-//                    _determinant = _determinant + _rows[i][0] * A(i, 0);
-//                }
-                return _determinant;
+                // gaussian elimination with partial pivoting on a copy, the cofactor expansion
+                // would instantiate minor matrices all the way down; it runs in long double so
+                // integral element types don't truncate the multipliers, and is rounded back
+                std::array<long double, row_count * col_count> lu;
+                for (size_t i = 0; i < row_count; ++i) {
+                    for (size_t j = 0; j < col_count; ++j) {
+                        lu[i * col_count + j] = static_cast<long double>(_rows[i][j]);
+                    }
+                }
+                long double det = 1;
+                for (size_t k = 0; k < row_count; ++k) {
+                    size_t pivot = k;
+                    for (size_t i = k + 1; i < row_count; ++i) {
+                        if (std::fabs(lu[i * col_count + k]) > std::fabs(lu[pivot * col_count + k])) pivot = i;
+                    }
+                    long double divisor = lu[pivot * col_count + k];
+                    if (divisor == 0) return (_determinant = elem_type{});
+                    if (pivot != k) {
+                        for (size_t j = k; j < col_count; ++j) {
+                            std::swap(lu[k * col_count + j], lu[pivot * col_count + j]);
+                        }
+                        det = -det;
+                    }
+                    det = det * divisor;
+                    for (size_t i = k + 1; i < row_count; ++i) {
+                        long double f = lu[i * col_count + k] / divisor;
+                        for (size_t j = k + 1; j < col_count; ++j) lu[i * col_count + j] -= f * lu[k * col_count + j];
+                    }
+                }
+                if (std::numeric_limits<elem_type>::is_integer) det = std::round(det);
+                return (_determinant = static_cast<elem_type>(det));
             }
         }
     }
@@ -417,6 +515,7 @@ namespace bcg
     {
         _is_determinant_updated = _is_trace_updated = false;
         _is_min_elem_updated = _is_max_elem_updated = false;
+        invalidate_inverse_cache();
         return _rows[row_idx];
     }
 
@@ -448,7 +547,29 @@ namespace bcg
     template<size_t row_count, size_t col_count, typename elem_type>
     matrix<row_count, col_count, elem_type> matrix<row_count, col_count, elem_type>::inverse() const
     {
-        return adjoint() / determinant();
+        if (!_inverse_cache) return adjoint() / determinant();
+
+        if (_inverse_cache->is_inverse_updated) {
+            ++_inverse_cache->stats.hits;
+            return _inverse_cache->inverse;
+        }
+        ++_inverse_cache->stats.misses;
+        _inverse_cache->is_inverse_updated = true;
+        return (_inverse_cache->inverse = adjoint() / determinant());
+    }
+
+    template<size_t row_count, size_t col_count, typename elem_type>
+    matrix<col_count, row_count, elem_type> matrix<row_count, col_count, elem_type>::inverse_transpose() const
+    {
+        if (!_inverse_cache) return inverse().transpose();
+
+        if (_inverse_cache->is_inverse_transpose_updated) {
+            ++_inverse_cache->stats.hits;
+            return _inverse_cache->inverse_transpose;
+        }
+        // built from the cached inverse when there is one, that lookup counts on its own
+        _inverse_cache->is_inverse_transpose_updated = true;
+        return (_inverse_cache->inverse_transpose = inverse().transpose());
     }
 
     template<size_t row_count, size_t col_count, typename elem_type>
@@ -540,6 +661,7 @@ namespace bcg
     {
         _is_determinant_updated = _is_trace_updated = false;
         _is_min_elem_updated = _is_max_elem_updated = false;
+        invalidate_inverse_cache();
         _rows[row_idx] = row;
     }
 
@@ -548,6 +670,7 @@ namespace bcg
     {
         _is_determinant_updated = _is_trace_updated = false;
         _is_min_elem_updated = _is_max_elem_updated = false;
+        invalidate_inverse_cache();
         for (size_t i = 0; i < row_count; ++i) {
             _rows[i][col_idx] = col[i];
         }
@@ -558,6 +681,7 @@ namespace bcg
     {
         _is_determinant_updated = _is_trace_updated = false;
         _is_min_elem_updated = _is_max_elem_updated = false;
+        invalidate_inverse_cache();
         _rows[row_idx][col_idx] = value;
     }
 
@@ -589,6 +713,35 @@ namespace bcg
         return _is_dirty;
     }
 
+    template<size_t row_count, size_t col_count, typename elem_type>
+    void matrix<row_count, col_count, elem_type>::set_inverse_caching(bool enabled)
+    {
+        if (!enabled) _inverse_cache.reset();
+        else if (!_inverse_cache) _inverse_cache.reset(new inverse_cache());
+    }
+
+    template<size_t row_count, size_t col_count, typename elem_type>
+    bool matrix<row_count, col_count, elem_type>::is_inverse_caching() const
+    {
+        return _inverse_cache != nullptr;
+    }
+
+    template<size_t row_count, size_t col_count, typename elem_type>
+    matrix_cache_stats matrix<row_count, col_count, elem_type>::inverse_cache_stats() const
+    {
+        return _inverse_cache ? _inverse_cache->stats : matrix_cache_stats();
+    }
+
+    template<size_t row_count, size_t col_count, typename elem_type>
+    void matrix<row_count, col_count, elem_type>::invalidate_inverse_cache()
+    {
+        if (!_inverse_cache) return;
+        if (_inverse_cache->is_inverse_updated || _inverse_cache->is_inverse_transpose_updated) {
+            ++_inverse_cache->stats.invalidations;
+        }
+        _inverse_cache->is_inverse_updated = _inverse_cache->is_inverse_transpose_updated = false;
+    }
+
 }
 
-#endif // BCG_MATRIX_HPP
\ No newline at end of file
+#endif // BCG_MATRIX_HPP
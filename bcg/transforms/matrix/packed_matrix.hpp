@@ -0,0 +1,141 @@
+#ifndef BCG_PACKED_MATRIX_HPP
+#define BCG_PACKED_MATRIX_HPP
+
+#include "transforms/matrix/matrix.hpp"
+
+#include <cstddef>
+
+namespace bcg
+{
+    //////////////////////////////////////////////////////////////////////////////////////////////////
+    // packed_matrix4
+    //////////////////////////////////////////////////////////////////////////////////////////////////
+
+    // Row-major 4x4 matrix in a plain array. Batched kernels convert a matrix<4, 4> once and then run
+    // their inner loops on this, without the bounds checks and cache flags of matrix and b_vector.
+    template<typename elem_type=float>
+    struct packed_matrix4
+    {
+        elem_type m[16];
+
+        packed_matrix4(); // identity
+        explicit packed_matrix4(const matrix<4, 4, elem_type>& src);
+
+        matrix<4, 4, elem_type> to_matrix() const;
+
+        elem_type& operator ()(size_t row_idx, size_t col_idx) { return m[row_idx * 4 + col_idx]; }
+        const elem_type& operator ()(size_t row_idx, size_t col_idx) const { return m[row_idx * 4 + col_idx]; }
+
+        packed_matrix4<elem_type> operator *(const packed_matrix4<elem_type>& r_matrix) const;
+
+        // (x, y, z, 1) -> (x', y', z'), the bottom row is ignored
+        void transform_point(const elem_type* in, elem_type* out) const;
+        // (x, y, z, 0) -> (x', y', z')
+        void transform_vector(const elem_type* in, elem_type* out) const;
+        // (x, y, z, 1) -> (x', y', z', w')
+        void transform_homogeneous(const elem_type* in, elem_type* out) const;
+
+        // row-major inverse-transpose of the upper-left 3x3, the matrix that keeps normals normal;
+        // a singular 3x3 gives its cofactor matrix instead (same directions up to scale) and false
+        bool normal_matrix(elem_type* out) const;
+    };
+
+    //////////////////////////////////////////////////////////////////////////////////////////////////
+    // packed_matrix4 implementation
+    //////////////////////////////////////////////////////////////////////////////////////////////////
+
+    template<typename elem_type>
+    packed_matrix4<elem_type>::packed_matrix4()
+    {
+        for (size_t i = 0; i < 16; ++i) {
+            m[i] = (i % 5 == 0) ? elem_type(1) : elem_type(0);
+        }
+    }
+
+    template<typename elem_type>
+    packed_matrix4<elem_type>::packed_matrix4(const matrix<4, 4, elem_type>& src)
+    {
+        for (size_t row_idx = 0; row_idx < 4; ++row_idx) {
+            const b_vector<4, elem_type>& row = src.get_row(row_idx);
+            for (size_t col_idx = 0; col_idx < 4; ++col_idx) {
+                m[row_idx * 4 + col_idx] = row[col_idx];
+            }
+        }
+    }
+
+    template<typename elem_type>
+    matrix<4, 4, elem_type> packed_matrix4<elem_type>::to_matrix() const
+    {
+        std::array<elem_type, 16> elems;
+        for (size_t i = 0; i < 16; ++i) {
+            elems[i] = m[i];
+        }
+        return matrix<4, 4, elem_type>(elems);
+    }
+
+    template<typename elem_type>
+    packed_matrix4<elem_type> packed_matrix4<elem_type>::operator *(const packed_matrix4<elem_type>& r_matrix) const
+    {
+        packed_matrix4<elem_type> prod;
+        for (size_t row_idx = 0; row_idx < 4; ++row_idx) {
+            for (size_t col_idx = 0; col_idx < 4; ++col_idx) {
+                elem_type tmp_elem = {};
+                for (size_t i = 0; i < 4; ++i) {
+                    tmp_elem += m[row_idx * 4 + i] * r_matrix.m[i * 4 + col_idx];
+                }
+                prod.m[row_idx * 4 + col_idx] = tmp_elem;
+            }
+        }
+        return prod;
+    }
+
+    template<typename elem_type>
+    void packed_matrix4<elem_type>::transform_point(const elem_type* in, elem_type* out) const
+    {
+        elem_type x = in[0], y = in[1], z = in[2];
+        out[0] = m[0] * x + m[1] * y + m[2] * z + m[3];
+        out[1] = m[4] * x + m[5] * y + m[6] * z + m[7];
+        out[2] = m[8] * x + m[9] * y + m[10] * z + m[11];
+    }
+
+    template<typename elem_type>
+    void packed_matrix4<elem_type>::transform_vector(const elem_type* in, elem_type* out) const
+    {
+        elem_type x = in[0], y = in[1], z = in[2];
+        out[0] = m[0] * x + m[1] * y + m[2] * z;
+        out[1] = m[4] * x + m[5] * y + m[6] * z;
+        out[2] = m[8] * x + m[9] * y + m[10] * z;
+    }
+
+    template<typename elem_type>
+    void packed_matrix4<elem_type>::transform_homogeneous(const elem_type* in, elem_type* out) const
+    {
+        elem_type x = in[0], y = in[1], z = in[2];
+        out[0] = m[0] * x + m[1] * y + m[2] * z + m[3];
+        out[1] = m[4] * x + m[5] * y + m[6] * z + m[7];
+        out[2] = m[8] * x + m[9] * y + m[10] * z + m[11];
+        out[3] = m[12] * x + m[13] * y + m[14] * z + m[15];
+    }
+
+    template<typename elem_type>
+    bool packed_matrix4<elem_type>::normal_matrix(elem_type* out) const
+    {
+        // cofactors of the 3x3 are det * inverse-transpose
+        out[0] = m[5] * m[10] - m[6] * m[9];
+        out[1] = m[6] * m[8] - m[4] * m[10];
+        out[2] = m[4] * m[9] - m[5] * m[8];
+        out[3] = m[2] * m[9] - m[1] * m[10];
+        out[4] = m[0] * m[10] - m[2] * m[8];
+        out[5] = m[1] * m[8] - m[0] * m[9];
+        out[6] = m[1] * m[6] - m[2] * m[5];
+        out[7] = m[2] * m[4] - m[0] * m[6];
+        out[8] = m[0] * m[5] - m[1] * m[4];
+
+        elem_type det = m[0] * out[0] + m[1] * out[1] + m[2] * out[2];
+        if (det == elem_type(0)) return false;
+        for (size_t i = 0; i < 9; ++i) out[i] /= det;
+        return true;
+    }
+}
+
+#endif // BCG_PACKED_MATRIX_HPP
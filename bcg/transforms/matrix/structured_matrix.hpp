@@ -0,0 +1,1059 @@
+#ifndef BCG_STRUCTURED_MATRIX_HPP
+#define BCG_STRUCTURED_MATRIX_HPP
+
+#include "transforms/b_vector/b_vector.hpp"
+#include "transforms/matrix/matrix.hpp"
+
+#include <algorithm>
+#include <array>
+#include <cmath>
+#include <initializer_list>
+#include <iostream>
+
+namespace bcg
+{
+    //////////////////////////////////////////////////////////////////////////////////////////////////
+    // diagonal_matrix
+    //////////////////////////////////////////////////////////////////////////////////////////////////
+
+    // Square matrix that is zero off the diagonal, only the diagonal is stored.
+    template<size_t order, typename elem_type=double>
+    class diagonal_matrix
+    {
+    public:
+        diagonal_matrix(); // zero matrix
+        diagonal_matrix(std::initializer_list<elem_type> diagonal);
+        // keeps the diagonal of [m] and drops everything else
+        explicit diagonal_matrix(const matrix<order, order, elem_type>& m);
+
+        explicit operator matrix<order, order, elem_type>() const;
+        matrix<order, order, elem_type> to_matrix() const;
+
+    public:
+        // addition & subtraction
+        diagonal_matrix<order, elem_type> operator +(const diagonal_matrix<order, elem_type>& r_matrix) const;
+        diagonal_matrix<order, elem_type> operator -(const diagonal_matrix<order, elem_type>& r_matrix) const;
+        diagonal_matrix<order, elem_type> operator -() const;
+        matrix<order, order, elem_type> operator +(const matrix<order, order, elem_type>& r_matrix) const;
+        matrix<order, order, elem_type> operator -(const matrix<order, order, elem_type>& r_matrix) const;
+
+        // scalar multiplication
+        diagonal_matrix<order, elem_type> operator *(const elem_type& lambda) const;
+        diagonal_matrix<order, elem_type> operator /(const elem_type& lambda) const;
+
+        // multiplication, by a matrix scales its rows
+        diagonal_matrix<order, elem_type> operator *(const diagonal_matrix<order, elem_type>& r_matrix) const;
+        template<size_t r_col_count>
+        matrix<order, r_col_count, elem_type> operator *(const matrix<order, r_col_count, elem_type>& r_matrix) const;
+        b_vector<order, elem_type> operator *(const b_vector<order, elem_type>& r_vector) const;
+
+        // n operations each
+        elem_type determinant() const;
+        elem_type trace() const;
+        diagonal_matrix<order, elem_type> inverse() const;
+        diagonal_matrix<order, elem_type> transpose() const { return *this; }
+        b_vector<order, elem_type> solve(const b_vector<order, elem_type>& rhs) const;
+
+        template<size_t _order, typename _elem_type>
+        friend std::ostream& operator <<(std::ostream& out, const diagonal_matrix<_order, _elem_type>& self);
+
+    public:
+        elem_type get_cell(size_t row_idx, size_t col_idx) const;
+        const elem_type& get_diagonal(size_t idx) const { return _diagonal[idx]; }
+        void set_diagonal(size_t idx, const elem_type& value) { _diagonal[idx] = value; }
+
+    private:
+        std::array<elem_type, order> _diagonal;
+    };
+
+    //////////////////////////////////////////////////////////////////////////////////////////////////
+    // symmetric_matrix
+    //////////////////////////////////////////////////////////////////////////////////////////////////
+
+    // Square matrix equal to its transpose. The upper triangle is stored packed row by row,
+    // n (n + 1) / 2 elements, e.g. covariance matrices and error quadrics.
+    template<size_t order, typename elem_type=double>
+    class symmetric_matrix
+    {
+    public:
+        symmetric_matrix(); // zero matrix
+        // the upper triangle row by row, e.g. a00 a01 a02 a11 a12 a22
+        symmetric_matrix(std::initializer_list<elem_type> upper);
+        // keeps the upper triangle of [m], so the caller vouches for the symmetry
+        explicit symmetric_matrix(const matrix<order, order, elem_type>& m);
+
+        explicit operator matrix<order, order, elem_type>() const;
+        matrix<order, order, elem_type> to_matrix() const;
+
+    public:
+        // addition & subtraction
+        symmetric_matrix<order, elem_type> operator +(const symmetric_matrix<order, elem_type>& r_matrix) const;
+        symmetric_matrix<order, elem_type> operator -(const symmetric_matrix<order, elem_type>& r_matrix) const;
+        symmetric_matrix<order, elem_type> operator -() const;
+        matrix<order, order, elem_type> operator +(const matrix<order, order, elem_type>& r_matrix) const;
+        matrix<order, order, elem_type> operator -(const matrix<order, order, elem_type>& r_matrix) const;
+
+        // scalar multiplication
+        symmetric_matrix<order, elem_type> operator *(const elem_type& lambda) const;
+        symmetric_matrix<order, elem_type> operator /(const elem_type& lambda) const;
+
+        // multiplication
+        template<size_t r_col_count>
+        matrix<order, r_col_count, elem_type> operator *(const matrix<order, r_col_count, elem_type>& r_matrix) const;
+        b_vector<order, elem_type> operator *(const b_vector<order, elem_type>& r_vector) const;
+        // v^T A v
+        elem_type quadratic_form(const b_vector<order, elem_type>& v) const;
+
+        // Through an LDL^T factorisation (n^3 / 6 multiplications), with a pivoting fallback for
+        // indefinite matrices whose small pivots make the factors grow (never the case for positive
+        // definite ones). A singular matrix has a zero determinant and a non-finite inverse, as with
+        // matrix::inverse().
+        elem_type determinant() const;
+        elem_type trace() const;
+        symmetric_matrix<order, elem_type> inverse() const;
+        symmetric_matrix<order, elem_type> transpose() const { return *this; }
+        b_vector<order, elem_type> solve(const b_vector<order, elem_type>& rhs) const;
+
+        template<size_t _order, typename _elem_type>
+        friend std::ostream& operator <<(std::ostream& out, const symmetric_matrix<_order, _elem_type>& self);
+
+    public:
+        const elem_type& get_cell(size_t row_idx, size_t col_idx) const { return _upper[index(row_idx, col_idx)]; }
+        // sets both (row, col) and (col, row)
+        void set_cell(size_t row_idx, size_t col_idx, const elem_type& value) { _upper[index(row_idx, col_idx)] = value; }
+        const elem_type* data() const { return _upper.data(); }
+
+    private:
+        static size_t index(size_t row_idx, size_t col_idx);
+        // unit lower L (below the diagonal) and D (on it) of A = L D L^T, false on a zero pivot or
+        // growth beyond structured_detail::ldl_growth_limit
+        bool factorize(std::array<elem_type, order * order>& ld) const;
+
+    private:
+        std::array<elem_type, order * (order + 1) / 2> _upper;
+    };
+
+    //////////////////////////////////////////////////////////////////////////////////////////////////
+    // triangular_matrix
+    //////////////////////////////////////////////////////////////////////////////////////////////////
+
+    enum class triangle_kind
+    {
+        lower,
+        upper
+    };
+
+    // Square matrix that is zero above (lower) or below (upper) the diagonal. The triangle is
+    // stored packed row by row, n (n + 1) / 2 elements, e.g. LU and Cholesky factors.
+    template<size_t order, triangle_kind kind=triangle_kind::lower, typename elem_type=double>
+    class triangular_matrix
+    {
+    public:
+        triangular_matrix(); // zero matrix
+        // the triangle row by row, e.g. a00 a10 a11 a20 a21 a22 for a lower one
+        triangular_matrix(std::initializer_list<elem_type> triangle);
+        // keeps the triangle of [m] and drops the rest
+        explicit triangular_matrix(const matrix<order, order, elem_type>& m);
+
+        explicit operator matrix<order, order, elem_type>() const;
+        matrix<order, order, elem_type> to_matrix() const;
+
+    public:
+        // addition & subtraction
+        triangular_matrix<order, kind, elem_type> operator +(const triangular_matrix<order, kind, elem_type>& r_matrix) const;
+        triangular_matrix<order, kind, elem_type> operator -(const triangular_matrix<order, kind, elem_type>& r_matrix) const;
+        triangular_matrix<order, kind, elem_type> operator -() const;
+        matrix<order, order, elem_type> operator +(const matrix<order, order, elem_type>& r_matrix) const;
+        matrix<order, order, elem_type> operator -(const matrix<order, order, elem_type>& r_matrix) const;
+
+        // scalar multiplication
+        triangular_matrix<order, kind, elem_type> operator *(const elem_type& lambda) const;
+        triangular_matrix<order, kind, elem_type> operator /(const elem_type& lambda) const;
+
+        // multiplication, products of two lower (upper) matrices stay lower (upper)
+        triangular_matrix<order, kind, elem_type> operator *(const triangular_matrix<order, kind, elem_type>& r_matrix) const;
+        template<size_t r_col_count>
+        matrix<order, r_col_count, elem_type> operator *(const matrix<order, r_col_count, elem_type>& r_matrix) const;
+        b_vector<order, elem_type> operator *(const b_vector<order, elem_type>& r_vector) const;
+
+        // the determinant is the product of the diagonal, solve is one substitution sweep
+        elem_type determinant() const;
+        elem_type trace() const;
+        triangular_matrix<order, kind, elem_type> inverse() const;
+        triangular_matrix<order, kind == triangle_kind::lower ? triangle_kind::upper : triangle_kind::lower, elem_type>
+            transpose() const;
+        b_vector<order, elem_type> solve(const b_vector<order, elem_type>& rhs) const;
+
+        template<size_t _order, triangle_kind _kind, typename _elem_type>
+        friend std::ostream& operator <<(std::ostream& out, const triangular_matrix<_order, _kind, _elem_type>& self);
+
+    public:
+        // zero outside the triangle
+        elem_type get_cell(size_t row_idx, size_t col_idx) const;
+        // cells outside the triangle are ignored
+        void set_cell(size_t row_idx, size_t col_idx, const elem_type& value);
+        bool in_triangle(size_t row_idx, size_t col_idx) const
+        {
+            return kind == triangle_kind::lower ? col_idx <= row_idx : col_idx >= row_idx;
+        }
+        const elem_type* data() const { return _triangle.data(); }
+
+    private:
+        static size_t index(size_t row_idx, size_t col_idx);
+        // columns [first_col(i), last_col(i)] of row i are inside the triangle
+        static size_t first_col(size_t row_idx) { return kind == triangle_kind::lower ? 0 : row_idx; }
+        static size_t last_col(size_t row_idx) { return kind == triangle_kind::lower ? row_idx : order - 1; }
+
+    private:
+        std::array<elem_type, order * (order + 1) / 2> _triangle;
+    };
+
+    //////////////////////////////////////////////////////////////////////////////////////////////////
+    // mixed operators with matrix on the left
+    //////////////////////////////////////////////////////////////////////////////////////////////////
+
+    template<size_t row_count, size_t order, typename elem_type>
+    matrix<row_count, order, elem_type>
+        operator *(const matrix<row_count, order, elem_type>& l_matrix, const diagonal_matrix<order, elem_type>& r_matrix);
+    template<size_t row_count, size_t order, typename elem_type>
+    matrix<row_count, order, elem_type>
+        operator *(const matrix<row_count, order, elem_type>& l_matrix, const symmetric_matrix<order, elem_type>& r_matrix);
+    template<size_t row_count, size_t order, triangle_kind kind, typename elem_type>
+    matrix<row_count, order, elem_type>
+        operator *(const matrix<row_count, order, elem_type>& l_matrix, const triangular_matrix<order, kind, elem_type>& r_matrix);
+
+    template<size_t order, typename elem_type>
+    matrix<order, order, elem_type>
+        operator +(const matrix<order, order, elem_type>& l_matrix, const diagonal_matrix<order, elem_type>& r_matrix);
+    template<size_t order, typename elem_type>
+    matrix<order, order, elem_type>
+        operator -(const matrix<order, order, elem_type>& l_matrix, const diagonal_matrix<order, elem_type>& r_matrix);
+    template<size_t order, typename elem_type>
+    matrix<order, order, elem_type>
+        operator +(const matrix<order, order, elem_type>& l_matrix, const symmetric_matrix<order, elem_type>& r_matrix);
+    template<size_t order, typename elem_type>
+    matrix<order, order, elem_type>
+        operator -(const matrix<order, order, elem_type>& l_matrix, const symmetric_matrix<order, elem_type>& r_matrix);
+    template<size_t order, triangle_kind kind, typename elem_type>
+    matrix<order, order, elem_type>
+        operator +(const matrix<order, order, elem_type>& l_matrix, const triangular_matrix<order, kind, elem_type>& r_matrix);
+    template<size_t order, triangle_kind kind, typename elem_type>
+    matrix<order, order, elem_type>
+        operator -(const matrix<order, order, elem_type>& l_matrix, const triangular_matrix<order, kind, elem_type>& r_matrix);
+
+    //////////////////////////////////////////////////////////////////////////////////////////////////
+    // structured matrix helpers
+    //////////////////////////////////////////////////////////////////////////////////////////////////
+
+    namespace structured_detail
+    {
+        // LDL^T without pivoting is abandoned once sum_k l_jk^2 |d_k| exceeds this times the largest
+        // entry, which bounds |L| |D| |L^T| and with it the backward error
+        const double ldl_growth_limit = 64;
+
+        // In-place Gauss-Jordan with partial pivoting on a row-major n x n array: [a] becomes its
+        // inverse and the determinant is returned. Used where a structured factorisation breaks down.
+        template<size_t order, typename elem_type>
+        elem_type gauss_jordan(std::array<elem_type, order * order>& a)
+        {
+            std::array<size_t, order> pivots;
+            elem_type det = 1;
+            for (size_t k = 0; k < order; ++k) {
+                size_t pivot = k;
+                for (size_t i = k + 1; i < order; ++i) {
+                    if (std::fabs(a[i * order + k]) > std::fabs(a[pivot * order + k])) pivot = i;
+                }
+                pivots[k] = pivot;
+                if (pivot != k) {
+                    for (size_t j = 0; j < order; ++j) std::swap(a[k * order + j], a[pivot * order + j]);
+                    det = -det;
+                }
+                elem_type p = a[k * order + k];
+                det *= p;
+                a[k * order + k] = 1;
+                for (size_t j = 0; j < order; ++j) a[k * order + j] /= p;
+                for (size_t i = 0; i < order; ++i) {
+                    if (i == k) continue;
+                    elem_type f = a[i * order + k];
+                    a[i * order + k] = 0;
+                    for (size_t j = 0; j < order; ++j) a[i * order + j] -= f * a[k * order + j];
+                }
+            }
+            // row swaps of the input are column swaps of the inverse, undone last one first
+            for (size_t k = order; k-- > 0;) {
+                if (pivots[k] == k) continue;
+                for (size_t i = 0; i < order; ++i) std::swap(a[i * order + k], a[i * order + pivots[k]]);
+            }
+            return det;
+        }
+    }
+
+    //////////////////////////////////////////////////////////////////////////////////////////////////
+    // diagonal_matrix implementation
+    //////////////////////////////////////////////////////////////////////////////////////////////////
+
+    template<size_t order, typename elem_type>
+    diagonal_matrix<order, elem_type>::diagonal_matrix()
+    {
+        _diagonal.fill(elem_type());
+    }
+
+    template<size_t order, typename elem_type>
+    diagonal_matrix<order, elem_type>::diagonal_matrix(std::initializer_list<elem_type> diagonal)
+    {
+        _diagonal.fill(elem_type());
+        size_t i = 0;
+        for (auto p_elem = diagonal.begin(); i < order && p_elem != diagonal.end(); ++i, ++p_elem) {
+            _diagonal[i] = *p_elem;
+        }
+    }
+
+    template<size_t order, typename elem_type>
+    diagonal_matrix<order, elem_type>::diagonal_matrix(const matrix<order, order, elem_type>& m)
+    {
+        for (size_t i = 0; i < order; ++i) _diagonal[i] = m[i][i];
+    }
+
+    template<size_t order, typename elem_type>
+    diagonal_matrix<order, elem_type>::operator matrix<order, order, elem_type>() const
+    {
+        return to_matrix();
+    }
+
+    template<size_t order, typename elem_type>
+    matrix<order, order, elem_type> diagonal_matrix<order, elem_type>::to_matrix() const
+    {
+        matrix<order, order, elem_type> m;
+        for (size_t i = 0; i < order; ++i) m[i][i] = _diagonal[i];
+        return m;
+    }
+
+    template<size_t order, typename elem_type>
+    diagonal_matrix<order, elem_type>
+    diagonal_matrix<order, elem_type>::operator +(const diagonal_matrix<order, elem_type>& r_matrix) const
+    {
+        diagonal_matrix<order, elem_type> sum_matrix;
+        for (size_t i = 0; i < order; ++i) sum_matrix._diagonal[i] = _diagonal[i] + r_matrix._diagonal[i];
+        return sum_matrix;
+    }
+
+    template<size_t order, typename elem_type>
+    diagonal_matrix<order, elem_type>
+    diagonal_matrix<order, elem_type>::operator -(const diagonal_matrix<order, elem_type>& r_matrix) const
+    {
+        diagonal_matrix<order, elem_type> diff_matrix;
+        for (size_t i = 0; i < order; ++i) diff_matrix._diagonal[i] = _diagonal[i] - r_matrix._diagonal[i];
+        return diff_matrix;
+    }
+
+    template<size_t order, typename elem_type>
+    diagonal_matrix<order, elem_type> diagonal_matrix<order, elem_type>::operator -() const
+    {
+        return (*this) * elem_type(-1);
+    }
+
+    template<size_t order, typename elem_type>
+    matrix<order, order, elem_type>
+    diagonal_matrix<order, elem_type>::operator +(const matrix<order, order, elem_type>& r_matrix) const
+    {
+        matrix<order, order, elem_type> sum_matrix = r_matrix;
+        for (size_t i = 0; i < order; ++i) sum_matrix[i][i] = _diagonal[i] + r_matrix[i][i];
+        return sum_matrix;
+    }
+
+    template<size_t order, typename elem_type>
+    matrix<order, order, elem_type>
+    diagonal_matrix<order, elem_type>::operator -(const matrix<order, order, elem_type>& r_matrix) const
+    {
+        matrix<order, order, elem_type> diff_matrix = -r_matrix;
+        for (size_t i = 0; i < order; ++i) diff_matrix[i][i] = _diagonal[i] - r_matrix[i][i];
+        return diff_matrix;
+    }
+
+    template<size_t order, typename elem_type>
+    diagonal_matrix<order, elem_type> diagonal_matrix<order, elem_type>::operator *(const elem_type& lambda) const
+    {
+        diagonal_matrix<order, elem_type> l_matrix;
+        for (size_t i = 0; i < order; ++i) l_matrix._diagonal[i] = lambda * _diagonal[i];
+        return l_matrix;
+    }
+
+    template<size_t order, typename elem_type>
+    diagonal_matrix<order, elem_type> diagonal_matrix<order, elem_type>::operator /(const elem_type& lambda) const
+    {
+        return (*this) * (1 / lambda);
+    }
+
+    template<size_t order, typename elem_type>
+    diagonal_matrix<order, elem_type>
+    diagonal_matrix<order, elem_type>::operator *(const diagonal_matrix<order, elem_type>& r_matrix) const
+    {
+        diagonal_matrix<order, elem_type> prod_matrix;
+        for (size_t i = 0; i < order; ++i) prod_matrix._diagonal[i] = _diagonal[i] * r_matrix._diagonal[i];
+        return prod_matrix;
+    }
+
+    template<size_t order, typename elem_type>
+    template<size_t r_col_count>
+    matrix<order, r_col_count, elem_type>
+    diagonal_matrix<order, elem_type>::operator *(const matrix<order, r_col_count, elem_type>& r_matrix) const
+    {
+        matrix<order, r_col_count, elem_type> prod_matrix;
+        for (size_t i = 0; i < order; ++i) {
+            for (size_t j = 0; j < r_col_count; ++j) prod_matrix[i][j] = _diagonal[i] * r_matrix[i][j];
+        }
+        return prod_matrix;
+    }
+
+    template<size_t order, typename elem_type>
+    b_vector<order, elem_type> diagonal_matrix<order, elem_type>::operator *(const b_vector<order, elem_type>& r_vector) const
+    {
+        b_vector<order, elem_type> prod_vector;
+        for (size_t i = 0; i < order; ++i) prod_vector[i] = _diagonal[i] * r_vector[i];
+        return prod_vector;
+    }
+
+    template<size_t order, typename elem_type>
+    elem_type diagonal_matrix<order, elem_type>::determinant() const
+    {
+        elem_type det = 1;
+        for (size_t i = 0; i < order; ++i) det *= _diagonal[i];
+        return det;
+    }
+
+    template<size_t order, typename elem_type>
+    elem_type diagonal_matrix<order, elem_type>::trace() const
+    {
+        elem_type sum = {};
+        for (size_t i = 0; i < order; ++i) sum += _diagonal[i];
+        return sum;
+    }
+
+    template<size_t order, typename elem_type>
+    diagonal_matrix<order, elem_type> diagonal_matrix<order, elem_type>::inverse() const
+    {
+        diagonal_matrix<order, elem_type> i_matrix;
+        for (size_t i = 0; i < order; ++i) i_matrix._diagonal[i] = 1 / _diagonal[i];
+        return i_matrix;
+    }
+
+    template<size_t order, typename elem_type>
+    b_vector<order, elem_type> diagonal_matrix<order, elem_type>::solve(const b_vector<order, elem_type>& rhs) const
+    {
+        b_vector<order, elem_type> x;
+        for (size_t i = 0; i < order; ++i) x[i] = rhs[i] / _diagonal[i];
+        return x;
+    }
+
+    template<size_t order, typename elem_type>
+    elem_type diagonal_matrix<order, elem_type>::get_cell(size_t row_idx, size_t col_idx) const
+    {
+        return row_idx == col_idx ? _diagonal[row_idx] : elem_type();
+    }
+
+    template<size_t _order, typename _elem_type>
+    std::ostream& operator <<(std::ostream& out, const diagonal_matrix<_order, _elem_type>& self)
+    {
+        return out << self.to_matrix();
+    }
+
+    //////////////////////////////////////////////////////////////////////////////////////////////////
+    // symmetric_matrix implementation
+    //////////////////////////////////////////////////////////////////////////////////////////////////
+
+    template<size_t order, typename elem_type>
+    symmetric_matrix<order, elem_type>::symmetric_matrix()
+    {
+        _upper.fill(elem_type());
+    }
+
+    template<size_t order, typename elem_type>
+    symmetric_matrix<order, elem_type>::symmetric_matrix(std::initializer_list<elem_type> upper)
+    {
+        _upper.fill(elem_type());
+        size_t i = 0;
+        for (auto p_elem = upper.begin(); i < _upper.size() && p_elem != upper.end(); ++i, ++p_elem) {
+            _upper[i] = *p_elem;
+        }
+    }
+
+    template<size_t order, typename elem_type>
+    symmetric_matrix<order, elem_type>::symmetric_matrix(const matrix<order, order, elem_type>& m)
+    {
+        for (size_t i = 0; i < order; ++i) {
+            for (size_t j = i; j < order; ++j) _upper[index(i, j)] = m[i][j];
+        }
+    }
+
+    template<size_t order, typename elem_type>
+    symmetric_matrix<order, elem_type>::operator matrix<order, order, elem_type>() const
+    {
+        return to_matrix();
+    }
+
+    template<size_t order, typename elem_type>
+    matrix<order, order, elem_type> symmetric_matrix<order, elem_type>::to_matrix() const
+    {
+        matrix<order, order, elem_type> m;
+        for (size_t i = 0; i < order; ++i) {
+            for (size_t j = i; j < order; ++j) {
+                m[i][j] = _upper[index(i, j)];
+                m[j][i] = _upper[index(i, j)];
+            }
+        }
+        return m;
+    }
+
+    template<size_t order, typename elem_type>
+    size_t symmetric_matrix<order, elem_type>::index(size_t row_idx, size_t col_idx)
+    {
+        if (row_idx > col_idx) std::swap(row_idx, col_idx);
+        return row_idx * order - row_idx * (row_idx - 1) / 2 + (col_idx - row_idx);
+    }
+
+    template<size_t order, typename elem_type>
+    symmetric_matrix<order, elem_type>
+    symmetric_matrix<order, elem_type>::operator +(const symmetric_matrix<order, elem_type>& r_matrix) const
+    {
+        symmetric_matrix<order, elem_type> sum_matrix;
+        for (size_t i = 0; i < _upper.size(); ++i) sum_matrix._upper[i] = _upper[i] + r_matrix._upper[i];
+        return sum_matrix;
+    }
+
+    template<size_t order, typename elem_type>
+    symmetric_matrix<order, elem_type>
+    symmetric_matrix<order, elem_type>::operator -(const symmetric_matrix<order, elem_type>& r_matrix) const
+    {
+        symmetric_matrix<order, elem_type> diff_matrix;
+        for (size_t i = 0; i < _upper.size(); ++i) diff_matrix._upper[i] = _upper[i] - r_matrix._upper[i];
+        return diff_matrix;
+    }
+
+    template<size_t order, typename elem_type>
+    symmetric_matrix<order, elem_type> symmetric_matrix<order, elem_type>::operator -() const
+    {
+        return (*this) * elem_type(-1);
+    }
+
+    template<size_t order, typename elem_type>
+    matrix<order, order, elem_type>
+    symmetric_matrix<order, elem_type>::operator +(const matrix<order, order, elem_type>& r_matrix) const
+    {
+        matrix<order, order, elem_type> sum_matrix;
+        for (size_t i = 0; i < order; ++i) {
+            for (size_t j = 0; j < order; ++j) sum_matrix[i][j] = _upper[index(i, j)] + r_matrix[i][j];
+        }
+        return sum_matrix;
+    }
+
+    template<size_t order, typename elem_type>
+    matrix<order, order, elem_type>
+    symmetric_matrix<order, elem_type>::operator -(const matrix<order, order, elem_type>& r_matrix) const
+    {
+        matrix<order, order, elem_type> diff_matrix;
+        for (size_t i = 0; i < order; ++i) {
+            for (size_t j = 0; j < order; ++j) diff_matrix[i][j] = _upper[index(i, j)] - r_matrix[i][j];
+        }
+        return diff_matrix;
+    }
+
+    template<size_t order, typename elem_type>
+    symmetric_matrix<order, elem_type> symmetric_matrix<order, elem_type>::operator *(const elem_type& lambda) const
+    {
+        symmetric_matrix<order, elem_type> l_matrix;
+        for (size_t i = 0; i < _upper.size(); ++i) l_matrix._upper[i] = lambda * _upper[i];
+        return l_matrix;
+    }
+
+    template<size_t order, typename elem_type>
+    symmetric_matrix<order, elem_type> symmetric_matrix<order, elem_type>::operator /(const elem_type& lambda) const
+    {
+        return (*this) * (1 / lambda);
+    }
+
+    template<size_t order, typename elem_type>
+    template<size_t r_col_count>
+    matrix<order, r_col_count, elem_type>
+    symmetric_matrix<order, elem_type>::operator *(const matrix<order, r_col_count, elem_type>& r_matrix) const
+    {
+        matrix<order, r_col_count, elem_type> prod_matrix;
+        for (size_t i = 0; i < order; ++i) {
+            for (size_t j = 0; j < r_col_count; ++j) {
+                elem_type tmp_elem = {};
+                for (size_t k = 0; k < order; ++k) tmp_elem += _upper[index(i, k)] * r_matrix[k][j];
+                prod_matrix[i][j] = tmp_elem;
+            }
+        }
+        return prod_matrix;
+    }
+
+    template<size_t order, typename elem_type>
+    b_vector<order, elem_type> symmetric_matrix<order, elem_type>::operator *(const b_vector<order, elem_type>& r_vector) const
+    {
+        // each stored off-diagonal element serves both of its cells
+        b_vector<order, elem_type> prod_vector;
+        size_t k = 0;
+        for (size_t i = 0; i < order; ++i) {
+            prod_vector[i] += _upper[k++] * r_vector[i];
+            for (size_t j = i + 1; j < order; ++j, ++k) {
+                prod_vector[i] += _upper[k] * r_vector[j];
+                prod_vector[j] += _upper[k] * r_vector[i];
+            }
+        }
+        return prod_vector;
+    }
+
+    template<size_t order, typename elem_type>
+    elem_type symmetric_matrix<order, elem_type>::quadratic_form(const b_vector<order, elem_type>& v) const
+    {
+        elem_type sum = {};
+        size_t k = 0;
+        for (size_t i = 0; i < order; ++i) {
+            elem_type row = _upper[k++] * v[i];
+            elem_type off = {};
+            for (size_t j = i + 1; j < order; ++j) off += _upper[k++] * v[j];
+            sum += v[i] * (row + 2 * off);
+        }
+        return sum;
+    }
+
+    template<size_t order, typename elem_type>
+    bool symmetric_matrix<order, elem_type>::factorize(std::array<elem_type, order * order>& ld) const
+    {
+        elem_type scale = {};
+        for (const elem_type& a : _upper) scale = std::max<elem_type>(scale, std::fabs(a));
+        elem_type limit = elem_type(structured_detail::ldl_growth_limit) * scale;
+        for (size_t j = 0; j < order; ++j) {
+            elem_type d = _upper[index(j, j)];
+            // for positive definite matrices the growth stays below a_jj
+            elem_type growth = {};
+            for (size_t k = 0; k < j; ++k) {
+                elem_type t = ld[j * order + k] * ld[j * order + k] * ld[k * order + k];
+                d -= t;
+                growth += std::fabs(t);
+            }
+            // a tiny pivot shows up as growth in the later rows, a zero one right away
+            if (d == 0 || !(growth <= limit)) return false;
+            ld[j * order + j] = d;
+            for (size_t i = j + 1; i < order; ++i) {
+                elem_type l = _upper[index(i, j)];
+                for (size_t k = 0; k < j; ++k) l -= ld[i * order + k] * ld[j * order + k] * ld[k * order + k];
+                ld[i * order + j] = l / d;
+            }
+        }
+        return true;
+    }
+
+    template<size_t order, typename elem_type>
+    elem_type symmetric_matrix<order, elem_type>::determinant() const
+    {
+        std::array<elem_type, order * order> ld;
+        if (factorize(ld)) {
+            elem_type det = 1;
+            for (size_t i = 0; i < order; ++i) det *= ld[i * order + i];
+            return det;
+        }
+        std::array<elem_type, order * order> full;
+        for (size_t i = 0; i < order; ++i) {
+            for (size_t j = 0; j < order; ++j) full[i * order + j] = _upper[index(i, j)];
+        }
+        return structured_detail::gauss_jordan<order, elem_type>(full);
+    }
+
+    template<size_t order, typename elem_type>
+    elem_type symmetric_matrix<order, elem_type>::trace() const
+    {
+        elem_type sum = {};
+        for (size_t i = 0; i < order; ++i) sum += _upper[index(i, i)];
+        return sum;
+    }
+
+    template<size_t order, typename elem_type>
+    symmetric_matrix<order, elem_type> symmetric_matrix<order, elem_type>::inverse() const
+    {
+        symmetric_matrix<order, elem_type> i_matrix;
+        std::array<elem_type, order * order> ld;
+        if (!factorize(ld)) {
+            std::array<elem_type, order * order> full;
+            for (size_t i = 0; i < order; ++i) {
+                for (size_t j = 0; j < order; ++j) full[i * order + j] = _upper[index(i, j)];
+            }
+            structured_detail::gauss_jordan<order, elem_type>(full);
+            for (size_t i = 0; i < order; ++i) {
+                for (size_t j = i; j < order; ++j) i_matrix._upper[index(i, j)] = full[i * order + j];
+            }
+            return i_matrix;
+        }
+        // column j of the inverse solves A x = e_j, only rows j.. are needed for the upper triangle
+        for (size_t j = 0; j < order; ++j) {
+            std::array<elem_type, order> x;
+            x.fill(elem_type());
+            x[j] = 1;
+            for (size_t i = j + 1; i < order; ++i) {
+                for (size_t k = j; k < i; ++k) x[i] -= ld[i * order + k] * x[k];
+            }
+            for (size_t i = j; i < order; ++i) x[i] /= ld[i * order + i];
+            for (size_t i = order; i-- > j;) {
+                for (size_t k = i + 1; k < order; ++k) x[i] -= ld[k * order + i] * x[k];
+            }
+            for (size_t i = j; i < order; ++i) i_matrix._upper[index(j, i)] = x[i];
+        }
+        return i_matrix;
+    }
+
+    template<size_t order, typename elem_type>
+    b_vector<order, elem_type> symmetric_matrix<order, elem_type>::solve(const b_vector<order, elem_type>& rhs) const
+    {
+        std::array<elem_type, order * order> ld;
+        if (!factorize(ld)) return inverse() * rhs;
+        b_vector<order, elem_type> x = rhs;
+        for (size_t i = 0; i < order; ++i) {
+            for (size_t k = 0; k < i; ++k) x[i] -= ld[i * order + k] * x[k];
+        }
+        for (size_t i = 0; i < order; ++i) x[i] /= ld[i * order + i];
+        for (size_t i = order; i-- > 0;) {
+            for (size_t k = i + 1; k < order; ++k) x[i] -= ld[k * order + i] * x[k];
+        }
+        return x;
+    }
+
+    template<size_t _order, typename _elem_type>
+    std::ostream& operator <<(std::ostream& out, const symmetric_matrix<_order, _elem_type>& self)
+    {
+        return out << self.to_matrix();
+    }
+
+    //////////////////////////////////////////////////////////////////////////////////////////////////
+    // triangular_matrix implementation
+    //////////////////////////////////////////////////////////////////////////////////////////////////
+
+    template<size_t order, triangle_kind kind, typename elem_type>
+    triangular_matrix<order, kind, elem_type>::triangular_matrix()
+    {
+        _triangle.fill(elem_type());
+    }
+
+    template<size_t order, triangle_kind kind, typename elem_type>
+    triangular_matrix<order, kind, elem_type>::triangular_matrix(std::initializer_list<elem_type> triangle)
+    {
+        _triangle.fill(elem_type());
+        size_t i = 0;
+        for (auto p_elem = triangle.begin(); i < _triangle.size() && p_elem != triangle.end(); ++i, ++p_elem) {
+            _triangle[i] = *p_elem;
+        }
+    }
+
+    template<size_t order, triangle_kind kind, typename elem_type>
+    triangular_matrix<order, kind, elem_type>::triangular_matrix(const matrix<order, order, elem_type>& m)
+    {
+        for (size_t i = 0; i < order; ++i) {
+            for (size_t j = first_col(i); j <= last_col(i); ++j) _triangle[index(i, j)] = m[i][j];
+        }
+    }
+
+    template<size_t order, triangle_kind kind, typename elem_type>
+    triangular_matrix<order, kind, elem_type>::operator matrix<order, order, elem_type>() const
+    {
+        return to_matrix();
+    }
+
+    template<size_t order, triangle_kind kind, typename elem_type>
+    matrix<order, order, elem_type> triangular_matrix<order, kind, elem_type>::to_matrix() const
+    {
+        matrix<order, order, elem_type> m;
+        for (size_t i = 0; i < order; ++i) {
+            for (size_t j = first_col(i); j <= last_col(i); ++j) m[i][j] = _triangle[index(i, j)];
+        }
+        return m;
+    }
+
+    template<size_t order, triangle_kind kind, typename elem_type>
+    size_t triangular_matrix<order, kind, elem_type>::index(size_t row_idx, size_t col_idx)
+    {
+        if (kind == triangle_kind::lower) return row_idx * (row_idx + 1) / 2 + col_idx;
+        return row_idx * order - row_idx * (row_idx - 1) / 2 + (col_idx - row_idx);
+    }
+
+    template<size_t order, triangle_kind kind, typename elem_type>
+    triangular_matrix<order, kind, elem_type>
+    triangular_matrix<order, kind, elem_type>::operator +(const triangular_matrix<order, kind, elem_type>& r_matrix) const
+    {
+        triangular_matrix<order, kind, elem_type> sum_matrix;
+        for (size_t i = 0; i < _triangle.size(); ++i) sum_matrix._triangle[i] = _triangle[i] + r_matrix._triangle[i];
+        return sum_matrix;
+    }
+
+    template<size_t order, triangle_kind kind, typename elem_type>
+    triangular_matrix<order, kind, elem_type>
+    triangular_matrix<order, kind, elem_type>::operator -(const triangular_matrix<order, kind, elem_type>& r_matrix) const
+    {
+        triangular_matrix<order, kind, elem_type> diff_matrix;
+        for (size_t i = 0; i < _triangle.size(); ++i) diff_matrix._triangle[i] = _triangle[i] - r_matrix._triangle[i];
+        return diff_matrix;
+    }
+
+    template<size_t order, triangle_kind kind, typename elem_type>
+    triangular_matrix<order, kind, elem_type> triangular_matrix<order, kind, elem_type>::operator -() const
+    {
+        return (*this) * elem_type(-1);
+    }
+
+    template<size_t order, triangle_kind kind, typename elem_type>
+    matrix<order, order, elem_type>
+    triangular_matrix<order, kind, elem_type>::operator +(const matrix<order, order, elem_type>& r_matrix) const
+    {
+        matrix<order, order, elem_type> sum_matrix = r_matrix;
+        for (size_t i = 0; i < order; ++i) {
+            for (size_t j = first_col(i); j <= last_col(i); ++j) sum_matrix[i][j] = _triangle[index(i, j)] + r_matrix[i][j];
+        }
+        return sum_matrix;
+    }
+
+    template<size_t order, triangle_kind kind, typename elem_type>
+    matrix<order, order, elem_type>
+    triangular_matrix<order, kind, elem_type>::operator -(const matrix<order, order, elem_type>& r_matrix) const
+    {
+        matrix<order, order, elem_type> diff_matrix = -r_matrix;
+        for (size_t i = 0; i < order; ++i) {
+            for (size_t j = first_col(i); j <= last_col(i); ++j) diff_matrix[i][j] = _triangle[index(i, j)] - r_matrix[i][j];
+        }
+        return diff_matrix;
+    }
+
+    template<size_t order, triangle_kind kind, typename elem_type>
+    triangular_matrix<order, kind, elem_type>
+    triangular_matrix<order, kind, elem_type>::operator *(const elem_type& lambda) const
+    {
+        triangular_matrix<order, kind, elem_type> l_matrix;
+        for (size_t i = 0; i < _triangle.size(); ++i) l_matrix._triangle[i] = lambda * _triangle[i];
+        return l_matrix;
+    }
+
+    template<size_t order, triangle_kind kind, typename elem_type>
+    triangular_matrix<order, kind, elem_type>
+    triangular_matrix<order, kind, elem_type>::operator /(const elem_type& lambda) const
+    {
+        return (*this) * (1 / lambda);
+    }
+
+    template<size_t order, triangle_kind kind, typename elem_type>
+    triangular_matrix<order, kind, elem_type>
+    triangular_matrix<order, kind, elem_type>::operator *(const triangular_matrix<order, kind, elem_type>& r_matrix) const
+    {
+        // (i, j) only sums over k between i and j
+        triangular_matrix<order, kind, elem_type> prod_matrix;
+        for (size_t i = 0; i < order; ++i) {
+            for (size_t j = first_col(i); j <= last_col(i); ++j) {
+                size_t k_first = std::min(i, j), k_last = std::max(i, j);
+                elem_type tmp_elem = {};
+                for (size_t k = k_first; k <= k_last; ++k) {
+                    tmp_elem += _triangle[index(i, k)] * r_matrix._triangle[index(k, j)];
+                }
+                prod_matrix._triangle[index(i, j)] = tmp_elem;
+            }
+        }
+        return prod_matrix;
+    }
+
+    template<size_t order, triangle_kind kind, typename elem_type>
+    template<size_t r_col_count>
+    matrix<order, r_col_count, elem_type>
+    triangular_matrix<order, kind, elem_type>::operator *(const matrix<order, r_col_count, elem_type>& r_matrix) const
+    {
+        matrix<order, r_col_count, elem_type> prod_matrix;
+        for (size_t i = 0; i < order; ++i) {
+            for (size_t j = 0; j < r_col_count; ++j) {
+                elem_type tmp_elem = {};
+                for (size_t k = first_col(i); k <= last_col(i); ++k) tmp_elem += _triangle[index(i, k)] * r_matrix[k][j];
+                prod_matrix[i][j] = tmp_elem;
+            }
+        }
+        return prod_matrix;
+    }
+
+    template<size_t order, triangle_kind kind, typename elem_type>
+    b_vector<order, elem_type>
+    triangular_matrix<order, kind, elem_type>::operator *(const b_vector<order, elem_type>& r_vector) const
+    {
+        b_vector<order, elem_type> prod_vector;
+        for (size_t i = 0; i < order; ++i) {
+            elem_type tmp_elem = {};
+            for (size_t k = first_col(i); k <= last_col(i); ++k) tmp_elem += _triangle[index(i, k)] * r_vector[k];
+            prod_vector[i] = tmp_elem;
+        }
+        return prod_vector;
+    }
+
+    template<size_t order, triangle_kind kind, typename elem_type>
+    elem_type triangular_matrix<order, kind, elem_type>::determinant() const
+    {
+        elem_type det = 1;
+        for (size_t i = 0; i < order; ++i) det *= _triangle[index(i, i)];
+        return det;
+    }
+
+    template<size_t order, triangle_kind kind, typename elem_type>
+    elem_type triangular_matrix<order, kind, elem_type>::trace() const
+    {
+        elem_type sum = {};
+        for (size_t i = 0; i < order; ++i) sum += _triangle[index(i, i)];
+        return sum;
+    }
+
+    template<size_t order, triangle_kind kind, typename elem_type>
+    triangular_matrix<order, kind, elem_type> triangular_matrix<order, kind, elem_type>::inverse() const
+    {
+        if (kind == triangle_kind::upper) {
+            // the inverse of the transpose is the transpose of the inverse
+            return transpose().inverse().transpose();
+        }
+        triangular_matrix<order, kind, elem_type> i_matrix;
+        for (size_t j = 0; j < order; ++j) {
+            i_matrix._triangle[index(j, j)] = 1 / _triangle[index(j, j)];
+            for (size_t i = j + 1; i < order; ++i) {
+                elem_type sum = {};
+                for (size_t k = j; k < i; ++k) sum += _triangle[index(i, k)] * i_matrix._triangle[index(k, j)];
+                i_matrix._triangle[index(i, j)] = -sum / _triangle[index(i, i)];
+            }
+        }
+        return i_matrix;
+    }
+
+    template<size_t order, triangle_kind kind, typename elem_type>
+    triangular_matrix<order, kind == triangle_kind::lower ? triangle_kind::upper : triangle_kind::lower, elem_type>
+    triangular_matrix<order, kind, elem_type>::transpose() const
+    {
+        triangular_matrix<order, kind == triangle_kind::lower ? triangle_kind::upper : triangle_kind::lower, elem_type> t_matrix;
+        for (size_t i = 0; i < order; ++i) {
+            for (size_t j = first_col(i); j <= last_col(i); ++j) t_matrix.set_cell(j, i, _triangle[index(i, j)]);
+        }
+        return t_matrix;
+    }
+
+    template<size_t order, triangle_kind kind, typename elem_type>
+    b_vector<order, elem_type> triangular_matrix<order, kind, elem_type>::solve(const b_vector<order, elem_type>& rhs) const
+    {
+        // forward substitution for lower, backward for upper
+        b_vector<order, elem_type> x;
+        for (size_t step = 0; step < order; ++step) {
+            size_t i = kind == triangle_kind::lower ? step : order - 1 - step;
+            elem_type sum = rhs[i];
+            for (size_t k = first_col(i); k <= last_col(i); ++k) {
+                if (k != i) sum -= _triangle[index(i, k)] * x[k];
+            }
+            x[i] = sum / _triangle[index(i, i)];
+        }
+        return x;
+    }
+
+    template<size_t order, triangle_kind kind, typename elem_type>
+    elem_type triangular_matrix<order, kind, elem_type>::get_cell(size_t row_idx, size_t col_idx) const
+    {
+        return in_triangle(row_idx, col_idx) ? _triangle[index(row_idx, col_idx)] : elem_type();
+    }
+
+    template<size_t order, triangle_kind kind, typename elem_type>
+    void triangular_matrix<order, kind, elem_type>::set_cell(size_t row_idx, size_t col_idx, const elem_type& value)
+    {
+        if (in_triangle(row_idx, col_idx)) _triangle[index(row_idx, col_idx)] = value;
+    }
+
+    template<size_t _order, triangle_kind _kind, typename _elem_type>
+    std::ostream& operator <<(std::ostream& out, const triangular_matrix<_order, _kind, _elem_type>& self)
+    {
+        return out << self.to_matrix();
+    }
+
+    //////////////////////////////////////////////////////////////////////////////////////////////////
+    // mixed operators implementation
+    //////////////////////////////////////////////////////////////////////////////////////////////////
+
+    template<size_t row_count, size_t order, typename elem_type>
+    matrix<row_count, order, elem_type>
+    operator *(const matrix<row_count, order, elem_type>& l_matrix, const diagonal_matrix<order, elem_type>& r_matrix)
+    {
+        // scales the columns
+        matrix<row_count, order, elem_type> prod_matrix;
+        for (size_t i = 0; i < row_count; ++i) {
+            for (size_t j = 0; j < order; ++j) prod_matrix[i][j] = l_matrix[i][j] * r_matrix.get_diagonal(j);
+        }
+        return prod_matrix;
+    }
+
+    template<size_t row_count, size_t order, typename elem_type>
+    matrix<row_count, order, elem_type>
+    operator *(const matrix<row_count, order, elem_type>& l_matrix, const symmetric_matrix<order, elem_type>& r_matrix)
+    {
+        matrix<row_count, order, elem_type> prod_matrix;
+        for (size_t i = 0; i < row_count; ++i) {
+            for (size_t j = 0; j < order; ++j) {
+                elem_type tmp_elem = {};
+                for (size_t k = 0; k < order; ++k) tmp_elem += l_matrix[i][k] * r_matrix.get_cell(k, j);
+                prod_matrix[i][j] = tmp_elem;
+            }
+        }
+        return prod_matrix;
+    }
+
+    template<size_t row_count, size_t order, triangle_kind kind, typename elem_type>
+    matrix<row_count, order, elem_type>
+    operator *(const matrix<row_count, order, elem_type>& l_matrix, const triangular_matrix<order, kind, elem_type>& r_matrix)
+    {
+        // column j of a lower matrix is zero above row j, of an upper one below it
+        matrix<row_count, order, elem_type> prod_matrix;
+        for (size_t i = 0; i < row_count; ++i) {
+            for (size_t j = 0; j < order; ++j) {
+                size_t k_first = kind == triangle_kind::lower ? j : 0;
+                size_t k_last = kind == triangle_kind::lower ? order - 1 : j;
+                elem_type tmp_elem = {};
+                for (size_t k = k_first; k <= k_last; ++k) tmp_elem += l_matrix[i][k] * r_matrix.get_cell(k, j);
+                prod_matrix[i][j] = tmp_elem;
+            }
+        }
+        return prod_matrix;
+    }
+
+    template<size_t order, typename elem_type>
+    matrix<order, order, elem_type>
+    operator +(const matrix<order, order, elem_type>& l_matrix, const diagonal_matrix<order, elem_type>& r_matrix)
+    {
+        return r_matrix + l_matrix;
+    }
+
+    template<size_t order, typename elem_type>
+    matrix<order, order, elem_type>
+    operator -(const matrix<order, order, elem_type>& l_matrix, const diagonal_matrix<order, elem_type>& r_matrix)
+    {
+        return (-r_matrix) + l_matrix;
+    }
+
+    template<size_t order, typename elem_type>
+    matrix<order, order, elem_type>
+    operator +(const matrix<order, order, elem_type>& l_matrix, const symmetric_matrix<order, elem_type>& r_matrix)
+    {
+        return r_matrix + l_matrix;
+    }
+
+    template<size_t order, typename elem_type>
+    matrix<order, order, elem_type>
+    operator -(const matrix<order, order, elem_type>& l_matrix, const symmetric_matrix<order, elem_type>& r_matrix)
+    {
+        return (-r_matrix) + l_matrix;
+    }
+
+    template<size_t order, triangle_kind kind, typename elem_type>
+    matrix<order, order, elem_type>
+    operator +(const matrix<order, order, elem_type>& l_matrix, const triangular_matrix<order, kind, elem_type>& r_matrix)
+    {
+        return r_matrix + l_matrix;
+    }
+
+    template<size_t order, triangle_kind kind, typename elem_type>
+    matrix<order, order, elem_type>
+    operator -(const matrix<order, order, elem_type>& l_matrix, const triangular_matrix<order, kind, elem_type>& r_matrix)
+    {
+        return (-r_matrix) + l_matrix;
+    }
+}
+
+#endif // BCG_STRUCTURED_MATRIX_HPP
@@ -0,0 +1,177 @@
+#ifndef BCG_SVD_HPP
+#define BCG_SVD_HPP
+
+#include "transforms/b_vector/b_vector.hpp"
+#include "transforms/matrix/matrix.hpp"
+#include "transforms/matrix/symmetric_eigen.hpp"
+
+#include <cmath>
+
+namespace bcg
+{
+    //////////////////////////////////////////////////////////////////////////////////////////////////
+    // svd
+    //////////////////////////////////////////////////////////////////////////////////////////////////
+
+    // Singular value decomposition of a 3x3 matrix, A = U diag(singular_values) V^T.
+    template<typename elem_type=double>
+    struct svd
+    {
+        // orthogonal, det(u) = sign(det(A)) (+1 for a singular A)
+        matrix<3, 3, elem_type> u;
+        // descending and non-negative
+        b_vector<3, elem_type> singular_values;
+        // a rotation (det = +1)
+        matrix<3, 3, elem_type> v;
+    };
+
+    // V and the singular values come from the eigen-decomposition of A^T A, then the columns of
+    // A V are orthogonalised (Gram-Schmidt) into U, which gives the small singular values back
+    // from A itself rather than from the squared spectrum. Rank-deficient matrices get zero
+    // singular values and U completed to an orthonormal basis. Worked in double.
+    template<typename elem_type>
+    svd<elem_type> svd_decompose(const matrix<3, 3, elem_type>& a);
+
+    // the rotation closest to [a] in the Frobenius norm, U diag(1, 1, det(U V^T)) V^T; with [a] a
+    // cross-covariance sum(q p^T) of centred points it is the rotation taking the p's onto the
+    // q's (Kabsch)
+    template<typename elem_type>
+    matrix<3, 3, elem_type> nearest_rotation(const matrix<3, 3, elem_type>& a);
+
+    namespace svd_detail
+    {
+        // row-major [a], [out_u] and [out_v], same conventions as svd
+        inline void decompose(const double a[9], double out_u[9], double out_singular_values[3], double out_v[9]);
+    }
+
+    //////////////////////////////////////////////////////////////////////////////////////////////////
+    // svd implementation
+    //////////////////////////////////////////////////////////////////////////////////////////////////
+
+    namespace svd_detail
+    {
+        // any unit vector orthogonal to the unit vector [w]
+        inline void any_orthogonal(const double* w, double* out)
+        {
+            if (std::fabs(w[0]) > std::fabs(w[1])) {
+                double inv = 1 / std::sqrt(w[0] * w[0] + w[2] * w[2]);
+                out[0] = -w[2] * inv; out[1] = 0; out[2] = w[0] * inv;
+            }
+            else {
+                double inv = 1 / std::sqrt(w[1] * w[1] + w[2] * w[2]);
+                out[0] = 0; out[1] = w[2] * inv; out[2] = -w[1] * inv;
+            }
+        }
+
+        inline void decompose(const double a[9], double out_u[9], double out_singular_values[3], double out_v[9])
+        {
+            // A^T A, upper triangle
+            double ata[6];
+            size_t k = 0;
+            for (size_t i = 0; i < 3; ++i) {
+                for (size_t j = i; j < 3; ++j) {
+                    ata[k++] = a[i] * a[j] + a[3 + i] * a[3 + j] + a[6 + i] * a[6 + j];
+                }
+            }
+            double values[3], vectors[9];
+            symmetric_eigen_detail::decompose(ata, values, vectors);
+
+            // descending order: swap the first and last columns, negate the middle one to stay a rotation
+            for (size_t i = 0; i < 3; ++i) {
+                out_v[i * 3 + 0] = vectors[i * 3 + 2];
+                out_v[i * 3 + 1] = -vectors[i * 3 + 1];
+                out_v[i * 3 + 2] = vectors[i * 3 + 0];
+            }
+
+            // b = A V, column by column
+            double b[3][3];
+            for (size_t j = 0; j < 3; ++j) {
+                for (size_t i = 0; i < 3; ++i) {
+                    b[j][i] = a[i * 3] * out_v[j] + a[i * 3 + 1] * out_v[3 + j] + a[i * 3 + 2] * out_v[6 + j];
+                }
+            }
+
+            double u[3][3];
+            double s0 = std::sqrt(symmetric_eigen_detail::dot(b[0], b[0]));
+            if (s0 > 0) {
+                for (size_t i = 0; i < 3; ++i) u[0][i] = b[0][i] / s0;
+            }
+            else {
+                u[0][0] = 1; u[0][1] = 0; u[0][2] = 0;
+            }
+            double along = symmetric_eigen_detail::dot(u[0], b[1]);
+            for (size_t i = 0; i < 3; ++i) u[1][i] = b[1][i] - along * u[0][i];
+            double s1 = std::sqrt(symmetric_eigen_detail::dot(u[1], u[1]));
+            // relative to s0, a zero column of A V can still carry rounding noise
+            if (s1 > 1e-15 * s0 && s1 > 0) {
+                for (size_t i = 0; i < 3; ++i) u[1][i] /= s1;
+            }
+            else {
+                s1 = 0;
+                any_orthogonal(u[0], u[1]);
+            }
+            symmetric_eigen_detail::cross(u[0], u[1], u[2]);
+            double s2 = symmetric_eigen_detail::dot(u[2], b[2]);
+            // det(A) < 0: keep the singular value non-negative by flipping the last column of U
+            if (s2 < 0) {
+                s2 = -s2;
+                for (size_t i = 0; i < 3; ++i) u[2][i] = -u[2][i];
+            }
+
+            out_singular_values[0] = s0;
+            out_singular_values[1] = s1;
+            out_singular_values[2] = s2;
+            for (size_t i = 0; i < 3; ++i) {
+                for (size_t j = 0; j < 3; ++j) out_u[i * 3 + j] = u[j][i];
+            }
+        }
+    }
+
+    template<typename elem_type>
+    svd<elem_type> svd_decompose(const matrix<3, 3, elem_type>& a)
+    {
+        double packed[9], u[9], singular_values[3], v[9];
+        for (size_t i = 0; i < 3; ++i) {
+            for (size_t j = 0; j < 3; ++j) packed[i * 3 + j] = double(a[i][j]);
+        }
+        svd_detail::decompose(packed, u, singular_values, v);
+
+        svd<elem_type> result;
+        for (size_t i = 0; i < 3; ++i) {
+            result.singular_values[i] = static_cast<elem_type>(singular_values[i]);
+            for (size_t j = 0; j < 3; ++j) {
+                result.u[i][j] = static_cast<elem_type>(u[i * 3 + j]);
+                result.v[i][j] = static_cast<elem_type>(v[i * 3 + j]);
+            }
+        }
+        return result;
+    }
+
+    template<typename elem_type>
+    matrix<3, 3, elem_type> nearest_rotation(const matrix<3, 3, elem_type>& a)
+    {
+        double packed[9], u[9], singular_values[3], v[9];
+        for (size_t i = 0; i < 3; ++i) {
+            for (size_t j = 0; j < 3; ++j) packed[i * 3 + j] = double(a[i][j]);
+        }
+        svd_detail::decompose(packed, u, singular_values, v);
+
+        // v is a rotation, so det(U V^T) = det(U); a reflection flips the last column of U
+        double last[3] = { u[2], u[5], u[8] };
+        double first_two[3];
+        double c0[3] = { u[0], u[3], u[6] }, c1[3] = { u[1], u[4], u[7] };
+        symmetric_eigen_detail::cross(c0, c1, first_two);
+        if (symmetric_eigen_detail::dot(first_two, last) < 0) {
+            u[2] = -u[2]; u[5] = -u[5]; u[8] = -u[8];
+        }
+        matrix<3, 3, elem_type> r;
+        for (size_t i = 0; i < 3; ++i) {
+            for (size_t j = 0; j < 3; ++j) {
+                r[i][j] = static_cast<elem_type>(u[i * 3] * v[j * 3] + u[i * 3 + 1] * v[j * 3 + 1] + u[i * 3 + 2] * v[j * 3 + 2]);
+            }
+        }
+        return r;
+    }
+}
+
+#endif // BCG_SVD_HPP
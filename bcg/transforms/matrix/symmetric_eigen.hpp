@@ -0,0 +1,286 @@
+#ifndef BCG_SYMMETRIC_EIGEN_HPP
+#define BCG_SYMMETRIC_EIGEN_HPP
+
+#include "transforms/b_vector/b_vector.hpp"
+#include "transforms/matrix/matrix.hpp"
+#include "transforms/matrix/structured_matrix.hpp"
+
+#include <algorithm>
+#include <cmath>
+#include <utility>
+
+namespace bcg
+{
+    //////////////////////////////////////////////////////////////////////////////////////////////////
+    // symmetric_eigen
+    //////////////////////////////////////////////////////////////////////////////////////////////////
+
+    // Eigen-decomposition of a symmetric 3x3 matrix, A = V diag(values) V^T.
+    template<typename elem_type=double>
+    struct symmetric_eigen
+    {
+        // in ascending order
+        b_vector<3, elem_type> values;
+        // column i is the unit eigenvector of values[i], the columns form a rotation (det = +1)
+        matrix<3, 3, elem_type> vectors;
+    };
+
+    // Closed-form eigenvalues (trigonometric solution of the characteristic cubic) and
+    // eigenvectors (cross products of the rows of A - lambda I), polished by cyclic Jacobi sweeps
+    // that usually converge in one. The Jacobi sweeps also take over from the identity when the
+    // closed form breaks down, so repeated eigenvalues are handled. Only the upper triangle of a
+    // general matrix is read, and the work is done in double whatever [elem_type] is.
+    template<typename elem_type>
+    symmetric_eigen<elem_type> eigen_decompose(const matrix<3, 3, elem_type>& a);
+    template<typename elem_type>
+    symmetric_eigen<elem_type> eigen_decompose(const symmetric_matrix<3, elem_type>& a);
+
+    namespace symmetric_eigen_detail
+    {
+        // [upper] is a00 a01 a02 a11 a12 a22, [out_vectors] is row-major with eigenvectors in
+        // the columns, same conventions as symmetric_eigen
+        inline void decompose(const double upper[6], double out_values[3], double out_vectors[9]);
+    }
+
+    //////////////////////////////////////////////////////////////////////////////////////////////////
+    // symmetric_eigen implementation
+    //////////////////////////////////////////////////////////////////////////////////////////////////
+
+    namespace symmetric_eigen_detail
+    {
+        inline void cross(const double* a, const double* b, double* out)
+        {
+            out[0] = a[1] * b[2] - a[2] * b[1];
+            out[1] = a[2] * b[0] - a[0] * b[2];
+            out[2] = a[0] * b[1] - a[1] * b[0];
+        }
+
+        inline double dot(const double* a, const double* b) { return a[0] * b[0] + a[1] * b[1] + a[2] * b[2]; }
+
+        // unit vector along the longest cross product of two rows of [m], false if all vanish
+        inline bool null_vector(const double m[3][3], double* out)
+        {
+            double c[3][3];
+            cross(m[0], m[1], c[0]);
+            cross(m[0], m[2], c[1]);
+            cross(m[1], m[2], c[2]);
+            size_t best = 0;
+            double best_norm2 = dot(c[0], c[0]);
+            for (size_t i = 1; i < 3; ++i) {
+                double n2 = dot(c[i], c[i]);
+                if (n2 > best_norm2) {
+                    best = i;
+                    best_norm2 = n2;
+                }
+            }
+            if (!(best_norm2 > 0)) return false;
+            double inv = 1 / std::sqrt(best_norm2);
+            for (size_t d = 0; d < 3; ++d) out[d] = c[best][d] * inv;
+            return true;
+        }
+
+        // closed-form eigenvectors of [b] (scaled so its largest element is 1), columns of [v]
+        inline bool closed_form(const double b[3][3], double v[3][3])
+        {
+            double off2 = b[0][1] * b[0][1] + b[0][2] * b[0][2] + b[1][2] * b[1][2];
+            double q = (b[0][0] + b[1][1] + b[2][2]) / 3;
+            double p2 = (b[0][0] - q) * (b[0][0] - q) + (b[1][1] - q) * (b[1][1] - q) + (b[2][2] - q) * (b[2][2] - q) +
+                        2 * off2;
+            // (nearly) a multiple of the identity, every direction is an eigenvector
+            if (!(p2 > 1e-24)) return false;
+
+            double p = std::sqrt(p2 / 6);
+            double c[3][3];
+            for (size_t i = 0; i < 3; ++i) {
+                for (size_t j = 0; j < 3; ++j) c[i][j] = (b[i][j] - (i == j ? q : 0)) / p;
+            }
+            double half_det = (c[0][0] * (c[1][1] * c[2][2] - c[1][2] * c[2][1]) -
+                               c[0][1] * (c[1][0] * c[2][2] - c[1][2] * c[2][0]) +
+                               c[0][2] * (c[1][0] * c[2][1] - c[1][1] * c[2][0])) / 2;
+            double phi = std::acos(std::max(-1.0, std::min(1.0, half_det))) / 3;
+            const double third_turn = 2.0943951023931954923;
+            double largest = q + 2 * p * std::cos(phi);
+            double smallest = q + 2 * p * std::cos(phi + third_turn);
+            double middle = 3 * q - largest - smallest;
+
+            // the eigenvalue further from the middle one is well separated, its eigenvector is
+            // stable; the other two are found in the plane orthogonal to it
+            bool top_isolated = largest - middle >= middle - smallest;
+            double isolated = top_isolated ? largest : smallest;
+            double shifted[3][3];
+            for (size_t i = 0; i < 3; ++i) {
+                for (size_t j = 0; j < 3; ++j) shifted[i][j] = b[i][j] - (i == j ? isolated : 0);
+            }
+            double w[3];
+            if (!null_vector(shifted, w)) return false;
+
+            // orthonormal basis (s, t) of the plane orthogonal to w
+            double s[3], t[3];
+            if (std::fabs(w[0]) > std::fabs(w[1])) {
+                double inv = 1 / std::sqrt(w[0] * w[0] + w[2] * w[2]);
+                s[0] = -w[2] * inv; s[1] = 0; s[2] = w[0] * inv;
+            }
+            else {
+                double inv = 1 / std::sqrt(w[1] * w[1] + w[2] * w[2]);
+                s[0] = 0; s[1] = w[2] * inv; s[2] = -w[1] * inv;
+            }
+            cross(w, s, t);
+
+            // 2x2 restriction of b - middle I to the plane, its null vector gives the middle one
+            double bs[3], bt[3];
+            for (size_t i = 0; i < 3; ++i) {
+                bs[i] = dot(b[i], s);
+                bt[i] = dot(b[i], t);
+            }
+            double m00 = dot(s, bs) - middle, m01 = dot(s, bt), m11 = dot(t, bt) - middle;
+            double cs, sn;
+            if (std::fabs(m00) >= std::fabs(m11)) {
+                double len = std::sqrt(m00 * m00 + m01 * m01);
+                if (len > 0) { cs = -m01 / len; sn = m00 / len; }
+                else { cs = 1; sn = 0; }
+            }
+            else {
+                double len = std::sqrt(m11 * m11 + m01 * m01);
+                cs = m11 / len;
+                sn = -m01 / len;
+            }
+            double mid[3], other[3];
+            for (size_t d = 0; d < 3; ++d) mid[d] = cs * s[d] + sn * t[d];
+
+            // columns ordered smallest, middle, largest, right-handed
+            const double* columns[3] = { other, mid, other };
+            if (top_isolated) {
+                cross(mid, w, other);
+                columns[2] = w;
+            }
+            else {
+                cross(w, mid, other);
+                columns[0] = w;
+            }
+            for (size_t i = 0; i < 3; ++i) {
+                for (size_t j = 0; j < 3; ++j) v[i][j] = columns[j][i];
+            }
+            return true;
+        }
+
+        // cyclic Jacobi on d = v^T b v, rotations are accumulated into v
+        inline void jacobi(double d[3][3], double v[3][3], size_t max_sweeps)
+        {
+            static const size_t pairs[3][2] = { { 0, 1 }, { 0, 2 }, { 1, 2 } };
+            for (size_t sweep = 0; sweep < max_sweeps; ++sweep) {
+                double off = d[0][1] * d[0][1] + d[0][2] * d[0][2] + d[1][2] * d[1][2];
+                double diag = d[0][0] * d[0][0] + d[1][1] * d[1][1] + d[2][2] * d[2][2];
+                if (!(off > 1e-30 * diag)) return;
+                for (size_t r = 0; r < 3; ++r) {
+                    size_t p = pairs[r][0], q = pairs[r][1];
+                    // already negligible next to the diagonal, a rotation would only add rounding
+                    if (!(std::fabs(d[p][q]) > 1e-17 * (std::fabs(d[p][p]) + std::fabs(d[q][q])))) {
+                        d[p][q] = d[q][p] = 0;
+                        continue;
+                    }
+                    double theta = (d[q][q] - d[p][p]) / (2 * d[p][q]);
+                    double t = (theta >= 0 ? 1 : -1) / (std::fabs(theta) + std::sqrt(theta * theta + 1));
+                    double c = 1 / std::sqrt(t * t + 1), s = t * c;
+                    // d = J^T d J with J the rotation in the (p, q) plane
+                    for (size_t k = 0; k < 3; ++k) {
+                        double dkp = d[k][p], dkq = d[k][q];
+                        d[k][p] = c * dkp - s * dkq;
+                        d[k][q] = s * dkp + c * dkq;
+                    }
+                    for (size_t k = 0; k < 3; ++k) {
+                        double dpk = d[p][k], dqk = d[q][k];
+                        d[p][k] = c * dpk - s * dqk;
+                        d[q][k] = s * dpk + c * dqk;
+                    }
+                    d[p][q] = d[q][p] = 0;
+                    for (size_t k = 0; k < 3; ++k) {
+                        double vkp = v[k][p], vkq = v[k][q];
+                        v[k][p] = c * vkp - s * vkq;
+                        v[k][q] = s * vkp + c * vkq;
+                    }
+                }
+            }
+        }
+
+        inline void decompose(const double upper[6], double out_values[3], double out_vectors[9])
+        {
+            double scale = 0;
+            for (size_t i = 0; i < 6; ++i) scale = std::max(scale, std::fabs(upper[i]));
+            double v[3][3] = { { 1, 0, 0 }, { 0, 1, 0 }, { 0, 0, 1 } };
+            if (scale == 0) {
+                for (size_t i = 0; i < 3; ++i) out_values[i] = 0;
+                for (size_t i = 0; i < 9; ++i) out_vectors[i] = v[i / 3][i % 3];
+                return;
+            }
+
+            double b[3][3];
+            b[0][0] = upper[0] / scale; b[0][1] = b[1][0] = upper[1] / scale; b[0][2] = b[2][0] = upper[2] / scale;
+            b[1][1] = upper[3] / scale; b[1][2] = b[2][1] = upper[4] / scale; b[2][2] = upper[5] / scale;
+
+            bool closed = closed_form(b, v);
+            if (!closed) {
+                for (size_t i = 0; i < 3; ++i) {
+                    for (size_t j = 0; j < 3; ++j) v[i][j] = i == j ? 1 : 0;
+                }
+            }
+            // d = v^T b v, diagonal up to rounding when the closed form succeeded
+            double bv[3][3], d[3][3];
+            for (size_t i = 0; i < 3; ++i) {
+                for (size_t j = 0; j < 3; ++j) bv[i][j] = b[i][0] * v[0][j] + b[i][1] * v[1][j] + b[i][2] * v[2][j];
+            }
+            for (size_t i = 0; i < 3; ++i) {
+                for (size_t j = 0; j < 3; ++j) d[i][j] = v[0][i] * bv[0][j] + v[1][i] * bv[1][j] + v[2][i] * bv[2][j];
+            }
+            jacobi(d, v, closed ? 4 : 32);
+
+            // ascending order, keeping the columns a rotation
+            size_t order[3] = { 0, 1, 2 };
+            std::sort(order, order + 3, [&](size_t i, size_t j) { return d[i][i] < d[j][j]; });
+            for (size_t i = 0; i < 3; ++i) {
+                out_values[i] = d[order[i]][order[i]] * scale;
+                for (size_t j = 0; j < 3; ++j) out_vectors[i * 3 + j] = v[i][order[j]];
+            }
+            double c0[3] = { out_vectors[0], out_vectors[3], out_vectors[6] };
+            double c1[3] = { out_vectors[1], out_vectors[4], out_vectors[7] };
+            double c2[3] = { out_vectors[2], out_vectors[5], out_vectors[8] };
+            double n[3];
+            cross(c0, c1, n);
+            if (dot(n, c2) < 0) {
+                for (size_t i = 0; i < 3; ++i) out_vectors[i * 3 + 2] = -out_vectors[i * 3 + 2];
+            }
+        }
+
+        template<typename elem_type>
+        symmetric_eigen<elem_type> to_result(const double values[3], const double vectors[9])
+        {
+            symmetric_eigen<elem_type> result;
+            for (size_t i = 0; i < 3; ++i) {
+                result.values[i] = static_cast<elem_type>(values[i]);
+                for (size_t j = 0; j < 3; ++j) result.vectors[i][j] = static_cast<elem_type>(vectors[i * 3 + j]);
+            }
+            return result;
+        }
+    }
+
+    template<typename elem_type>
+    symmetric_eigen<elem_type> eigen_decompose(const matrix<3, 3, elem_type>& a)
+    {
+        double upper[6] = { double(a[0][0]), double(a[0][1]), double(a[0][2]),
+                            double(a[1][1]), double(a[1][2]), double(a[2][2]) };
+        double values[3], vectors[9];
+        symmetric_eigen_detail::decompose(upper, values, vectors);
+        return symmetric_eigen_detail::to_result<elem_type>(values, vectors);
+    }
+
+    template<typename elem_type>
+    symmetric_eigen<elem_type> eigen_decompose(const symmetric_matrix<3, elem_type>& a)
+    {
+        double upper[6];
+        for (size_t i = 0; i < 6; ++i) upper[i] = double(a.data()[i]);
+        double values[3], vectors[9];
+        symmetric_eigen_detail::decompose(upper, values, vectors);
+        return symmetric_eigen_detail::to_result<elem_type>(values, vectors);
+    }
+}
+
+#endif // BCG_SYMMETRIC_EIGEN_HPP
@@ -0,0 +1,272 @@
+#ifndef BCG_TRANSFORM_HIERARCHY_HPP
+#define BCG_TRANSFORM_HIERARCHY_HPP
+
+#include "transforms/matrix/matrix.hpp"
+#include "transforms/matrix/packed_matrix.hpp"
+#include "utils/parallel.hpp"
+
+#include <algorithm>
+#include <cstdint>
+#include <limits>
+#include <utility>
+#include <vector>
+
+namespace bcg
+{
+    //////////////////////////////////////////////////////////////////////////////////////////////////
+    // transform_hierarchy
+    //////////////////////////////////////////////////////////////////////////////////////////////////
+
+    // Parent-child transforms stored in flat depth-first arrays: a node's subtree is the slot
+    // range [slot, subtree_end), and every parent comes before its children, so world matrices
+    // are one forward pass. set_local() only records the node as dirty; update() recomputes the
+    // subtrees under dirty nodes and skips everything else, spreading independent subtrees over
+    // threads. Nodes are addressed by the stable id add_node() returns; structural changes
+    // (add_node, reparent) re-lay the arrays out on the next update().
+    class transform_hierarchy
+    {
+    public:
+        typedef std::uint32_t index_type;
+
+        enum : index_type { invalid_index = std::numeric_limits<index_type>::max() };
+
+    public:
+        transform_hierarchy() = default;
+        ~transform_hierarchy() = default;
+
+    public:
+        // a new node under [parent] (invalid_index for a root), returns its id
+        index_type add_node(const packed_matrix4<float>& local, index_type parent = invalid_index);
+        index_type add_node(const matrix<4, 4, float>& local, index_type parent = invalid_index);
+        // moves [id] and its subtree under [new_parent]; false (and nothing changes) if
+        // [new_parent] is inside that subtree
+        bool reparent(index_type id, index_type new_parent);
+
+        void set_local(index_type id, const packed_matrix4<float>& local);
+        void set_local(index_type id, const matrix<4, 4, float>& local);
+        const packed_matrix4<float>& local(index_type id) const { return _local[_slot_of[id]]; }
+
+        // parent world * local, valid after update()
+        const packed_matrix4<float>& world(index_type id) const { return _world[_slot_of[id]]; }
+
+        // recomputes the world matrices of every dirty subtree, returns how many were recomputed
+        size_t update(size_t thread_count = 0);
+        // marks every node dirty, the next update() recomputes all of them
+        void invalidate();
+
+    public:
+        size_t size() const { return _parent_id.size(); }
+        index_type parent(index_type id) const { return _parent_id[id]; }
+        // true when set_local() or a structural change is waiting for update()
+        bool is_dirty() const { return _layout_dirty || !_dirty_slots.empty(); }
+
+        // raw access in depth-first order, slot in [0, size())
+        index_type slot_of(index_type id) const { return _slot_of[id]; }
+        index_type id_of_slot(size_t slot) const { return _id_of_slot[slot]; }
+        const packed_matrix4<float>* world_data() const { return _world.data(); }
+
+    private:
+        // rebuilds the depth-first order from the parent ids
+        void relayout();
+        void mark_roots_dirty();
+        // world matrices of slots [first, last), a whole number of subtrees whose parents are up to date
+        void recompute(index_type first, index_type last);
+
+    private:
+        // by id
+        std::vector<index_type> _parent_id;
+        std::vector<index_type> _slot_of;
+
+        // by slot, depth-first
+        std::vector<index_type> _id_of_slot;
+        std::vector<index_type> _parent_slot;
+        std::vector<index_type> _subtree_end;
+        std::vector<packed_matrix4<float>> _local;
+        std::vector<packed_matrix4<float>> _world;
+        std::vector<std::uint8_t> _is_slot_dirty;
+        std::vector<index_type> _dirty_slots;
+
+        bool _layout_dirty = false;
+    };
+
+    //////////////////////////////////////////////////////////////////////////////////////////////////
+    // transform_hierarchy implementation
+    //////////////////////////////////////////////////////////////////////////////////////////////////
+
+    inline transform_hierarchy::index_type transform_hierarchy::add_node(const packed_matrix4<float>& local,
+                                                                         index_type parent)
+    {
+        index_type id = static_cast<index_type>(_parent_id.size());
+        _parent_id.push_back(parent);
+        // appended at the end until the next relayout, which puts it under its parent
+        _slot_of.push_back(id);
+        _id_of_slot.push_back(id);
+        _local.push_back(local);
+        _world.push_back(local);
+        _layout_dirty = true;
+        return id;
+    }
+
+    inline transform_hierarchy::index_type transform_hierarchy::add_node(const matrix<4, 4, float>& local,
+                                                                         index_type parent)
+    {
+        return add_node(packed_matrix4<float>(local), parent);
+    }
+
+    inline bool transform_hierarchy::reparent(index_type id, index_type new_parent)
+    {
+        const index_type none = invalid_index;
+        for (index_type p = new_parent; p != none; p = _parent_id[p]) {
+            if (p == id) return false;
+        }
+        _parent_id[id] = new_parent;
+        _layout_dirty = true;
+        return true;
+    }
+
+    inline void transform_hierarchy::set_local(index_type id, const packed_matrix4<float>& local)
+    {
+        index_type slot = _slot_of[id];
+        _local[slot] = local;
+        if (_layout_dirty) return;
+        if (!_is_slot_dirty[slot]) {
+            _is_slot_dirty[slot] = 1;
+            _dirty_slots.push_back(slot);
+        }
+    }
+
+    inline void transform_hierarchy::set_local(index_type id, const matrix<4, 4, float>& local)
+    {
+        set_local(id, packed_matrix4<float>(local));
+    }
+
+    inline void transform_hierarchy::invalidate()
+    {
+        if (!_layout_dirty) mark_roots_dirty();
+    }
+
+    inline void transform_hierarchy::mark_roots_dirty()
+    {
+        for (size_t slot = 0; slot < _subtree_end.size(); slot = _subtree_end[slot]) {
+            if (_is_slot_dirty[slot]) continue;
+            _is_slot_dirty[slot] = 1;
+            _dirty_slots.push_back(static_cast<index_type>(slot));
+        }
+    }
+
+    inline void transform_hierarchy::relayout()
+    {
+        const index_type none = invalid_index;
+        size_t n = _parent_id.size();
+
+        // children lists in id order (CSR), then an iterative depth-first walk from the roots
+        std::vector<index_type> child_offsets(n + 2, 0);
+        for (size_t id = 0; id < n; ++id) {
+            if (_parent_id[id] != none) ++child_offsets[_parent_id[id] + 2];
+        }
+        for (size_t i = 2; i < n + 2; ++i) child_offsets[i] += child_offsets[i - 1];
+        std::vector<index_type> children(n);
+        for (size_t id = 0; id < n; ++id) {
+            if (_parent_id[id] != none) children[child_offsets[_parent_id[id] + 1]++] = static_cast<index_type>(id);
+        }
+
+        std::vector<packed_matrix4<float>> local(n);
+        std::vector<index_type> id_of_slot(n), parent_slot(n), subtree_end(n);
+        std::vector<index_type> stack;
+        index_type next_slot = 0;
+        for (size_t root = 0; root < n; ++root) {
+            if (_parent_id[root] != none) continue;
+            stack.push_back(static_cast<index_type>(root));
+            while (!stack.empty()) {
+                index_type id = stack.back();
+                stack.pop_back();
+                index_type slot = next_slot++;
+                id_of_slot[slot] = id;
+                local[slot] = _local[_slot_of[id]];
+                parent_slot[slot] = _parent_id[id] == none ? none : _slot_of[_parent_id[id]];
+                // children pushed in reverse so they come out in id order
+                for (index_type c = child_offsets[id + 1]; c-- > child_offsets[id];) stack.push_back(children[c]);
+                _slot_of[id] = slot;
+            }
+        }
+
+        // subtree ends, children before parents when walking backwards
+        for (size_t slot = 0; slot < n; ++slot) subtree_end[slot] = static_cast<index_type>(slot + 1);
+        for (size_t slot = n; slot-- > 0;) {
+            if (parent_slot[slot] != none) {
+                subtree_end[parent_slot[slot]] = std::max(subtree_end[parent_slot[slot]], subtree_end[slot]);
+            }
+        }
+
+        _id_of_slot.swap(id_of_slot);
+        _parent_slot.swap(parent_slot);
+        _subtree_end.swap(subtree_end);
+        _local.swap(local);
+        _world.resize(n);
+        _is_slot_dirty.assign(n, 0);
+        _dirty_slots.clear();
+        mark_roots_dirty();
+        _layout_dirty = false;
+    }
+
+    inline void transform_hierarchy::recompute(index_type first, index_type last)
+    {
+        const index_type none = invalid_index;
+        for (index_type slot = first; slot < last; ++slot) {
+            index_type p = _parent_slot[slot];
+            _world[slot] = p == none ? _local[slot] : _world[p] * _local[slot];
+            _is_slot_dirty[slot] = 0;
+        }
+    }
+
+    inline size_t transform_hierarchy::update(size_t thread_count)
+    {
+        if (_layout_dirty) relayout();
+        if (_dirty_slots.empty()) return 0;
+
+        // the top-most dirty slots, a dirty slot inside an earlier dirty subtree is covered by it
+        std::sort(_dirty_slots.begin(), _dirty_slots.end());
+        std::vector<std::pair<index_type, index_type>> ranges;
+        size_t total = 0;
+        index_type covered_end = 0;
+        for (index_type slot : _dirty_slots) {
+            if (slot < covered_end) continue;
+            covered_end = _subtree_end[slot];
+            ranges.push_back(std::make_pair(slot, covered_end));
+            total += covered_end - slot;
+        }
+        _dirty_slots.clear();
+
+        // split large subtrees at their children until there is enough work to go round: the
+        // root is computed here, its children's subtrees become independent ranges
+        const size_t grain = 4096;
+        size_t worker_count = resolve_thread_count(total, thread_count, grain);
+        if (worker_count > 1) {
+            size_t target = std::max(grain, total / (worker_count * 4));
+            for (size_t i = 0; i < ranges.size(); ++i) {
+                index_type first = ranges[i].first, last = ranges[i].second;
+                while (last - first > target) {
+                    recompute(first, first + 1);
+                    index_type child = first + 1;
+                    if (child == last) break;
+                    // the first child continues in this range, its siblings are appended
+                    index_type sibling = _subtree_end[child];
+                    while (sibling < last) {
+                        ranges.push_back(std::make_pair(sibling, _subtree_end[sibling]));
+                        sibling = _subtree_end[sibling];
+                    }
+                    first = child;
+                    last = _subtree_end[child];
+                }
+                ranges[i] = std::make_pair(first, last);
+            }
+        }
+
+        parallel_for(0, ranges.size(), [&](size_t begin, size_t end) {
+            for (size_t i = begin; i < end; ++i) recompute(ranges[i].first, ranges[i].second);
+        }, worker_count, 1);
+        return total;
+    }
+}
+
+#endif // BCG_TRANSFORM_HIERARCHY_HPP
@@ -0,0 +1,262 @@
+#ifndef BCG_TRANSFORM_STORE_HPP
+#define BCG_TRANSFORM_STORE_HPP
+
+#include "transforms/matrix/matrix.hpp"
+#include "transforms/matrix/packed_matrix.hpp"
+
+#include <algorithm>
+#include <atomic>
+#include <cstdint>
+#include <memory>
+#include <thread>
+#include <vector>
+
+namespace bcg
+{
+    //////////////////////////////////////////////////////////////////////////////////////////////////
+    // transform_store
+    //////////////////////////////////////////////////////////////////////////////////////////////////
+
+    struct transform_store_stats
+    {
+        size_t publishes = 0;
+        // acquires that lost a race with a publish and tried again
+        size_t reader_retries = 0;
+        // publishes that found every spare buffer still held by readers and had to wait
+        size_t writer_waits = 0;
+    };
+
+    // A fixed-size batch of transforms shared between one writer thread and any number of reader
+    // threads without locks. The writer fills a spare buffer and publishes it as a whole; readers
+    // pin the latest published buffer and read it in place, so a snapshot is never torn and never
+    // changes under them. Every publish stamps the buffer with the next generation, which lets
+    // readers skip batches they have already seen.
+    //
+    // With buffer_count = 2 the writer waits for readers of the older buffer to let go; with 3 or
+    // more (triple buffering) it only waits when readers hold snapshots across several publishes.
+    template<typename elem_type=float>
+    class transform_store
+    {
+    private:
+        struct buffer;
+
+    public:
+        // a pinned, read-only view of one published batch, released when destroyed
+        class snapshot
+        {
+        public:
+            snapshot() = default;
+            snapshot(snapshot&& other);
+            snapshot& operator =(snapshot&& other);
+            snapshot(const snapshot&) = delete;
+            snapshot& operator =(const snapshot&) = delete;
+            ~snapshot() { release(); }
+
+            // lets go of the buffer early, the snapshot is empty afterwards
+            void release();
+
+            bool empty() const { return _buffer == nullptr; }
+            std::uint64_t generation() const { return _buffer->generation; }
+            size_t size() const { return _size; }
+            const packed_matrix4<elem_type>* data() const { return _buffer->transforms.data(); }
+            const packed_matrix4<elem_type>& operator [](size_t idx) const { return _buffer->transforms[idx]; }
+
+        private:
+            friend class transform_store;
+            snapshot(buffer* b, size_t size) : _buffer(b), _size(size) {}
+
+        private:
+            buffer* _buffer = nullptr;
+            size_t _size = 0;
+        };
+
+    public:
+        // [transform_count] identity transforms published as generation 0
+        explicit transform_store(size_t transform_count, size_t buffer_count = 3);
+        transform_store(const transform_store&) = delete;
+        transform_store& operator =(const transform_store&) = delete;
+
+    public:
+        // writer side, one thread at a time
+
+        // a spare buffer to fill, its contents are whatever an older batch left there unless
+        // [keep_latest] copies the latest published batch in first (for partial updates)
+        packed_matrix4<elem_type>* begin_write(bool keep_latest = false);
+        // makes the buffer from begin_write() the latest batch, returns its generation
+        std::uint64_t publish();
+        // begin_write(), copy [transforms] in, publish()
+        std::uint64_t publish(const packed_matrix4<elem_type>* transforms);
+        std::uint64_t publish(const matrix<4, 4, elem_type>* transforms);
+
+        // reader side, any thread
+
+        // pins the latest published batch, never waits for the writer
+        snapshot acquire() const;
+        // generation of the latest published batch
+        std::uint64_t generation() const;
+
+    public:
+        size_t size() const { return _transform_count; }
+        size_t buffer_count() const { return _buffer_count; }
+        transform_store_stats stats() const;
+
+    private:
+        size_t _transform_count = 0;
+        size_t _buffer_count = 0;
+        std::unique_ptr<buffer[]> _buffers;
+        std::atomic<size_t> _latest;
+
+        // writer only
+        size_t _writing = 0;
+        bool _is_writing = false;
+        std::uint64_t _next_generation = 1;
+
+        // counters, readable from any thread
+        std::atomic<size_t> _publishes;
+        std::atomic<size_t> _writer_waits;
+        mutable std::atomic<size_t> _reader_retries;
+    };
+
+    //////////////////////////////////////////////////////////////////////////////////////////////////
+    // transform_store implementation
+    //////////////////////////////////////////////////////////////////////////////////////////////////
+
+    template<typename elem_type>
+    struct transform_store<elem_type>::buffer
+    {
+        // readers currently pinning this buffer, padded so buffers don't share a cache line
+        std::atomic<size_t> reader_count;
+        char padding[64 - sizeof(std::atomic<size_t>)];
+        // written by the writer before the buffer is published, read-only while it is pinned
+        std::uint64_t generation = 0;
+        std::vector<packed_matrix4<elem_type>> transforms;
+
+        buffer() : reader_count(0) {}
+    };
+
+    template<typename elem_type>
+    transform_store<elem_type>::snapshot::snapshot(snapshot&& other) : _buffer(other._buffer), _size(other._size)
+    {
+        other._buffer = nullptr;
+    }
+
+    template<typename elem_type>
+    typename transform_store<elem_type>::snapshot&
+    transform_store<elem_type>::snapshot::operator =(snapshot&& other)
+    {
+        if (this == &other) return *this;
+        release();
+        _buffer = other._buffer;
+        _size = other._size;
+        other._buffer = nullptr;
+        return *this;
+    }
+
+    template<typename elem_type>
+    void transform_store<elem_type>::snapshot::release()
+    {
+        if (_buffer == nullptr) return;
+        _buffer->reader_count.fetch_sub(1, std::memory_order_release);
+        _buffer = nullptr;
+    }
+
+    template<typename elem_type>
+    transform_store<elem_type>::transform_store(size_t transform_count, size_t buffer_count)
+        : _transform_count(transform_count), _buffer_count(std::max<size_t>(2, buffer_count)),
+          _buffers(new buffer[std::max<size_t>(2, buffer_count)]), _latest(0), _publishes(0),
+          _writer_waits(0), _reader_retries(0)
+    {
+        for (size_t b = 0; b < _buffer_count; ++b) {
+            _buffers[b].transforms.resize(transform_count);
+        }
+    }
+
+    template<typename elem_type>
+    packed_matrix4<elem_type>* transform_store<elem_type>::begin_write(bool keep_latest)
+    {
+        if (!_is_writing) {
+            // only the writer changes _latest, so it is stable here
+            size_t latest = _latest.load(std::memory_order_relaxed);
+            // a spare buffer nobody reads; a reader that pins one after this check will see it is
+            // no longer the latest and back off (both sides are sequentially consistent)
+            bool waited = false;
+            for (;;) {
+                size_t found = _buffer_count;
+                for (size_t i = 1; i < _buffer_count && found == _buffer_count; ++i) {
+                    size_t b = (latest + i) % _buffer_count;
+                    if (_buffers[b].reader_count.load() == 0) found = b;
+                }
+                if (found != _buffer_count) {
+                    _writing = found;
+                    break;
+                }
+                waited = true;
+                std::this_thread::yield();
+            }
+            if (waited) _writer_waits.fetch_add(1, std::memory_order_relaxed);
+            _is_writing = true;
+            if (keep_latest) _buffers[_writing].transforms = _buffers[latest].transforms;
+        }
+        return _buffers[_writing].transforms.data();
+    }
+
+    template<typename elem_type>
+    std::uint64_t transform_store<elem_type>::publish()
+    {
+        begin_write();
+        buffer& b = _buffers[_writing];
+        b.generation = _next_generation++;
+        _latest.store(_writing);
+        _is_writing = false;
+        _publishes.fetch_add(1, std::memory_order_relaxed);
+        return b.generation;
+    }
+
+    template<typename elem_type>
+    std::uint64_t transform_store<elem_type>::publish(const packed_matrix4<elem_type>* transforms)
+    {
+        std::copy(transforms, transforms + _transform_count, begin_write());
+        return publish();
+    }
+
+    template<typename elem_type>
+    std::uint64_t transform_store<elem_type>::publish(const matrix<4, 4, elem_type>* transforms)
+    {
+        packed_matrix4<elem_type>* out = begin_write();
+        for (size_t i = 0; i < _transform_count; ++i) out[i] = packed_matrix4<elem_type>(transforms[i]);
+        return publish();
+    }
+
+    template<typename elem_type>
+    typename transform_store<elem_type>::snapshot transform_store<elem_type>::acquire() const
+    {
+        for (;;) {
+            size_t latest = _latest.load();
+            buffer& b = _buffers[latest];
+            b.reader_count.fetch_add(1);
+            // still the latest after pinning: the writer can't pick it until we let go
+            if (_latest.load() == latest) return snapshot(&b, _transform_count);
+            b.reader_count.fetch_sub(1, std::memory_order_release);
+            _reader_retries.fetch_add(1, std::memory_order_relaxed);
+        }
+    }
+
+    template<typename elem_type>
+    std::uint64_t transform_store<elem_type>::generation() const
+    {
+        snapshot s = acquire();
+        return s.generation();
+    }
+
+    template<typename elem_type>
+    transform_store_stats transform_store<elem_type>::stats() const
+    {
+        transform_store_stats s;
+        s.publishes = _publishes.load(std::memory_order_relaxed);
+        s.reader_retries = _reader_retries.load(std::memory_order_relaxed);
+        s.writer_waits = _writer_waits.load(std::memory_order_relaxed);
+        return s;
+    }
+}
+
+#endif // BCG_TRANSFORM_STORE_HPP
@@ -25,6 +25,8 @@ namespace bcg
 
         void apply_to(point& p) const;
 
+        matrix<4, 4, float> to_matrix() const;
+
         friend std::ostream& operator<<(std::ostream& out, const translation& trans);
 
     public:
@@ -76,6 +78,11 @@ namespace bcg
         p.data() = static_cast<b_vector<4, float>>(_trans * obj);
     }
 
+    matrix<4, 4, float> translation::to_matrix() const
+    {
+        return _trans;
+    }
+
     std::ostream& operator<<(std::ostream& out, const translation& trans)
     {
         out << "{ dx: " << trans.dx() << " dy: " << trans.dy() << " dz: " << trans.dz() << " }";
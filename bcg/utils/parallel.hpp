@@ -0,0 +1,148 @@
+#ifndef BCG_PARALLEL_HPP
+#define BCG_PARALLEL_HPP
+
+#include <algorithm>
+#include <atomic>
+#include <condition_variable>
+#include <cstddef>
+#include <deque>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+namespace bcg
+{
+    //////////////////////////////////////////////////////////////////////////////////////////////////
+    // parallel utils
+    //////////////////////////////////////////////////////////////////////////////////////////////////
+
+    // number of hardware threads, never 0
+    inline size_t hardware_thread_count()
+    {
+        unsigned int n = std::thread::hardware_concurrency();
+        return n == 0 ? 1 : static_cast<size_t>(n);
+    }
+
+    // number of threads actually used for [item_count] items, given a requested [thread_count]
+    // (0 means all hardware threads) and the smallest amount of work worth a thread
+    inline size_t resolve_thread_count(size_t item_count, size_t thread_count, size_t grain_size)
+    {
+        if (thread_count == 0) thread_count = hardware_thread_count();
+        if (grain_size == 0) grain_size = 1;
+        size_t max_useful = (item_count + grain_size - 1) / grain_size;
+        return std::max<size_t>(1, std::min(thread_count, max_useful));
+    }
+
+    // run fn(first, last) over blocks of [begin, end), blocks are handed out dynamically
+    template<typename func_type>
+    void parallel_for(size_t begin, size_t end, func_type fn, size_t thread_count = 0, size_t grain_size = 1024)
+    {
+        if (end <= begin) return;
+        if (grain_size == 0) grain_size = 1;
+
+        size_t worker_count = resolve_thread_count(end - begin, thread_count, grain_size);
+        if (worker_count == 1) {
+            fn(begin, end);
+            return;
+        }
+
+        std::atomic<size_t> next_block(begin);
+        auto worker = [&]() {
+            for (;;) {
+                size_t first = next_block.fetch_add(grain_size);
+                if (first >= end) return;
+                fn(first, std::min(first + grain_size, end));
+            }
+        };
+
+        std::vector<std::thread> workers;
+        workers.reserve(worker_count - 1);
+        for (size_t i = 0; i + 1 < worker_count; ++i) {
+            workers.emplace_back(worker);
+        }
+        worker();
+        for (auto& t : workers) t.join();
+    }
+
+    // split [begin, end) into one contiguous range per thread and run fn(thread_idx, first, last),
+    // useful when each thread keeps its own accumulator (see resolve_thread_count)
+    template<typename func_type>
+    void parallel_partition(size_t begin, size_t end, func_type fn, size_t thread_count = 0, size_t grain_size = 1024)
+    {
+        if (end <= begin) return;
+
+        size_t worker_count = resolve_thread_count(end - begin, thread_count, grain_size);
+        if (worker_count == 1) {
+            fn(size_t(0), begin, end);
+            return;
+        }
+
+        size_t total = end - begin;
+        size_t step = total / worker_count;
+        size_t remainder = total % worker_count;
+
+        std::vector<std::thread> workers;
+        workers.reserve(worker_count - 1);
+        size_t first = begin;
+        for (size_t i = 0; i < worker_count; ++i) {
+            size_t last = first + step + (i < remainder ? 1 : 0);
+            if (i + 1 == worker_count) {
+                fn(i, first, last);
+            }
+            else {
+                workers.emplace_back(fn, i, first, last);
+            }
+            first = last;
+        }
+        for (auto& t : workers) t.join();
+    }
+
+    // run two callables concurrently, the second one on the calling thread
+    template<typename func_a_type, typename func_b_type>
+    void parallel_invoke(func_a_type fa, func_b_type fb, bool spawn = true)
+    {
+        if (!spawn) {
+            fa();
+            fb();
+            return;
+        }
+        std::thread t(fa);
+        fb();
+        t.join();
+    }
+
+    //////////////////////////////////////////////////////////////////////////////////////////////////
+    // blocking_queue
+    //////////////////////////////////////////////////////////////////////////////////////////////////
+
+    // unbounded FIFO handing items between threads, pop() waits until an item is available
+    template<typename elem_type>
+    class blocking_queue
+    {
+    public:
+        void push(const elem_type& item)
+        {
+            {
+                std::lock_guard<std::mutex> lock(_mutex);
+                _items.push_back(item);
+            }
+            _ready.notify_one();
+        }
+
+        elem_type pop()
+        {
+            std::unique_lock<std::mutex> lock(_mutex);
+            _ready.wait(lock, [this]() { return !_items.empty(); });
+            elem_type item = _items.front();
+            _items.pop_front();
+            return item;
+        }
+
+    private:
+        std::mutex _mutex;
+        std::condition_variable _ready;
+        std::deque<elem_type> _items;
+    };
+}
+
+#endif // BCG_PARALLEL_HPP
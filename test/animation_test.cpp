@@ -0,0 +1,211 @@
+#include "transforms/animation.hpp"
+#include "transforms/matrix/matrix.hpp"
+#include "transforms/matrix/packed_matrix.hpp"
+#include "transforms/transform_hierarchy.hpp"
+#include "test_timing.hpp"
+using namespace bcg;
+
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <cstring>
+#include <iostream>
+#include <random>
+#include <vector>
+using std::cout;
+using std::endl;
+
+// [key_count] keys per channel at increasing random times in [0, 10]
+static keyframe_track make_track(size_t key_count, std::mt19937& rng)
+{
+    std::uniform_real_distribution<float> unit(-1.0f, 1.0f);
+    keyframe_track track;
+    for (size_t k = 0; k < key_count; ++k) {
+        float time = 10.0f * (k + 0.5f + 0.4f * unit(rng)) / key_count;
+        track.add_translation(time, 5 * unit(rng), 5 * unit(rng), 5 * unit(rng));
+        float w = unit(rng), x = unit(rng), y = unit(rng), z = unit(rng);
+        float len = std::sqrt(w * w + x * x + y * y + z * z);
+        track.add_rotation(time, w / len, x / len, y / len, z / len);
+        track.add_scale(time, 1.5f + unit(rng), 1.5f + unit(rng), 1.5f + unit(rng));
+    }
+    return track;
+}
+
+// scalar reference: linear key search, double precision slerp, matrix<4, 4> products
+static void lerp_channel(const float* times, const float* values, size_t count, size_t stride, float time,
+                         double* out)
+{
+    size_t i = 0;
+    while (i + 2 < count && times[i + 1] <= time) ++i;
+    double f = 0;
+    if (count > 1) f = std::min(1.0, std::max(0.0, double(time - times[i]) / (times[i + 1] - times[i])));
+    const float* a = values + i * stride;
+    const float* b = count > 1 ? a + stride : a;
+    if (stride == 3) {
+        for (size_t d = 0; d < 3; ++d) out[d] = a[d] + (b[d] - double(a[d])) * f;
+        return;
+    }
+    double dot = 0;
+    for (size_t d = 0; d < 4; ++d) dot += double(a[d]) * b[d];
+    double sign = dot < 0 ? -1 : 1, theta = std::acos(std::min(1.0, dot * sign)), len = 0;
+    for (size_t d = 0; d < 4; ++d) {
+        out[d] = theta < 1e-6 ? a[d] * (1 - f) + sign * b[d] * f
+                              : (std::sin((1 - f) * theta) * a[d] + sign * std::sin(f * theta) * b[d]) / std::sin(theta);
+        len += out[d] * out[d];
+    }
+    for (size_t d = 0; d < 4; ++d) out[d] /= std::sqrt(len);
+}
+
+static matrix<4, 4, float> reference_local(const animation_clip& clip, animation_clip::index_type track, float time)
+{
+    double t[3], q[4], s[3];
+    lerp_channel(clip.key_times(track, animation_clip::translation_channel),
+                 clip.key_values(track, animation_clip::translation_channel),
+                 clip.key_count(track, animation_clip::translation_channel), 3, time, t);
+    lerp_channel(clip.key_times(track, animation_clip::rotation_channel),
+                 clip.key_values(track, animation_clip::rotation_channel),
+                 clip.key_count(track, animation_clip::rotation_channel), 4, time, q);
+    lerp_channel(clip.key_times(track, animation_clip::scale_channel),
+                 clip.key_values(track, animation_clip::scale_channel),
+                 clip.key_count(track, animation_clip::scale_channel), 3, time, s);
+    matrix<4, 4, float> translate = make_identity_matrix<4, float>(), rotate = translate, scale = translate;
+    double w = q[0], x = q[1], y = q[2], z = q[3];
+    double r[9] = { 1 - 2 * (y * y + z * z), 2 * (x * y - w * z), 2 * (x * z + w * y),
+                    2 * (x * y + w * z), 1 - 2 * (x * x + z * z), 2 * (y * z - w * x),
+                    2 * (x * z - w * y), 2 * (y * z + w * x), 1 - 2 * (x * x + y * y) };
+    for (size_t i = 0; i < 3; ++i) {
+        translate.set_cell(i, 3, float(t[i]));
+        scale.set_cell(i, i, float(s[i]));
+        for (size_t j = 0; j < 3; ++j) rotate.set_cell(i, j, float(r[i * 3 + j]));
+    }
+    return translate * rotate * scale;
+}
+
+static float max_error(const packed_matrix4<float>& a, const matrix<4, 4, float>& b)
+{
+    float worst = 0;
+    for (size_t i = 0; i < 4; ++i) {
+        for (size_t j = 0; j < 4; ++j) worst = std::max(worst, std::fabs(a(i, j) - b.get_cell(i, j)));
+    }
+    return worst;
+}
+
+int main()
+{
+    cout << "*************************************" << endl;
+    cout << "blacker-cglib/test/animation_test.cpp" << endl;
+    cout << "*************************************" << endl;
+
+    cout << std::boolalpha;
+    std::mt19937 rng(46);
+    //////////////////////////////////////////////////////////////////////////////////////////////
+    // test keyframe sampling
+    //////////////////////////////////////////////////////////////////////////////////////////////
+    cout << "======================" << endl;
+    cout << "test keyframe sampling" << endl;
+    cout << "======================" << endl;
+    {
+        animation_clip clip;
+        for (size_t i = 0; i < 37; ++i) clip.add_track(make_track(1 + i % 9, rng));
+        // channels with no keys and a single key
+        keyframe_track sparse;
+        sparse.add_translation(2.0f, 1, 2, 3);
+        clip.add_track(sparse);
+        cout << "track count [should be 38] = " << clip.track_count() << endl;
+        cout << "duration <= 10 [should be true] = " << (clip.duration() <= 10.0f) << endl;
+
+        std::vector<packed_matrix4<float>> locals(clip.track_count());
+        animation_sampler sampler;
+        sampler.sample(clip, 1.0f, locals.data());
+        cout << "keyless track is translation only [should be 1 2 3 / 1 1 1] = " << locals[37](0, 3) << " "
+             << locals[37](1, 3) << " " << locals[37](2, 3) << " / " << locals[37](0, 0) << " " << locals[37](1, 1)
+             << " " << locals[37](2, 2) << endl;
+
+        // exactly at keys, between keys and before and after all keys
+        animation_clip::index_type probe = 8;
+        const float* times = clip.key_times(probe, animation_clip::translation_channel);
+        const float* values = clip.key_values(probe, animation_clip::translation_channel);
+        sampler.sample(clip, times[3], locals.data());
+        cout << "at the 4th key, translation x [should be " << values[9] << "] = " << locals[probe](0, 3) << endl;
+        sampler.sample(clip, (times[3] + times[4]) / 2, locals.data());
+        cout << "halfway to the 5th key [should be " << (values[9] + values[12]) / 2 << "] = " << locals[probe](0, 3)
+             << endl;
+        sampler.sample(clip, -5.0f, locals.data());
+        cout << "before the first key [should be " << values[0] << "] = " << locals[probe](0, 3) << endl;
+        sampler.sample(clip, 50.0f, locals.data());
+        cout << "after the last key [should be " << values[8 * 3] << "] = " << locals[probe](0, 3) << endl;
+
+        // forward playback, backward playback and random jumps all match the reference
+        std::uniform_real_distribution<float> jump(-1.0f, 11.0f);
+        float worst = 0;
+        animation_sampler threaded;
+        std::vector<packed_matrix4<float>> threaded_locals(clip.track_count());
+        bool same = true;
+        for (size_t frame = 0; frame < 600; ++frame) {
+            float time = frame < 200 ? frame * 0.06f - 1 : frame < 400 ? (400 - frame) * 0.06f - 1 : jump(rng);
+            sampler.sample(clip, time, locals.data(), 1);
+            threaded.sample(clip, time, threaded_locals.data(), 4);
+            same = same && std::memcmp(locals.data(), threaded_locals.data(), locals.size() * sizeof(locals[0])) == 0;
+            for (animation_clip::index_type i = 0; i < clip.track_count(); ++i) {
+                worst = std::max(worst, max_error(locals[i], reference_local(clip, i, time)));
+            }
+        }
+        cout << "600 frames forward, backward and random against the scalar reference, error < 1e-4 "
+             << "[should be true] = " << (worst < 1e-4f) << " (" << worst << ")" << endl;
+        cout << "1 and 4 threads sample identical matrices [should be true] = " << same << endl;
+
+        // the sampled locals drive a hierarchy
+        transform_hierarchy hierarchy;
+        transform_hierarchy::index_type root = hierarchy.add_node(packed_matrix4<float>());
+        transform_hierarchy::index_type child = hierarchy.add_node(packed_matrix4<float>(), root);
+        sampler.sample(clip, 4.0f, locals.data());
+        hierarchy.set_local(root, locals[0]);
+        hierarchy.set_local(child, locals[1]);
+        hierarchy.update();
+        cout << "hierarchy world = parent local * child local, error < 1e-4 [should be true] = "
+             << (max_error(hierarchy.world(child), (locals[0] * locals[1]).to_matrix()) < 1e-4f) << endl;
+    }
+    //////////////////////////////////////////////////////////////////////////////////////////////
+    // test animation performance
+    //////////////////////////////////////////////////////////////////////////////////////////////
+    cout << "==========================" << endl;
+    cout << "test animation performance" << endl;
+    cout << "==========================" << endl;
+    {
+        const size_t track_count = 20000, key_count = 60, frame_count = 300;
+        animation_clip clip;
+        for (size_t i = 0; i < track_count; ++i) clip.add_track(make_track(key_count, rng));
+        std::vector<packed_matrix4<float>> locals(track_count);
+
+        // scalar reference for a few frames only, it is slow
+        auto start = std::chrono::steady_clock::now();
+        std::vector<matrix<4, 4, float>> reference(track_count);
+        for (size_t frame = 0; frame < 10; ++frame) {
+            for (animation_clip::index_type i = 0; i < track_count; ++i) {
+                reference[i] = reference_local(clip, i, frame * 10.0f / frame_count);
+            }
+        }
+        double reference_ms = elapsed_ms(start) / 10;
+
+        animation_sampler sampler;
+        start = std::chrono::steady_clock::now();
+        for (size_t frame = 0; frame < frame_count; ++frame) sampler.sample(clip, frame * 10.0f / frame_count, locals.data(), 1);
+        double forward_ms = elapsed_ms(start) / frame_count;
+
+        std::uniform_real_distribution<float> jump(0.0f, 10.0f);
+        std::vector<float> jumps(frame_count);
+        for (float& t : jumps) t = jump(rng);
+        start = std::chrono::steady_clock::now();
+        for (size_t frame = 0; frame < frame_count; ++frame) sampler.sample(clip, jumps[frame], locals.data(), 1);
+        double random_ms = elapsed_ms(start) / frame_count;
+
+        start = std::chrono::steady_clock::now();
+        for (size_t frame = 0; frame < frame_count; ++frame) sampler.sample(clip, frame * 10.0f / frame_count, locals.data());
+        double threaded_ms = elapsed_ms(start) / frame_count;
+
+        cout << track_count << " tracks x " << key_count << " keys per frame, scalar reference: " << reference_ms
+             << " ms, forward playback: " << forward_ms << " ms (" << threaded_ms << " ms threaded), random jumps: "
+             << random_ms << " ms" << endl;
+        cout << "forward playback faster than the reference [should be true] = " << (forward_ms < reference_ms) << endl;
+    }
+}
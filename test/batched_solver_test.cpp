@@ -0,0 +1,210 @@
+#include "transforms/b_vector/b_vector.hpp"
+#include "transforms/matrix/batched_solver.hpp"
+#include "transforms/matrix/matrix.hpp"
+#include "test_timing.hpp"
+using namespace bcg;
+
+#include <chrono>
+#include <cmath>
+#include <iostream>
+#include <random>
+#include <vector>
+using std::cout;
+using std::endl;
+
+// random systems, every 997th one singular (row 1 repeats row 0); with [spd] a = m^T m + I,
+// and the singular ones repeat column 0 in column 1 too so they stay symmetric
+template<size_t order>
+static void make_systems(size_t n, bool spd, matrix_batch<order>& a, vector_batch<order>& b)
+{
+    std::mt19937 rng(38);
+    std::uniform_real_distribution<float> unit(-1.0f, 1.0f);
+    a.resize(n);
+    b.resize(n);
+    for (size_t s = 0; s < n; ++s) {
+        float m[order][order];
+        for (size_t i = 0; i < order; ++i) {
+            for (size_t j = 0; j < order; ++j) m[i][j] = unit(rng);
+        }
+        if (spd) {
+            float product[order][order];
+            for (size_t i = 0; i < order; ++i) {
+                for (size_t j = 0; j < order; ++j) {
+                    product[i][j] = i == j ? 1.0f : 0.0f;
+                    for (size_t k = 0; k < order; ++k) product[i][j] += m[k][i] * m[k][j];
+                }
+            }
+            for (size_t i = 0; i < order; ++i) {
+                for (size_t j = 0; j < order; ++j) m[i][j] = product[i][j];
+            }
+            if (s % 997 == 0) {
+                for (size_t i = 0; i < order; ++i) m[i][1] = m[i][0];
+            }
+        }
+        if (s % 997 == 0) {
+            for (size_t j = 0; j < order; ++j) m[1][j] = m[0][j];
+        }
+        for (size_t i = 0; i < order; ++i) {
+            for (size_t j = 0; j < order; ++j) a.cell(i, j)[s] = m[i][j];
+            b.component(i)[s] = unit(rng);
+        }
+    }
+}
+
+// largest |a x - b| over the systems not reported as rank deficient, relative to |b| + |a||x|
+template<size_t order>
+static double worst_residual(const matrix_batch<order>& a, const vector_batch<order>& b, const vector_batch<order>& x,
+                             const std::vector<std::uint32_t>& deficient)
+{
+    double worst = 0;
+    size_t next = 0;
+    for (size_t s = 0; s < a.size(); ++s) {
+        if (next < deficient.size() && deficient[next] == s) {
+            ++next;
+            continue;
+        }
+        for (size_t i = 0; i < order; ++i) {
+            double sum = -b.component(i)[s], scale = std::fabs(b.component(i)[s]);
+            for (size_t j = 0; j < order; ++j) {
+                sum += double(a.cell(i, j)[s]) * x.component(j)[s];
+                scale += std::fabs(a.cell(i, j)[s] * x.component(j)[s]);
+            }
+            worst = std::max(worst, std::fabs(sum) / scale);
+        }
+    }
+    return worst;
+}
+
+// constructed singular systems that were not reported, and reported systems that were not
+// constructed singular (numerically rank deficient ones, they should be rare)
+static void count_reports(const std::vector<std::uint32_t>& deficient, size_t n, size_t& missed, size_t& extra)
+{
+    missed = 0;
+    extra = 0;
+    size_t next = 0;
+    for (size_t s = 0; s < n; ++s) {
+        bool reported = next < deficient.size() && deficient[next] == s;
+        if (reported) ++next;
+        if (s % 997 == 0 && !reported) ++missed;
+        if (s % 997 != 0 && reported) ++extra;
+    }
+}
+
+int main()
+{
+    cout << "******************************************" << endl;
+    cout << "blacker-cglib/test/batched_solver_test.cpp" << endl;
+    cout << "******************************************" << endl;
+
+    // not a multiple of the block width, so the last block is partial
+    const size_t n = 1000003;
+    cout << std::boolalpha;
+    //////////////////////////////////////////////////////////////////////////////////////////////
+    // test batched lu
+    //////////////////////////////////////////////////////////////////////////////////////////////
+    cout << "===============" << endl;
+    cout << "test batched lu" << endl;
+    cout << "===============" << endl;
+    {
+        matrix_batch<3> a3;
+        vector_batch<3> b3, x3;
+        make_systems(n, false, a3, b3);
+        std::vector<std::uint32_t> deficient;
+        size_t count = solve_batch(a3, b3, x3, solve_method::lu, &deficient);
+        size_t missed, extra;
+        count_reports(deficient, n, missed, extra);
+        cout << "3x3: " << count << " rank-deficient systems, singular ones missed [should be 0] = " << missed << endl;
+        cout << "3x3: ill-conditioned ones reported below 0.1% [should be true] = " << (extra < n / 1000)
+             << " (" << extra << ")" << endl;
+        cout << "3x3: x of a rank-deficient system [should be (0, 0, 0)] = " << x3.get(0) << endl;
+        cout << "3x3: worst relative residual < 1e-5 [should be true] = "
+             << (worst_residual(a3, b3, x3, deficient) < 1e-5) << " (" << worst_residual(a3, b3, x3, deficient) << ")" << endl;
+
+        matrix<3, 3, float> m = a3.get(1);
+        b_vector<3, float> expected = static_cast<b_vector<3, float>>(m.inverse() * static_cast<matrix<3, 1, float>>(b3.get(1)));
+        cout << "3x3: system 1 [should be about " << expected << "] = " << x3.get(1) << endl;
+
+        matrix_batch<4> a4;
+        vector_batch<4> b4, x4;
+        make_systems(n, false, a4, b4);
+        deficient.clear();
+        count = solve_batch(a4, b4, x4, solve_method::lu, &deficient);
+        count_reports(deficient, n, missed, extra);
+        cout << "4x4: singular systems missed [should be 0] = " << missed << endl;
+        cout << "4x4: ill-conditioned ones reported below 0.1% [should be true] = " << (extra < n / 1000)
+             << " (" << extra << ")" << endl;
+        cout << "4x4: worst relative residual < 1e-5 [should be true] = "
+             << (worst_residual(a4, b4, x4, deficient) < 1e-5) << " (" << worst_residual(a4, b4, x4, deficient) << ")" << endl;
+    }
+    //////////////////////////////////////////////////////////////////////////////////////////////
+    // test batched cholesky
+    //////////////////////////////////////////////////////////////////////////////////////////////
+    cout << "=====================" << endl;
+    cout << "test batched cholesky" << endl;
+    cout << "=====================" << endl;
+    {
+        matrix_batch<4> a4;
+        vector_batch<4> b4, x4;
+        make_systems(n, true, a4, b4);
+        std::vector<std::uint32_t> deficient;
+        solve_batch(a4, b4, x4, solve_method::cholesky, &deficient);
+        size_t missed, extra;
+        count_reports(deficient, n, missed, extra);
+        cout << "4x4: singular systems missed [should be 0] = " << missed << endl;
+        cout << "4x4: ill-conditioned ones reported below 0.1% [should be true] = " << (extra < n / 1000)
+             << " (" << extra << ")" << endl;
+        cout << "4x4: worst relative residual < 1e-5 [should be true] = "
+             << (worst_residual(a4, b4, x4, deficient) < 1e-5) << " (" << worst_residual(a4, b4, x4, deficient) << ")" << endl;
+
+        matrix_batch<3> indefinite(1);
+        vector_batch<3> rhs(1), x;
+        indefinite.set(0, { 1, 0, 0, 0, -1, 0, 0, 0, 1 });
+        cout << "indefinite matrix counts as deficient for cholesky [should be 1] = "
+             << solve_batch(indefinite, rhs, x, solve_method::cholesky) << endl;
+    }
+    //////////////////////////////////////////////////////////////////////////////////////////////
+    // test batched solver performance
+    //////////////////////////////////////////////////////////////////////////////////////////////
+    cout << "===============================" << endl;
+    cout << "test batched solver performance" << endl;
+    cout << "===============================" << endl;
+    {
+        matrix_batch<3> a3;
+        vector_batch<3> b3, x3;
+        make_systems(n, true, a3, b3);
+
+        auto start = std::chrono::steady_clock::now();
+        solve_batch(a3, b3, x3, solve_method::lu, nullptr, 1);
+        double lu_ms = elapsed_ms(start);
+        start = std::chrono::steady_clock::now();
+        solve_batch(a3, b3, x3, solve_method::cholesky, nullptr, 1);
+        double cholesky_ms = elapsed_ms(start);
+        start = std::chrono::steady_clock::now();
+        solve_batch(a3, b3, x3, solve_method::lu);
+        double threaded_ms = elapsed_ms(start);
+
+        start = std::chrono::steady_clock::now();
+        float checksum = 0;
+        for (size_t s = 1; s < n; ++s) {
+            if (s % 997 == 0) continue;
+            matrix<3, 3, float> m = a3.get(s);
+            checksum += (m.inverse() * static_cast<matrix<3, 1, float>>(b3.get(s)))[0][0];
+        }
+        double inverse_ms = elapsed_ms(start);
+
+        matrix_batch<4> a4;
+        vector_batch<4> b4, x4;
+        make_systems(n, true, a4, b4);
+        start = std::chrono::steady_clock::now();
+        solve_batch(a4, b4, x4, solve_method::lu, nullptr, 1);
+        double lu4_ms = elapsed_ms(start);
+        start = std::chrono::steady_clock::now();
+        solve_batch(a4, b4, x4, solve_method::cholesky, nullptr, 1);
+        double cholesky4_ms = elapsed_ms(start);
+
+        cout << n << " 3x3 systems, matrix::inverse() each: " << inverse_ms << " ms (checksum " << checksum
+             << "), batched lu: " << lu_ms << " ms, batched cholesky: " << cholesky_ms
+             << " ms, batched lu on all threads: " << threaded_ms << " ms" << endl;
+        cout << n << " 4x4 systems, batched lu: " << lu4_ms << " ms, batched cholesky: " << cholesky4_ms << " ms" << endl;
+    }
+}
@@ -0,0 +1,209 @@
+#include "io/binary_format.hpp"
+#include "transforms/matrix/matrix.hpp"
+#include "transforms/point.hpp"
+#include "test_timing.hpp"
+using namespace bcg;
+
+#include <chrono>
+#include <cstdio>
+#include <fstream>
+#include <iostream>
+#include <random>
+#include <vector>
+using std::cout;
+using std::endl;
+
+// overwrite [size] bytes at [offset] of an existing file
+static void patch_file(const std::string& path, size_t offset, const void* bytes, size_t size)
+{
+    std::fstream file(path, std::ios::binary | std::ios::in | std::ios::out);
+    file.seekp(static_cast<std::streamoff>(offset));
+    file.write(static_cast<const char*>(bytes), static_cast<std::streamsize>(size));
+}
+
+int main()
+{
+    cout << "*****************************************" << endl;
+    cout << "blacker-cglib/test/binary_format_test.cpp" << endl;
+    cout << "*****************************************" << endl;
+
+    const std::string point_path = "binary_format_test_points.bcgb";
+    const std::string matrix_path = "binary_format_test_matrices.bcgb";
+    const std::string text_path = "binary_format_test_points.txt";
+    //////////////////////////////////////////////////////////////////////////////////////////////
+    // test point buffers
+    //////////////////////////////////////////////////////////////////////////////////////////////
+    cout << "==================" << endl;
+    cout << "test point buffers" << endl;
+    cout << "==================" << endl;
+    {
+        std::vector<point> points = { point(1, 2, 3), point(-4.5f, 0.25f, 7), point(0, 0, -1) };
+        cout << "write_point_file(xyz) [should be ok] = "
+             << to_string(write_point_file(point_path, points)) << endl;
+
+        binary_header header;
+        cout << "read_binary_header() [should be ok] = " << to_string(read_binary_header(point_path, header)) << endl;
+        cout << "header.record_count [should be 3] = " << header.record_count << endl;
+        cout << "header.data_offset % 64 [should be 0] = " << header.data_offset % binary_alignment << endl;
+
+        point_file_view<float> view;
+        cout << "view.open() [should be ok] = " << to_string(view.open(point_path)) << endl;
+        cout << "view.stride() [should be 3] = " << view.stride() << endl;
+        cout << "view.get(1) [should be (-4.5, 0.25, 7)] = " << view.get(1) << endl;
+        cout << std::boolalpha << "view.is_mapped() [should be true] = " << view.is_mapped() << endl;
+        cout << "payload is 16-byte aligned [should be true] = "
+             << (reinterpret_cast<std::uintptr_t>(view.data()) % 16 == 0) << endl;
+
+        cout << "write_point_file(xyzw) [should be ok] = "
+             << to_string(write_point_file(point_path, points, binary_layout::point_xyzw)) << endl;
+        view.open(point_path);
+        cout << "view.stride() [should be 4] = " << view.stride() << endl;
+        cout << "w of view.coords(2) [should be 1] = " << view.coords(2)[3] << endl;
+
+        point_file_view<double> wrong_view;
+        cout << "open float points as double [should be type mismatch] = "
+             << to_string(wrong_view.open(point_path)) << endl;
+    }
+    //////////////////////////////////////////////////////////////////////////////////////////////
+    // test matrix arrays
+    //////////////////////////////////////////////////////////////////////////////////////////////
+    cout << "==================" << endl;
+    cout << "test matrix arrays" << endl;
+    cout << "==================" << endl;
+    {
+        std::vector<matrix<4, 4, double>> matrices;
+        for (int i = 0; i < 100; ++i) {
+            matrix<4, 4, double> m = make_identity_matrix<4, double>();
+            m.set_cell(0, 3, i);
+            m.set_cell(2, 1, -0.5 * i);
+            matrices.push_back(m);
+        }
+        cout << "write_matrix_file() [should be ok] = " << to_string(write_matrix_file(matrix_path, matrices)) << endl;
+
+        matrix_file_view<4, 4, double> view;
+        cout << "view.open() [should be ok] = " << to_string(view.open(matrix_path)) << endl;
+        cout << "view.size() [should be 100] = " << view.size() << endl;
+        cout << "view.get(7) [should be translate x by 7, cell (2, 1) = -3.5] = " << endl << view.get(7) << endl;
+        size_t wrong_count = 0;
+        for (size_t i = 0; i < view.size(); ++i) {
+            for (size_t c = 0; c < 16; ++c) {
+                if (view.cells(i)[c] != matrices[i].get_row(c / 4)[c % 4]) ++wrong_count;
+            }
+        }
+        cout << "cells differing from the written matrices [should be 0] = " << wrong_count << endl;
+
+        matrix_file_view<3, 3, double> wrong_shape;
+        cout << "open 4x4 matrices as 3x3 [should be type mismatch] = "
+             << to_string(wrong_shape.open(matrix_path)) << endl;
+        point_file_view<double> wrong_layout;
+        cout << "open matrices as points [should be type mismatch] = "
+             << to_string(wrong_layout.open(matrix_path)) << endl;
+    }
+    //////////////////////////////////////////////////////////////////////////////////////////////
+    // test header validation
+    //////////////////////////////////////////////////////////////////////////////////////////////
+    cout << "======================" << endl;
+    cout << "test header validation" << endl;
+    cout << "======================" << endl;
+    {
+        matrix_file_view<4, 4, double> view;
+        cout << "open missing file [should be open failed] = "
+             << to_string(view.open("binary_format_test_missing.bcgb")) << endl;
+
+        std::uint16_t next_major = binary_header::current_major + 1;
+        patch_file(matrix_path, 4, &next_major, sizeof(next_major));
+        cout << "open newer major version [should be unsupported version] = "
+             << to_string(view.open(matrix_path)) << endl;
+
+        std::uint32_t swapped = 0x04030201;
+        write_matrix_file(matrix_path, std::vector<matrix<4, 4, double>>(1));
+        patch_file(matrix_path, 8, &swapped, sizeof(swapped));
+        cout << "open foreign byte order [should be foreign byte order] = "
+             << to_string(view.open(matrix_path)) << endl;
+
+        write_matrix_file(matrix_path, std::vector<matrix<4, 4, double>>(1));
+        patch_file(matrix_path, 0, "XXXX", 4);
+        cout << "open bad magic [should be bad magic] = " << to_string(view.open(matrix_path)) << endl;
+
+        std::uint64_t too_many = 1000;
+        write_matrix_file(matrix_path, std::vector<matrix<4, 4, double>>(1));
+        patch_file(matrix_path, 24, &too_many, sizeof(too_many));
+        cout << "open with inconsistent record count [should be truncated] = "
+             << to_string(view.open(matrix_path)) << endl;
+
+        // sizes that only match after wrapping around 2^64
+        std::vector<matrix<4, 4, double>> two(2);
+        std::uint64_t wrapping_count = (std::uint64_t(1) << 57) + 1;
+        write_matrix_file(matrix_path, two);
+        patch_file(matrix_path, 24, &wrapping_count, sizeof(wrapping_count));
+        cout << "open with a record count overflowing the payload size [should be truncated] = "
+             << to_string(view.open(matrix_path)) << endl;
+
+        std::uint64_t wrapping_offset = std::uint64_t(0) - binary_alignment;
+        write_matrix_file(matrix_path, two);
+        patch_file(matrix_path, 32, &wrapping_offset, sizeof(wrapping_offset));
+        cout << "open with an offset wrapping past the file end [should be truncated] = "
+             << to_string(view.open(matrix_path)) << endl;
+
+        // one record inside the file, but not at an aligned offset
+        std::uint64_t one_record = 1, record_size = sizeof(double) * 16, misaligned = binary_alignment + 8;
+        write_matrix_file(matrix_path, two);
+        patch_file(matrix_path, 24, &one_record, sizeof(one_record));
+        patch_file(matrix_path, 32, &misaligned, sizeof(misaligned));
+        patch_file(matrix_path, 40, &record_size, sizeof(record_size));
+        cout << "open with a misaligned payload [should be parse failed] = " << to_string(view.open(matrix_path))
+             << endl;
+    }
+    //////////////////////////////////////////////////////////////////////////////////////////////
+    // test open time against text parsing
+    //////////////////////////////////////////////////////////////////////////////////////////////
+    cout << "===================================" << endl;
+    cout << "test open time against text parsing" << endl;
+    cout << "===================================" << endl;
+    {
+        const size_t n = 2000000;
+        std::mt19937 rng(3);
+        std::uniform_real_distribution<float> uniform(-100.0f, 100.0f);
+        std::vector<float> coords(n * 3);
+        for (auto& c : coords) c = uniform(rng);
+
+        write_point_file(point_path, coords.data(), n);
+        {
+            std::ofstream text(text_path);
+            for (size_t i = 0; i < n; ++i) {
+                text << coords[i * 3] << ' ' << coords[i * 3 + 1] << ' ' << coords[i * 3 + 2] << '\n';
+            }
+        }
+
+        auto start = std::chrono::steady_clock::now();
+        point_file_view<float> view;
+        io_status status = view.open(point_path);
+        double open_ms = elapsed_ms(start);
+        // touch every point, this is where the pages are actually read
+        start = std::chrono::steady_clock::now();
+        double sum = 0;
+        for (size_t i = 0; i < view.size(); ++i) sum += view.coords(i)[1];
+        double scan_ms = elapsed_ms(start);
+
+        start = std::chrono::steady_clock::now();
+        std::vector<float> parsed;
+        parsed.reserve(n * 3);
+        {
+            std::ifstream text(text_path);
+            float value;
+            while (text >> value) parsed.push_back(value);
+        }
+        double parse_ms = elapsed_ms(start);
+
+        double expected = 0;
+        for (size_t i = 0; i < n; ++i) expected += coords[i * 3 + 1];
+        cout << "view.open() [should be ok] = " << to_string(status) << ", " << view.size() << " points" << endl;
+        cout << std::boolalpha << "mapped sum equals source sum [should be true] = " << (sum == expected) << endl;
+        cout << "parsed values [should be " << n * 3 << "] = " << parsed.size() << endl;
+        cout << "open: " << open_ms << " ms, first scan: " << scan_ms << " ms, text parse: " << parse_ms << " ms" << endl;
+    }
+
+    std::remove(point_path.c_str());
+    std::remove(matrix_path.c_str());
+    std::remove(text_path.c_str());
+}
@@ -0,0 +1,190 @@
+#include "spatial/aabb.hpp"
+#include "spatial/broad_phase.hpp"
+#include "transforms/point.hpp"
+#include "test_timing.hpp"
+using namespace bcg;
+
+#include <algorithm>
+#include <chrono>
+#include <iostream>
+#include <random>
+#include <vector>
+using std::cout;
+using std::endl;
+
+// centers spread evenly over a cube of side [side]
+static std::vector<point> uniform_scene(size_t n, float side, std::mt19937& rng)
+{
+    std::uniform_real_distribution<float> unit(0.0f, side);
+    std::vector<point> centers;
+    centers.reserve(n);
+    for (size_t i = 0; i < n; ++i) centers.push_back(point(unit(rng), unit(rng), unit(rng)));
+    return centers;
+}
+
+// centers in [cluster_count] tight gaussian clusters inside the same cube
+static std::vector<point> clustered_scene(size_t n, float side, size_t cluster_count, std::mt19937& rng)
+{
+    std::uniform_real_distribution<float> unit(0.0f, side);
+    std::normal_distribution<float> spread(0.0f, side / 80);
+    std::vector<point> clusters = uniform_scene(cluster_count, side, rng);
+    std::vector<point> centers;
+    centers.reserve(n);
+    for (size_t i = 0; i < n; ++i) {
+        const b_vector<4, float>& c = clusters[i % cluster_count].data();
+        centers.push_back(point(c[0] + spread(rng), c[1] + spread(rng), c[2] + spread(rng)));
+    }
+    return centers;
+}
+
+// every point takes a small random step
+static void jitter(std::vector<point>& centers, float step, std::mt19937& rng)
+{
+    std::uniform_real_distribution<float> unit(-step, step);
+    for (point& p : centers) {
+        b_vector<4, float>& c = p.data();
+        for (size_t d = 0; d < 3; ++d) c[d] += unit(rng);
+    }
+}
+
+static std::vector<collision_pair> brute_force(const std::vector<aabb>& boxes)
+{
+    std::vector<collision_pair> pairs;
+    for (std::uint32_t i = 0; i < boxes.size(); ++i) {
+        for (std::uint32_t j = i + 1; j < boxes.size(); ++j) {
+            if (boxes[i].overlaps(boxes[j])) pairs.push_back(collision_pair{ i, j });
+        }
+    }
+    return pairs;
+}
+
+static std::vector<collision_pair> sorted(std::vector<collision_pair> pairs)
+{
+    std::sort(pairs.begin(), pairs.end());
+    return pairs;
+}
+
+int main()
+{
+    cout << "***************************************" << endl;
+    cout << "blacker-cglib/test/broad_phase_test.cpp" << endl;
+    cout << "***************************************" << endl;
+
+    cout << std::boolalpha;
+    std::mt19937 rng(48);
+    //////////////////////////////////////////////////////////////////////////////////////////////
+    // test candidate pairs
+    //////////////////////////////////////////////////////////////////////////////////////////////
+    cout << "====================" << endl;
+    cout << "test candidate pairs" << endl;
+    cout << "====================" << endl;
+    {
+        const size_t n = 4000;
+        const char* names[] = { "uniform", "clustered" };
+        for (size_t scene = 0; scene < 2; ++scene) {
+            std::vector<point> centers = scene == 0 ? uniform_scene(n, 100, rng) : clustered_scene(n, 100, 20, rng);
+            std::vector<aabb> boxes(n);
+            sweep_and_prune sap;
+            spatial_hash_grid grid;
+            spatial_hash_grid fine_grid(0.3f);
+            bool sap_same = true, grid_same = true, fine_same = true, unique = true;
+            size_t pair_count = 0, swaps = 0, full_sorts = 0;
+            for (size_t frame = 0; frame < 20; ++frame) {
+                boxes_around_points(centers.data(), n, 1.0f, boxes.data());
+                std::vector<collision_pair> expected = brute_force(boxes);
+                sap.update(boxes.data(), n, frame % 2 ? 4 : 1);
+                grid.update(boxes.data(), n, frame % 2 ? 4 : 1);
+                fine_grid.update(boxes.data(), n);
+                std::vector<collision_pair> found = sorted(sap.pairs());
+                sap_same = sap_same && found == expected;
+                unique = unique && std::adjacent_find(found.begin(), found.end()) == found.end();
+                grid_same = grid_same && sorted(grid.pairs()) == expected;
+                fine_same = fine_same && sorted(fine_grid.pairs()) == expected;
+                pair_count += expected.size();
+                if (frame > 0) {
+                    swaps += sap.stats().swaps;
+                    full_sorts += sap.stats().full_sorts;
+                }
+                jitter(centers, 0.2f, rng);
+            }
+            cout << names[scene] << ", 20 moving frames of " << n << " boxes, " << pair_count / 20 << " pairs per frame"
+                 << endl;
+            cout << "  sweep and prune equals brute force [should be true] = " << sap_same << ", no duplicates "
+                 << "[should be true] = " << unique << endl;
+            cout << "  spatial hash equals brute force [should be true] = " << grid_same << ", with cells smaller "
+                 << "than the boxes [should be true] = " << fine_same << endl;
+            cout << "  insertion sort swaps per box per frame [should be < 8] = " << double(swaps) / n / 19
+                 << ", full sorts after the first frame [should be 0] = " << full_sorts << endl;
+        }
+
+        // boxes far apart whose wrapped cells share keys, and a box spanning many cells
+        std::vector<aabb> boxes;
+        float far = 1 << 21;
+        boxes.push_back(aabb(0.1f, 0.1f, 0.1f, 0.9f, 0.9f, 0.9f));
+        boxes.push_back(aabb(far + 0.1f, 0.1f, 0.1f, far + 0.9f, 0.9f, 0.9f));
+        boxes.push_back(aabb(-5, -5, -5, 5, 5, 5));
+        boxes.push_back(aabb(4.5f, 4.5f, 4.5f, 6, 6, 6));
+        spatial_hash_grid grid(1);
+        grid.update(boxes.data(), boxes.size());
+        cout << "wrapped keys and a box over 1000 cells, same as brute force [should be true] = "
+             << (sorted(grid.pairs()) == brute_force(boxes)) << endl;
+    }
+    //////////////////////////////////////////////////////////////////////////////////////////////
+    // test broad phase performance
+    //////////////////////////////////////////////////////////////////////////////////////////////
+    cout << "============================" << endl;
+    cout << "test broad phase performance" << endl;
+    cout << "============================" << endl;
+    {
+        const size_t n = 300000, frame_count = 6;
+        const char* names[] = { "uniform", "clustered" };
+        for (size_t scene = 0; scene < 2; ++scene) {
+            std::vector<point> centers = scene == 0 ? uniform_scene(n, 400, rng) : clustered_scene(n, 400, 200, rng);
+            std::vector<std::vector<aabb>> frames(frame_count, std::vector<aabb>(n));
+            for (size_t f = 0; f < frame_count; ++f) {
+                boxes_around_points(centers.data(), n, 0.5f, frames[f].data());
+                jitter(centers, 0.05f, rng);
+            }
+
+            sweep_and_prune sap;
+            sap.update(frames[0].data(), n);
+            auto start = std::chrono::steady_clock::now();
+            size_t pairs = 0;
+            for (size_t f = 1; f < frame_count; ++f) {
+                sap.update(frames[f].data(), n, 1);
+                pairs += sap.pairs().size();
+            }
+            double incremental_ms = elapsed_ms(start) / (frame_count - 1);
+
+            start = std::chrono::steady_clock::now();
+            for (size_t f = 1; f < frame_count; ++f) {
+                sap.reset();
+                sap.update(frames[f].data(), n, 1);
+            }
+            double full_ms = elapsed_ms(start) / (frame_count - 1);
+
+            start = std::chrono::steady_clock::now();
+            for (size_t f = 1; f < frame_count; ++f) sap.update(frames[f].data(), n);
+            double threaded_ms = elapsed_ms(start) / (frame_count - 1);
+
+            spatial_hash_grid grid;
+            start = std::chrono::steady_clock::now();
+            bool same = true;
+            for (size_t f = 1; f < frame_count; ++f) {
+                grid.update(frames[f].data(), n, 1);
+                sap.update(frames[f].data(), n);
+                if (f == 1) same = sorted(grid.pairs()) == sorted(sap.pairs());
+            }
+            double grid_ms = elapsed_ms(start) / (frame_count - 1) - threaded_ms;
+
+            cout << names[scene] << ", " << n << " moving boxes, " << pairs / (frame_count - 1) << " pairs per frame"
+                 << endl;
+            cout << "  sweep and prune per frame, incremental: " << incremental_ms << " ms, sorted from scratch: "
+                 << full_ms << " ms, threaded incremental: " << threaded_ms << " ms" << endl;
+            cout << "  spatial hash per frame: " << grid_ms << " ms (" << grid.stats().cell_entries << " cell entries, "
+                 << grid.stats().overlap_tests << " box tests against " << sap.stats().overlap_tests
+                 << " for the sweep)" << endl;
+            cout << "  both find the same pairs [should be true] = " << same << endl;
+        }
+    }
+}
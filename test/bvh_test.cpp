@@ -0,0 +1,222 @@
+#include "spatial/bvh.hpp"
+#include "transforms/point.hpp"
+#include "transforms/vector.hpp"
+#include "test_timing.hpp"
+using namespace bcg;
+
+#include <chrono>
+#include <cmath>
+#include <iostream>
+#include <random>
+#include <vector>
+using std::cout;
+using std::endl;
+
+// synthetic mesh: uv sphere of radius r around the origin
+static void make_sphere(size_t rings, size_t segments, float r,
+                        std::vector<point>& vertices, std::vector<bvh::index_type>& indices)
+{
+    const float pi = 3.14159265358979f;
+    for (size_t i = 0; i <= rings; ++i) {
+        float theta = pi * i / rings;
+        for (size_t j = 0; j < segments; ++j) {
+            float phi = 2 * pi * j / segments;
+            vertices.push_back(point(r * std::sin(theta) * std::cos(phi),
+                                     r * std::sin(theta) * std::sin(phi),
+                                     r * std::cos(theta)));
+        }
+    }
+    for (size_t i = 0; i < rings; ++i) {
+        for (size_t j = 0; j < segments; ++j) {
+            bvh::index_type a = static_cast<bvh::index_type>(i * segments + j);
+            bvh::index_type b = static_cast<bvh::index_type>(i * segments + (j + 1) % segments);
+            bvh::index_type c = static_cast<bvh::index_type>((i + 1) * segments + j);
+            bvh::index_type d = static_cast<bvh::index_type>((i + 1) * segments + (j + 1) % segments);
+            indices.push_back(a); indices.push_back(c); indices.push_back(b);
+            indices.push_back(b); indices.push_back(c); indices.push_back(d);
+        }
+    }
+}
+
+// brute force reference: closest hit distance over every triangle
+static float brute_force_closest(const std::vector<point>& vertices, const std::vector<bvh::index_type>& indices,
+                                 const ray& r)
+{
+    float best = std::numeric_limits<float>::max();
+    for (size_t t = 0; t < indices.size() / 3; ++t) {
+        float v[3][3];
+        for (size_t c = 0; c < 3; ++c) {
+            for (size_t d = 0; d < 3; ++d) v[c][d] = vertices[indices[t * 3 + c]].data()[d];
+        }
+        float e1[3] = { v[1][0] - v[0][0], v[1][1] - v[0][1], v[1][2] - v[0][2] };
+        float e2[3] = { v[2][0] - v[0][0], v[2][1] - v[0][1], v[2][2] - v[0][2] };
+        const float* dir = r.direction;
+        float p[3] = { dir[1] * e2[2] - dir[2] * e2[1], dir[2] * e2[0] - dir[0] * e2[2], dir[0] * e2[1] - dir[1] * e2[0] };
+        float det = e1[0] * p[0] + e1[1] * p[1] + e1[2] * p[2];
+        if (std::fabs(det) <= 1e-12f) continue;
+        float s[3] = { r.origin[0] - v[0][0], r.origin[1] - v[0][1], r.origin[2] - v[0][2] };
+        float u = (s[0] * p[0] + s[1] * p[1] + s[2] * p[2]) / det;
+        float q[3] = { s[1] * e1[2] - s[2] * e1[1], s[2] * e1[0] - s[0] * e1[2], s[0] * e1[1] - s[1] * e1[0] };
+        float w = (dir[0] * q[0] + dir[1] * q[1] + dir[2] * q[2]) / det;
+        float dist = (e2[0] * q[0] + e2[1] * q[1] + e2[2] * q[2]) / det;
+        if (u >= 0 && w >= 0 && u + w <= 1 && dist >= r.t_min && dist < best) best = dist;
+    }
+    return best;
+}
+
+int main()
+{
+    cout << "*******************************" << endl;
+    cout << "blacker-cglib/test/bvh_test.cpp" << endl;
+    cout << "*******************************" << endl;
+
+    std::vector<point> vertices;
+    std::vector<bvh::index_type> indices;
+    make_sphere(256, 512, 10.0f, vertices, indices);
+    // plus a cloud of small random triangles inside the sphere
+    std::mt19937 rng(7);
+    std::uniform_real_distribution<float> pos(-6.0f, 6.0f);
+    std::uniform_real_distribution<float> jitter(-0.3f, 0.3f);
+    for (size_t i = 0; i < 20000; ++i) {
+        float cx = pos(rng), cy = pos(rng), cz = pos(rng);
+        for (size_t c = 0; c < 3; ++c) {
+            indices.push_back(static_cast<bvh::index_type>(vertices.size()));
+            vertices.push_back(point(cx + jitter(rng), cy + jitter(rng), cz + jitter(rng)));
+        }
+    }
+    size_t triangle_count = indices.size() / 3;
+
+    // rays from random points on a far shell towards random points near the centre
+    const size_t ray_count = 200000;
+    std::vector<ray> rays(ray_count);
+    std::normal_distribution<float> gauss(0.0f, 1.0f);
+    for (size_t i = 0; i < ray_count; ++i) {
+        float ox = gauss(rng), oy = gauss(rng), oz = gauss(rng);
+        float len = std::sqrt(ox * ox + oy * oy + oz * oz);
+        point origin(30 * ox / len, 30 * oy / len, 30 * oz / len);
+        float tx = pos(rng), ty = pos(rng), tz = pos(rng);
+        vector dir(tx - origin.data()[0], ty - origin.data()[1], tz - origin.data()[2]);
+        dir.normalize();
+        rays[i] = make_ray(origin, dir);
+    }
+    //////////////////////////////////////////////////////////////////////////////////////////////
+    // test build
+    //////////////////////////////////////////////////////////////////////////////////////////////
+    cout << "==========" << endl;
+    cout << "test build" << endl;
+    cout << "==========" << endl;
+    bvh tree;
+    {
+        auto start = std::chrono::steady_clock::now();
+        tree.build(vertices, indices, 1);
+        cout << "single thread build over " << triangle_count << " triangles: " << elapsed_ms(start) << " ms" << endl;
+        start = std::chrono::steady_clock::now();
+        tree.build(vertices, indices);
+        cout << "parallel build over " << triangle_count << " triangles: " << elapsed_ms(start) << " ms" << endl;
+        cout << "tree.triangle_count() [should be " << triangle_count << "] = " << tree.triangle_count() << endl;
+        cout << "tree.node_count() = " << tree.node_count() << endl;
+        cout << "tree.bounds() [should be about +-10] = " << tree.bounds() << endl;
+    }
+    //////////////////////////////////////////////////////////////////////////////////////////////
+    // test closest hit
+    //////////////////////////////////////////////////////////////////////////////////////////////
+    cout << "================" << endl;
+    cout << "test closest hit" << endl;
+    cout << "================" << endl;
+    {
+        std::vector<ray_hit> hits(ray_count);
+        auto start = std::chrono::steady_clock::now();
+        tree.intersect_stream(rays.data(), ray_count, hits.data());
+        double stream_ms = elapsed_ms(start);
+
+        start = std::chrono::steady_clock::now();
+        size_t single_mismatch_count = 0;
+        for (size_t i = 0; i < ray_count; ++i) {
+            ray_hit hit = tree.intersect(rays[i]);
+            if (hit.triangle != hits[i].triangle || hit.t != hits[i].t) ++single_mismatch_count;
+        }
+        double single_ms = elapsed_ms(start);
+
+        const size_t brute_force_count = 100;
+        size_t bf_mismatch_count = 0;
+        start = std::chrono::steady_clock::now();
+        for (size_t i = 0; i < brute_force_count; ++i) {
+            float t = brute_force_closest(vertices, indices, rays[i]);
+            if (std::fabs(t - hits[i].t) > 1e-4f * t) ++bf_mismatch_count;
+        }
+        double bf_ms = elapsed_ms(start) * ray_count / brute_force_count;
+
+        size_t hit_count = 0;
+        for (auto& hit : hits) hit_count += hit.is_hit() ? 1 : 0;
+        // a few rays may slip through shared edges of the float mesh
+        cout << "hit ratio [should be about 1] = " << double(hit_count) / ray_count << endl;
+        cout << "single vs stream mismatches [should be 0] = " << single_mismatch_count << endl;
+        cout << "brute force mismatches [should be 0] = " << bf_mismatch_count << endl;
+        cout << ray_count << " rays, stream: " << stream_ms << " ms (" << ray_count / stream_ms / 1000
+             << " Mrays/s), single: " << single_ms << " ms, brute force: " << bf_ms << " ms (extrapolated)" << endl;
+    }
+    //////////////////////////////////////////////////////////////////////////////////////////////
+    // test coherent camera rays
+    //////////////////////////////////////////////////////////////////////////////////////////////
+    cout << "=========================" << endl;
+    cout << "test coherent camera rays" << endl;
+    cout << "=========================" << endl;
+    {
+        const size_t width = 512, height = 512;
+        std::vector<ray> camera_rays;
+        for (size_t y = 0; y < height; ++y) {
+            for (size_t x = 0; x < width; ++x) {
+                vector dir(-1.0f + 2.0f * (x + 0.5f) / width, -1.0f + 2.0f * (y + 0.5f) / height, 2.5f);
+                dir.normalize();
+                camera_rays.push_back(make_ray(point(0, 0, -30), dir));
+            }
+        }
+        std::vector<ray_hit> hits(camera_rays.size());
+        auto start = std::chrono::steady_clock::now();
+        tree.intersect_stream(camera_rays.data(), camera_rays.size(), hits.data());
+        double stream_ms = elapsed_ms(start);
+
+        size_t mismatch_count = 0;
+        start = std::chrono::steady_clock::now();
+        for (size_t i = 0; i < camera_rays.size(); ++i) {
+            ray_hit hit = tree.intersect(camera_rays[i]);
+            if (hit.triangle != hits[i].triangle) ++mismatch_count;
+        }
+        double single_ms = elapsed_ms(start);
+        cout << "single vs stream mismatches [should be 0] = " << mismatch_count << endl;
+        cout << camera_rays.size() << " camera rays, stream: " << stream_ms << " ms, single: " << single_ms
+             << " ms" << endl;
+    }
+    //////////////////////////////////////////////////////////////////////////////////////////////
+    // test any hit
+    //////////////////////////////////////////////////////////////////////////////////////////////
+    cout << "============" << endl;
+    cout << "test any hit" << endl;
+    cout << "============" << endl;
+    {
+        // shadow rays: every other ray stops short of the sphere
+        std::vector<ray> shadow_rays = rays;
+        for (size_t i = 0; i < ray_count; i += 2) {
+            shadow_rays[i].t_max = 5.0f;
+        }
+        std::vector<std::uint8_t> occluded(ray_count);
+        auto start = std::chrono::steady_clock::now();
+        tree.occluded_stream(shadow_rays.data(), ray_count, occluded.data());
+        double stream_ms = elapsed_ms(start);
+
+        std::vector<ray_hit> hits(ray_count);
+        tree.intersect_stream(rays.data(), ray_count, hits.data());
+        size_t wrong_count = 0;
+        for (size_t i = 0; i < ray_count; ++i) {
+            bool expected = (i % 2 != 0) && hits[i].is_hit();
+            if ((occluded[i] != 0) != expected) ++wrong_count;
+            if (i < 1000 && tree.occluded(shadow_rays[i]) != expected) ++wrong_count;
+        }
+        cout << "wrong occlusion results [should be 0] = " << wrong_count << endl;
+        cout << ray_count << " shadow rays, stream: " << stream_ms << " ms" << endl;
+
+        bvh empty_tree;
+        cout << std::boolalpha << "empty bvh hits anything [should be false] = "
+             << empty_tree.intersect(rays[0]).is_hit() << endl;
+    }
+}
@@ -0,0 +1,184 @@
+#include "spatial/compact_points.hpp"
+#include "transforms/matrix/packed_matrix.hpp"
+#include "test_timing.hpp"
+using namespace bcg;
+
+#include <chrono>
+#include <cmath>
+#include <iomanip>
+#include <iostream>
+#include <random>
+#include <vector>
+using std::cout;
+using std::endl;
+
+// rotation of 30 degrees about z and 20 degrees about x, then a shift
+static packed_matrix4<float> make_transform()
+{
+    float a = 0.5235988f, b = 0.3490659f;
+    packed_matrix4<float> rz, rx, shift;
+    rz(0, 0) = std::cos(a); rz(0, 1) = -std::sin(a);
+    rz(1, 0) = std::sin(a); rz(1, 1) = std::cos(a);
+    rx(1, 1) = std::cos(b); rx(1, 2) = -std::sin(b);
+    rx(2, 1) = std::sin(b); rx(2, 2) = std::cos(b);
+    shift(0, 3) = 120; shift(1, 3) = -40; shift(2, 3) = 7;
+    return shift * rx * rz;
+}
+
+int main()
+{
+    cout << "******************************************" << endl;
+    cout << "blacker-cglib/test/compact_points_test.cpp" << endl;
+    cout << "******************************************" << endl;
+
+    // a 1000 x 500 x 50 m survey block
+    const size_t n = 2000000;
+    std::mt19937 rng(8);
+    std::uniform_real_distribution<float> unit(0.0f, 1.0f);
+    std::vector<float> coords(n * 3);
+    for (size_t i = 0; i < n; ++i) {
+        coords[i * 3 + 0] = 5000.0f + 1000.0f * unit(rng);
+        coords[i * 3 + 1] = -2000.0f + 500.0f * unit(rng);
+        coords[i * 3 + 2] = 50.0f * unit(rng);
+    }
+    //////////////////////////////////////////////////////////////////////////////////////////////
+    // test half precision
+    //////////////////////////////////////////////////////////////////////////////////////////////
+    cout << "===================" << endl;
+    cout << "test half precision" << endl;
+    cout << "===================" << endl;
+    {
+        cout << std::hex;
+        cout << "float_to_half(1) [should be 3c00] = " << float_to_half(1.0f) << endl;
+        cout << "float_to_half(-2) [should be c000] = " << float_to_half(-2.0f) << endl;
+        cout << "float_to_half(65504) [should be 7bff] = " << float_to_half(65504.0f) << endl;
+        cout << "float_to_half(1e5) [should be 7c00] = " << float_to_half(1e5f) << endl;
+        cout << "float_to_half(2^-24) [should be 1] = " << float_to_half(5.9604645e-8f) << endl;
+        cout << "float_to_half(1 + 2^-11) ties to even [should be 3c00] = " << float_to_half(1.00048828125f) << endl;
+        cout << std::dec;
+
+        size_t mismatch_count = 0;
+        for (std::uint32_t h = 0; h < 65536; ++h) {
+            bool is_nan = (h & 0x7c00) == 0x7c00 && (h & 0x03ff) != 0;
+            if (!is_nan && float_to_half(half_to_float(static_cast<std::uint16_t>(h))) != h) ++mismatch_count;
+        }
+        cout << "halves not surviving a float round trip [should be 0] = " << mismatch_count << endl;
+        cout << std::boolalpha << "half_to_float(7e00) is nan [should be true] = "
+             << std::isnan(half_to_float(0x7e00)) << endl;
+    }
+    //////////////////////////////////////////////////////////////////////////////////////////////
+    // test quantized buffer
+    //////////////////////////////////////////////////////////////////////////////////////////////
+    cout << "=====================" << endl;
+    cout << "test quantized buffer" << endl;
+    cout << "=====================" << endl;
+    {
+        quantized_point_buffer buffer = quantized_point_buffer::from_coords(coords.data(), n);
+        std::vector<float> decoded(n * 3);
+        buffer.decode(decoded.data());
+
+        cout << "bytes per point [should be 6] = " << buffer.byte_size() / buffer.size() << endl;
+        for (size_t d = 0; d < 3; ++d) {
+            float max_error = 0;
+            for (size_t i = 0; i < n; ++i) {
+                max_error = std::max(max_error, std::fabs(decoded[i * 3 + d] - coords[i * 3 + d]));
+            }
+            cout << "axis " << d << ": max error " << max_error << " <= bound " << buffer.max_error(d)
+                 << " [should be true] = " << (max_error <= buffer.max_error(d)) << endl;
+        }
+        cout << "buffer.get(0) [should be about (" << coords[0] << ", " << coords[1] << ", " << coords[2]
+             << ")] = " << buffer.get(0) << endl;
+    }
+    //////////////////////////////////////////////////////////////////////////////////////////////
+    // test half buffer
+    //////////////////////////////////////////////////////////////////////////////////////////////
+    cout << "================" << endl;
+    cout << "test half buffer" << endl;
+    cout << "================" << endl;
+    {
+        half_point_buffer buffer = half_point_buffer::from_coords(coords.data(), n);
+        std::vector<float> decoded(n * 3);
+        buffer.decode(decoded.data());
+
+        cout << "bytes per point [should be 6] = " << buffer.byte_size() / buffer.size() << endl;
+        cout << "buffer.origin() = (" << buffer.origin()[0] << ", " << buffer.origin()[1] << ", "
+             << buffer.origin()[2] << ")" << endl;
+        size_t violation_count = 0;
+        float max_error = 0;
+        for (size_t i = 0; i < n * 3; ++i) {
+            float offset = coords[i] - buffer.origin()[i % 3];
+            float error = std::fabs(decoded[i] - coords[i]);
+            // the bound plus the float rounding of adding the origin back
+            float bound = half_point_buffer::max_error(offset) + FLT_EPSILON * std::fabs(coords[i]);
+            if (error > bound) ++violation_count;
+            max_error = std::max(max_error, error);
+        }
+        cout << "coordinates beyond max_error(offset) [should be 0] = " << violation_count
+             << " (max error " << max_error << ")" << endl;
+
+        float far_origin[3] = { 0, 0, 0 };
+        half_point_buffer far(far_origin);
+        float big = 1e6f;
+        far.resize(1);
+        far.encode(0, 1, &big, &big, &big);
+        cout << "offset of 1e6 clamps to [should be 65504] = " << far.get(0).data()[0] << endl;
+    }
+    //////////////////////////////////////////////////////////////////////////////////////////////
+    // test decode-transform-encode
+    //////////////////////////////////////////////////////////////////////////////////////////////
+    cout << "============================" << endl;
+    cout << "test decode-transform-encode" << endl;
+    cout << "============================" << endl;
+    {
+        packed_matrix4<float> trans = make_transform();
+        quantized_point_buffer quantized = quantized_point_buffer::from_coords(coords.data(), n);
+        half_point_buffer halves = half_point_buffer::from_coords(coords.data(), n);
+
+        // float path: transform the original coordinates
+        std::vector<float> expected(n * 3);
+        auto start = std::chrono::steady_clock::now();
+        for (size_t i = 0; i < n; ++i) trans.transform_point(&coords[i * 3], &expected[i * 3]);
+        double float_ms = elapsed_ms(start);
+
+        start = std::chrono::steady_clock::now();
+        quantized_point_buffer quantized_out = transform_compact(quantized, trans, 1);
+        double quantized_ms = elapsed_ms(start);
+        start = std::chrono::steady_clock::now();
+        half_point_buffer half_out = transform_compact(halves, trans, 1);
+        double half_ms = elapsed_ms(start);
+
+        std::vector<float> quantized_result(n * 3), half_result(n * 3), direct_result(n * 3);
+        quantized_out.decode(quantized_result.data());
+        half_out.decode(half_result.data());
+        decode_transform(quantized, trans, direct_result.data());
+
+        size_t quantized_violations = 0, half_violations = 0, direct_violations = 0;
+        for (size_t i = 0; i < n; ++i) {
+            for (size_t r = 0; r < 3; ++r) {
+                // propagate the input error through the rows of the matrix
+                float in_quantized = 0, in_half = 0;
+                for (size_t c = 0; c < 3; ++c) {
+                    float offset = coords[i * 3 + c] - halves.origin()[c];
+                    in_quantized += std::fabs(trans(r, c)) * quantized.max_error(c);
+                    in_half += std::fabs(trans(r, c)) * (half_point_buffer::max_error(offset) +
+                                                         FLT_EPSILON * std::fabs(coords[i * 3 + c]));
+                }
+                float out_offset = expected[i * 3 + r] - half_out.origin()[r];
+                float rounding = 4 * FLT_EPSILON * std::fabs(expected[i * 3 + r]);
+                float quantized_bound = in_quantized + quantized_out.max_error(r) + rounding;
+                float half_bound = in_half + half_point_buffer::max_error(out_offset) + rounding;
+                float direct_bound = in_quantized + rounding;
+
+                if (std::fabs(quantized_result[i * 3 + r] - expected[i * 3 + r]) > quantized_bound) ++quantized_violations;
+                if (std::fabs(half_result[i * 3 + r] - expected[i * 3 + r]) > half_bound) ++half_violations;
+                if (std::fabs(direct_result[i * 3 + r] - expected[i * 3 + r]) > direct_bound) ++direct_violations;
+            }
+        }
+        cout << "quantized results beyond the propagated bound [should be 0] = " << quantized_violations << endl;
+        cout << "half results beyond the propagated bound [should be 0] = " << half_violations << endl;
+        cout << "decode_transform results beyond the bound [should be 0] = " << direct_violations << endl;
+        cout << n << " points, float path: " << float_ms << " ms (" << n * 24 / 1048576 << " MB touched), "
+             << "quantized: " << quantized_ms << " ms, half: " << half_ms << " ms (" << n * 12 / 1048576
+             << " MB touched)" << endl;
+    }
+}
@@ -0,0 +1,324 @@
+#include "spatial/bvh.hpp"
+#include "spatial/distance_queries.hpp"
+#include "transforms/b_vector/b_vector.hpp"
+#include "test_timing.hpp"
+using namespace bcg;
+
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <iostream>
+#include <limits>
+#include <random>
+#include <vector>
+using std::cout;
+using std::endl;
+
+typedef b_vector<3, float> vec3;
+
+static vec3 make_vec3(const float* v)
+{
+    return vec3({ v[0], v[1], v[2] });
+}
+
+static float clamp01(float v)
+{
+    return std::min(1.0f, std::max(0.0f, v));
+}
+
+//////////////////////////////////////////////////////////////////////////////////////////////////
+// scalar references, written with b_vector operators and the usual branches
+//////////////////////////////////////////////////////////////////////////////////////////////////
+
+static vec3 reference_point_segment(const vec3& p, const vec3& a, const vec3& b)
+{
+    vec3 ab = b - a;
+    float len2 = (ab, ab);
+    float t = len2 > 0 ? clamp01((p - a, ab) / len2) : 0.0f;
+    return a + ab * t;
+}
+
+// closest point on triangle abc by Voronoi regions (Ericson, Real-Time Collision Detection 5.1.5)
+static vec3 reference_point_triangle(const vec3& p, const vec3& a, const vec3& b, const vec3& c)
+{
+    vec3 ab = b - a, ac = c - a, ap = p - a;
+    float d1 = (ab, ap), d2 = (ac, ap);
+    if (d1 <= 0 && d2 <= 0) return a;
+    vec3 bp = p - b;
+    float d3 = (ab, bp), d4 = (ac, bp);
+    if (d3 >= 0 && d4 <= d3) return b;
+    float vc = d1 * d4 - d3 * d2;
+    if (vc <= 0 && d1 >= 0 && d3 <= 0) return a + ab * (d1 / (d1 - d3));
+    vec3 cp = p - c;
+    float d5 = (ab, cp), d6 = (ac, cp);
+    if (d6 >= 0 && d5 <= d6) return c;
+    float vb = d5 * d2 - d1 * d6;
+    if (vb <= 0 && d2 >= 0 && d6 <= 0) return a + ac * (d2 / (d2 - d6));
+    float va = d3 * d6 - d5 * d4;
+    if (va <= 0 && (d4 - d3) >= 0 && (d5 - d6) >= 0) return b + (c - b) * ((d4 - d3) / ((d4 - d3) + (d5 - d6)));
+    float denom = 1 / (va + vb + vc);
+    return a + ab * (vb * denom) + ac * (vc * denom);
+}
+
+// closest points of segments p1q1 and p2q2 (Ericson 5.1.9), returns the squared distance
+static float reference_segment_segment(const vec3& p1, const vec3& q1, const vec3& p2, const vec3& q2, float& s,
+                                       float& t)
+{
+    vec3 d1 = q1 - p1, d2 = q2 - p2, r = p1 - p2;
+    float a = (d1, d1), e = (d2, d2), f = (d2, r);
+    if (a <= 0 && e <= 0) {
+        s = t = 0;
+        return (r, r);
+    }
+    if (a <= 0) {
+        s = 0;
+        t = clamp01(f / e);
+    }
+    else {
+        float c = (d1, r);
+        if (e <= 0) {
+            t = 0;
+            s = clamp01(-c / a);
+        }
+        else {
+            float b = (d1, d2), denom = a * e - b * b;
+            s = denom != 0 ? clamp01((b * f - c * e) / denom) : 0.0f;
+            t = (b * s + f) / e;
+            if (t < 0) {
+                t = 0;
+                s = clamp01(-c / a);
+            }
+            else if (t > 1) {
+                t = 1;
+                s = clamp01((b - c) / a);
+            }
+        }
+    }
+    vec3 diff = (p1 + d1 * s) - (p2 + d2 * t);
+    return (diff, diff);
+}
+
+static float reference_ray_plane(const ray& r, const float* n, float d)
+{
+    vec3 normal = make_vec3(n);
+    float denom = (normal, make_vec3(r.direction));
+    if (denom == 0) return std::numeric_limits<float>::infinity();
+    float t = (d - (normal, make_vec3(r.origin))) / denom;
+    return t >= r.t_min && t <= r.t_max ? t : std::numeric_limits<float>::infinity();
+}
+
+static float distance2(const vec3& a, const vec3& b)
+{
+    vec3 d = a - b;
+    return (d, d);
+}
+
+static bool close(float found, float expected)
+{
+    return std::fabs(found - expected) <= 1e-4f * (1 + std::fabs(expected));
+}
+
+int main()
+{
+    cout << "********************************************" << endl;
+    cout << "blacker-cglib/test/distance_queries_test.cpp" << endl;
+    cout << "********************************************" << endl;
+
+    cout << std::boolalpha;
+    std::mt19937 rng(49);
+    std::uniform_real_distribution<float> unit(-1.0f, 1.0f);
+    auto random_point = [&](float* out) { for (size_t d = 0; d < 3; ++d) out[d] = 3 * unit(rng); };
+    //////////////////////////////////////////////////////////////////////////////////////////////
+    // test against scalar references
+    //////////////////////////////////////////////////////////////////////////////////////////////
+    cout << "===============================" << endl;
+    cout << "test against scalar references" << endl;
+    cout << "===============================" << endl;
+    {
+        const size_t n = 10007, query_count = 20;
+        // random primitives plus degenerate ones: points as segments, slivers and collinear triangles
+        segment_set segments;
+        triangle_set triangles;
+        plane_set planes;
+        for (size_t i = 0; i < n; ++i) {
+            float a[3], b[3], c[3], normal[3];
+            random_point(a);
+            random_point(b);
+            random_point(c);
+            random_point(normal);
+            if (i % 97 == 0) std::copy(a, a + 3, b);
+            if (i % 89 == 0) for (size_t d = 0; d < 3; ++d) c[d] = a[d] + 2 * (b[d] - a[d]);
+            if (i % 83 == 0) normal[2] = normal[1] = normal[0] = 0;
+            segments.add(a, b);
+            triangles.add(a, b, c);
+            planes.add(normal, unit(rng));
+        }
+
+        std::vector<float> dist2(n), closest(n * 3), s(n), t(n);
+        float segment_error = 0, triangle_error = 0, triangle_point_error = 0;
+        bool segment_ok = true, triangle_ok = true, pair_ok = true, plane_ok = true;
+        for (size_t q = 0; q < query_count; ++q) {
+            float p[3], e[3];
+            random_point(p);
+            random_point(e);
+            // every fifth query lies on a triangle's vertex, or is a point-like segment
+            if (q % 5 == 0) {
+                p[0] = triangles.ax[q]; p[1] = triangles.ay[q]; p[2] = triangles.az[q];
+                std::copy(p, p + 3, e);
+            }
+            vec3 vp = make_vec3(p), ve = make_vec3(e);
+
+            point_segment_distances(p, segments, dist2.data(), closest.data(), q % 2 ? 4 : 1);
+            for (size_t i = 0; i < n; ++i) {
+                float a[3] = { segments.ax[i], segments.ay[i], segments.az[i] };
+                float b[3] = { segments.bx[i], segments.by[i], segments.bz[i] };
+                vec3 c = reference_point_segment(vp, make_vec3(a), make_vec3(b));
+                segment_ok = segment_ok && close(dist2[i], distance2(vp, c));
+                segment_error = std::max(segment_error, std::sqrt(distance2(make_vec3(&closest[i * 3]), c)));
+            }
+
+            point_triangle_distances(p, triangles, dist2.data(), closest.data(), q % 2 ? 4 : 1);
+            for (size_t i = 0; i < n; ++i) {
+                float a[3] = { triangles.ax[i], triangles.ay[i], triangles.az[i] };
+                float b[3] = { triangles.bx[i], triangles.by[i], triangles.bz[i] };
+                float c[3] = { triangles.cx[i], triangles.cy[i], triangles.cz[i] };
+                vec3 va = make_vec3(a), vb = make_vec3(b), vc = make_vec3(c);
+                vec3 expected = reference_point_triangle(vp, va, vb, vc);
+                float expected2 = distance2(vp, expected);
+                // collinear triangles and those with a repeated vertex divide by zero in the reference and have
+                // no unique closest point, their distance is the nearest of the three edges
+                if (i % 89 == 0 || i % 97 == 0) {
+                    expected2 = std::min(std::min(distance2(vp, reference_point_segment(vp, va, vb)),
+                                                  distance2(vp, reference_point_segment(vp, va, vc))),
+                                         distance2(vp, reference_point_segment(vp, vb, vc)));
+                } else {
+                    triangle_point_error = std::max(triangle_point_error,
+                                                    std::sqrt(distance2(make_vec3(&closest[i * 3]), expected)));
+                }
+                triangle_ok = triangle_ok && close(dist2[i], expected2) &&
+                              close(distance2(vp, make_vec3(&closest[i * 3])), dist2[i]);
+                triangle_error = std::max(triangle_error, std::fabs(dist2[i] - expected2));
+            }
+
+            segment_segment_distances(p, e, segments, dist2.data(), s.data(), t.data(), q % 2 ? 4 : 1);
+            for (size_t i = 0; i < n; ++i) {
+                float a[3] = { segments.ax[i], segments.ay[i], segments.az[i] };
+                float b[3] = { segments.bx[i], segments.by[i], segments.bz[i] };
+                float rs, rt;
+                float expected = reference_segment_segment(vp, ve, make_vec3(a), make_vec3(b), rs, rt);
+                // the parameters must give the reported distance, and the distance must match
+                vec3 on_query = vp + (ve - vp) * s[i];
+                vec3 on_segment = make_vec3(a) + (make_vec3(b) - make_vec3(a)) * t[i];
+                pair_ok = pair_ok && close(dist2[i], expected) && close(distance2(on_query, on_segment), expected);
+            }
+
+            ray r;
+            std::copy(p, p + 3, r.origin);
+            std::copy(e, e + 3, r.direction);
+            r.t_min = -2;
+            r.t_max = 5;
+            ray_plane_intersections(r, planes, dist2.data(), q % 2 ? 4 : 1);
+            for (size_t i = 0; i < n; ++i) {
+                float normal[3] = { planes.nx[i], planes.ny[i], planes.nz[i] };
+                float expected = reference_ray_plane(r, normal, planes.d[i]);
+                plane_ok = plane_ok && (std::isinf(expected) ? std::isinf(dist2[i]) : close(dist2[i], expected));
+            }
+        }
+        cout << query_count << " queries against " << n << " primitives each" << endl;
+        cout << "point-segment distances match [should be true] = " << segment_ok
+             << ", closest point error < 1e-5 [should be true] = " << (segment_error < 1e-5f) << endl;
+        // thin random triangles make the projection ill-conditioned, so the point is compared at the coordinate scale
+        cout << "point-triangle distances match [should be true] = " << triangle_ok << " (" << triangle_error
+             << "), closest point error < 1e-3 * 3 [should be true] = " << (triangle_point_error < 3e-3f) << " ("
+             << triangle_point_error << ")" << endl;
+        cout << "segment-segment distances and parameters match [should be true] = " << pair_ok << endl;
+        cout << "ray-plane hits and misses match [should be true] = " << plane_ok << endl;
+
+        // hand-picked cases
+        triangle_set one;
+        float a[3] = { 0, 0, 0 }, b[3] = { 1, 0, 0 }, c[3] = { 0, 1, 0 };
+        one.add(a, b, c);
+        float above[3] = { 0.25f, 0.25f, 2 }, beyond[3] = { 2, 2, 0 }, d2, q[3];
+        point_triangle_distances(above, one, &d2, q);
+        cout << "above the face [should be 4 at 0.25 0.25 0] = " << d2 << " at " << q[0] << " " << q[1] << " " << q[2]
+             << endl;
+        point_triangle_distances(beyond, one, &d2, q);
+        cout << "beyond the long edge [should be 4.5 at 0.5 0.5 0] = " << d2 << " at " << q[0] << " " << q[1] << " "
+             << q[2] << endl;
+        segment_set crossing;
+        float s0[3] = { -1, 0, 1 }, s1[3] = { 1, 0, 1 };
+        crossing.add(s0, s1);
+        float pa[3] = { 0, -1, 0 }, pb[3] = { 0, 1, 0 }, ps, pt;
+        segment_segment_distances(pa, pb, crossing, &d2, &ps, &pt);
+        cout << "skew segments one apart [should be 1, s 0.5, t 0.5] = " << d2 << ", s " << ps << ", t " << pt << endl;
+    }
+    //////////////////////////////////////////////////////////////////////////////////////////////
+    // test distance query performance
+    //////////////////////////////////////////////////////////////////////////////////////////////
+    cout << "===============================" << endl;
+    cout << "test distance query performance" << endl;
+    cout << "===============================" << endl;
+    {
+        const size_t n = 1000000, query_count = 10;
+        segment_set segments;
+        triangle_set triangles;
+        std::vector<vec3> aos(n * 3);
+        for (size_t i = 0; i < n; ++i) {
+            float a[3], b[3], c[3];
+            random_point(a);
+            random_point(b);
+            random_point(c);
+            segments.add(a, b);
+            triangles.add(a, b, c);
+            aos[i * 3] = make_vec3(a);
+            aos[i * 3 + 1] = make_vec3(b);
+            aos[i * 3 + 2] = make_vec3(c);
+        }
+        std::vector<float> dist2(n), reference(n);
+        std::vector<float> queries(query_count * 3);
+        for (size_t q = 0; q < query_count; ++q) random_point(&queries[q * 3]);
+
+        auto rate = [&](double ms) { return query_count * n / ms / 1000; };
+        auto start = std::chrono::steady_clock::now();
+        for (size_t q = 0; q < query_count; ++q) {
+            vec3 p = make_vec3(&queries[q * 3]);
+            for (size_t i = 0; i < n; ++i) reference[i] = distance2(p, reference_point_segment(p, aos[i * 3], aos[i * 3 + 1]));
+        }
+        double reference_ms = elapsed_ms(start);
+        start = std::chrono::steady_clock::now();
+        for (size_t q = 0; q < query_count; ++q) point_segment_distances(&queries[q * 3], segments, dist2.data(), nullptr, 1);
+        double batched_ms = elapsed_ms(start);
+        cout << "point-segment, b_vector reference: " << rate(reference_ms) << " M/s, batched: " << rate(batched_ms)
+             << " M/s per core, faster [should be true] = " << (batched_ms < reference_ms) << endl;
+
+        start = std::chrono::steady_clock::now();
+        for (size_t q = 0; q < query_count; ++q) {
+            vec3 p = make_vec3(&queries[q * 3]);
+            for (size_t i = 0; i < n; ++i) {
+                reference[i] = distance2(p, reference_point_triangle(p, aos[i * 3], aos[i * 3 + 1], aos[i * 3 + 2]));
+            }
+        }
+        reference_ms = elapsed_ms(start);
+        start = std::chrono::steady_clock::now();
+        for (size_t q = 0; q < query_count; ++q) point_triangle_distances(&queries[q * 3], triangles, dist2.data(), nullptr, 1);
+        batched_ms = elapsed_ms(start);
+        cout << "point-triangle, b_vector reference: " << rate(reference_ms) << " M/s, batched: " << rate(batched_ms)
+             << " M/s per core, faster [should be true] = " << (batched_ms < reference_ms) << endl;
+
+        start = std::chrono::steady_clock::now();
+        for (size_t q = 0; q < query_count; ++q) {
+            vec3 p = make_vec3(&queries[q * 3]), e = make_vec3(&queries[((q + 1) % query_count) * 3]);
+            float s, t;
+            for (size_t i = 0; i < n; ++i) reference[i] = reference_segment_segment(p, e, aos[i * 3], aos[i * 3 + 1], s, t);
+        }
+        reference_ms = elapsed_ms(start);
+        start = std::chrono::steady_clock::now();
+        for (size_t q = 0; q < query_count; ++q) {
+            segment_segment_distances(&queries[q * 3], &queries[((q + 1) % query_count) * 3], segments, dist2.data(),
+                                      nullptr, nullptr, 1);
+        }
+        batched_ms = elapsed_ms(start);
+        cout << "segment-segment, b_vector reference: " << rate(reference_ms) << " M/s, batched: " << rate(batched_ms)
+             << " M/s per core, faster [should be true] = " << (batched_ms < reference_ms) << endl;
+    }
+}
@@ -0,0 +1,189 @@
+#include "mesh/half_edge_mesh.hpp"
+#include "mesh/mesh.hpp"
+#include "transforms/point.hpp"
+#include "test_timing.hpp"
+using namespace bcg;
+
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <iostream>
+#include <vector>
+using std::cout;
+using std::endl;
+
+// closed latitude-longitude sphere, welded so the seam and the poles share vertices
+static mesh make_sphere(size_t stacks, size_t slices)
+{
+    const float pi = 3.14159265f;
+    auto corner = [&](std::vector<float>& soup, size_t i, size_t j) {
+        float theta = pi * i / stacks, phi = 2 * pi * (j % slices) / slices;
+        if (i == 0 || i == stacks) phi = 0;
+        soup.push_back(std::sin(theta) * std::cos(phi));
+        soup.push_back(std::sin(theta) * std::sin(phi));
+        soup.push_back(std::cos(theta));
+    };
+    std::vector<float> soup;
+    for (size_t i = 0; i < stacks; ++i) {
+        for (size_t j = 0; j < slices; ++j) {
+            corner(soup, i, j); corner(soup, i + 1, j); corner(soup, i + 1, j + 1);
+            corner(soup, i, j); corner(soup, i + 1, j + 1); corner(soup, i, j + 1);
+        }
+    }
+    return mesh::from_triangle_soup(soup.data(), soup.size() / 9);
+}
+
+// side x side vertex grid in the xy plane
+static void make_grid(size_t side, std::vector<float>& positions, std::vector<half_edge_mesh::index_type>& triangles)
+{
+    for (size_t y = 0; y < side; ++y) {
+        for (size_t x = 0; x < side; ++x) {
+            positions.push_back(float(x));
+            positions.push_back(float(y));
+            positions.push_back(0.0f);
+            if (x + 1 < side && y + 1 < side) {
+                half_edge_mesh::index_type v = static_cast<half_edge_mesh::index_type>(y * side + x);
+                half_edge_mesh::index_type s = static_cast<half_edge_mesh::index_type>(side);
+                half_edge_mesh::index_type quad[6] = { v, v + 1, v + s + 1, v, v + s + 1, v + s };
+                triangles.insert(triangles.end(), quad, quad + 6);
+            }
+        }
+    }
+}
+
+int main()
+{
+    cout << "******************************************" << endl;
+    cout << "blacker-cglib/test/half_edge_mesh_test.cpp" << endl;
+    cout << "******************************************" << endl;
+    //////////////////////////////////////////////////////////////////////////////////////////////
+    // test closed mesh
+    //////////////////////////////////////////////////////////////////////////////////////////////
+    cout << "================" << endl;
+    cout << "test closed mesh" << endl;
+    cout << "================" << endl;
+    {
+        mesh sphere = make_sphere(64, 128);
+        half_edge_mesh he(sphere);
+
+        size_t bad_twins = 0, boundary_edges = 0;
+        for (half_edge_mesh::index_type h = 0; h < he.half_edge_count(); ++h) {
+            if (he.is_boundary_half_edge(h)) {
+                ++boundary_edges;
+                continue;
+            }
+            half_edge_mesh::index_type t = he.twin(h);
+            if (he.twin(t) != h || he.from_vertex(t) != he.to_vertex(h) || he.to_vertex(t) != he.from_vertex(h)) ++bad_twins;
+        }
+        long long euler = static_cast<long long>(he.vertex_count()) - static_cast<long long>(he.half_edge_count() / 2) +
+                          static_cast<long long>(he.face_count());
+        cout << "he.vertex_count() = " << he.vertex_count() << ", he.face_count() = " << he.face_count() << endl;
+        cout << "inconsistent twins [should be 0] = " << bad_twins << endl;
+        cout << "boundary half-edges [should be 0] = " << boundary_edges << endl;
+        cout << "V - E + F [should be 2] = " << euler << endl;
+        cout << "he.non_manifold_edge_count() [should be 0] = " << he.non_manifold_edge_count() << endl;
+        cout << "valence of the north pole [should be 128] = " << he.valence(0) << endl;
+
+        size_t face_visits = 0;
+        for (half_edge_mesh::index_type v = 0; v < he.vertex_count(); ++v) {
+            he.for_each_face(v, [&](half_edge_mesh::index_type) { ++face_visits; });
+        }
+        cout << "faces visited over all one-rings [should be " << 3 * he.face_count() << "] = " << face_visits << endl;
+    }
+    //////////////////////////////////////////////////////////////////////////////////////////////
+    // test open and non-manifold meshes
+    //////////////////////////////////////////////////////////////////////////////////////////////
+    cout << "=================================" << endl;
+    cout << "test open and non-manifold meshes" << endl;
+    cout << "=================================" << endl;
+    {
+        std::vector<float> positions;
+        std::vector<half_edge_mesh::index_type> triangles;
+        make_grid(4, positions, triangles);
+        half_edge_mesh grid(positions.data(), 16, triangles.data(), triangles.size() / 3);
+
+        cout << std::boolalpha;
+        cout << "grid.is_boundary_vertex(0) [should be true] = " << grid.is_boundary_vertex(0) << endl;
+        cout << "grid.is_boundary_vertex(5) [should be false] = " << grid.is_boundary_vertex(5) << endl;
+        cout << "grid.valence(5) [should be 6] = " << grid.valence(5) << endl;
+        cout << "grid.valence(0) [should be 3] = " << grid.valence(0) << endl;
+        cout << "grid.valence(3) [should be 2] = " << grid.valence(3) << endl;
+        std::vector<half_edge_mesh::index_type> ring;
+        grid.for_each_neighbour(5, [&](half_edge_mesh::index_type u) { ring.push_back(u); });
+        std::sort(ring.begin(), ring.end());
+        cout << "neighbours of 5 [should be 0 1 4 6 9 10] =";
+        for (auto u : ring) cout << " " << u;
+        cout << endl;
+
+        std::vector<float> out_positions;
+        std::vector<half_edge_mesh::index_type> out_triangles;
+        grid.to_buffers(out_positions, out_triangles);
+        cout << "flat buffers survive a round trip [should be true] = "
+             << (out_positions == positions && out_triangles == triangles) << endl;
+
+        // three triangles on the edge 0-1
+        std::vector<point> fin_vertices = { point(0, 0, 0), point(1, 0, 0), point(0, 1, 0), point(0, -1, 0), point(0, 0, 1) };
+        std::vector<half_edge_mesh::index_type> fin_triangles = { 0, 1, 2, 1, 0, 3, 0, 1, 4 };
+        half_edge_mesh fins(fin_vertices, fin_triangles);
+        cout << "fins.non_manifold_edge_count() [should be 1] = " << fins.non_manifold_edge_count() << endl;
+    }
+    //////////////////////////////////////////////////////////////////////////////////////////////
+    // test build and smoothing performance
+    //////////////////////////////////////////////////////////////////////////////////////////////
+    cout << "====================================" << endl;
+    cout << "test build and smoothing performance" << endl;
+    cout << "====================================" << endl;
+    {
+        std::vector<float> positions;
+        std::vector<half_edge_mesh::index_type> triangles;
+        const size_t side = 1000;
+        make_grid(side, positions, triangles);
+        size_t n = side * side;
+
+        auto start = std::chrono::steady_clock::now();
+        half_edge_mesh he(positions.data(), n, triangles.data(), triangles.size() / 3);
+        double build_ms = elapsed_ms(start);
+        start = std::chrono::steady_clock::now();
+        half_edge_mesh he_single(positions.data(), n, triangles.data(), triangles.size() / 3, 1);
+        double build_single_ms = elapsed_ms(start);
+
+        // one Laplacian smoothing pass of z after a bump, straight from the half-edges
+        for (size_t v = 0; v < n; ++v) he.z()[v] = (v % 7 == 0) ? 1.0f : 0.0f;
+        std::vector<float> smoothed(n);
+        start = std::chrono::steady_clock::now();
+        for (half_edge_mesh::index_type v = 0; v < n; ++v) {
+            float sum = 0;
+            size_t count = 0;
+            he.for_each_neighbour(v, [&](half_edge_mesh::index_type u) { sum += he.z()[u]; ++count; });
+            smoothed[v] = sum / count;
+        }
+        double traverse_ms = elapsed_ms(start);
+
+        std::vector<half_edge_mesh::index_type> offsets, neighbours;
+        start = std::chrono::steady_clock::now();
+        he.one_rings(offsets, neighbours);
+        double table_ms = elapsed_ms(start);
+        std::vector<float> smoothed_table(n);
+        start = std::chrono::steady_clock::now();
+        for (size_t v = 0; v < n; ++v) {
+            float sum = 0;
+            for (size_t k = offsets[v]; k < offsets[v + 1]; ++k) sum += he.z()[neighbours[k]];
+            smoothed_table[v] = sum / (offsets[v + 1] - offsets[v]);
+        }
+        double table_pass_ms = elapsed_ms(start);
+
+        bool same = true;
+        for (half_edge_mesh::index_type v = 0; same && v < n; ++v) {
+            same = he.vertex_half_edge(v) == he_single.vertex_half_edge(v);
+        }
+        for (half_edge_mesh::index_type h = 0; same && h < he.half_edge_count(); ++h) {
+            same = he.twin(h) == he_single.twin(h);
+        }
+        cout << "same half-edges with 1 thread [should be true] = " << same << endl;
+        cout << "same smoothing from half-edges and one-ring table [should be true] = "
+             << (smoothed == smoothed_table) << endl;
+        cout << triangles.size() / 3 << " triangles, build: " << build_ms << " ms (1 thread: " << build_single_ms
+             << " ms), smoothing pass over half-edges: " << traverse_ms << " ms, one_rings(): " << table_ms
+             << " ms, smoothing pass over the table: " << table_pass_ms << " ms" << endl;
+    }
+}
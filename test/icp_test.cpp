@@ -0,0 +1,216 @@
+#include "spatial/icp.hpp"
+#include "transforms/matrix/matrix.hpp"
+#include "transforms/matrix/packed_matrix.hpp"
+#include "test_timing.hpp"
+using namespace bcg;
+
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <iostream>
+#include <random>
+#include <thread>
+#include <vector>
+using std::cout;
+using std::endl;
+
+// random samples of a bumpy height field over [-3, 3]^2, with its analytic normals
+static void make_surface(size_t n, std::mt19937& rng, std::vector<float>& coords, std::vector<float>& normals)
+{
+    std::uniform_real_distribution<float> unit(-3.0f, 3.0f);
+    coords.resize(n * 3);
+    normals.resize(n * 3);
+    for (size_t i = 0; i < n; ++i) {
+        float x = unit(rng), y = unit(rng);
+        float z = 0.4f * std::sin(1.3f * x) * std::cos(0.7f * y) + 0.05f * x * y;
+        float fx = 0.52f * std::cos(1.3f * x) * std::cos(0.7f * y) + 0.05f * y;
+        float fy = -0.28f * std::sin(1.3f * x) * std::sin(0.7f * y) + 0.05f * x;
+        float inv = 1 / std::sqrt(fx * fx + fy * fy + 1);
+        coords[i * 3] = x; coords[i * 3 + 1] = y; coords[i * 3 + 2] = z;
+        normals[i * 3] = -fx * inv; normals[i * 3 + 1] = -fy * inv; normals[i * 3 + 2] = inv;
+    }
+}
+
+// rotation by [angle] about the axis (x, y, z), then a translation
+static packed_matrix4<double> rigid(double x, double y, double z, double angle, double tx, double ty, double tz)
+{
+    double len = std::sqrt(x * x + y * y + z * z);
+    x /= len; y /= len; z /= len;
+    double c = std::cos(angle), s = std::sin(angle), k = 1 - c;
+    packed_matrix4<double> m;
+    m(0, 0) = c + k * x * x;     m(0, 1) = k * x * y - s * z; m(0, 2) = k * x * z + s * y; m(0, 3) = tx;
+    m(1, 0) = k * x * y + s * z; m(1, 1) = c + k * y * y;     m(1, 2) = k * y * z - s * x; m(1, 3) = ty;
+    m(2, 0) = k * x * z - s * y; m(2, 1) = k * y * z + s * x; m(2, 2) = c + k * z * z;     m(2, 3) = tz;
+    return m;
+}
+
+// inverse of a rigid transform, R^T and -R^T t
+static packed_matrix4<double> rigid_inverse(const packed_matrix4<double>& m)
+{
+    packed_matrix4<double> inv;
+    for (size_t i = 0; i < 3; ++i) {
+        for (size_t j = 0; j < 3; ++j) inv(i, j) = m(j, i);
+        inv(i, 3) = -(m(0, i) * m(0, 3) + m(1, i) * m(1, 3) + m(2, i) * m(2, 3));
+    }
+    return inv;
+}
+
+// [coords] moved by [m]
+static std::vector<float> moved(const std::vector<float>& coords, const packed_matrix4<double>& m)
+{
+    std::vector<float> out(coords.size());
+    for (size_t i = 0; i < coords.size() / 3; ++i) {
+        double in[3] = { coords[i * 3], coords[i * 3 + 1], coords[i * 3 + 2] }, p[3];
+        m.transform_point(in, p);
+        for (size_t d = 0; d < 3; ++d) out[i * 3 + d] = float(p[d]);
+    }
+    return out;
+}
+
+// largest element difference of the rotation part, and of the translation part
+static void transform_error(const matrix<4, 4, double>& found, const packed_matrix4<double>& expected,
+                            double& rotation_error, double& translation_error)
+{
+    rotation_error = 0;
+    translation_error = 0;
+    for (size_t i = 0; i < 3; ++i) {
+        for (size_t j = 0; j < 3; ++j) rotation_error = std::max(rotation_error, std::fabs(found[i][j] - expected(i, j)));
+        translation_error = std::max(translation_error, std::fabs(found[i][3] - expected(i, 3)));
+    }
+}
+
+int main()
+{
+    cout << "*******************************" << endl;
+    cout << "blacker-cglib/test/icp_test.cpp" << endl;
+    cout << "*******************************" << endl;
+
+    cout << std::boolalpha;
+    std::mt19937 rng(40);
+    packed_matrix4<double> truth = rigid(1, 2, 3, 0.14, 0.15, -0.1, 0.05);
+    //////////////////////////////////////////////////////////////////////////////////////////////
+    // test icp convergence
+    //////////////////////////////////////////////////////////////////////////////////////////////
+    cout << "====================" << endl;
+    cout << "test icp convergence" << endl;
+    cout << "====================" << endl;
+    {
+        std::vector<float> target, normals;
+        make_surface(200000, rng, target, normals);
+        // every 4th target point, moved away by the inverse of the transform to find
+        std::vector<float> subset;
+        for (size_t i = 0; i < target.size() / 3; i += 4) subset.insert(subset.end(), &target[i * 3], &target[i * 3 + 3]);
+        std::vector<float> source = moved(subset, rigid_inverse(truth));
+
+        icp_registration registration(target.data(), target.size() / 3, normals.data());
+        // point-to-point creeps along a smooth surface, give it room
+        icp_options options;
+        options.max_iterations = 200;
+        icp_stats stats;
+        double rotation_error, translation_error;
+        matrix<4, 4, double> found = registration.align(source.data(), source.size() / 3, options,
+                                                        make_identity_matrix<4, double>(), &stats);
+        transform_error(found, truth, rotation_error, translation_error);
+        cout << "point-to-point converged [should be true] = " << stats.converged << " (" << stats.iterations
+             << " iterations, rms " << stats.rms_error << ")" << endl;
+        cout << "point-to-point recovers the transform [should be true] = "
+             << (rotation_error < 1e-4 && translation_error < 1e-4) << " (" << rotation_error << ", "
+             << translation_error << ")" << endl;
+
+        options.metric = icp_metric::point_to_plane;
+        found = registration.align(source.data(), source.size() / 3, options, make_identity_matrix<4, double>(), &stats);
+        transform_error(found, truth, rotation_error, translation_error);
+        cout << "point-to-plane converged [should be true] = " << stats.converged << " (" << stats.iterations
+             << " iterations, rms " << stats.rms_error << ")" << endl;
+        cout << "point-to-plane recovers the transform [should be true] = "
+             << (rotation_error < 1e-4 && translation_error < 1e-4) << " (" << rotation_error << ", "
+             << translation_error << ")" << endl;
+        cout << "bottom row [should be (0, 0, 0, 1)] = " << found.get_row(3) << endl;
+
+        // a different sampling of the surface plus 10% far outliers, which the distance cut drops
+        std::vector<float> other, other_normals;
+        make_surface(50000, rng, other, other_normals);
+        std::uniform_real_distribution<float> far(20.0f, 30.0f);
+        for (size_t i = 0; i < 5000; ++i) {
+            other.push_back(far(rng));
+            other.push_back(far(rng));
+            other.push_back(far(rng));
+        }
+        source = moved(other, rigid_inverse(truth));
+        options.max_correspondence_distance = 1.0f;
+        found = registration.align(source.data(), source.size() / 3, options, make_identity_matrix<4, double>(), &stats);
+        transform_error(found, truth, rotation_error, translation_error);
+        cout << "outliers rejected, correspondences [should be 50000] = " << stats.correspondence_count << endl;
+        cout << "resampled point-to-plane recovers the transform [should be true] = "
+             << (rotation_error < 2e-3 && translation_error < 2e-3) << " (" << rotation_error << ", "
+             << translation_error << ")" << endl;
+
+        // start from the answer, nothing left to do
+        options = icp_options();
+        found = registration.align(moved(subset, rigid_inverse(truth)).data(), subset.size() / 3, options,
+                                   truth.to_matrix(), &stats);
+        cout << "starting at the answer, rms [should be about 0] = " << stats.rms_error << " (" << stats.iterations
+             << " iterations)" << endl;
+        // estimated target normals, two scans aligned against the same registration at once
+        icp_registration estimated(target.data(), target.size() / 3);
+        options.metric = icp_metric::point_to_plane;
+        source = moved(subset, rigid_inverse(truth));
+        matrix<4, 4, double> first_found, second_found;
+        std::thread first([&]() { first_found = estimated.align(source.data(), source.size() / 3, options); });
+        std::thread second([&]() { second_found = estimated.align(source.data(), source.size() / 3, options); });
+        first.join();
+        second.join();
+        transform_error(first_found, truth, rotation_error, translation_error);
+        cout << "concurrent point-to-plane with estimated normals recovers the transform [should be true] = "
+             << (rotation_error < 1e-3 && translation_error < 1e-3) << " (" << rotation_error << ", "
+             << translation_error << ")" << endl;
+        bool agree = true;
+        for (size_t i = 0; i < 4; ++i) {
+            for (size_t j = 0; j < 4; ++j) agree = agree && first_found[i][j] == second_found[i][j];
+        }
+        cout << "both threads agree [should be true] = " << agree << endl;
+    }
+    //////////////////////////////////////////////////////////////////////////////////////////////
+    // test icp performance
+    //////////////////////////////////////////////////////////////////////////////////////////////
+    cout << "====================" << endl;
+    cout << "test icp performance" << endl;
+    cout << "====================" << endl;
+    {
+        const size_t n = 1000000;
+        std::vector<float> target, normals, scan, scan_normals;
+        make_surface(n, rng, target, normals);
+        make_surface(n, rng, scan, scan_normals);
+        std::vector<float> source = moved(scan, rigid_inverse(truth));
+
+        auto start = std::chrono::steady_clock::now();
+        icp_registration registration(target.data(), n, normals.data());
+        double build_ms = elapsed_ms(start);
+
+        icp_options options;
+        options.max_iterations = 200;
+        options.max_samples = 20000;
+        icp_stats point_stats, plane_stats;
+        double rotation_error, translation_error;
+        matrix<4, 4, double> found = registration.align(source.data(), n, options, make_identity_matrix<4, double>(),
+                                                        &point_stats);
+        transform_error(found, truth, rotation_error, translation_error);
+        cout << "point-to-point on 20000 samples within 5e-3 [should be true] = "
+             << (rotation_error < 5e-3 && translation_error < 5e-3) << " (" << rotation_error << ", "
+             << translation_error << ")" << endl;
+        options.metric = icp_metric::point_to_plane;
+        found = registration.align(source.data(), n, options, make_identity_matrix<4, double>(), &plane_stats);
+        transform_error(found, truth, rotation_error, translation_error);
+        cout << "point-to-plane on 20000 samples within 1e-3 [should be true] = "
+             << (rotation_error < 1e-3 && translation_error < 1e-3) << " (" << rotation_error << ", "
+             << translation_error << ")" << endl;
+        cout << n << " point scans, target tree build: " << build_ms << " ms, point-to-point: " << point_stats.seconds * 1000
+             << " ms (" << point_stats.iterations << " iterations), point-to-plane: " << plane_stats.seconds * 1000
+             << " ms (" << plane_stats.iterations << " iterations)" << endl;
+
+        options.max_samples = 100000;
+        found = registration.align(source.data(), n, options, make_identity_matrix<4, double>(), &plane_stats);
+        cout << "point-to-plane on 100000 samples: " << plane_stats.seconds * 1000 << " ms ("
+             << plane_stats.iterations << " iterations)" << endl;
+    }
+}
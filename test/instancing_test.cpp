@@ -0,0 +1,228 @@
+#include "spatial/aabb.hpp"
+#include "transforms/instancing.hpp"
+#include "transforms/matrix/matrix.hpp"
+#include "transforms/matrix/packed_matrix.hpp"
+#include "test_timing.hpp"
+using namespace bcg;
+
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <cstring>
+#include <iostream>
+#include <random>
+#include <vector>
+using std::cout;
+using std::endl;
+
+// random affine transforms: rotation about a random axis, a scale and a translation
+static std::vector<packed_matrix4<float>> make_transforms(size_t n, std::mt19937& rng)
+{
+    std::uniform_real_distribution<float> unit(-1.0f, 1.0f);
+    std::vector<packed_matrix4<float>> transforms(n);
+    for (packed_matrix4<float>& m : transforms) {
+        float x = unit(rng), y = unit(rng), z = unit(rng);
+        float len = std::sqrt(x * x + y * y + z * z);
+        x /= len; y /= len; z /= len;
+        float angle = 3 * unit(rng), scale = 1.5f + unit(rng);
+        float c = std::cos(angle), s = std::sin(angle), k = 1 - c;
+        float r[9] = { c + k * x * x, k * x * y - s * z, k * x * z + s * y,
+                       k * x * y + s * z, c + k * y * y, k * y * z - s * x,
+                       k * x * z - s * y, k * y * z + s * x, c + k * z * z };
+        for (size_t i = 0; i < 3; ++i) {
+            for (size_t j = 0; j < 3; ++j) m(i, j) = r[i * 3 + j] * scale;
+            m(i, 3) = 10 * unit(rng);
+        }
+    }
+    return transforms;
+}
+
+static std::vector<float> make_points(size_t n, std::mt19937& rng)
+{
+    std::uniform_real_distribution<float> unit(-1.0f, 1.0f);
+    std::vector<float> coords(n * 3);
+    for (float& c : coords) c = unit(rng);
+    return coords;
+}
+
+static bool same_box(const aabb& a, const aabb& b)
+{
+    for (size_t d = 0; d < 3; ++d) {
+        if (a.lower[d] != b.lower[d] || a.upper[d] != b.upper[d]) return false;
+    }
+    return true;
+}
+
+static float volume(const aabb& box)
+{
+    return box.extent(0) * box.extent(1) * box.extent(2);
+}
+
+int main()
+{
+    cout << "**************************************" << endl;
+    cout << "blacker-cglib/test/instancing_test.cpp" << endl;
+    cout << "**************************************" << endl;
+
+    cout << std::boolalpha;
+    std::mt19937 rng(45);
+    //////////////////////////////////////////////////////////////////////////////////////////////
+    // test transform instances
+    //////////////////////////////////////////////////////////////////////////////////////////////
+    cout << "========================" << endl;
+    cout << "test transform instances" << endl;
+    cout << "========================" << endl;
+    {
+        // sizes that leave partial tiles in both dimensions
+        const size_t n = 77, m = 3001;
+        std::vector<packed_matrix4<float>> transforms = make_transforms(n, rng);
+        std::vector<float> coords = make_points(m, rng);
+        std::vector<float> expected(n * m * 3);
+        for (size_t i = 0; i < n; ++i) {
+            for (size_t p = 0; p < m; ++p) transforms[i].transform_point(&coords[p * 3], &expected[(i * m + p) * 3]);
+        }
+
+        instancing_options options;
+        options.point_tile = 500;
+        options.instance_tile = 10;
+        for (size_t threads = 1; threads <= 4; threads += 3) {
+            options.thread_count = threads;
+            std::vector<float> out(n * m * 3, -1.0f);
+            transform_instances(transforms.data(), n, coords.data(), m, out.data(), options);
+            cout << n << " instances x " << m << " points, " << threads << " thread(s), same as one transform_point() "
+                 << "at a time [should be true] = "
+                 << (std::memcmp(out.data(), expected.data(), out.size() * sizeof(float)) == 0) << endl;
+        }
+
+        std::vector<matrix<4, 4, float>> matrices;
+        for (const packed_matrix4<float>& t : transforms) matrices.push_back(t.to_matrix());
+        std::vector<float> out(n * m * 3);
+        transform_instances(matrices.data(), n, coords.data(), m, out.data());
+        cout << "matrix<4, 4> transforms, default tiles [should be true] = "
+             << (std::memcmp(out.data(), expected.data(), out.size() * sizeof(float)) == 0) << endl;
+    }
+    //////////////////////////////////////////////////////////////////////////////////////////////
+    // test instance reductions
+    //////////////////////////////////////////////////////////////////////////////////////////////
+    cout << "========================" << endl;
+    cout << "test instance reductions" << endl;
+    cout << "========================" << endl;
+    {
+        const size_t n = 130, m = 10007;
+        std::vector<packed_matrix4<float>> transforms = make_transforms(n, rng);
+        std::vector<float> coords = make_points(m, rng);
+        std::vector<aabb> expected(n);
+        aabb local;
+        for (size_t p = 0; p < m; ++p) local.expand(&coords[p * 3]);
+        for (size_t i = 0; i < n; ++i) {
+            for (size_t p = 0; p < m; ++p) {
+                float t[3];
+                transforms[i].transform_point(&coords[p * 3], t);
+                expected[i].expand(t);
+            }
+        }
+
+        instancing_options options;
+        options.point_tile = 1000;
+        options.instance_tile = 16;
+        bool all_same = true;
+        float tighter = 0;
+        for (size_t threads = 1; threads <= 4; threads += 3) {
+            options.thread_count = threads;
+            std::vector<aabb> bounds(n);
+            instance_bounds(transforms.data(), n, coords.data(), m, bounds.data(), options);
+            for (size_t i = 0; i < n; ++i) {
+                all_same = all_same && same_box(bounds[i], expected[i]);
+                tighter += volume(bounds[i]) / volume(transform_bounds(local, transforms[i])) / n / 2;
+            }
+        }
+        cout << "instance_bounds() with 1 and 4 threads equal the bounds of every point [should be true] = " << all_same
+             << endl;
+        cout << "mean volume against transform_bounds() of the point bounds [should be < 1] = " << tighter << endl;
+
+        // per-instance centroids through per-thread sums
+        options.thread_count = 4;
+        size_t thread_total = instance_tile_thread_count(n, m, options);
+        std::vector<double> sums(thread_total * n * 3, 0.0);
+        for_each_instance_tile(transforms.data(), n, coords.data(), m,
+                               [&](size_t thread_idx, size_t instance, size_t, size_t count, const float* x,
+                                   const float* y, const float* z) {
+            double* sum = &sums[(thread_idx * n + instance) * 3];
+            for (size_t l = 0; l < count; ++l) {
+                sum[0] += x[l];
+                sum[1] += y[l];
+                sum[2] += z[l];
+            }
+        }, options);
+        double worst = 0;
+        for (size_t i = 0; i < n; ++i) {
+            double local_centroid[3] = {}, centroid[3];
+            for (size_t p = 0; p < m; ++p) {
+                for (size_t d = 0; d < 3; ++d) local_centroid[d] += coords[p * 3 + d] / double(m);
+            }
+            for (size_t d = 0; d < 3; ++d) {
+                centroid[d] = transforms[i].m[d * 4] * local_centroid[0] + transforms[i].m[d * 4 + 1] * local_centroid[1] +
+                              transforms[i].m[d * 4 + 2] * local_centroid[2] + transforms[i].m[d * 4 + 3];
+                double found = 0;
+                for (size_t t = 0; t < thread_total; ++t) found += sums[(t * n + i) * 3 + d] / double(m);
+                worst = std::max(worst, std::fabs(found - centroid[d]));
+            }
+        }
+        cout << "instance_tile_thread_count() [should be 4] = " << thread_total << endl;
+        cout << "for_each_instance_tile() centroids, error < 1e-4 [should be true] = " << (worst < 1e-4) << " (" << worst
+             << ")" << endl;
+    }
+    //////////////////////////////////////////////////////////////////////////////////////////////
+    // test instancing performance
+    //////////////////////////////////////////////////////////////////////////////////////////////
+    cout << "===========================" << endl;
+    cout << "test instancing performance" << endl;
+    cout << "===========================" << endl;
+    {
+        // bounds: the points don't fit in cache, one pass per instance streams them every time
+        const size_t n = 256, m = 2000000;
+        std::vector<packed_matrix4<float>> transforms = make_transforms(n, rng);
+        std::vector<float> coords = make_points(m, rng);
+        std::vector<aabb> naive(n), bounds(n);
+        auto start = std::chrono::steady_clock::now();
+        for (size_t i = 0; i < n; ++i) {
+            for (size_t p = 0; p < m; ++p) {
+                float t[3];
+                transforms[i].transform_point(&coords[p * 3], t);
+                naive[i].expand(t);
+            }
+        }
+        double naive_ms = elapsed_ms(start);
+        instancing_options options;
+        options.thread_count = 1;
+        start = std::chrono::steady_clock::now();
+        instance_bounds(transforms.data(), n, coords.data(), m, bounds.data(), options);
+        double tiled_ms = elapsed_ms(start);
+        options.thread_count = 0;
+        start = std::chrono::steady_clock::now();
+        instance_bounds(transforms.data(), n, coords.data(), m, bounds.data(), options);
+        double threaded_ms = elapsed_ms(start);
+        bool same = true;
+        for (size_t i = 0; i < n; ++i) same = same && same_box(naive[i], bounds[i]);
+        cout << n << " instance bounds over " << m << " points, per-instance passes: " << naive_ms << " ms, tiled: "
+             << tiled_ms << " ms (" << threaded_ms << " ms threaded), same boxes [should be true] = " << same << endl;
+
+        // writing every transformed point
+        const size_t write_n = 64, write_m = 262144;
+        std::vector<float> out(write_n * write_m * 3), naive_out(write_n * write_m * 3);
+        start = std::chrono::steady_clock::now();
+        for (size_t i = 0; i < write_n; ++i) {
+            for (size_t p = 0; p < write_m; ++p) {
+                transforms[i].transform_point(&coords[p * 3], &naive_out[(i * write_m + p) * 3]);
+            }
+        }
+        naive_ms = elapsed_ms(start);
+        options.thread_count = 1;
+        start = std::chrono::steady_clock::now();
+        transform_instances(transforms.data(), write_n, coords.data(), write_m, out.data(), options);
+        tiled_ms = elapsed_ms(start);
+        cout << write_n << " x " << write_m << " points written, per-instance passes: " << naive_ms << " ms, tiled: "
+             << tiled_ms << " ms, same output [should be true] = "
+             << (std::memcmp(out.data(), naive_out.data(), out.size() * sizeof(float)) == 0) << endl;
+    }
+}
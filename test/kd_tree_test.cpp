@@ -0,0 +1,159 @@
+#include "spatial/kd_tree.hpp"
+#include "transforms/point.hpp"
+#include "test_timing.hpp"
+using namespace bcg;
+
+#include <chrono>
+#include <iostream>
+#include <limits>
+#include <random>
+#include <vector>
+using std::cout;
+using std::endl;
+
+// brute force reference: k nearest by full scan
+static void brute_force_knn(const std::vector<float>& coords, const float* q, size_t k,
+                            std::vector<kd_tree::index_type>& out_indices, std::vector<float>& out_dist2)
+{
+    size_t n = coords.size() / 3;
+    std::vector<std::pair<float, kd_tree::index_type>> all(n);
+    for (size_t i = 0; i < n; ++i) {
+        float dx = coords[i * 3] - q[0], dy = coords[i * 3 + 1] - q[1], dz = coords[i * 3 + 2] - q[2];
+        all[i] = std::make_pair(dx * dx + dy * dy + dz * dz, static_cast<kd_tree::index_type>(i));
+    }
+    std::partial_sort(all.begin(), all.begin() + k, all.end());
+    out_indices.resize(k);
+    out_dist2.resize(k);
+    for (size_t i = 0; i < k; ++i) {
+        out_indices[i] = all[i].second;
+        out_dist2[i] = all[i].first;
+    }
+}
+
+int main()
+{
+    cout << "***********************************" << endl;
+    cout << "blacker-cglib/test/kd_tree_test.cpp" << endl;
+    cout << "***********************************" << endl;
+
+    std::mt19937 rng(2022);
+    std::uniform_real_distribution<float> dist(-100.0f, 100.0f);
+
+    const size_t point_count = 200000;
+    const size_t query_count = 2000;
+    const size_t brute_force_query_count = 100; // brute force only checks a prefix of the queries
+    std::vector<point> cloud;
+    std::vector<float> coords;
+    cloud.reserve(point_count);
+    for (size_t i = 0; i < point_count; ++i) {
+        cloud.push_back(point(dist(rng), dist(rng), dist(rng)));
+        coords.push_back(cloud.back().data()[0]);
+        coords.push_back(cloud.back().data()[1]);
+        coords.push_back(cloud.back().data()[2]);
+    }
+    std::vector<point> queries;
+    for (size_t i = 0; i < query_count; ++i) {
+        queries.push_back(point(dist(rng), dist(rng), dist(rng)));
+    }
+    //////////////////////////////////////////////////////////////////////////////////////////////
+    // test build
+    //////////////////////////////////////////////////////////////////////////////////////////////
+    cout << "==========" << endl;
+    cout << "test build" << endl;
+    cout << "==========" << endl;
+    kd_tree tree;
+    {
+        auto start = std::chrono::steady_clock::now();
+        tree.build(cloud, 1);
+        cout << "single thread build of " << point_count << " points: " << elapsed_ms(start) << " ms" << endl;
+        start = std::chrono::steady_clock::now();
+        tree.build(cloud);
+        cout << "parallel build of " << point_count << " points: " << elapsed_ms(start) << " ms" << endl;
+        cout << "tree.size() [should be " << point_count << "] = " << tree.size() << endl;
+        kd_tree empty_tree;
+        float q[3] = { 0, 0, 0 };
+        cout << std::boolalpha << "empty_tree.nearest(q) == invalid_index [should be true] = "
+             << (empty_tree.nearest(q) == kd_tree::invalid_index) << endl;
+    }
+    //////////////////////////////////////////////////////////////////////////////////////////////
+    // test knn against brute force
+    //////////////////////////////////////////////////////////////////////////////////////////////
+    cout << "============================" << endl;
+    cout << "test knn against brute force" << endl;
+    cout << "============================" << endl;
+    {
+        const size_t k = 8;
+        std::vector<kd_tree::index_type> indices;
+        std::vector<float> dist2;
+
+        auto start = std::chrono::steady_clock::now();
+        tree.knn_batch(queries, k, indices, dist2);
+        double tree_ms = elapsed_ms(start);
+
+        size_t mismatch_count = 0;
+        std::vector<kd_tree::index_type> bf_indices;
+        std::vector<float> bf_dist2;
+        start = std::chrono::steady_clock::now();
+        for (size_t q = 0; q < brute_force_query_count; ++q) {
+            float qc[3] = { queries[q].data()[0], queries[q].data()[1], queries[q].data()[2] };
+            brute_force_knn(coords, qc, k, bf_indices, bf_dist2);
+            for (size_t i = 0; i < k; ++i) {
+                if (bf_dist2[i] != dist2[q * k + i]) ++mismatch_count;
+            }
+        }
+        double bf_ms = elapsed_ms(start);
+
+        cout << "knn mismatches [should be 0] = " << mismatch_count << endl;
+        cout << query_count << " x " << k << "-nn, kd_tree batch: " << tree_ms << " ms, brute force: "
+             << bf_ms * query_count / brute_force_query_count << " ms (extrapolated)" << endl;
+
+        kd_tree small_tree(std::vector<point>{ point(0, 0, 0), point(1, 0, 0) });
+        kd_tree::index_type small_indices[4];
+        float small_dist2[4];
+        size_t found = small_tree.knn(point(0.9f, 0, 0), 4, small_indices, small_dist2);
+        cout << "knn with k > size, found [should be 2] = " << found
+             << ", nearest [should be 1] = " << small_indices[0]
+             << ", third is invalid [should be true] = " << (small_indices[2] == kd_tree::invalid_index) << endl;
+
+        // binding invalid_index to a reference must link without an out-of-line definition
+        std::vector<kd_tree::index_type> padded(small_indices, small_indices + found);
+        padded.push_back(kd_tree::invalid_index);
+        cout << "padded.back() == invalid_index [should be true] = "
+             << (padded.back() == std::numeric_limits<kd_tree::index_type>::max()) << endl;
+    }
+    //////////////////////////////////////////////////////////////////////////////////////////////
+    // test radius against brute force
+    //////////////////////////////////////////////////////////////////////////////////////////////
+    cout << "===============================" << endl;
+    cout << "test radius against brute force" << endl;
+    cout << "===============================" << endl;
+    {
+        const float r = 6.0f;
+        std::vector<std::vector<kd_tree::index_type>> results;
+
+        auto start = std::chrono::steady_clock::now();
+        tree.radius_batch(queries, r, results);
+        double tree_ms = elapsed_ms(start);
+
+        size_t mismatch_count = 0;
+        size_t total_found = 0;
+        start = std::chrono::steady_clock::now();
+        for (size_t q = 0; q < brute_force_query_count; ++q) {
+            size_t bf_count = 0;
+            const b_vector<4, float>& qc = queries[q].data();
+            for (size_t i = 0; i < point_count; ++i) {
+                float dx = coords[i * 3] - qc[0], dy = coords[i * 3 + 1] - qc[1], dz = coords[i * 3 + 2] - qc[2];
+                if (dx * dx + dy * dy + dz * dz <= r * r) ++bf_count;
+            }
+            if (bf_count != results[q].size()) ++mismatch_count;
+        }
+        double bf_ms = elapsed_ms(start);
+        for (size_t q = 0; q < query_count; ++q) {
+            total_found += results[q].size();
+        }
+
+        cout << "radius mismatches [should be 0] = " << mismatch_count << ", total found = " << total_found << endl;
+        cout << query_count << " radius queries, kd_tree batch: " << tree_ms << " ms, brute force: "
+             << bf_ms * query_count / brute_force_query_count << " ms (extrapolated)" << endl;
+    }
+}
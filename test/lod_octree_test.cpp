@@ -0,0 +1,221 @@
+#include "spatial/lod_octree.hpp"
+#include "transforms/matrix/matrix.hpp"
+using namespace bcg;
+
+#include <algorithm>
+#include <cmath>
+#include <cstdio>
+#include <iostream>
+#include <random>
+#include <string>
+#include <vector>
+using std::cout;
+using std::endl;
+
+// perspective (fovy 60 deg, aspect 1, near 0.1, far 1000) looking down -z from (0, 0, eye_z)
+static matrix<4, 4, float> make_view_projection(float eye_z)
+{
+    float f = 1.0f / std::tan(3.14159265f / 6);
+    float n = 0.1f, fa = 1000.0f;
+    matrix<4, 4, float> projection = {
+        f, 0, 0, 0,
+        0, f, 0, 0,
+        0, 0, (fa + n) / (n - fa), 2 * fa * n / (n - fa),
+        0, 0, -1, 0
+    };
+    matrix<4, 4, float> view = {
+        1, 0, 0, 0,
+        0, 1, 0, 0,
+        0, 0, 1, -eye_z,
+        0, 0, 0, 1
+    };
+    return projection * view;
+}
+
+static void make_scan(size_t count, std::vector<float>& coords)
+{
+    // noisy sphere of radius 10 plus a ground plane
+    std::mt19937 rng(11);
+    std::normal_distribution<float> gauss(0.0f, 1.0f);
+    std::uniform_real_distribution<float> uniform(-20.0f, 20.0f);
+    for (size_t i = 0; i < count; ++i) {
+        if (i % 2 == 0) {
+            float x = gauss(rng), y = gauss(rng), z = gauss(rng);
+            float len = std::sqrt(x * x + y * y + z * z);
+            float r = 10.0f + 0.05f * gauss(rng);
+            coords.push_back(r * x / len);
+            coords.push_back(r * y / len);
+            coords.push_back(r * z / len);
+        }
+        else {
+            coords.push_back(uniform(rng));
+            coords.push_back(-12.0f + 0.01f * gauss(rng));
+            coords.push_back(uniform(rng));
+        }
+    }
+}
+
+static size_t count_loaded_points(const lod_octree& tree)
+{
+    size_t total = 0;
+    std::vector<float> coords;
+    for (lod_octree::index_type i = 0; i < tree.node_count(); ++i) {
+        coords.clear();
+        tree.load_points(i, coords);
+        total += coords.size() / 3;
+    }
+    return total;
+}
+
+int main()
+{
+    cout << "**************************************" << endl;
+    cout << "blacker-cglib/test/lod_octree_test.cpp" << endl;
+    cout << "**************************************" << endl;
+
+    const size_t point_count = 400000;
+    std::vector<float> coords;
+    make_scan(point_count, coords);
+    aabb bounds;
+    for (size_t i = 0; i < point_count; ++i) {
+        bounds.expand(&coords[i * 3]);
+    }
+    //////////////////////////////////////////////////////////////////////////////////////////////
+    // test in-memory build
+    //////////////////////////////////////////////////////////////////////////////////////////////
+    cout << "====================" << endl;
+    cout << "test in-memory build" << endl;
+    cout << "====================" << endl;
+    {
+        lod_octree_options options;
+        options.leaf_capacity = 4000;
+        options.sample_grid = 32;
+        lod_octree tree(bounds, options);
+        tree.insert(coords.data(), point_count);
+        tree.finalize();
+
+        std::uint64_t stored = 0;
+        for (lod_octree::index_type i = 0; i < tree.node_count(); ++i) {
+            stored += tree.get_node(i).point_count;
+        }
+        cout << "tree.node_count() = " << tree.node_count() << endl;
+        cout << "sum of node point counts [should be " << point_count << "] = " << stored << endl;
+        cout << "loaded points [should be " << point_count << "] = " << count_loaded_points(tree) << endl;
+        cout << "spilled points [should be 0] = " << tree.spilled_point_count() << endl;
+    }
+    //////////////////////////////////////////////////////////////////////////////////////////////
+    // test bounded-memory build
+    //////////////////////////////////////////////////////////////////////////////////////////////
+    cout << "=========================" << endl;
+    cout << "test bounded-memory build" << endl;
+    cout << "=========================" << endl;
+    {
+        lod_octree_options options;
+        options.leaf_capacity = 4000;
+        options.sample_grid = 32;
+        options.max_resident_points = 50000;
+        options.spill_prefix = "lod_octree_test_spill";
+        lod_octree tree(bounds, options);
+        // stream the scan in chunks
+        const size_t chunk = 10000;
+        for (size_t first = 0; first < point_count; first += chunk) {
+            tree.insert(&coords[first * 3], std::min(chunk, point_count - first));
+        }
+        tree.finalize();
+
+        cout << "tree.point_count() [should be " << point_count << "] = " << tree.point_count() << endl;
+        cout << "loaded points [should be " << point_count << "] = " << count_loaded_points(tree) << endl;
+        cout << std::boolalpha << "peak resident points <= budget + leaf capacity [should be true] = "
+             << (tree.peak_resident_point_count() <= options.max_resident_points + options.leaf_capacity)
+             << " (" << tree.peak_resident_point_count() << ")" << endl;
+        cout << "spilled points > 0 [should be true] = " << (tree.spilled_point_count() > 0) << endl;
+        // sample grids count against the same budget, a 32^3 grid is 4 KiB; one insert can add a
+        // split's worth of points and grids on top
+        size_t grid_bytes = 32 * 32 * 32 / 8;
+        size_t bound = (options.max_resident_points + options.leaf_capacity) * 3 * sizeof(float) + 16 * grid_bytes;
+        cout << "peak resident bytes with occupancy <= budget + leaf capacity + 16 grids [should be true] = "
+             << (tree.peak_resident_bytes() <= bound) << " (" << tree.peak_resident_bytes() << ")" << endl;
+        cout << "build status [should be ok] = " << to_string(tree.status()) << endl;
+    }
+    //////////////////////////////////////////////////////////////////////////////////////////////
+    // test spill failures
+    //////////////////////////////////////////////////////////////////////////////////////////////
+    cout << "===================" << endl;
+    cout << "test spill failures" << endl;
+    cout << "===================" << endl;
+    {
+        lod_octree_options options;
+        options.leaf_capacity = 4000;
+        options.sample_grid = 32;
+        options.max_resident_points = 50000;
+        // a directory that doesn't exist, the first spill can't open its file
+        options.spill_prefix = "lod_octree_test_missing_dir/spill";
+        lod_octree tree(bounds, options);
+        io_status status = tree.insert(coords.data(), point_count);
+        cout << "insert with unwritable spill files [should be open failed] = " << to_string(status) << endl;
+        cout << "loaded points [should be " << point_count << "] = " << count_loaded_points(tree) << endl;
+
+        // spill files removed before they are read back
+        options.spill_prefix = "lod_octree_test_removed";
+        lod_octree removed(bounds, options);
+        removed.insert(coords.data(), point_count);
+        size_t unreadable = 0;
+        std::vector<float> loaded;
+        for (lod_octree::index_type i = 0; i < removed.node_count(); ++i) {
+            std::remove(("lod_octree_test_removed_n" + std::to_string(i) + "_s.bin").c_str());
+            std::remove(("lod_octree_test_removed_n" + std::to_string(i) + "_o.bin").c_str());
+        }
+        for (lod_octree::index_type i = 0; i < removed.node_count(); ++i) {
+            loaded.clear();
+            if (removed.load_points(i, loaded) != io_status::ok) ++unreadable;
+        }
+        cout << "nodes whose spill file is gone report it [should be true] = " << (unreadable > 0) << " ("
+             << unreadable << ")" << endl;
+    }
+    //////////////////////////////////////////////////////////////////////////////////////////////
+    // test view-dependent selection
+    //////////////////////////////////////////////////////////////////////////////////////////////
+    cout << "=============================" << endl;
+    cout << "test view-dependent selection" << endl;
+    cout << "=============================" << endl;
+    {
+        lod_octree_options options;
+        options.leaf_capacity = 4000;
+        options.sample_grid = 32;
+        lod_octree tree(bounds, options);
+        tree.insert(coords.data(), point_count);
+        tree.finalize();
+
+        std::vector<lod_octree::index_type> near_nodes, far_nodes, coarse_nodes, budget_nodes, behind_nodes;
+        tree.select(make_view_projection(25.0f), 1080, 1.0f, point_count, near_nodes);
+        tree.select(make_view_projection(400.0f), 1080, 1.0f, point_count, far_nodes);
+        tree.select(make_view_projection(25.0f), 1080, 1e9f, point_count, coarse_nodes);
+        tree.select(make_view_projection(25.0f), 1080, 1.0f, 20000, budget_nodes);
+        // camera at z = -200 looking down -z sees nothing of the scan
+        tree.select(make_view_projection(-200.0f), 1080, 1.0f, point_count, behind_nodes);
+
+        auto selected_points = [&](const std::vector<lod_octree::index_type>& nodes) {
+            std::uint64_t total = 0;
+            for (auto idx : nodes) total += tree.get_node(idx).point_count;
+            return total;
+        };
+        size_t orphan_count = 0;
+        for (auto idx : near_nodes) {
+            lod_octree::index_type parent = tree.get_node(idx).parent;
+            if (parent != lod_octree::invalid_index &&
+                std::find(near_nodes.begin(), near_nodes.end(), parent) == near_nodes.end()) {
+                ++orphan_count;
+            }
+        }
+        cout << "near view: " << near_nodes.size() << " nodes, " << selected_points(near_nodes) << " points" << endl;
+        cout << "far view: " << far_nodes.size() << " nodes, " << selected_points(far_nodes) << " points" << endl;
+        cout << "far view selects fewer points [should be true] = "
+             << (selected_points(far_nodes) < selected_points(near_nodes)) << endl;
+        cout << "huge error budget selects only the root [should be 1] = " << coarse_nodes.size() << endl;
+        cout << "point budget respected [should be true] = " << (selected_points(budget_nodes) <= 20000) << endl;
+        cout << "selected nodes without selected parent [should be 0] = " << orphan_count << endl;
+        cout << "nodes selected behind the camera [should be 0] = " << behind_nodes.size() << endl;
+        cout << "root screen error, near view = " << tree.screen_error(0, make_view_projection(25.0f), 1080)
+             << " px, far view = " << tree.screen_error(0, make_view_projection(400.0f), 1080) << " px" << endl;
+    }
+}
@@ -1,6 +1,9 @@
 #include "transforms/matrix/matrix.hpp"
+#include "test_timing.hpp"
 using namespace bcg;
 
+#include <chrono>
+#include <cmath>
 #include <iostream>
 using std::cout;
 using std::endl;
@@ -292,4 +295,116 @@ int main()
         auto trans2 = make_zero_matrix<2>();
         cout << "auto trans2 = make_zero_matrix<2>(), trans2 = " << endl << trans2 << endl;
     }
-}
\ No newline at end of file
+    //////////////////////////////////////////////////////////////////////////////////////////////
+    // test high order determinant, inverse
+    //////////////////////////////////////////////////////////////////////////////////////////////
+    cout << "====================================" << endl;
+    cout << "test high order determinant, inverse" << endl;
+    cout << "====================================" << endl;
+    {
+        // a view-like matrix: rotation about z, then a translation
+        matrix<4> view = {
+            0.6, -0.8, 0, 1,
+            0.8, 0.6, 0, 2,
+            0, 0, 1, 3,
+            0, 0, 0, 1
+        };
+        cout << "We set view = " << endl << view << endl;
+        cout << "view.determinant() [should be 1] = " << view.determinant() << endl;
+        matrix<4> product = view * view.inverse();
+        double error = 0;
+        for (size_t i = 0; i < 4; ++i) {
+            for (size_t j = 0; j < 4; ++j) error = std::max(error, std::fabs(product[i][j] - (i == j ? 1 : 0)));
+        }
+        cout << "view * view.inverse() is identity [should be true] = " << std::boolalpha << (error < 1e-12) << endl;
+        cout << "view.inverse_transpose() = " << endl << view.inverse_transpose() << endl;
+
+        matrix<5> scaled = make_identity_matrix<5>() * 2.0;
+        scaled[0][4] = 7;
+        cout << "5x5 upper triangular with diagonal 2, determinant [should be 32] = " << scaled.determinant() << endl;
+        matrix<4> singular = { 1, 2, 3, 4, 2, 4, 6, 8, 0, 1, 0, 1, 1, 0, 1, 0 };
+        cout << "singular 4x4 determinant [should be 0] = " << singular.determinant() << endl;
+        matrix<4, 4, int> tridiagonal = { 2, 1, 0, 0, 1, 2, 1, 0, 0, 1, 2, 1, 0, 0, 1, 2 };
+        cout << "int 4x4 tridiagonal determinant [should be 5] = " << tridiagonal.determinant() << endl;
+    }
+    //////////////////////////////////////////////////////////////////////////////////////////////
+    // test inverse cache
+    //////////////////////////////////////////////////////////////////////////////////////////////
+    cout << "==================" << endl;
+    cout << "test inverse cache" << endl;
+    cout << "==================" << endl;
+    {
+        matrix<4> view = {
+            0.6, -0.8, 0, 1,
+            0.8, 0.6, 0, 2,
+            0, 0, 1, 3,
+            0, 0, 0, 1
+        };
+        matrix<4> uncached_inverse = view.inverse();
+        cout << "view.is_inverse_caching() [should be false] = " << view.is_inverse_caching() << endl;
+        view.set_inverse_caching(true);
+        for (int i = 0; i < 10; ++i) view.inverse();
+        matrix_cache_stats stats = view.inverse_cache_stats();
+        cout << "10 inverses, misses [should be 1] = " << stats.misses << ", hits [should be 9] = " << stats.hits << endl;
+
+        bool same = true;
+        matrix<4> cached_inverse = view.inverse();
+        for (size_t i = 0; i < 4; ++i) {
+            for (size_t j = 0; j < 4; ++j) same = same && cached_inverse.get_cell(i, j) == uncached_inverse.get_cell(i, j);
+        }
+        cout << "cached inverse equals the uncached one [should be true] = " << same << endl;
+
+        view.inverse_transpose();
+        view.inverse_transpose();
+        stats = view.inverse_cache_stats();
+        cout << "2 inverse transposes on top, hits [should be 12] = " << stats.hits << endl;
+
+        view.set_cell(0, 3, 5);
+        matrix<4> moved_inverse = view.inverse();
+        stats = view.inverse_cache_stats();
+        cout << "after set_cell, invalidations [should be 1] = " << stats.invalidations << ", misses [should be 2] = "
+             << stats.misses << endl;
+        cout << "moved inverse translation [should be -4.6] = " << moved_inverse[0][3] << endl;
+
+        view[1][3] = 0;
+        view.inverse();
+        cout << "after operator [], invalidations [should be 2] = " << view.inverse_cache_stats().invalidations << endl;
+
+        // a copy keeps the cache, assigning a new value keeps caching on but drops the stale inverse
+        matrix<4> copy = view;
+        copy.inverse();
+        cout << "copy is caching [should be true] = " << copy.is_inverse_caching() << ", hits [should be "
+             << view.inverse_cache_stats().hits + 1 << "] = " << copy.inverse_cache_stats().hits << endl;
+        view = make_identity_matrix<4>();
+        cout << "after assignment, still caching [should be true] = " << view.is_inverse_caching()
+             << ", inverse [0][3] [should be 0] = " << view.inverse()[0][3] << endl;
+        view.set_inverse_caching(false);
+        cout << "caching off, stats hits [should be 0] = " << view.inverse_cache_stats().hits << endl;
+    }
+    //////////////////////////////////////////////////////////////////////////////////////////////
+    // test inverse cache performance
+    //////////////////////////////////////////////////////////////////////////////////////////////
+    cout << "==============================" << endl;
+    cout << "test inverse cache performance" << endl;
+    cout << "==============================" << endl;
+    {
+        matrix<4> view = {
+            0.6, -0.8, 0, 1,
+            0.8, 0.6, 0, 2,
+            0, 0, 1, 3,
+            0, 0, 0, 1
+        };
+        const int rounds = 100000;
+        double checksum = 0;
+        auto start = std::chrono::steady_clock::now();
+        for (int i = 0; i < rounds; ++i) checksum += view.inverse_transpose().get_cell(3, 0);
+        double uncached_ms = elapsed_ms(start);
+
+        view.set_inverse_caching(true);
+        start = std::chrono::steady_clock::now();
+        for (int i = 0; i < rounds; ++i) checksum += view.inverse_transpose().get_cell(3, 0);
+        double cached_ms = elapsed_ms(start);
+        cout << rounds << " 4x4 inverse transposes, uncached: " << uncached_ms << " ms, cached: " << cached_ms
+             << " ms (checksum " << checksum << ", hits " << view.inverse_cache_stats().hits << ")" << endl;
+    }
+}
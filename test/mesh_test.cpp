@@ -0,0 +1,154 @@
+#include "mesh/mesh.hpp"
+#include "transforms/matrix/matrix.hpp"
+#include "transforms/point.hpp"
+#include "transforms/translation.hpp"
+#include "test_timing.hpp"
+using namespace bcg;
+
+#include <chrono>
+#include <cmath>
+#include <iostream>
+#include <random>
+#include <vector>
+using std::cout;
+using std::endl;
+
+// side x side grid of a wavy surface as a triangle soup, 2 triangles per quad
+static std::vector<float> make_grid_soup(size_t side, float jitter)
+{
+    std::mt19937 rng(6);
+    std::uniform_real_distribution<float> noise(-jitter, jitter);
+    auto corner = [&](std::vector<float>& soup, size_t x, size_t y) {
+        soup.push_back(float(x) + noise(rng));
+        soup.push_back(float(y) + noise(rng));
+        soup.push_back(std::sin(0.1f * x) * std::cos(0.1f * y) + noise(rng));
+    };
+    std::vector<float> soup;
+    for (size_t y = 0; y + 1 < side; ++y) {
+        for (size_t x = 0; x + 1 < side; ++x) {
+            corner(soup, x, y); corner(soup, x + 1, y); corner(soup, x + 1, y + 1);
+            corner(soup, x, y); corner(soup, x + 1, y + 1); corner(soup, x, y + 1);
+        }
+    }
+    return soup;
+}
+
+int main()
+{
+    cout << "********************************" << endl;
+    cout << "blacker-cglib/test/mesh_test.cpp" << endl;
+    cout << "********************************" << endl;
+    //////////////////////////////////////////////////////////////////////////////////////////////
+    // test mesh construction
+    //////////////////////////////////////////////////////////////////////////////////////////////
+    cout << "======================" << endl;
+    cout << "test mesh construction" << endl;
+    cout << "======================" << endl;
+    {
+        float positions[] = { 0, 0, 0, 1, 0, 0, 1, 1, 0, 0, 1, 0 };
+        mesh::index_type indices[] = { 0, 1, 2, 0, 2, 3 };
+        mesh square(positions, 4, indices, 2);
+        square.compute_normals();
+        cout << "square.vertex_count() [should be 4] = " << square.vertex_count() << endl;
+        cout << "square.triangle_count() [should be 2] = " << square.triangle_count() << endl;
+        cout << "square.position(2) [should be (1, 1, 0)] = " << square.position(2) << endl;
+        cout << "square.normal(3) [should be (0, 0, 1)] = " << square.normal(3) << endl;
+        cout << "square.bounds() = " << square.bounds() << endl;
+    }
+    //////////////////////////////////////////////////////////////////////////////////////////////
+    // test batched transforms
+    //////////////////////////////////////////////////////////////////////////////////////////////
+    cout << "=======================" << endl;
+    cout << "test batched transforms" << endl;
+    cout << "=======================" << endl;
+    {
+        mesh surface = mesh::from_triangle_soup(make_grid_soup(1000, 0).data(), 2 * 999 * 999);
+        surface.compute_normals();
+        size_t n = surface.vertex_count();
+
+        // translation against translation::apply_to per vertex
+        translation trans(3, -2, 5);
+        std::vector<point> points;
+        for (size_t i = 0; i < n; ++i) points.push_back(surface.position(i));
+        auto start = std::chrono::steady_clock::now();
+        for (auto& p : points) trans.apply_to(p);
+        double per_vertex_ms = elapsed_ms(start);
+        mesh moved = surface;
+        start = std::chrono::steady_clock::now();
+        moved.transform(trans, 1);
+        double batched_ms = elapsed_ms(start);
+        size_t mismatch_count = 0;
+        for (size_t i = 0; i < n; ++i) {
+            for (size_t d = 0; d < 3; ++d) {
+                if (std::fabs(moved.position(i).data()[d] - points[i].data()[d]) > 1e-4f) ++mismatch_count;
+            }
+        }
+        cout << "positions differing from translation::apply_to [should be 0] = " << mismatch_count << endl;
+        cout << n << " vertices, per-vertex apply_to: " << per_vertex_ms << " ms, mesh::transform (positions and normals): "
+             << batched_ms << " ms" << endl;
+
+        // a non-uniform scale with a shear: transformed normals should match recomputed ones
+        matrix<4, 4, float> skew = {
+            2.0f, 0.5f, 0.0f, 1.0f,
+            0.0f, 1.0f, 0.0f, 0.0f,
+            0.0f, 0.0f, 0.25f, 3.0f,
+            0.0f, 0.0f, 0.0f, 1.0f
+        };
+        mesh skewed = surface;
+        skewed.transform(skew);
+        mesh recomputed = skewed;
+        recomputed.compute_normals();
+        float worst_dot = 1;
+        for (size_t i = 0; i < n; ++i) {
+            float dot = skewed.nx()[i] * recomputed.nx()[i] + skewed.ny()[i] * recomputed.ny()[i] +
+                        skewed.nz()[i] * recomputed.nz()[i];
+            worst_dot = std::min(worst_dot, dot);
+        }
+        cout << std::boolalpha << "transformed normals agree with recomputed ones [should be true] = "
+             << (worst_dot > 0.999f) << " (worst cosine " << worst_dot << ")" << endl;
+    }
+    //////////////////////////////////////////////////////////////////////////////////////////////
+    // test vertex welding
+    //////////////////////////////////////////////////////////////////////////////////////////////
+    cout << "===================" << endl;
+    cout << "test vertex welding" << endl;
+    cout << "===================" << endl;
+    {
+        const size_t side = 1000;
+        const size_t triangle_count = 2 * (side - 1) * (side - 1);
+        std::vector<float> exact = make_grid_soup(side, 0);
+
+        auto start = std::chrono::steady_clock::now();
+        mesh welded = mesh::from_triangle_soup(exact.data(), triangle_count);
+        double weld_ms = elapsed_ms(start);
+        mesh welded_single = mesh::from_triangle_soup(exact.data(), triangle_count, 0, 1);
+        cout << "welded.vertex_count() [should be " << side * side << "] = " << welded.vertex_count() << endl;
+        cout << "welded.triangle_count() [should be " << triangle_count << "] = " << welded.triangle_count() << endl;
+        bool same = welded.vertex_count() == welded_single.vertex_count();
+        for (size_t i = 0; same && i < welded.triangle_count() * 3; ++i) {
+            same = welded.indices()[i] == welded_single.indices()[i];
+        }
+        cout << "same result with 1 thread [should be true] = " << same << endl;
+        cout << side * side * 6 << " corners welded in " << weld_ms << " ms" << endl;
+
+        // noise of 1e-3 in x and y welds on a grid of 0.01 when the corners sit in the middle of a
+        // cell; z is snapped to cell centres since a noisy z could straddle a cell boundary
+        std::vector<float> noisy = make_grid_soup(side, 1e-3f);
+        for (size_t i = 0; i < noisy.size(); i += 3) {
+            float x = std::round(noisy[i]), y = std::round(noisy[i + 1]);
+            noisy[i] += 0.005f;
+            noisy[i + 1] += 0.005f;
+            noisy[i + 2] = std::floor(std::sin(0.1f * x) * std::cos(0.1f * y) * 100) / 100 + 0.005f;
+        }
+        mesh noisy_exact = mesh::from_triangle_soup(noisy.data(), triangle_count);
+        mesh noisy_welded = mesh::from_triangle_soup(noisy.data(), triangle_count, 0.01f);
+        cout << "noisy soup, exact weld: " << noisy_exact.vertex_count() << " vertices, 0.01 weld [should be "
+             << side * side << "] = " << noisy_welded.vertex_count() << endl;
+
+        float positions[] = { 0, 0, 0, 1, 0, 0, 1, 1, 0, 1, 0, 0, 0, 0, -0.0f };
+        mesh::index_type indices[] = { 0, 1, 2, 0, 3, 4 };
+        mesh duplicated(positions, 5, indices, 2);
+        cout << "duplicated.weld() removed [should be 2] = " << duplicated.weld() << endl;
+        cout << "collapsed triangles dropped, triangle_count() [should be 1] = " << duplicated.triangle_count() << endl;
+    }
+}
@@ -0,0 +1,131 @@
+#include "spatial/kd_tree.hpp"
+#include "spatial/normal_estimation.hpp"
+#include "test_timing.hpp"
+using namespace bcg;
+
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <iostream>
+#include <random>
+#include <vector>
+using std::cout;
+using std::endl;
+
+// uniform points on a sphere of [radius] centred at (cx, cy, cz)
+static std::vector<float> make_sphere_cloud(size_t n, float radius, float cx, float cy, float cz, std::mt19937& rng)
+{
+    std::normal_distribution<float> gauss;
+    std::vector<float> coords;
+    coords.reserve(n * 3);
+    for (size_t i = 0; i < n; ++i) {
+        float x = gauss(rng), y = gauss(rng), z = gauss(rng);
+        float inv = radius / std::sqrt(x * x + y * y + z * z);
+        coords.push_back(cx + x * inv);
+        coords.push_back(cy + y * inv);
+        coords.push_back(cz + z * inv);
+    }
+    return coords;
+}
+
+int main()
+{
+    cout << "*********************************************" << endl;
+    cout << "blacker-cglib/test/normal_estimation_test.cpp" << endl;
+    cout << "*********************************************" << endl;
+
+    cout << std::boolalpha;
+    std::mt19937 rng(39);
+    //////////////////////////////////////////////////////////////////////////////////////////////
+    // test normal accuracy
+    //////////////////////////////////////////////////////////////////////////////////////////////
+    cout << "====================" << endl;
+    cout << "test normal accuracy" << endl;
+    cout << "====================" << endl;
+    {
+        // far from the origin so the covariance has to cope with large coordinates
+        const size_t n = 50000;
+        const float cx = 1000, cy = -500, cz = 250;
+        std::vector<float> coords = make_sphere_cloud(n, 1.0f, cx, cy, cz, rng);
+        std::vector<float> normals(n * 3), curvature(n);
+        normal_estimation_options options;
+        options.orient_to_view_point = true;
+        options.view_point[0] = cx;
+        options.view_point[1] = cy;
+        options.view_point[2] = cz;
+        size_t degenerate = estimate_normals(coords.data(), n, normals.data(), options, curvature.data());
+
+        // the true normal is radial, facing the centre after orientation
+        float worst_angle_cos = 1, worst_length = 0;
+        for (size_t i = 0; i < n; ++i) {
+            float rx = cx - coords[i * 3], ry = cy - coords[i * 3 + 1], rz = cz - coords[i * 3 + 2];
+            float len = std::sqrt(rx * rx + ry * ry + rz * rz);
+            float c = (normals[i * 3] * rx + normals[i * 3 + 1] * ry + normals[i * 3 + 2] * rz) / len;
+            worst_angle_cos = std::min(worst_angle_cos, c);
+            float nl = std::sqrt(normals[i * 3] * normals[i * 3] + normals[i * 3 + 1] * normals[i * 3 + 1] +
+                                 normals[i * 3 + 2] * normals[i * 3 + 2]);
+            worst_length = std::max(worst_length, std::fabs(nl - 1));
+        }
+        cout << "degenerate points [should be 0] = " << degenerate << endl;
+        cout << "every normal within 5 degrees of the radial direction [should be true] = "
+             << (worst_angle_cos > std::cos(5 * 3.14159265f / 180)) << " (worst cos " << worst_angle_cos << ")" << endl;
+        cout << "unit length [should be true] = " << (worst_length < 1e-5f) << endl;
+        cout << "curvature of a smooth sphere below 0.01 [should be true] = "
+             << (*std::max_element(curvature.begin(), curvature.end()) < 0.01f) << endl;
+
+        // a noisy plane z = 0.5 x, normal (-0.5, 0, 1) / |..|
+        std::vector<float> plane;
+        std::uniform_real_distribution<float> unit(-10.0f, 10.0f), noise(-0.01f, 0.01f);
+        for (size_t i = 0; i < n; ++i) {
+            float x = unit(rng), y = unit(rng);
+            plane.push_back(x);
+            plane.push_back(y);
+            plane.push_back(0.5f * x + noise(rng));
+        }
+        options = normal_estimation_options();
+        options.radius = 0.5f;
+        estimate_normals(plane.data(), n, normals.data(), options);
+        float expected[3] = { -0.5f / std::sqrt(1.25f), 0, 1 / std::sqrt(1.25f) };
+        float worst_plane_cos = 1;
+        for (size_t i = 0; i < n; ++i) {
+            float c = std::fabs(normals[i * 3] * expected[0] + normals[i * 3 + 1] * expected[1] +
+                                normals[i * 3 + 2] * expected[2]);
+            worst_plane_cos = std::min(worst_plane_cos, c);
+        }
+        cout << "noisy plane with radius neighbourhoods, within 5 degrees [should be true] = "
+             << (worst_plane_cos > std::cos(5 * 3.14159265f / 180)) << " (worst |cos| " << worst_plane_cos << ")" << endl;
+
+        float lonely[6] = { 0, 0, 0, 100, 0, 0 };
+        float lonely_normals[6];
+        options.radius = 1.0f;
+        cout << "isolated points get zero normals [should be 2] = " << estimate_normals(lonely, 2, lonely_normals, options)
+             << endl;
+    }
+    //////////////////////////////////////////////////////////////////////////////////////////////
+    // test normal estimation performance
+    //////////////////////////////////////////////////////////////////////////////////////////////
+    cout << "==================================" << endl;
+    cout << "test normal estimation performance" << endl;
+    cout << "==================================" << endl;
+    {
+        const size_t n = 2000000;
+        std::vector<float> coords = make_sphere_cloud(n, 10.0f, 0, 0, 0, rng);
+        std::vector<float> normals(n * 3), single_normals(n * 3);
+        auto start = std::chrono::steady_clock::now();
+        kd_tree tree(coords.data(), n);
+        double build_ms = elapsed_ms(start);
+
+        normal_estimation_options options;
+        options.thread_count = 1;
+        start = std::chrono::steady_clock::now();
+        estimate_normals(tree, coords.data(), single_normals.data(), options);
+        double single_ms = elapsed_ms(start);
+        options.thread_count = 0;
+        start = std::chrono::steady_clock::now();
+        estimate_normals(tree, coords.data(), normals.data(), options);
+        double parallel_ms = elapsed_ms(start);
+        cout << "same normals on every thread count [should be true] = " << (normals == single_normals) << endl;
+        cout << n << " points, 16 neighbours, tree build: " << build_ms << " ms, normals on 1 thread: " << single_ms
+             << " ms, on all threads: " << parallel_ms << " ms" << endl;
+    }
+}
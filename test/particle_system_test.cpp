@@ -0,0 +1,213 @@
+#include "physics/particle_system.hpp"
+#include "transforms/b_vector/b_vector.hpp"
+#include "transforms/point.hpp"
+#include "transforms/vector.hpp"
+#include "utils/parallel.hpp"
+#include "test_timing.hpp"
+using namespace bcg;
+
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <cstring>
+#include <iostream>
+#include <random>
+#include <vector>
+using std::cout;
+using std::endl;
+
+static particle_system make_particles(size_t n, std::mt19937& rng)
+{
+    std::uniform_real_distribution<float> unit(-1.0f, 1.0f);
+    particle_system particles;
+    particles.reserve(n);
+    for (size_t i = 0; i < n; ++i) {
+        particles.add(point(unit(rng), unit(rng), unit(rng)), vector(unit(rng), unit(rng), unit(rng)),
+                      1.5f + unit(rng));
+    }
+    return particles;
+}
+
+// one particle with b_vector operators, the way it is written without the particle system
+struct aos_particle
+{
+    b_vector<4, float> position;
+    b_vector<4, float> velocity;
+    b_vector<4, float> force;
+    float inverse_mass;
+};
+
+static float orbit_radius(particle_integrator integrator)
+{
+    // unit circular orbit around an attractor of strength 1, 4 revolutions
+    particle_system particles;
+    particles.add(point(1, 0, 0), vector(0, 1, 0));
+    const float center[3] = { 0, 0, 0 };
+    particle_step_options options;
+    options.integrator = integrator;
+    const float pi = 3.14159265f;
+    for (size_t i = 0; i < 4000; ++i) {
+        particles.apply_attractor(center, 1, 0);
+        particles.step(8 * pi / 4000, options);
+    }
+    return std::sqrt(particles.x()[0] * particles.x()[0] + particles.y()[0] * particles.y()[0]);
+}
+
+int main()
+{
+    cout << "*******************************************" << endl;
+    cout << "blacker-cglib/test/particle_system_test.cpp" << endl;
+    cout << "*******************************************" << endl;
+
+    cout << std::boolalpha;
+    std::mt19937 rng(47);
+    //////////////////////////////////////////////////////////////////////////////////////////////
+    // test integrators
+    //////////////////////////////////////////////////////////////////////////////////////////////
+    cout << "================" << endl;
+    cout << "test integrators" << endl;
+    cout << "================" << endl;
+    {
+        // free fall for 100 steps: x = x0 + v0 t + g dt^2 n (n + 1) / 2 (semi-implicit and verlet),
+        // n (n - 1) / 2 for explicit euler
+        const float dt = 0.01f, g = -9.81f;
+        const size_t n = 100;
+        particle_integrator integrators[] = { particle_integrator::euler, particle_integrator::semi_implicit_euler,
+                                              particle_integrator::verlet };
+        const char* names[] = { "euler", "semi-implicit euler", "verlet" };
+        for (size_t k = 0; k < 3; ++k) {
+            particle_system particles;
+            particles.add(point(0, 10, 0), vector(1, 2, 0));
+            particles.add(point(0, 10, 0), vector(1, 2, 0), 0);
+            particle_step_options options;
+            options.integrator = integrators[k];
+            options.gravity[1] = g;
+            for (size_t i = 0; i < n; ++i) particles.step(dt, options);
+            float steps = k == 0 ? n * (n - 1) / 2.0f : n * (n + 1) / 2.0f;
+            float expected = 10 + 2 * dt * n + g * dt * dt * steps;
+            // verlet rebuilds the velocity from position differences, so it drifts by float rounding
+            cout << names[k] << " free fall height [should be ~" << expected << "] = " << particles.y()[0]
+                 << ", x [should be 1] = " << particles.x()[0] << ", velocity y [should be " << 2 + g * dt * n
+                 << "] = " << particles.vy()[0] << ", within 1e-2 [should be true] = "
+                 << (std::fabs(particles.y()[0] - expected) < 1e-2f) << endl;
+            cout << names[k] << " pinned particle stays [should be 0 10 0] = " << particles.x()[1] << " "
+                 << particles.y()[1] << " " << particles.z()[1] << endl;
+        }
+
+        // forces: accumulated, consumed and cleared by the step
+        particle_system particles;
+        particles.add(point(0, 0, 0), vector(0, 0, 0), 0.5f);
+        particles.add_force(0, 2, 0, 0);
+        particles.add_force(0, 2, 0, 0);
+        particles.step(1.0f);
+        cout << "force 4 on inverse mass 0.5 for 1 s, velocity [should be 2] = " << particles.vx()[0]
+             << ", force cleared [should be 0] = " << particles.fx()[0] << endl;
+        particles.apply_drag(0.5f);
+        cout << "drag 0.5 at velocity 2 [should be -1] = " << particles.fx()[0] << endl;
+
+        // verlet: a position moved between steps (a constraint) carries its velocity
+        particle_system constrained;
+        constrained.add(point(0, 0, 0), vector(1, 0, 0));
+        particle_step_options verlet;
+        verlet.integrator = particle_integrator::verlet;
+        constrained.step(0.1f, verlet);
+        constrained.x()[0] = 0.05f;
+        constrained.step(0.1f, verlet);
+        cout << "verlet after pulling the particle back halfway [should be 0.1 / 0.5] = " << constrained.x()[0] << " / "
+             << constrained.vx()[0] << endl;
+
+        cout << "orbit radius after 4 revolutions, euler [should be > 1.1] = "
+             << orbit_radius(particle_integrator::euler) << ", semi-implicit [should be ~1] = "
+             << orbit_radius(particle_integrator::semi_implicit_euler) << ", verlet [should be ~1] = "
+             << orbit_radius(particle_integrator::verlet) << endl;
+
+        // random particles against b_vector operators, and 1 against 4 threads
+        particle_system a = make_particles(100003, rng);
+        std::vector<aos_particle> reference(a.size());
+        for (size_t i = 0; i < a.size(); ++i) {
+            a.add_force(i, float(i % 7) - 3, 1, float(i % 3));
+            reference[i].position = b_vector<4, float>({ a.x()[i], a.y()[i], a.z()[i], 1 });
+            reference[i].velocity = b_vector<4, float>({ a.vx()[i], a.vy()[i], a.vz()[i], 0 });
+            reference[i].force = b_vector<4, float>({ a.fx()[i], a.fy()[i], a.fz()[i], 0 });
+            reference[i].inverse_mass = a.inverse_masses()[i];
+        }
+        particle_system b = a;
+        particle_step_options options;
+        options.gravity[2] = -1;
+        options.thread_count = 1;
+        a.step(0.02f, options);
+        options.thread_count = 4;
+        b.step(0.02f, options);
+        const b_vector<4, float> gravity({ 0, 0, -1, 0 });
+        float worst = 0;
+        for (size_t i = 0; i < reference.size(); ++i) {
+            aos_particle& p = reference[i];
+            p.velocity = p.velocity + (p.force * p.inverse_mass + gravity) * 0.02f;
+            p.position = p.position + p.velocity * 0.02f;
+            const float found[3] = { a.x()[i], a.y()[i], a.z()[i] };
+            for (size_t d = 0; d < 3; ++d) worst = std::max(worst, std::fabs(found[d] - p.position[d]));
+        }
+        cout << "100003 particles against b_vector operators, error < 1e-6 [should be true] = " << (worst < 1e-6f)
+             << " (" << worst << ")" << endl;
+        cout << "1 and 4 threads step identically [should be true] = "
+             << (std::memcmp(a.x(), b.x(), a.size() * sizeof(float)) == 0 &&
+                 std::memcmp(a.vz(), b.vz(), a.size() * sizeof(float)) == 0) << endl;
+    }
+    //////////////////////////////////////////////////////////////////////////////////////////////
+    // test particle performance
+    //////////////////////////////////////////////////////////////////////////////////////////////
+    cout << "=========================" << endl;
+    cout << "test particle performance" << endl;
+    cout << "=========================" << endl;
+    {
+        const size_t n = 4000000, steps = 10;
+        const float dt = 1.0f / 60;
+        particle_system particles = make_particles(n, rng);
+        std::vector<aos_particle> reference(n);
+        for (size_t i = 0; i < n; ++i) {
+            reference[i].position = b_vector<4, float>({ particles.x()[i], particles.y()[i], particles.z()[i], 1 });
+            reference[i].velocity = b_vector<4, float>({ particles.vx()[i], particles.vy()[i], particles.vz()[i], 0 });
+            reference[i].inverse_mass = particles.inverse_masses()[i];
+        }
+        const b_vector<4, float> gravity({ 0, -9.81f, 0, 0 });
+
+        auto start = std::chrono::steady_clock::now();
+        for (size_t s = 0; s < steps; ++s) {
+            for (aos_particle& p : reference) {
+                p.velocity = p.velocity + (p.force * p.inverse_mass + gravity) * dt;
+                p.position = p.position + p.velocity * dt;
+                p.force = b_vector<4, float>();
+            }
+        }
+        double reference_ms = elapsed_ms(start);
+
+        particle_step_options options;
+        options.gravity[1] = -9.81f;
+        particle_integrator integrators[] = { particle_integrator::euler, particle_integrator::semi_implicit_euler,
+                                              particle_integrator::verlet };
+        const char* names[] = { "euler", "semi-implicit euler", "verlet" };
+        double rate = n * steps / reference_ms / 1000;
+        cout << n << " particles x " << steps << " steps, b_vector<4> operators: " << reference_ms << " ms ("
+             << rate << " M particles/s/core)" << endl;
+        double semi_implicit_ms = 0;
+        for (size_t k = 0; k < 3; ++k) {
+            options.integrator = integrators[k];
+            options.thread_count = 1;
+            particles.step(dt, options);
+            start = std::chrono::steady_clock::now();
+            for (size_t s = 0; s < steps; ++s) particles.step(dt, options);
+            double single_ms = elapsed_ms(start);
+            if (k == 1) semi_implicit_ms = single_ms;
+            options.thread_count = 0;
+            start = std::chrono::steady_clock::now();
+            for (size_t s = 0; s < steps; ++s) particles.step(dt, options);
+            double threaded_ms = elapsed_ms(start);
+            size_t threads = resolve_thread_count(n, 0, 1 << 14);
+            cout << names[k] << ": " << single_ms << " ms (" << n * steps / single_ms / 1000
+                 << " M particles/s/core), " << threads << " thread(s): " << threaded_ms << " ms ("
+                 << n * steps / threaded_ms / 1000 / threads << " M particles/s/core)" << endl;
+        }
+        cout << "fused semi-implicit step faster than b_vector<4> operators [should be true] = "
+             << (semi_implicit_ms < reference_ms) << endl;
+    }
+}
@@ -0,0 +1,383 @@
+#include "mesh/mesh.hpp"
+#include "render/rasterizer.hpp"
+#include "transforms/b_vector/b_vector.hpp"
+#include "transforms/matrix/matrix.hpp"
+#include "utils/parallel.hpp"
+#include "test_timing.hpp"
+using namespace bcg;
+
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <cstdint>
+#include <cstdlib>
+#include <cstring>
+#include <iostream>
+#include <random>
+#include <vector>
+using std::cout;
+using std::endl;
+
+typedef b_vector<3, float> vec3;
+typedef b_vector<4, float> vec4;
+
+// the square [-1, 1]^2 at z = 0 as cells_x * cells_y quads, inner vertices jittered, counter-clockwise
+static mesh grid_mesh(size_t cells_x, size_t cells_y, float jitter, bool reversed, std::mt19937& rng)
+{
+    std::uniform_real_distribution<float> unit(-1.0f, 1.0f);
+    std::vector<float> positions;
+    for (size_t j = 0; j <= cells_y; ++j) {
+        for (size_t i = 0; i <= cells_x; ++i) {
+            bool inner = i > 0 && j > 0 && i < cells_x && j < cells_y;
+            float x = -1 + 2.0f * i / cells_x + (inner ? jitter * unit(rng) / cells_x : 0.0f);
+            float y = -1 + 2.0f * j / cells_y + (inner ? jitter * unit(rng) / cells_y : 0.0f);
+            positions.insert(positions.end(), { x, y, 0 });
+        }
+    }
+    std::vector<std::uint32_t> indices;
+    for (std::uint32_t j = 0; j < cells_y; ++j) {
+        for (std::uint32_t i = 0; i < cells_x; ++i) {
+            std::uint32_t a = j * std::uint32_t(cells_x + 1) + i, b = a + 1, c = a + std::uint32_t(cells_x + 1), d = c + 1;
+            if (reversed) indices.insert(indices.end(), { a, c, b, b, c, d });
+            else indices.insert(indices.end(), { a, b, c, b, d, c });
+        }
+    }
+    return mesh(positions.data(), positions.size() / 3, indices.data(), indices.size() / 3);
+}
+
+// unit sphere around [center] with outward normals
+static mesh sphere_mesh(size_t rings, size_t segments, const float* center)
+{
+    const float pi = 3.14159265f;
+    std::vector<float> positions;
+    for (size_t r = 0; r <= rings; ++r) {
+        float theta = pi * r / rings;
+        for (size_t s = 0; s <= segments; ++s) {
+            float phi = 2 * pi * s / segments;
+            positions.insert(positions.end(), { center[0] + std::sin(theta) * std::cos(phi),
+                                                center[1] + std::cos(theta),
+                                                center[2] - std::sin(theta) * std::sin(phi) });
+        }
+    }
+    std::vector<std::uint32_t> indices;
+    for (std::uint32_t r = 0; r < rings; ++r) {
+        for (std::uint32_t s = 0; s < segments; ++s) {
+            std::uint32_t a = r * std::uint32_t(segments + 1) + s, b = a + 1, c = a + std::uint32_t(segments + 1), d = c + 1;
+            indices.insert(indices.end(), { a, c, b, b, c, d });
+        }
+    }
+    mesh m(positions.data(), positions.size() / 3, indices.data(), indices.size() / 3);
+    m.compute_normals();
+    return m;
+}
+
+// Lambert intensity as the rasterizer computes it
+static float reference_lambert(const vec3& n, const raster_options& options)
+{
+    vec3 l({ options.light_direction[0], options.light_direction[1], options.light_direction[2] });
+    float len = std::sqrt((n, n) * (l, l));
+    float facing = len > 0 ? -(n, l) / len : 0.0f;
+    return options.ambient + (1 - options.ambient) * std::max(0.0f, facing);
+}
+
+static float edge(const vec3& a, const vec3& b, float px, float py)
+{
+    return (b[0] - a[0]) * (py - a[1]) - (b[1] - a[1]) * (px - a[0]);
+}
+
+// The usual way, with b_vector operators: clip coordinates by matrix rows, then a barycentric test of
+// every pixel in each triangle's bounds. No clipping, so the scenes stay in front of the near plane.
+static void reference_draw(const mesh& m, const matrix<4, 4, float>& mvp, const raster_options& options,
+                           size_t width, size_t height, std::vector<float>& depth, std::vector<std::uint32_t>& color)
+{
+    std::vector<vec4> clip(m.vertex_count());
+    for (size_t v = 0; v < m.vertex_count(); ++v) {
+        vec4 p({ m.x()[v], m.y()[v], m.z()[v], 1 });
+        clip[v] = vec4({ (mvp.get_row(0), p), (mvp.get_row(1), p), (mvp.get_row(2), p), (mvp.get_row(3), p) });
+    }
+    for (size_t t = 0; t < m.triangle_count(); ++t) {
+        const std::uint32_t* tri = m.indices() + t * 3;
+        vec3 screen[3];
+        float inv_w[3], shade[3];
+        vec3 corner[3];
+        for (size_t i = 0; i < 3; ++i) {
+            const vec4& c = clip[tri[i]];
+            inv_w[i] = 1 / c[3];
+            screen[i] = vec3({ (c[0] * inv_w[i] * 0.5f + 0.5f) * width, (0.5f - c[1] * inv_w[i] * 0.5f) * height,
+                               c[2] * inv_w[i] * 0.5f + 0.5f });
+            corner[i] = vec3({ m.x()[tri[i]], m.y()[tri[i]], m.z()[tri[i]] });
+        }
+        vec3 e1 = corner[1] - corner[0], e2 = corner[2] - corner[0];
+        vec3 face({ e1[1] * e2[2] - e1[2] * e2[1], e1[2] * e2[0] - e1[0] * e2[2], e1[0] * e2[1] - e1[1] * e2[0] });
+        for (size_t i = 0; i < 3; ++i) {
+            shade[i] = reference_lambert(m.has_normals() ? vec3({ m.nx()[tri[i]], m.ny()[tri[i]], m.nz()[tri[i]] })
+                                                         : face, options);
+        }
+        // front faces are clockwise on screen
+        float area = edge(screen[0], screen[1], screen[2][0], screen[2][1]);
+        if (area >= 0) continue;
+
+        float min_x = std::min(screen[0][0], std::min(screen[1][0], screen[2][0]));
+        float max_x = std::max(screen[0][0], std::max(screen[1][0], screen[2][0]));
+        float min_y = std::min(screen[0][1], std::min(screen[1][1], screen[2][1]));
+        float max_y = std::max(screen[0][1], std::max(screen[1][1], screen[2][1]));
+        int x0 = std::max(0, int(std::floor(min_x))), x1 = std::min(int(width) - 1, int(std::ceil(max_x)));
+        int y0 = std::max(0, int(std::floor(min_y))), y1 = std::min(int(height) - 1, int(std::ceil(max_y)));
+        for (int y = y0; y <= y1; ++y) {
+            for (int x = x0; x <= x1; ++x) {
+                float px = x + 0.5f, py = y + 0.5f;
+                float l0 = edge(screen[1], screen[2], px, py) / area;
+                float l1 = edge(screen[2], screen[0], px, py) / area;
+                float l2 = edge(screen[0], screen[1], px, py) / area;
+                if (l0 < 0 || l1 < 0 || l2 < 0) continue;
+                float z = l0 * screen[0][2] + l1 * screen[1][2] + l2 * screen[2][2];
+                float& d = depth[y * width + x];
+                if (z >= d) continue;
+                d = z;
+                float s = (l0 * shade[0] * inv_w[0] + l1 * shade[1] * inv_w[1] + l2 * shade[2] * inv_w[2]) /
+                          (l0 * inv_w[0] + l1 * inv_w[1] + l2 * inv_w[2]);
+                s = std::max(0.0f, std::min(s, 1.0f));
+                color[y * width + x] = 0xff000000u | std::uint32_t(int(options.color[0] * 255 * s + 0.5f)) |
+                                       std::uint32_t(int(options.color[1] * 255 * s + 0.5f)) << 8 |
+                                       std::uint32_t(int(options.color[2] * 255 * s + 0.5f)) << 16;
+            }
+        }
+    }
+}
+
+// pixels covered by exactly one of the two images (by depth), and the worst depth and color
+// differences where both are covered
+struct image_difference
+{
+    size_t coverage = 0;
+    float depth = 0;
+    int color = 0;
+};
+
+static image_difference compare(const rasterizer& r, const std::vector<float>& depth,
+                                const std::vector<std::uint32_t>& color)
+{
+    image_difference diff;
+    for (size_t y = 0; y < r.height(); ++y) {
+        for (size_t x = 0; x < r.width(); ++x) {
+            float a = r.depth_at(x, y), b = depth[y * r.width() + x];
+            if ((a < 1) != (b < 1)) {
+                ++diff.coverage;
+                continue;
+            }
+            if (a >= 1) continue;
+            diff.depth = std::max(diff.depth, std::fabs(a - b));
+            std::uint32_t ca = r.color_at(x, y), cb = color[y * r.width() + x];
+            for (size_t shift = 0; shift < 24; shift += 8) {
+                diff.color = std::max(diff.color, std::abs(int(ca >> shift & 0xff) - int(cb >> shift & 0xff)));
+            }
+        }
+    }
+    return diff;
+}
+
+// look down -z from the origin
+static packed_matrix4<float> camera(size_t width, size_t height)
+{
+    return perspective_projection(1.0f, float(width) / height, 0.5f, 100);
+}
+
+static size_t covered_pixels(const rasterizer& r)
+{
+    size_t count = 0;
+    for (size_t y = 0; y < r.height(); ++y) {
+        for (size_t x = 0; x < r.width(); ++x) count += r.depth_at(x, y) < 1 ? 1 : 0;
+    }
+    return count;
+}
+
+int main()
+{
+    cout << "**************************************" << endl;
+    cout << "blacker-cglib/test/rasterizer_test.cpp" << endl;
+    cout << "**************************************" << endl;
+
+    cout << std::boolalpha;
+    std::mt19937 rng(50);
+    //////////////////////////////////////////////////////////////////////////////////////////////
+    // test coverage and depth
+    //////////////////////////////////////////////////////////////////////////////////////////////
+    cout << "=======================" << endl;
+    cout << "test coverage and depth" << endl;
+    cout << "=======================" << endl;
+    {
+        // a jittered grid over the whole screen: every pixel center exactly once
+        const size_t width = 203, height = 149;
+        rasterizer r(width, height, 32);
+        mesh grid = grid_mesh(37, 23, 0.3f, false, rng);
+        r.draw(grid, packed_matrix4<float>());
+        cout << "jittered grid of " << grid.triangle_count() << " triangles over " << width << " x " << height
+             << ", fragments [should be " << width * height << "] = " << r.stats().fragments
+             << ", pixels covered [should be " << width * height << "] = " << covered_pixels(r) << endl;
+
+        mesh reversed = grid_mesh(37, 23, 0.3f, true, rng);
+        r.clear();
+        r.draw(reversed, packed_matrix4<float>());
+        size_t culled = r.stats().culled;
+        raster_options both_sides;
+        both_sides.cull_back_faces = false;
+        r.draw(reversed, packed_matrix4<float>(), both_sides);
+        cout << "reversed winding, culled [should be " << reversed.triangle_count() << "] = " << culled
+             << ", fragments without culling [should be " << width * height << "] = " << r.stats().fragments
+             << endl;
+
+        // two overlapping squares at different depths, in both orders
+        float near_square[] = { -0.5f, -0.5f, -0.5f, 0.5f, -0.5f, -0.5f, -0.5f, 0.5f, -0.5f, 0.5f, 0.5f, -0.5f };
+        float far_square[] = { -1, -1, 0.5f, 0, -1, 0.5f, -1, 0, 0.5f, 0, 0, 0.5f };
+        std::uint32_t quad[] = { 0, 1, 2, 1, 3, 2 };
+        mesh near_mesh(near_square, 4, quad, 2), far_mesh(far_square, 4, quad, 2);
+        raster_options red, blue;
+        red.color[1] = red.color[2] = 0;
+        blue.color[0] = blue.color[1] = 0;
+        red.ambient = blue.ambient = 1;
+        bool near_wins = true;
+        for (size_t order = 0; order < 2; ++order) {
+            r.clear();
+            r.draw(order ? far_mesh : near_mesh, packed_matrix4<float>(), order ? blue : red);
+            r.draw(order ? near_mesh : far_mesh, packed_matrix4<float>(), order ? red : blue);
+            // the overlap is red, the rest of the far square blue
+            near_wins = near_wins && r.color_at(width / 2 - 10, height / 2 + 10) == 0xff0000ffu &&
+                        r.color_at(10, height - 10) == 0xffff0000u && r.color_at(width - 10, 10) == 0xff000000u;
+        }
+        cout << "nearer square wins in either order [should be true] = " << near_wins
+             << ", its depth [should be 0.25] = " << r.depth_at(width / 2 - 10, height / 2 + 10) << endl;
+
+        // a floor reaching behind the camera, and a triangle entirely behind it
+        float floor[] = { -50, -1, 20, 50, -1, 20, -50, -1, -90, 50, -1, -90 };
+        std::uint32_t floor_quad[] = { 0, 1, 2, 1, 3, 2 };
+        mesh floor_mesh(floor, 4, floor_quad, 2);
+        r.clear();
+        r.draw(floor_mesh, camera(width, height));
+        size_t clipped = r.stats().clipped;
+        bool bottom_full = true, top_empty = true;
+        for (size_t x = 0; x < width; ++x) {
+            bottom_full = bottom_full && r.depth_at(x, height - 1) < 1;
+            top_empty = top_empty && r.depth_at(x, 0) == 1;
+        }
+        float behind[] = { -1, -1, 5, 1, -1, 5, 0, 1, 5 };
+        std::uint32_t one[] = { 0, 1, 2 };
+        r.clear();
+        r.draw(mesh(behind, 3, one, 1), camera(width, height));
+        cout << "floor through the near plane, clipped [should be 2] = " << clipped << ", bottom row covered "
+             << "[should be true] = " << bottom_full << ", top row empty [should be true] = " << top_empty << endl;
+        cout << "triangle behind the camera, fragments [should be 0] = " << r.stats().fragments << endl;
+
+        // a triangle far beyond the guard band on every side, clipped to it
+        float huge[] = { -1e5f, -1e5f, 0, 1e5f, -1e5f, 0, 0, 1e5f, 0 };
+        r.clear();
+        r.draw(mesh(huge, 3, one, 1), packed_matrix4<float>());
+        cout << "triangle around the screen, clipped [should be 1] = " << r.stats().clipped << ", fragments "
+             << "[should be " << width * height << "] = " << r.stats().fragments << endl;
+
+        // random spheres against the b_vector reference, and 1 against 4 threads
+        const size_t scene_width = 320, scene_height = 240;
+        rasterizer one_thread(scene_width, scene_height, 32), four_threads(scene_width, scene_height, 32);
+        std::vector<float> depth(scene_width * scene_height, 1);
+        std::vector<std::uint32_t> color(scene_width * scene_height, 0xff000000);
+        std::uniform_real_distribution<float> unit(-1.0f, 1.0f);
+        raster_options options, threaded;
+        options.thread_count = 1;
+        options.light_direction[0] = threaded.light_direction[0] = 0.5f;
+        threaded.thread_count = 4;
+        mesh flat = grid_mesh(8, 8, 0.5f, false, rng);
+        for (size_t i = 0; i < 12; ++i) {
+            float center[3] = { 4 * unit(rng), 3 * unit(rng), -10 + 3 * unit(rng) };
+            mesh sphere = sphere_mesh(16, 32, center);
+            matrix<4, 4, float> mvp = camera(scene_width, scene_height).to_matrix();
+            one_thread.draw(sphere, mvp, options);
+            four_threads.draw(sphere, mvp, threaded);
+            reference_draw(sphere, mvp, options, scene_width, scene_height, depth, color);
+        }
+        // and a flat-shaded tilted grid in front of them
+        packed_matrix4<float> tilt;
+        tilt(2, 1) = 0.5f;
+        tilt(2, 3) = -6;
+        packed_matrix4<float> mvp = camera(scene_width, scene_height) * tilt;
+        one_thread.draw(flat, mvp, options);
+        four_threads.draw(flat, mvp, threaded);
+        reference_draw(flat, mvp.to_matrix(), options, scene_width, scene_height, depth, color);
+
+        image_difference diff = compare(one_thread, depth, color);
+        cout << "12 spheres and a grid against b_vector operators, pixels covered differently < 0.2% [should be "
+             << "true] = " << (diff.coverage < scene_width * scene_height / 500) << " (" << diff.coverage << ")"
+             << endl;
+        // the rasterizer snaps vertices to 1/256 pixel, which shows at silhouettes where the planes are steep
+        cout << "  depth error < 1e-4 [should be true] = " << (diff.depth < 1e-4f) << ", color channel error <= 2 "
+             << "[should be true] = " << (diff.color <= 2) << endl;
+        bool same = true;
+        for (size_t y = 0; y < scene_height; ++y) {
+            same = same && std::memcmp(one_thread.colors() + y * one_thread.stride(),
+                                       four_threads.colors() + y * four_threads.stride(), scene_width * 4) == 0 &&
+                   std::memcmp(one_thread.depths() + y * one_thread.stride(),
+                               four_threads.depths() + y * four_threads.stride(), scene_width * 4) == 0;
+        }
+        cout << "1 thread and 4 threads draw the same image [should be true] = " << same << endl;
+    }
+    //////////////////////////////////////////////////////////////////////////////////////////////
+    // test rasterizer performance
+    //////////////////////////////////////////////////////////////////////////////////////////////
+    cout << "===========================" << endl;
+    cout << "test rasterizer performance" << endl;
+    cout << "===========================" << endl;
+    {
+        // a preview frame: a few dense spheres, mostly small triangles
+        const size_t width = 1280, height = 720, frame_count = 5;
+        std::vector<mesh> spheres;
+        size_t triangle_count = 0;
+        for (size_t i = 0; i < 4; ++i) {
+            float center[3] = { -3.3f + 2.2f * i, 0, -6 };
+            spheres.push_back(sphere_mesh(256, 512, center));
+            triangle_count += spheres.back().triangle_count();
+        }
+        packed_matrix4<float> mvp = camera(width, height);
+        matrix<4, 4, float> reference_mvp = mvp.to_matrix();
+        raster_options options;
+
+        std::vector<float> depth(width * height);
+        std::vector<std::uint32_t> color(width * height);
+        auto start = std::chrono::steady_clock::now();
+        for (size_t f = 0; f < frame_count; ++f) {
+            std::fill(depth.begin(), depth.end(), 1.0f);
+            std::fill(color.begin(), color.end(), 0xff000000u);
+            for (const mesh& sphere : spheres) reference_draw(sphere, reference_mvp, options, width, height, depth, color);
+        }
+        double reference_ms = elapsed_ms(start) / frame_count;
+
+        rasterizer r(width, height);
+        options.thread_count = 1;
+        start = std::chrono::steady_clock::now();
+        for (size_t f = 0; f < frame_count; ++f) {
+            r.clear();
+            for (const mesh& sphere : spheres) r.draw(sphere, mvp, options);
+        }
+        double single_ms = elapsed_ms(start) / frame_count;
+        image_difference diff = compare(r, depth, color);
+
+        options.thread_count = 0;
+        start = std::chrono::steady_clock::now();
+        for (size_t f = 0; f < frame_count; ++f) {
+            r.clear();
+            for (const mesh& sphere : spheres) r.draw(sphere, mvp, options);
+        }
+        double threaded_ms = elapsed_ms(start) / frame_count;
+        size_t threads = resolve_thread_count(triangle_count, 0, 1 << 12);
+
+        auto rate = [&](double ms) { return triangle_count / ms / 1000; };
+        cout << triangle_count << " triangles at " << width << " x " << height << ", " << covered_pixels(r)
+             << " pixels covered" << endl;
+        cout << "b_vector reference: " << reference_ms << " ms per frame (" << rate(reference_ms)
+             << " M triangles/s)" << endl;
+        cout << "rasterizer, 1 thread: " << single_ms << " ms per frame (" << rate(single_ms) << " M triangles/s), "
+             << threads << " thread(s): " << threaded_ms << " ms per frame (" << rate(threaded_ms)
+             << " M triangles/s)" << endl;
+        cout << "same image as the reference, pixels covered differently < 0.1% [should be true] = "
+             << (diff.coverage < width * height / 1000) << " (" << diff.coverage << ")" << endl;
+        cout << "faster than the b_vector reference on one thread [should be true] = " << (single_ms < reference_ms)
+             << endl;
+    }
+}
@@ -0,0 +1,171 @@
+#include "mesh/half_edge_mesh.hpp"
+#include "mesh/mesh.hpp"
+#include "mesh/simplify.hpp"
+#include "transforms/matrix/matrix.hpp"
+using namespace bcg;
+
+#include <chrono>
+#include <cmath>
+#include <iostream>
+#include <vector>
+using std::cout;
+using std::endl;
+
+// closed latitude-longitude sphere, welded so the seam and the poles share vertices
+static mesh make_sphere(size_t stacks, size_t slices)
+{
+    const float pi = 3.14159265f;
+    auto corner = [&](std::vector<float>& soup, size_t i, size_t j) {
+        float theta = pi * i / stacks, phi = 2 * pi * (j % slices) / slices;
+        if (i == 0 || i == stacks) phi = 0;
+        soup.push_back(std::sin(theta) * std::cos(phi));
+        soup.push_back(std::sin(theta) * std::sin(phi));
+        soup.push_back(std::cos(theta));
+    };
+    std::vector<float> soup;
+    for (size_t i = 0; i < stacks; ++i) {
+        for (size_t j = 0; j < slices; ++j) {
+            corner(soup, i, j); corner(soup, i + 1, j); corner(soup, i + 1, j + 1);
+            corner(soup, i, j); corner(soup, i + 1, j + 1); corner(soup, i, j + 1);
+        }
+    }
+    return mesh::from_triangle_soup(soup.data(), soup.size() / 9);
+}
+
+// side x side vertex grid in the xy plane
+static mesh make_grid(size_t side)
+{
+    std::vector<float> positions;
+    std::vector<mesh::index_type> triangles;
+    for (size_t y = 0; y < side; ++y) {
+        for (size_t x = 0; x < side; ++x) {
+            positions.push_back(float(x));
+            positions.push_back(float(y));
+            positions.push_back(0.0f);
+            if (x + 1 < side && y + 1 < side) {
+                mesh::index_type v = static_cast<mesh::index_type>(y * side + x);
+                mesh::index_type s = static_cast<mesh::index_type>(side);
+                mesh::index_type quad[6] = { v, v + 1, v + s + 1, v, v + s + 1, v + s };
+                triangles.insert(triangles.end(), quad, quad + 6);
+            }
+        }
+    }
+    return mesh(positions.data(), side * side, triangles.data(), triangles.size() / 3);
+}
+
+// largest distance of a vertex from the unit sphere
+static float sphere_deviation(const mesh& m)
+{
+    float worst = 0;
+    for (size_t v = 0; v < m.vertex_count(); ++v) {
+        float r = std::sqrt(m.x()[v] * m.x()[v] + m.y()[v] * m.y()[v] + m.z()[v] * m.z()[v]);
+        worst = std::max(worst, std::fabs(r - 1));
+    }
+    return worst;
+}
+
+static bool is_closed_manifold(const mesh& m)
+{
+    half_edge_mesh he(m);
+    for (half_edge_mesh::index_type h = 0; h < he.half_edge_count(); ++h) {
+        if (he.is_boundary_half_edge(h)) return false;
+    }
+    long long euler = static_cast<long long>(he.vertex_count()) - static_cast<long long>(he.half_edge_count() / 2) +
+                      static_cast<long long>(he.face_count());
+    return he.non_manifold_edge_count() == 0 && euler == 2;
+}
+
+int main()
+{
+    cout << "************************************" << endl;
+    cout << "blacker-cglib/test/simplify_test.cpp" << endl;
+    cout << "************************************" << endl;
+    //////////////////////////////////////////////////////////////////////////////////////////////
+    // test quadric
+    //////////////////////////////////////////////////////////////////////////////////////////////
+    cout << "============" << endl;
+    cout << "test quadric" << endl;
+    cout << "============" << endl;
+    {
+        // three orthogonal planes through (1, 2, 3)
+        quadric q = quadric::from_plane(1, 0, 0, -1) + quadric::from_plane(0, 1, 0, -2) +
+                    quadric::from_plane(0, 0, 1, -3);
+        double v[3] = { 0, 0, 0 };
+        cout << std::boolalpha;
+        cout << "q.minimiser() succeeds [should be true] = " << q.minimiser(v) << endl;
+        cout << "q.minimiser() [should be (1, 2, 3)] = (" << v[0] << ", " << v[1] << ", " << v[2] << ")" << endl;
+        cout << "q.evaluate(2, 2, 5) [should be 5] = " << q.evaluate(2, 2, 5) << endl;
+
+        matrix<4, 4, double> m = q.to_matrix();
+        matrix<4, 1, double> p = { 2, 2, 5, 1 };
+        cout << "p^T Q p with matrix<4, 4> [should be 5] = " << (p.T() * m * p)[0][0] << endl;
+        cout << "quadric(q.to_matrix()) evaluates the same [should be true] = "
+             << (quadric(m).evaluate(2, 2, 5) == q.evaluate(2, 2, 5)) << endl;
+
+        quadric flat = quadric::from_plane(0, 0, 1, 0);
+        cout << "flat.minimiser() of a single plane [should be false] = " << flat.minimiser(v) << endl;
+    }
+    //////////////////////////////////////////////////////////////////////////////////////////////
+    // test decimation quality
+    //////////////////////////////////////////////////////////////////////////////////////////////
+    cout << "=======================" << endl;
+    cout << "test decimation quality" << endl;
+    cout << "=======================" << endl;
+    {
+        mesh sphere = make_sphere(100, 200);
+        simplify_options options;
+        options.target_triangle_count = sphere.triangle_count() / 20;
+        simplify_stats stats;
+        mesh reduced = simplify(sphere, options, &stats);
+        cout << "sphere: " << stats.triangles_before << " -> " << stats.triangles_after << " triangles" << endl;
+        cout << "reduced.triangle_count() <= target [should be true] = "
+             << (reduced.triangle_count() <= options.target_triangle_count) << endl;
+        cout << "still a closed manifold sphere [should be true] = " << is_closed_manifold(reduced) << endl;
+        cout << "vertices off the unit sphere by less than 0.01 [should be true] = "
+             << (sphere_deviation(reduced) < 0.01f) << " (worst " << sphere_deviation(reduced) << ")" << endl;
+
+        mesh grid = make_grid(50);
+        options.target_triangle_count = 2;
+        mesh plane = simplify(grid, options, &stats);
+        aabb before = grid.bounds(), after = plane.bounds();
+        cout << "flat grid: " << stats.triangles_before << " -> " << stats.triangles_after << " triangles" << endl;
+        bool same_bounds = true;
+        for (size_t d = 0; d < 3; ++d) {
+            same_bounds = same_bounds && before.lower[d] == after.lower[d] && before.upper[d] == after.upper[d];
+        }
+        cout << "boundary kept in place, same bounds [should be true] = " << same_bounds << endl;
+        bool planar = true;
+        for (size_t v = 0; v < plane.vertex_count(); ++v) planar = planar && plane.z()[v] == 0;
+        cout << "still in the z = 0 plane [should be true] = " << planar << endl;
+
+        options.max_error = 1e-6;
+        options.target_triangle_count = 0;
+        mesh bounded = simplify(sphere, options, &stats);
+        cout << "max_error stops early, triangles left > 0 [should be true] = " << (stats.triangles_after > 0)
+             << " (" << stats.triangles_after << ")" << endl;
+    }
+    //////////////////////////////////////////////////////////////////////////////////////////////
+    // test decimation performance
+    //////////////////////////////////////////////////////////////////////////////////////////////
+    cout << "===========================" << endl;
+    cout << "test decimation performance" << endl;
+    cout << "===========================" << endl;
+    {
+        mesh sphere = make_sphere(1000, 1000);
+        simplify_options options;
+        options.target_triangle_count = sphere.triangle_count() / 10;
+        simplify_stats serial_stats, partitioned_stats;
+        mesh serial = simplify(sphere, options, &serial_stats);
+        options.partition_count = 16;
+        mesh partitioned = simplify(sphere, options, &partitioned_stats);
+
+        cout << "partitioned result is a closed manifold [should be true] = " << is_closed_manifold(partitioned) << endl;
+        cout << "partitioned deviation close to serial [should be true] = "
+             << (sphere_deviation(partitioned) < 2 * sphere_deviation(serial) + 1e-4f) << " (serial "
+             << sphere_deviation(serial) << ", partitioned " << sphere_deviation(partitioned) << ")" << endl;
+        cout << serial_stats.triangles_before << " -> " << serial_stats.triangles_after << " triangles, serial: "
+             << serial_stats.seconds << " s, 16 partitions: " << partitioned_stats.seconds << " s ("
+             << partitioned_stats.parallel_collapse_count << " of " << partitioned_stats.collapse_count
+             << " collapses in parallel)" << endl;
+    }
+}
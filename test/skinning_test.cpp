@@ -0,0 +1,273 @@
+#include "mesh/mesh.hpp"
+#include "mesh/skinning.hpp"
+#include "transforms/matrix/matrix.hpp"
+#include "transforms/matrix/packed_matrix.hpp"
+#include "test_timing.hpp"
+using namespace bcg;
+
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <iostream>
+#include <random>
+#include <vector>
+using std::cout;
+using std::endl;
+
+// unit-radius tube along x over [0, length], [rings] rings of [segments] vertices, with normals
+static mesh make_tube(size_t rings, size_t segments, float length)
+{
+    std::vector<float> positions;
+    std::vector<mesh::index_type> indices;
+    for (size_t r = 0; r < rings; ++r) {
+        for (size_t s = 0; s < segments; ++s) {
+            float angle = 6.2831853f * float(s) / float(segments);
+            positions.push_back(length * float(r) / float(rings - 1));
+            positions.push_back(std::cos(angle));
+            positions.push_back(std::sin(angle));
+        }
+    }
+    for (size_t r = 0; r + 1 < rings; ++r) {
+        for (size_t s = 0; s < segments; ++s) {
+            mesh::index_type a = mesh::index_type(r * segments + s);
+            mesh::index_type b = mesh::index_type(r * segments + (s + 1) % segments);
+            mesh::index_type c = mesh::index_type(a + segments), d = mesh::index_type(b + segments);
+            indices.push_back(a); indices.push_back(b); indices.push_back(d);
+            indices.push_back(a); indices.push_back(d); indices.push_back(c);
+        }
+    }
+    mesh tube(positions.data(), positions.size() / 3, indices.data(), indices.size() / 3);
+    tube.compute_normals();
+    return tube;
+}
+
+// rotation by [angle] about the unit axis (x, y, z), then a translation
+static packed_matrix4<float> rigid(float x, float y, float z, float angle, float tx, float ty, float tz)
+{
+    float c = std::cos(angle), s = std::sin(angle), k = 1 - c;
+    packed_matrix4<float> m;
+    m(0, 0) = c + k * x * x;     m(0, 1) = k * x * y - s * z; m(0, 2) = k * x * z + s * y; m(0, 3) = tx;
+    m(1, 0) = k * x * y + s * z; m(1, 1) = c + k * y * y;     m(1, 2) = k * y * z - s * x; m(1, 3) = ty;
+    m(2, 0) = k * x * z - s * y; m(2, 1) = k * y * z + s * x; m(2, 2) = c + k * z * z;     m(2, 3) = tz;
+    return m;
+}
+
+// random rigid bones
+static std::vector<packed_matrix4<float>> make_palette(size_t bone_count, std::mt19937& rng)
+{
+    std::uniform_real_distribution<float> unit(-1.0f, 1.0f);
+    std::vector<packed_matrix4<float>> palette;
+    for (size_t b = 0; b < bone_count; ++b) {
+        float x = unit(rng), y = unit(rng), z = unit(rng);
+        float len = std::sqrt(x * x + y * y + z * z);
+        palette.push_back(rigid(x / len, y / len, z / len, 3 * unit(rng), unit(rng), unit(rng), unit(rng)));
+    }
+    return palette;
+}
+
+// 4 random bones and random weights per vertex, some slots unused
+static void make_influences(size_t vertex_count, size_t bone_count, std::mt19937& rng,
+                            std::vector<skin::bone_index_type>& indices, std::vector<float>& weights)
+{
+    std::uniform_real_distribution<float> unit(0.0f, 1.0f);
+    indices.resize(vertex_count * skin::influence_count);
+    weights.resize(vertex_count * skin::influence_count);
+    for (size_t i = 0; i < indices.size(); ++i) {
+        indices[i] = skin::bone_index_type(rng() % bone_count);
+        weights[i] = (i % skin::influence_count == 3 && rng() % 2 == 0) ? 0.0f : unit(rng);
+    }
+}
+
+// largest distance between the positions of two meshes
+static double position_error(const mesh& a, const mesh& b)
+{
+    double worst = 0;
+    for (size_t i = 0; i < a.vertex_count(); ++i) {
+        double dx = a.x()[i] - b.x()[i], dy = a.y()[i] - b.y()[i], dz = a.z()[i] - b.z()[i];
+        worst = std::max(worst, std::sqrt(dx * dx + dy * dy + dz * dz));
+    }
+    return worst;
+}
+
+int main()
+{
+    cout << "************************************" << endl;
+    cout << "blacker-cglib/test/skinning_test.cpp" << endl;
+    cout << "************************************" << endl;
+
+    cout << std::boolalpha;
+    std::mt19937 rng(44);
+    //////////////////////////////////////////////////////////////////////////////////////////////
+    // test linear blend skinning
+    //////////////////////////////////////////////////////////////////////////////////////////////
+    cout << "==========================" << endl;
+    cout << "test linear blend skinning" << endl;
+    cout << "==========================" << endl;
+    {
+        mesh tube = make_tube(50, 33, 10);
+        const size_t bone_count = 16;
+        std::vector<skin::bone_index_type> indices;
+        std::vector<float> weights;
+        make_influences(tube.vertex_count(), bone_count, rng, indices, weights);
+        skin s(tube, indices.data(), weights.data());
+        cout << "s.bone_count() [should be 16] = " << s.bone_count() << endl;
+
+        mesh out;
+        std::vector<packed_matrix4<float>> identity(bone_count);
+        s.apply_linear(identity.data(), bone_count, out);
+        cout << "identity palette leaves the bind pose, error [should be about 0] = " << position_error(out, tube) << endl;
+
+        // reference in double through the same normalised weights
+        std::vector<packed_matrix4<float>> palette = make_palette(bone_count, rng);
+        cout << "apply_linear() [should be true] = " << s.apply_linear(palette.data(), bone_count, out) << endl;
+        double worst = 0, worst_normal = 0;
+        for (size_t v = 0; v < tube.vertex_count(); ++v) {
+            double sum = 0, blended[12] = {};
+            for (size_t k = 0; k < skin::influence_count; ++k) sum += std::max(0.0f, weights[v * 4 + k]);
+            for (size_t k = 0; k < skin::influence_count; ++k) {
+                for (size_t e = 0; e < 12; ++e) blended[e] += weights[v * 4 + k] / sum * palette[indices[v * 4 + k]].m[e];
+            }
+            double p[3] = { tube.x()[v], tube.y()[v], tube.z()[v] };
+            for (size_t d = 0; d < 3; ++d) {
+                double expected = blended[d * 4] * p[0] + blended[d * 4 + 1] * p[1] + blended[d * 4 + 2] * p[2] +
+                                  blended[d * 4 + 3];
+                double found = d == 0 ? out.x()[v] : d == 1 ? out.y()[v] : out.z()[v];
+                worst = std::max(worst, std::fabs(found - expected));
+            }
+            double len = std::sqrt(double(out.nx()[v]) * out.nx()[v] + double(out.ny()[v]) * out.ny()[v] +
+                                   double(out.nz()[v]) * out.nz()[v]);
+            worst_normal = std::max(worst_normal, std::fabs(len - 1));
+        }
+        cout << "random palette against a double reference, error < 1e-5 [should be true] = " << (worst < 1e-5) << " ("
+             << worst << ")" << endl;
+        cout << "skinned normals are unit length [should be true] = " << (worst_normal < 1e-5) << endl;
+
+        // one bone with a non-uniform scale matches mesh::transform, normals included
+        std::vector<skin::bone_index_type> single_index(tube.vertex_count() * 4, 0);
+        std::vector<float> single_weight(tube.vertex_count() * 4, 0.0f);
+        skin rigid_skin(tube, single_index.data(), single_weight.data());
+        packed_matrix4<float> stretch = rigid(0, 0.6f, 0.8f, 0.7f, 1, 2, 3);
+        for (size_t i = 0; i < 4; ++i) stretch(i, 0) *= 3;
+        rigid_skin.apply_linear(&stretch, 1, out);
+        mesh moved = tube;
+        moved.transform(stretch);
+        double normal_error = 0;
+        for (size_t v = 0; v < tube.vertex_count(); ++v) {
+            normal_error = std::max(normal_error, double(std::fabs(out.nx()[v] - moved.nx()[v])) +
+                                                  std::fabs(out.ny()[v] - moved.ny()[v]) +
+                                                  std::fabs(out.nz()[v] - moved.nz()[v]));
+        }
+        cout << "unweighted vertices follow bone 0 like mesh::transform, error < 1e-5 [should be true] = "
+             << (position_error(out, moved) < 1e-5 && normal_error < 1e-5) << endl;
+        cout << "palette too short, apply_linear() [should be false] = " << s.apply_linear(palette.data(), 3, out) << endl;
+
+        std::vector<matrix<4, 4, float>> matrices;
+        for (const packed_matrix4<float>& m : palette) matrices.push_back(m.to_matrix());
+        mesh from_matrices;
+        s.apply_linear(matrices.data(), bone_count, from_matrices);
+        s.apply_linear(palette.data(), bone_count, out);
+        cout << "matrix<4, 4> palette gives the same result, error [should be 0] = " << position_error(out, from_matrices)
+             << endl;
+    }
+    //////////////////////////////////////////////////////////////////////////////////////////////
+    // test dual quaternion skinning
+    //////////////////////////////////////////////////////////////////////////////////////////////
+    cout << "=============================" << endl;
+    cout << "test dual quaternion skinning" << endl;
+    cout << "=============================" << endl;
+    {
+        mesh tube = make_tube(50, 33, 10);
+        std::vector<packed_matrix4<float>> palette = make_palette(16, rng);
+
+        // single influences: the rigid bone transform exactly, same as linear blending
+        std::vector<skin::bone_index_type> indices(tube.vertex_count() * 4);
+        std::vector<float> weights(tube.vertex_count() * 4, 0.0f);
+        for (size_t v = 0; v < tube.vertex_count(); ++v) {
+            indices[v * 4] = skin::bone_index_type(v % 16);
+            weights[v * 4] = 1;
+        }
+        skin single(tube, indices.data(), weights.data());
+        mesh linear, dual;
+        single.apply_linear(palette.data(), 16, linear);
+        single.apply_dual_quaternion(palette.data(), 16, dual);
+        cout << "single influences match linear skinning, error < 1e-5 [should be true] = "
+             << (position_error(linear, dual) < 1e-5) << " (" << position_error(linear, dual) << ")" << endl;
+
+        // a 120 degree twist about the tube axis, blended half and half along the whole tube:
+        // linear blending shrinks the radius to cos(60) = 0.5, dual quaternions keep it at 1
+        packed_matrix4<float> twist[2] = { packed_matrix4<float>(), rigid(1, 0, 0, 2.0943951f, 0, 0, 0) };
+        for (size_t v = 0; v < tube.vertex_count(); ++v) {
+            indices[v * 4] = 0; indices[v * 4 + 1] = 1;
+            weights[v * 4] = 0.5f; weights[v * 4 + 1] = 0.5f;
+        }
+        skin half(tube, indices.data(), weights.data());
+        half.apply_linear(twist, 2, linear);
+        half.apply_dual_quaternion(twist, 2, dual);
+        float linear_radius = std::sqrt(linear.y()[5] * linear.y()[5] + linear.z()[5] * linear.z()[5]);
+        float dual_radius = std::sqrt(dual.y()[5] * dual.y()[5] + dual.z()[5] * dual.z()[5]);
+        cout << "twisted joint, linear radius [should be 0.5] = " << linear_radius << ", dual quaternion radius "
+             << "[should be 1] = " << dual_radius << endl;
+        float nx = dual.nx()[5], ny = dual.ny()[5], nz = dual.nz()[5];
+        cout << "dual quaternion normal stays radial, |n . p| / |p| [should be 1] = "
+             << std::fabs(ny * dual.y()[5] + nz * dual.z()[5]) / dual_radius << " (n.x " << nx << ")" << endl;
+
+        // the same bone twice, one copy with a negated quaternion, must not cancel out
+        packed_matrix4<float> same[2] = { twist[1], twist[1] };
+        half.apply_dual_quaternion(same, 2, dual);
+        mesh moved = tube;
+        moved.transform(twist[1]);
+        cout << "blending a bone with itself is that bone, error < 1e-5 [should be true] = "
+             << (position_error(dual, moved) < 1e-5) << endl;
+    }
+    //////////////////////////////////////////////////////////////////////////////////////////////
+    // test skinning performance
+    //////////////////////////////////////////////////////////////////////////////////////////////
+    cout << "=========================" << endl;
+    cout << "test skinning performance" << endl;
+    cout << "=========================" << endl;
+    {
+        mesh tube = make_tube(1000, 1000, 100);
+        const size_t bone_count = 64;
+        std::vector<skin::bone_index_type> indices;
+        std::vector<float> weights;
+        make_influences(tube.vertex_count(), bone_count, rng, indices, weights);
+        skin s(tube, indices.data(), weights.data());
+        std::vector<packed_matrix4<float>> palette = make_palette(bone_count, rng);
+        mesh out = tube;
+
+        auto start = std::chrono::steady_clock::now();
+        s.apply_linear(palette.data(), bone_count, out, 1);
+        double linear_ms = elapsed_ms(start);
+        start = std::chrono::steady_clock::now();
+        s.apply_linear(palette.data(), bone_count, out);
+        double linear_threaded_ms = elapsed_ms(start);
+        start = std::chrono::steady_clock::now();
+        s.apply_dual_quaternion(palette.data(), bone_count, out, 1);
+        double dual_ms = elapsed_ms(start);
+        start = std::chrono::steady_clock::now();
+        s.apply_dual_quaternion(palette.data(), bone_count, out);
+        double dual_threaded_ms = elapsed_ms(start);
+        cout << tube.vertex_count() << " vertices with normals, " << bone_count << " bones, linear: " << linear_ms
+             << " ms (" << linear_threaded_ms << " ms threaded), dual quaternion: " << dual_ms << " ms ("
+             << dual_threaded_ms << " ms threaded)" << endl;
+
+        // the same blend through matrix<4, 4> arithmetic, positions only
+        std::vector<matrix<4, 4, float>> matrices;
+        for (const packed_matrix4<float>& m : palette) matrices.push_back(m.to_matrix());
+        const size_t naive_count = 100000;
+        double checksum = 0;
+        start = std::chrono::steady_clock::now();
+        for (size_t v = 0; v < naive_count; ++v) {
+            matrix<4, 4, float> blended;
+            for (size_t k = 0; k < skin::influence_count; ++k) {
+                blended = blended + matrices[indices[v * 4 + k]] * weights[v * 4 + k];
+            }
+            matrix<4, 1, float> p = { tube.x()[v], tube.y()[v], tube.z()[v], 1 };
+            checksum += (blended * p)[0][0];
+        }
+        double naive_ms = elapsed_ms(start);
+        cout << naive_count << " vertices through matrix<4, 4> temporaries: " << naive_ms << " ms (checksum " << checksum
+             << "), the kernel per vertex is " << naive_ms / naive_count / (linear_ms / tube.vertex_count())
+             << "x faster" << endl;
+    }
+}
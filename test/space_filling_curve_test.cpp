@@ -0,0 +1,178 @@
+#include "spatial/kd_tree.hpp"
+#include "spatial/space_filling_curve.hpp"
+#include "transforms/matrix/packed_matrix.hpp"
+#include "test_timing.hpp"
+using namespace bcg;
+
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <iostream>
+#include <random>
+#include <vector>
+using std::cout;
+using std::endl;
+
+// neighbour queries and a transform-then-reduce pass over a point order, returns a checksum
+static double run_locality_benchmark(const char* name, const std::vector<float>& coords)
+{
+    const size_t k = 8;
+    size_t n = coords.size() / 3;
+    kd_tree tree(coords.data(), n);
+
+    std::vector<kd_tree::index_type> neighbours(n * k);
+    std::vector<float> dist2(n * k);
+    auto start = std::chrono::steady_clock::now();
+    tree.knn_batch(coords.data(), n, k, neighbours.data(), dist2.data(), 1);
+    double knn_ms = elapsed_ms(start);
+
+    // transform every point, then average it with its neighbours (a gather over neighbour indices)
+    packed_matrix4<float> trans;
+    trans(0, 3) = 1; trans(1, 3) = 2; trans(2, 3) = 3;
+    trans(0, 0) = 0.5f; trans(1, 1) = 2.0f;
+    std::vector<float> transformed(coords.size());
+    double checksum = 0;
+    start = std::chrono::steady_clock::now();
+    for (size_t i = 0; i < n; ++i) {
+        trans.transform_point(&coords[i * 3], &transformed[i * 3]);
+    }
+    for (size_t i = 0; i < n; ++i) {
+        float sum = 0;
+        for (size_t j = 0; j < k; ++j) {
+            const float* p = &transformed[size_t(neighbours[i * k + j]) * 3];
+            sum += p[0] + p[1] + p[2];
+        }
+        checksum += sum / k;
+    }
+    double reduce_ms = elapsed_ms(start);
+
+    cout << name << ": " << n << " knn queries " << knn_ms << " ms, transform-then-reduce " << reduce_ms
+         << " ms" << endl;
+    return checksum;
+}
+
+int main()
+{
+    cout << "**********************************************" << endl;
+    cout << "blacker-cglib/test/space_filling_curve_test.cpp" << endl;
+    cout << "**********************************************" << endl;
+    //////////////////////////////////////////////////////////////////////////////////////////////
+    // test morton and hilbert codes
+    //////////////////////////////////////////////////////////////////////////////////////////////
+    cout << "=============================" << endl;
+    cout << "test morton and hilbert codes" << endl;
+    cout << "=============================" << endl;
+    {
+        cout << "morton_encode(1, 0, 0) [should be 1] = " << morton_encode(1, 0, 0) << endl;
+        cout << "morton_encode(0, 1, 0) [should be 2] = " << morton_encode(0, 1, 0) << endl;
+        cout << "morton_encode(0, 0, 1) [should be 4] = " << morton_encode(0, 0, 1) << endl;
+        cout << "morton_encode(3, 3, 3) [should be 63] = " << morton_encode(3, 3, 3) << endl;
+
+        // the first 8^3 hilbert codes fill the corner cube, consecutive cells touch
+        std::vector<std::pair<std::uint64_t, std::uint32_t>> cells;
+        for (std::uint32_t x = 0; x < 8; ++x) {
+            for (std::uint32_t y = 0; y < 8; ++y) {
+                for (std::uint32_t z = 0; z < 8; ++z) {
+                    cells.push_back(std::make_pair(hilbert_encode(x, y, z), (x << 8) | (y << 4) | z));
+                }
+            }
+        }
+        std::sort(cells.begin(), cells.end());
+        size_t wrong_code_count = 0, jump_count = 0;
+        for (size_t i = 0; i < cells.size(); ++i) {
+            if (cells[i].first != i) ++wrong_code_count;
+            if (i == 0) continue;
+            int dx = int(cells[i].second >> 8) - int(cells[i - 1].second >> 8);
+            int dy = int((cells[i].second >> 4) & 15) - int((cells[i - 1].second >> 4) & 15);
+            int dz = int(cells[i].second & 15) - int(cells[i - 1].second & 15);
+            if (std::abs(dx) + std::abs(dy) + std::abs(dz) != 1) ++jump_count;
+        }
+        cout << "hilbert codes not in 0..511 [should be 0] = " << wrong_code_count << endl;
+        cout << "hilbert steps between non-adjacent cells [should be 0] = " << jump_count << endl;
+    }
+    //////////////////////////////////////////////////////////////////////////////////////////////
+    // test parallel radix sort
+    //////////////////////////////////////////////////////////////////////////////////////////////
+    cout << "========================" << endl;
+    cout << "test parallel radix sort" << endl;
+    cout << "========================" << endl;
+    {
+        const size_t n = 2000000;
+        std::mt19937_64 rng(5);
+        std::vector<std::uint64_t> keys(n);
+        for (auto& key : keys) key = rng() >> 1;
+        std::vector<std::uint64_t> expected = keys;
+        std::vector<std::uint32_t> indices(n);
+        for (size_t i = 0; i < n; ++i) indices[i] = static_cast<std::uint32_t>(i);
+        std::vector<std::uint64_t> original = keys;
+
+        auto start = std::chrono::steady_clock::now();
+        std::sort(expected.begin(), expected.end());
+        double std_ms = elapsed_ms(start);
+        start = std::chrono::steady_clock::now();
+        parallel_radix_sort(keys, indices);
+        double radix_ms = elapsed_ms(start);
+
+        size_t wrong_count = 0;
+        for (size_t i = 0; i < n; ++i) {
+            if (keys[i] != expected[i] || original[indices[i]] != keys[i]) ++wrong_count;
+        }
+        cout << "wrongly sorted keys [should be 0] = " << wrong_count << endl;
+        cout << n << " keys, std::sort: " << std_ms << " ms, parallel_radix_sort: " << radix_ms << " ms" << endl;
+    }
+    //////////////////////////////////////////////////////////////////////////////////////////////
+    // test reordering and locality
+    //////////////////////////////////////////////////////////////////////////////////////////////
+    cout << "============================" << endl;
+    cout << "test reordering and locality" << endl;
+    cout << "============================" << endl;
+    {
+        // a scan arrives in random order
+        const size_t n = 500000;
+        std::mt19937 rng(9);
+        std::uniform_real_distribution<float> uniform(0.0f, 100.0f);
+        std::vector<point> points;
+        std::vector<float> scanner_coords;
+        for (size_t i = 0; i < n; ++i) {
+            points.push_back(point(uniform(rng), uniform(rng), 0.1f * uniform(rng)));
+            for (size_t d = 0; d < 3; ++d) scanner_coords.push_back(points.back().data()[d]);
+        }
+        std::vector<std::uint32_t> ids(n);
+        for (size_t i = 0; i < n; ++i) ids[i] = static_cast<std::uint32_t>(i);
+
+        std::vector<point> reordered = points;
+        std::vector<std::uint32_t> order = reorder_points(reordered, curve_type::hilbert);
+        std::vector<std::uint32_t> reordered_ids;
+        apply_permutation(ids, order, reordered_ids);
+
+        std::vector<std::uint32_t> sorted_order = order;
+        std::sort(sorted_order.begin(), sorted_order.end());
+        size_t not_permutation = 0, wrong_attribute = 0;
+        for (size_t i = 0; i < n; ++i) {
+            if (sorted_order[i] != i) ++not_permutation;
+            if (reordered_ids[i] != order[i] ||
+                reordered[i].data()[0] != points[reordered_ids[i]].data()[0]) ++wrong_attribute;
+        }
+        cout << "order is not a permutation [should be 0] = " << not_permutation << endl;
+        cout << "attributes not following points [should be 0] = " << wrong_attribute << endl;
+
+        std::vector<float> morton_coords(scanner_coords.size()), hilbert_coords(scanner_coords.size());
+        auto start = std::chrono::steady_clock::now();
+        std::vector<std::uint32_t> morton = spatial_order(scanner_coords.data(), n, curve_type::morton);
+        double morton_ms = elapsed_ms(start);
+        start = std::chrono::steady_clock::now();
+        std::vector<std::uint32_t> hilbert = spatial_order(scanner_coords.data(), n, curve_type::hilbert);
+        double hilbert_ms = elapsed_ms(start);
+        apply_permutation(scanner_coords.data(), 3, morton, morton_coords.data());
+        apply_permutation(scanner_coords.data(), 3, hilbert, hilbert_coords.data());
+        cout << "spatial_order of " << n << " points, morton: " << morton_ms << " ms, hilbert: " << hilbert_ms
+             << " ms" << endl;
+
+        double scanner_sum = run_locality_benchmark("scanner order", scanner_coords);
+        double morton_sum = run_locality_benchmark("morton order ", morton_coords);
+        double hilbert_sum = run_locality_benchmark("hilbert order", hilbert_coords);
+        cout << std::boolalpha << "same reduction in every order [should be true] = "
+             << (std::fabs(scanner_sum - morton_sum) < 1e-6 * std::fabs(scanner_sum) &&
+                 std::fabs(scanner_sum - hilbert_sum) < 1e-6 * std::fabs(scanner_sum)) << endl;
+    }
+}
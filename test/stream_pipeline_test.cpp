@@ -0,0 +1,195 @@
+#include "io/binary_format.hpp"
+#include "io/stream_pipeline.hpp"
+#include "transforms/matrix/matrix.hpp"
+#include "transforms/translation.hpp"
+#include "test_timing.hpp"
+using namespace bcg;
+
+#include <chrono>
+#include <cmath>
+#include <cstdio>
+#include <fstream>
+#include <iostream>
+#include <random>
+#include <vector>
+using std::cout;
+using std::endl;
+
+// plain chunked copy of a file, the disk speed the pipeline is compared against
+static void copy_file(const std::string& src, const std::string& dst, size_t chunk_bytes)
+{
+    std::ifstream in(src, std::ios::binary);
+    std::ofstream out(dst, std::ios::binary | std::ios::trunc);
+    std::vector<char> buffer(chunk_bytes);
+    while (in) {
+        in.read(buffer.data(), static_cast<std::streamsize>(buffer.size()));
+        out.write(buffer.data(), in.gcount());
+    }
+}
+
+int main()
+{
+    cout << "*******************************************" << endl;
+    cout << "blacker-cglib/test/stream_pipeline_test.cpp" << endl;
+    cout << "*******************************************" << endl;
+
+    const std::string in_path = "stream_pipeline_test_in.bcgb";
+    const std::string out_path = "stream_pipeline_test_out.bcgb";
+    const std::string copy_path = "stream_pipeline_test_copy.bcgb";
+    const std::string small_path = "stream_pipeline_test_small.bcgb";
+
+    const size_t n = 4000000;
+    std::mt19937 rng(17);
+    std::uniform_real_distribution<float> uniform(-50.0f, 50.0f);
+    std::vector<float> coords(n * 3);
+    for (auto& c : coords) c = uniform(rng);
+    write_point_file(in_path, coords.data(), n);
+
+    // rotate 90 degrees about z, then shift
+    matrix<4, 4, float> rotation = {
+        0, -1, 0, 0,
+        1, 0, 0, 0,
+        0, 0, 1, 0,
+        0, 0, 0, 1
+    };
+    translation shift(10, 20, 30);
+    //////////////////////////////////////////////////////////////////////////////////////////////
+    // test transform and save
+    //////////////////////////////////////////////////////////////////////////////////////////////
+    cout << "=======================" << endl;
+    cout << "test transform and save" << endl;
+    cout << "=======================" << endl;
+    {
+        stream_pipeline_options options;
+        options.memory_budget = size_t(4) << 20;
+        stream_pipeline pipeline(options);
+        pipeline.transform(rotation).transform(shift);
+
+        stream_pipeline_stats stats;
+        cout << "pipeline.step_count() [should be 1] = " << pipeline.step_count() << endl;
+        cout << "pipeline.run() [should be ok] = " << to_string(pipeline.run(in_path, out_path, &stats)) << endl;
+        cout << "stats.points_written [should be " << n << "] = " << stats.points_written << endl;
+        cout << std::boolalpha << "buffers within the memory budget [should be true] = "
+             << (stats.buffer_bytes <= options.memory_budget) << " (" << stats.chunk_count << " chunks of "
+             << stats.chunk_points << " points)" << endl;
+
+        point_file_view<float> view;
+        view.open(out_path);
+        size_t wrong_count = 0;
+        for (size_t i = 0; i < view.size(); ++i) {
+            const float* p = view.coords(i);
+            point expected(coords[i * 3], coords[i * 3 + 1], coords[i * 3 + 2]);
+            expected = point(-expected.data()[1], expected.data()[0], expected.data()[2]);
+            shift.apply_to(expected);
+            for (size_t d = 0; d < 3; ++d) {
+                if (std::fabs(p[d] - expected.data()[d]) > 1e-4f) ++wrong_count;
+            }
+        }
+        cout << "view.size() [should be " << n << "] = " << view.size() << endl;
+        cout << "coordinates differing from translation::apply_to [should be 0] = " << wrong_count << endl;
+    }
+    //////////////////////////////////////////////////////////////////////////////////////////////
+    // test filters and stages
+    //////////////////////////////////////////////////////////////////////////////////////////////
+    cout << "=======================" << endl;
+    cout << "test filters and stages" << endl;
+    cout << "=======================" << endl;
+    {
+        stream_pipeline_options options;
+        options.memory_budget = size_t(1) << 20;
+        options.buffer_count = 2;
+        stream_pipeline pipeline(options);
+        pipeline.transform(shift)
+                .filter([](const float* p) { return p[2] > 30.0f; })
+                .stage([](float* p, size_t count, size_t stride) {
+                    for (size_t i = 0; i < count; ++i) p[i * stride + 2] *= 2.0f;
+                })
+                .filter([](const float* p) { return p[0] < 10.0f; });
+
+        size_t expected_count = 0;
+        for (size_t i = 0; i < n; ++i) {
+            if (coords[i * 3 + 2] > 0.0f && coords[i * 3] < 0.0f) ++expected_count;
+        }
+
+        stream_pipeline_stats stats;
+        cout << "pipeline.run() [should be ok] = " << to_string(pipeline.run(in_path, out_path, &stats)) << endl;
+        cout << "stats.points_written [should be " << expected_count << "] = " << stats.points_written << endl;
+
+        point_file_view<float> view;
+        view.open(out_path);
+        size_t out_of_range = 0;
+        for (size_t i = 0; i < view.size(); ++i) {
+            const float* p = view.coords(i);
+            if (p[2] <= 60.0f || p[0] >= 10.0f) ++out_of_range;
+        }
+        cout << "view.size() [should be " << expected_count << "] = " << view.size() << endl;
+        cout << "points violating a filter [should be 0] = " << out_of_range << endl;
+        cout << "run on a missing file [should be open failed] = "
+             << to_string(pipeline.run("stream_pipeline_test_missing.bcgb", out_path)) << endl;
+    }
+    //////////////////////////////////////////////////////////////////////////////////////////////
+    // test projective transforms
+    //////////////////////////////////////////////////////////////////////////////////////////////
+    cout << "==========================" << endl;
+    cout << "test projective transforms" << endl;
+    cout << "==========================" << endl;
+    {
+        // w' = z + 1, so xyz points are divided by it and xyzw records keep it
+        matrix<4, 4, float> projective = {
+            2, 0, 0, 1,
+            0, 2, 0, 0,
+            0, 0, 1, 0,
+            0, 0, 1, 1
+        };
+        const float xyz[] = { 1, 2, 3, -4, 0, 1 };
+        const float xyzw[] = { 1, 2, 3, 1, -4, 0, 1, 2 };
+        stream_pipeline pipeline;
+        pipeline.transform(projective);
+
+        point_file_view<float> view;
+        write_point_file(small_path, xyz, 2);
+        cout << "pipeline.run() on xyz [should be ok] = " << to_string(pipeline.run(small_path, out_path)) << endl;
+        view.open(out_path);
+        const float* p = view.coords(0);
+        const float* q = view.coords(1);
+        cout << "xyz points [should be (0.75, 1, 0.75) (-3.5, 0, 0.5)] = (" << p[0] << ", " << p[1] << ", " << p[2]
+             << ") (" << q[0] << ", " << q[1] << ", " << q[2] << ")" << endl;
+        view.close();
+
+        write_point_file(small_path, xyzw, 2, 4);
+        cout << "pipeline.run() on xyzw [should be ok] = " << to_string(pipeline.run(small_path, out_path)) << endl;
+        view.open(out_path);
+        p = view.coords(0);
+        q = view.coords(1);
+        cout << "xyzw records [should be (3, 4, 3, 4) (-6, 0, 1, 3)] = (" << p[0] << ", " << p[1] << ", " << p[2]
+             << ", " << p[3] << ") (" << q[0] << ", " << q[1] << ", " << q[2] << ", " << q[3] << ")" << endl;
+        view.close();
+    }
+    //////////////////////////////////////////////////////////////////////////////////////////////
+    // test throughput against a plain copy
+    //////////////////////////////////////////////////////////////////////////////////////////////
+    cout << "====================================" << endl;
+    cout << "test throughput against a plain copy" << endl;
+    cout << "====================================" << endl;
+    {
+        double megabytes = n * 3 * sizeof(float) / 1048576.0;
+
+        auto start = std::chrono::steady_clock::now();
+        copy_file(in_path, copy_path, size_t(4) << 20);
+        double copy_ms = elapsed_ms(start);
+
+        stream_pipeline pipeline;
+        pipeline.transform(rotation).transform(shift);
+        start = std::chrono::steady_clock::now();
+        pipeline.run(in_path, out_path);
+        double pipeline_ms = elapsed_ms(start);
+
+        cout << megabytes << " MB, plain copy: " << megabytes / (copy_ms / 1000) << " MB/s, transform and save: "
+             << megabytes / (pipeline_ms / 1000) << " MB/s" << endl;
+    }
+
+    std::remove(in_path.c_str());
+    std::remove(out_path.c_str());
+    std::remove(copy_path.c_str());
+    std::remove(small_path.c_str());
+}
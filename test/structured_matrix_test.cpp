@@ -0,0 +1,191 @@
+#include "transforms/b_vector/b_vector.hpp"
+#include "transforms/matrix/matrix.hpp"
+#include "transforms/matrix/structured_matrix.hpp"
+#include "test_timing.hpp"
+using namespace bcg;
+
+#include <chrono>
+#include <cmath>
+#include <iostream>
+#include <random>
+using std::cout;
+using std::endl;
+
+template<size_t row_count, size_t col_count>
+static double max_difference(const matrix<row_count, col_count>& a, const matrix<row_count, col_count>& b)
+{
+    double worst = 0;
+    for (size_t i = 0; i < row_count; ++i) {
+        for (size_t j = 0; j < col_count; ++j) worst = std::max(worst, std::fabs(a[i][j] - b[i][j]));
+    }
+    return worst;
+}
+
+int main()
+{
+    cout << "*********************************************" << endl;
+    cout << "blacker-cglib/test/structured_matrix_test.cpp" << endl;
+    cout << "*********************************************" << endl;
+
+    matrix<3> general = {
+        2, -1, 4,
+        0, 3, 1,
+        5, 2, -2
+    };
+    cout << std::boolalpha;
+    //////////////////////////////////////////////////////////////////////////////////////////////
+    // test diagonal matrix
+    //////////////////////////////////////////////////////////////////////////////////////////////
+    cout << "====================" << endl;
+    cout << "test diagonal matrix" << endl;
+    cout << "====================" << endl;
+    {
+        diagonal_matrix<3> scale = { 2, 4, 0.5 };
+        cout << "diagonal_matrix<3> scale = " << endl << scale << endl;
+        cout << "scale.determinant() [should be 4] = " << scale.determinant() << endl;
+        cout << "scale.inverse() * scale is the identity [should be true] = "
+             << (max_difference((scale.inverse() * scale).to_matrix(), make_identity_matrix<3>()) == 0) << endl;
+        cout << "scale * general matches the full product [should be true] = "
+             << (max_difference(scale * general, scale.to_matrix() * general) == 0) << endl;
+        cout << "general * scale matches the full product [should be true] = "
+             << (max_difference(general * scale, general * scale.to_matrix()) == 0) << endl;
+        cout << "general + scale matches the full sum [should be true] = "
+             << (max_difference(general + scale, general + scale.to_matrix()) == 0) << endl;
+        cout << "scale.solve({ 2, 8, 1 }) [should be (1, 2, 2)] = " << scale.solve({ 2, 8, 1 }) << endl;
+        cout << "diagonal_matrix<3>(general) keeps [should be (2, 3, -2)] = "
+             << diagonal_matrix<3>(general) * b_vector<3>({ 1, 1, 1 }) << endl;
+    }
+    //////////////////////////////////////////////////////////////////////////////////////////////
+    // test symmetric matrix
+    //////////////////////////////////////////////////////////////////////////////////////////////
+    cout << "=====================" << endl;
+    cout << "test symmetric matrix" << endl;
+    cout << "=====================" << endl;
+    {
+        symmetric_matrix<3> cov = {
+            4, 1, 2,
+               5, 3,
+                  6
+        };
+        matrix<3> full = cov.to_matrix();
+        cout << "symmetric_matrix<3> cov = " << endl << cov << endl;
+        cout << "cov.determinant() [should be " << full.determinant() << "] = " << cov.determinant() << endl;
+        cout << "cov.inverse() matches matrix::inverse() [should be true] = "
+             << (max_difference(cov.inverse().to_matrix(), full.inverse()) < 1e-12) << endl;
+        b_vector<3> v = { 1, -2, 3 };
+        cout << "cov * v [should be " << static_cast<b_vector<3>>(full * static_cast<matrix<3, 1>>(v)) << "] = "
+             << cov * v << endl;
+        cout << "cov.quadratic_form(v) [should be " << (v, cov * v) << "] = " << cov.quadratic_form(v) << endl;
+        cout << "cov * general matches the full product [should be true] = "
+             << (max_difference(cov * general, full * general) == 0) << endl;
+        cout << "general - cov matches the full difference [should be true] = "
+             << (max_difference(general - cov, general - full) == 0) << endl;
+        b_vector<3> x = cov.solve(v);
+        cout << "cov * cov.solve(v) [should be " << v << "] = " << cov * x << endl;
+
+        // a 6x6 normal matrix, beyond what matrix::determinant() covers
+        std::mt19937 rng(37);
+        std::uniform_real_distribution<double> unit(-1.0, 1.0);
+        matrix<6> m;
+        for (size_t i = 0; i < 6; ++i) {
+            for (size_t j = 0; j < 6; ++j) m[i][j] = unit(rng);
+        }
+        symmetric_matrix<6> normal(m.T() * m + make_identity_matrix<6>());
+        cout << "normal * normal.inverse() is the identity [should be true] = "
+             << (max_difference(normal * normal.inverse().to_matrix(), make_identity_matrix<6>()) < 1e-12) << endl;
+
+        // indefinite with a zero leading pivot, LDL^T needs the pivoting fallback
+        symmetric_matrix<2> swap = { 0, 1, 0 };
+        cout << "swap.determinant() [should be -1] = " << swap.determinant() << endl;
+        cout << "swap.inverse() [should be swap] = " << endl << swap.inverse() << endl;
+
+        // and with a tiny nonzero one, where LDL^T would divide by it and lose the rest
+        symmetric_matrix<2> tiny = { 1e-17, 1, 1 };
+        b_vector<2> tiny_x = tiny.solve(b_vector<2>({ 1, 2 }));
+        symmetric_matrix<2> tiny_inverse = tiny.inverse();
+        cout << "tiny.solve({ 1, 2 }) [should be about (1, 1)] = (" << tiny_x[0] << ", " << tiny_x[1] << ")" << endl;
+        cout << "tiny.inverse() [should be about { -1, 1, -1e-17 }] = " << endl << tiny_inverse << endl;
+        cout << "tiny.determinant() [should be about -1] = " << tiny.determinant() << endl;
+        cout << "tiny * tiny.inverse() is the identity [should be true] = "
+             << (max_difference(tiny * tiny_inverse.to_matrix(), make_identity_matrix<2>()) < 1e-12) << endl;
+    }
+    //////////////////////////////////////////////////////////////////////////////////////////////
+    // test triangular matrix
+    //////////////////////////////////////////////////////////////////////////////////////////////
+    cout << "======================" << endl;
+    cout << "test triangular matrix" << endl;
+    cout << "======================" << endl;
+    {
+        triangular_matrix<3, triangle_kind::lower> l = {
+            2,
+            1, 3,
+            -1, 4, 5
+        };
+        triangular_matrix<3, triangle_kind::upper> u = l.transpose();
+        cout << "triangular_matrix<3, lower> l = " << endl << l << endl;
+        cout << "l.transpose() = " << endl << u << endl;
+        cout << "l.determinant() [should be 30] = " << l.determinant() << endl;
+        cout << "l * u matches the full product [should be true] = "
+             << (max_difference(l * u.to_matrix(), l.to_matrix() * u.to_matrix()) == 0) << endl;
+        cout << "l * l stays lower and matches [should be true] = "
+             << (max_difference((l * l).to_matrix(), l.to_matrix() * l.to_matrix()) == 0) << endl;
+        cout << "general * u matches the full product [should be true] = "
+             << (max_difference(general * u, general * u.to_matrix()) == 0) << endl;
+        cout << "l.inverse() matches matrix::inverse() [should be true] = "
+             << (max_difference(l.inverse().to_matrix(), l.to_matrix().inverse()) < 1e-12) << endl;
+        cout << "u.inverse() matches matrix::inverse() [should be true] = "
+             << (max_difference(u.inverse().to_matrix(), u.to_matrix().inverse()) < 1e-12) << endl;
+        b_vector<3> rhs = { 2, 7, 8 };
+        cout << "l.solve({ 2, 7, 8 }) [should be (1, 2, 0.2)] = " << l.solve(rhs) << endl;
+        cout << "u * u.solve({ 2, 7, 8 }) [should be (2, 7, 8)] = " << u * u.solve(rhs) << endl;
+        cout << "l.get_cell(0, 2) outside the triangle [should be 0] = " << l.get_cell(0, 2) << endl;
+    }
+    //////////////////////////////////////////////////////////////////////////////////////////////
+    // test structured matrix performance
+    //////////////////////////////////////////////////////////////////////////////////////////////
+    cout << "==================================" << endl;
+    cout << "test structured matrix performance" << endl;
+    cout << "==================================" << endl;
+    {
+        const size_t rounds = 1000000;
+        symmetric_matrix<3> cov = { 4, 1, 2, 5, 3, 6 };
+        matrix<3> full = cov.to_matrix();
+        b_vector<3> v = { 1, -2, 3 };
+
+        auto start = std::chrono::steady_clock::now();
+        double sum = 0;
+        for (size_t i = 0; i < rounds; ++i) {
+            v[0] = double(i);
+            sum += cov.solve(v)[0];
+        }
+        double structured_ms = elapsed_ms(start);
+        start = std::chrono::steady_clock::now();
+        double full_sum = 0;
+        for (size_t i = 0; i < rounds; ++i) {
+            v[0] = double(i);
+            full_sum += static_cast<b_vector<3>>(full.inverse() * static_cast<matrix<3, 1>>(v))[0];
+        }
+        double full_ms = elapsed_ms(start);
+        cout << "same solutions [should be true] = " << (std::fabs(sum - full_sum) < 1e-6 * std::fabs(sum)) << endl;
+        cout << rounds << " 3x3 solves, symmetric_matrix::solve: " << structured_ms
+             << " ms, matrix::inverse() * v: " << full_ms << " ms" << endl;
+
+        diagonal_matrix<4> scale = { 2, 3, 4, 1 };
+        matrix<4> dense = make_identity_matrix<4>();
+        matrix<4> scale_full = scale.to_matrix();
+        start = std::chrono::steady_clock::now();
+        for (size_t i = 0; i < rounds; ++i) {
+            dense[0][3] = double(i);
+            sum += (scale * dense)[0][3];
+        }
+        structured_ms = elapsed_ms(start);
+        start = std::chrono::steady_clock::now();
+        for (size_t i = 0; i < rounds; ++i) {
+            dense[0][3] = double(i);
+            sum += (scale_full * dense)[0][3];
+        }
+        full_ms = elapsed_ms(start);
+        cout << rounds << " 4x4 scalings, diagonal_matrix * matrix: " << structured_ms
+             << " ms, matrix * matrix: " << full_ms << " ms (checksum " << sum << ")" << endl;
+    }
+}
@@ -0,0 +1,183 @@
+#include "transforms/b_vector/b_vector.hpp"
+#include "transforms/matrix/matrix.hpp"
+#include "transforms/matrix/svd.hpp"
+#include "test_timing.hpp"
+using namespace bcg;
+
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <iostream>
+#include <random>
+#include <vector>
+using std::cout;
+using std::endl;
+
+// largest |U S V^T - A| relative to the largest |A| element, and |U^T U - I|, |V^T V - I|
+static double decomposition_error(const matrix<3>& a, const svd<double>& d)
+{
+    double scale = 0, worst = 0;
+    for (size_t i = 0; i < 3; ++i) {
+        for (size_t j = 0; j < 3; ++j) scale = std::max(scale, std::fabs(a[i][j]));
+    }
+    for (size_t i = 0; i < 3; ++i) {
+        for (size_t j = 0; j < 3; ++j) {
+            double usv = 0, utu = 0, vtv = 0;
+            for (size_t k = 0; k < 3; ++k) {
+                usv += d.u[i][k] * d.singular_values[k] * d.v[j][k];
+                utu += d.u[k][i] * d.u[k][j];
+                vtv += d.v[k][i] * d.v[k][j];
+            }
+            worst = std::max(worst, std::fabs(usv - a[i][j]) / (scale > 0 ? scale : 1));
+            worst = std::max(worst, std::fabs(utu - (i == j ? 1 : 0)));
+            worst = std::max(worst, std::fabs(vtv - (i == j ? 1 : 0)));
+        }
+    }
+    return worst;
+}
+
+// rotation by [angle] about the unit axis (x, y, z)
+static matrix<3> axis_angle(double x, double y, double z, double angle)
+{
+    double c = std::cos(angle), s = std::sin(angle), k = 1 - c;
+    matrix<3> r = {
+        c + k * x * x, k * x * y - s * z, k * x * z + s * y,
+        k * x * y + s * z, c + k * y * y, k * y * z - s * x,
+        k * x * z - s * y, k * y * z + s * x, c + k * z * z
+    };
+    return r;
+}
+
+int main()
+{
+    cout << "*******************************" << endl;
+    cout << "blacker-cglib/test/svd_test.cpp" << endl;
+    cout << "*******************************" << endl;
+
+    cout << std::boolalpha;
+    std::mt19937 rng(40);
+    std::uniform_real_distribution<double> unit(-1.0, 1.0);
+    //////////////////////////////////////////////////////////////////////////////////////////////
+    // test svd
+    //////////////////////////////////////////////////////////////////////////////////////////////
+    cout << "========" << endl;
+    cout << "test svd" << endl;
+    cout << "========" << endl;
+    {
+        matrix<3> a = {
+            3, 0, 0,
+            0, -2, 0,
+            0, 0, 1
+        };
+        svd<double> d = svd_decompose(a);
+        cout << "svd_decompose(diag(3, -2, 1)).singular_values [should be (3, 2, 1)] = " << d.singular_values << endl;
+        cout << "det(u) carries the sign of det(a) [should be -1] = " << d.u.determinant() << endl;
+        cout << "det(v) [should be 1] = " << d.v.determinant() << endl;
+
+        double worst = 0;
+        bool ordered = true;
+        for (size_t s = 0; s < 100000; ++s) {
+            matrix<3> m;
+            for (size_t i = 0; i < 3; ++i) {
+                for (size_t j = 0; j < 3; ++j) m[i][j] = unit(rng);
+            }
+            d = svd_decompose(m);
+            worst = std::max(worst, decomposition_error(m, d));
+            ordered = ordered && d.singular_values[0] >= d.singular_values[1] && d.singular_values[1] >= d.singular_values[2] &&
+                      d.singular_values[2] >= 0;
+        }
+        cout << "100000 random matrices, worst error < 1e-12 [should be true] = " << (worst < 1e-12) << " (" << worst
+             << ")" << endl;
+        cout << "singular values descending and non-negative [should be true] = " << ordered << endl;
+    }
+    //////////////////////////////////////////////////////////////////////////////////////////////
+    // test rank-deficient svd
+    //////////////////////////////////////////////////////////////////////////////////////////////
+    cout << "======================" << endl;
+    cout << "test rank-deficient svd" << endl;
+    cout << "======================" << endl;
+    {
+        matrix<3> rank_two = { 1, 2, 3, 4, 5, 6, 7, 8, 9 };
+        svd<double> d = svd_decompose(rank_two);
+        cout << "rank two singular values [should be (16.8481, 1.06837, ~0)] = " << d.singular_values << endl;
+        cout << "rank two error < 1e-12 [should be true] = " << (decomposition_error(rank_two, d) < 1e-12) << endl;
+
+        matrix<3> rank_one = { 1, 2, 2, 2, 4, 4, -1, -2, -2 };
+        d = svd_decompose(rank_one);
+        cout << "rank one singular values [should be (" << std::sqrt(54.0) << ", 0, 0)] = " << d.singular_values << endl;
+        cout << "rank one error < 1e-12 [should be true] = " << (decomposition_error(rank_one, d) < 1e-12) << endl;
+
+        d = svd_decompose(matrix<3>());
+        cout << "zero matrix error [should be 0] = " << decomposition_error(matrix<3>(), d) << endl;
+
+        double worst = 0;
+        for (size_t s = 0; s < 10000; ++s) {
+            // rank two from two random outer products
+            double x[3] = { unit(rng), unit(rng), unit(rng) }, y[3] = { unit(rng), unit(rng), unit(rng) };
+            double z[3] = { unit(rng), unit(rng), unit(rng) }, w[3] = { unit(rng), unit(rng), unit(rng) };
+            matrix<3> m;
+            for (size_t i = 0; i < 3; ++i) {
+                for (size_t j = 0; j < 3; ++j) m[i][j] = x[i] * y[j] + z[i] * w[j];
+            }
+            worst = std::max(worst, decomposition_error(m, svd_decompose(m)));
+        }
+        cout << "10000 rank two matrices, worst error < 1e-12 [should be true] = " << (worst < 1e-12) << " (" << worst
+             << ")" << endl;
+    }
+    //////////////////////////////////////////////////////////////////////////////////////////////
+    // test nearest rotation
+    //////////////////////////////////////////////////////////////////////////////////////////////
+    cout << "=====================" << endl;
+    cout << "test nearest rotation" << endl;
+    cout << "=====================" << endl;
+    {
+        matrix<3> r = axis_angle(0, 0.6, 0.8, 1.1);
+        matrix<3> stretched = r * matrix<3>({ 2, 0, 0, 0, 0.5, 0, 0, 0, 3 });
+        matrix<3> back = nearest_rotation(stretched);
+        double error = 0;
+        for (size_t i = 0; i < 3; ++i) {
+            for (size_t j = 0; j < 3; ++j) error = std::max(error, std::fabs(back[i][j] - r[i][j]));
+        }
+        cout << "nearest_rotation(r * symmetric positive) recovers r [should be true] = " << (error < 1e-12) << endl;
+
+        // Kabsch: sum q p^T over points q = r p
+        std::vector<double> points(30);
+        for (double& c : points) c = unit(rng);
+        matrix<3> h;
+        for (size_t k = 0; k < 10; ++k) {
+            double p[3] = { points[k * 3], points[k * 3 + 1], points[k * 3 + 2] }, q[3];
+            for (size_t i = 0; i < 3; ++i) q[i] = r[i][0] * p[0] + r[i][1] * p[1] + r[i][2] * p[2];
+            for (size_t i = 0; i < 3; ++i) {
+                for (size_t j = 0; j < 3; ++j) h[i][j] += q[i] * p[j];
+            }
+        }
+        back = nearest_rotation(h);
+        error = 0;
+        for (size_t i = 0; i < 3; ++i) {
+            for (size_t j = 0; j < 3; ++j) error = std::max(error, std::fabs(back[i][j] - r[i][j]));
+        }
+        cout << "Kabsch on exact correspondences recovers r [should be true] = " << (error < 1e-12) << endl;
+
+        matrix<3> mirror = { 1, 0, 0, 0, 1, 0, 0, 0, -1 };
+        cout << "nearest_rotation(mirror) is a rotation, det [should be 1] = " << nearest_rotation(mirror).determinant()
+             << endl;
+    }
+    //////////////////////////////////////////////////////////////////////////////////////////////
+    // test svd performance
+    //////////////////////////////////////////////////////////////////////////////////////////////
+    cout << "====================" << endl;
+    cout << "test svd performance" << endl;
+    cout << "====================" << endl;
+    {
+        const size_t rounds = 1000000;
+        std::vector<double> packed(rounds * 9);
+        for (double& c : packed) c = unit(rng);
+        double u[9], singular_values[3], v[9], checksum = 0;
+        auto start = std::chrono::steady_clock::now();
+        for (size_t s = 0; s < rounds; ++s) {
+            svd_detail::decompose(&packed[s * 9], u, singular_values, v);
+            checksum += singular_values[2];
+        }
+        cout << rounds << " 3x3 svds: " << elapsed_ms(start) << " ms (checksum " << checksum << ")" << endl;
+    }
+}
@@ -0,0 +1,167 @@
+#include "transforms/b_vector/b_vector.hpp"
+#include "transforms/matrix/matrix.hpp"
+#include "transforms/matrix/structured_matrix.hpp"
+#include "transforms/matrix/symmetric_eigen.hpp"
+#include "test_timing.hpp"
+using namespace bcg;
+
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <iostream>
+#include <random>
+#include <vector>
+using std::cout;
+using std::endl;
+
+// largest |A v - lambda v| and |V^T V - I|, relative to the largest |A| element
+static double decomposition_error(const matrix<3>& a, const symmetric_eigen<double>& e)
+{
+    double scale = 0, worst = 0;
+    for (size_t i = 0; i < 3; ++i) {
+        for (size_t j = 0; j < 3; ++j) scale = std::max(scale, std::fabs(a[i][j]));
+    }
+    for (size_t k = 0; k < 3; ++k) {
+        for (size_t i = 0; i < 3; ++i) {
+            double av = 0;
+            for (size_t j = 0; j < 3; ++j) av += a[i][j] * e.vectors[j][k];
+            worst = std::max(worst, std::fabs(av - e.values[k] * e.vectors[i][k]) / (scale > 0 ? scale : 1));
+        }
+        for (size_t l = 0; l < 3; ++l) {
+            double d = 0;
+            for (size_t i = 0; i < 3; ++i) d += e.vectors[i][k] * e.vectors[i][l];
+            worst = std::max(worst, std::fabs(d - (k == l ? 1 : 0)));
+        }
+    }
+    return worst;
+}
+
+// R diag(d) R^T for a random rotation R
+static matrix<3> with_eigenvalues(std::mt19937& rng, double d0, double d1, double d2)
+{
+    std::normal_distribution<double> gauss;
+    double q[4] = { gauss(rng), gauss(rng), gauss(rng), gauss(rng) };
+    double len = std::sqrt(q[0] * q[0] + q[1] * q[1] + q[2] * q[2] + q[3] * q[3]);
+    double w = q[0] / len, x = q[1] / len, y = q[2] / len, z = q[3] / len;
+    matrix<3> r = {
+        1 - 2 * (y * y + z * z), 2 * (x * y - w * z), 2 * (x * z + w * y),
+        2 * (x * y + w * z), 1 - 2 * (x * x + z * z), 2 * (y * z - w * x),
+        2 * (x * z - w * y), 2 * (y * z + w * x), 1 - 2 * (x * x + y * y)
+    };
+    matrix<3> d = { d0, 0, 0, 0, d1, 0, 0, 0, d2 };
+    return r * d * r.T();
+}
+
+int main()
+{
+    cout << "*******************************************" << endl;
+    cout << "blacker-cglib/test/symmetric_eigen_test.cpp" << endl;
+    cout << "*******************************************" << endl;
+
+    cout << std::boolalpha;
+    std::mt19937 rng(39);
+    //////////////////////////////////////////////////////////////////////////////////////////////
+    // test eigen decomposition
+    //////////////////////////////////////////////////////////////////////////////////////////////
+    cout << "========================" << endl;
+    cout << "test eigen decomposition" << endl;
+    cout << "========================" << endl;
+    {
+        matrix<3> diagonal = { 3, 0, 0, 0, 1, 0, 0, 0, 2 };
+        symmetric_eigen<double> e = eigen_decompose(diagonal);
+        cout << "eigen_decompose(diag(3, 1, 2)).values [should be (1, 2, 3)] = " << e.values << endl;
+        cout << "vectors = " << endl << e.vectors << endl;
+
+        symmetric_matrix<3> cov = { 2, 1, 0, 2, 0, 5 };
+        e = eigen_decompose(cov);
+        cout << "eigen_decompose(cov).values [should be (1, 3, 5)] = " << e.values << endl;
+        cout << "cov decomposition error < 1e-14 [should be true] = " << (decomposition_error(cov.to_matrix(), e) < 1e-14)
+             << endl;
+
+        std::uniform_real_distribution<double> unit(-1.0, 1.0);
+        double worst = 0, worst_det = 0;
+        for (size_t s = 0; s < 100000; ++s) {
+            matrix<3> a;
+            for (size_t i = 0; i < 3; ++i) {
+                for (size_t j = i; j < 3; ++j) a[i][j] = a[j][i] = unit(rng);
+            }
+            e = eigen_decompose(a);
+            worst = std::max(worst, decomposition_error(a, e));
+            worst_det = std::max(worst_det, std::fabs(e.vectors.determinant() - 1));
+            if (e.values[0] > e.values[1] || e.values[1] > e.values[2]) worst = 1;
+        }
+        cout << "100000 random matrices, worst error < 1e-13 [should be true] = " << (worst < 1e-13) << " (" << worst
+             << ")" << endl;
+        cout << "vectors always a rotation [should be true] = " << (worst_det < 1e-13) << endl;
+    }
+    //////////////////////////////////////////////////////////////////////////////////////////////
+    // test degenerate spectra
+    //////////////////////////////////////////////////////////////////////////////////////////////
+    cout << "=======================" << endl;
+    cout << "test degenerate spectra" << endl;
+    cout << "=======================" << endl;
+    {
+        matrix<3> scaled_identity = { 5, 0, 0, 0, 5, 0, 0, 0, 5 };
+        symmetric_eigen<double> e = eigen_decompose(scaled_identity);
+        cout << "5 I values [should be (5, 5, 5)] = " << e.values << endl;
+        cout << "zero matrix values [should be (0, 0, 0)] = " << eigen_decompose(matrix<3>()).values << endl;
+
+        double worst = 0;
+        for (size_t s = 0; s < 10000; ++s) {
+            // a double eigenvalue, a nearly double one, rank one, and a tiny spread around a large mean
+            matrix<3> cases[4] = {
+                with_eigenvalues(rng, 1, 1, 4),
+                with_eigenvalues(rng, -2, 3, 3 + 1e-9),
+                with_eigenvalues(rng, 0, 0, 7),
+                with_eigenvalues(rng, 1e6, 1e6 + 1e-3, 1e6 + 2e-3)
+            };
+            for (size_t c = 0; c < 4; ++c) worst = std::max(worst, decomposition_error(cases[c], eigen_decompose(cases[c])));
+        }
+        cout << "repeated and clustered eigenvalues, worst error < 1e-12 [should be true] = " << (worst < 1e-12) << " ("
+             << worst << ")" << endl;
+
+        matrix<3> planar = with_eigenvalues(rng, 0, 2, 3);
+        e = eigen_decompose(planar);
+        cout << "smallest eigenvalue of a flat covariance [should be about 0] = " << e.values[0] << endl;
+
+        matrix<3, 3, float> single = { 4, 2, 0, 2, 1, 0, 0, 0, 0 };
+        symmetric_eigen<float> f = eigen_decompose(single);
+        cout << "float rank one values [should be (0, 0, 5)] = " << f.values << endl;
+    }
+    //////////////////////////////////////////////////////////////////////////////////////////////
+    // test eigen decomposition performance
+    //////////////////////////////////////////////////////////////////////////////////////////////
+    cout << "====================================" << endl;
+    cout << "test eigen decomposition performance" << endl;
+    cout << "====================================" << endl;
+    {
+        const size_t rounds = 1000000;
+        std::uniform_real_distribution<double> unit(-1.0, 1.0);
+        std::vector<double> uppers(rounds * 6);
+        for (double& u : uppers) u = unit(rng);
+
+        double values[3], vectors[9], checksum = 0;
+        auto start = std::chrono::steady_clock::now();
+        for (size_t s = 0; s < rounds; ++s) {
+            symmetric_eigen_detail::decompose(&uppers[s * 6], values, vectors);
+            checksum += values[0];
+        }
+        double closed_ms = elapsed_ms(start);
+
+        // Jacobi alone, from the identity
+        start = std::chrono::steady_clock::now();
+        double jacobi_checksum = 0;
+        for (size_t s = 0; s < rounds; ++s) {
+            const double* u = &uppers[s * 6];
+            double d[3][3] = { { u[0], u[1], u[2] }, { u[1], u[3], u[4] }, { u[2], u[4], u[5] } };
+            double v[3][3] = { { 1, 0, 0 }, { 0, 1, 0 }, { 0, 0, 1 } };
+            symmetric_eigen_detail::jacobi(d, v, 32);
+            jacobi_checksum += std::min(d[0][0], std::min(d[1][1], d[2][2]));
+        }
+        double jacobi_ms = elapsed_ms(start);
+        cout << "same smallest eigenvalues [should be true] = "
+             << (std::fabs(checksum - jacobi_checksum) < 1e-9 * std::fabs(checksum)) << endl;
+        cout << rounds << " decompositions, closed form + Jacobi polish: " << closed_ms << " ms, Jacobi alone: "
+             << jacobi_ms << " ms" << endl;
+    }
+}
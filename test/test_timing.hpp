@@ -0,0 +1,12 @@
+#ifndef BCG_TEST_TIMING_HPP
+#define BCG_TEST_TIMING_HPP
+
+#include <chrono>
+
+// milliseconds since [since], for the timing lines the tests print
+inline double elapsed_ms(std::chrono::steady_clock::time_point since)
+{
+    return std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - since).count();
+}
+
+#endif // BCG_TEST_TIMING_HPP
@@ -0,0 +1,295 @@
+#include "io/text_format.hpp"
+#include "transforms/point.hpp"
+#include "test_timing.hpp"
+using namespace bcg;
+
+#include <chrono>
+#include <cstdio>
+#include <cstring>
+#include <fstream>
+#include <iostream>
+#include <random>
+#include <string>
+#include <vector>
+using std::cout;
+using std::endl;
+
+static std::string formatted(float value, int digits = 9)
+{
+    char buffer[32];
+    return std::string(buffer, format_float(value, buffer, digits));
+}
+
+static float parsed(const char* text)
+{
+    float value = -12345;
+    parse_float(text, text + std::strlen(text), value);
+    return value;
+}
+
+static void write_text(const std::string& path, const char* text)
+{
+    std::ofstream out(path, std::ios::binary);
+    out << text;
+}
+
+int main()
+{
+    cout << "***************************************" << endl;
+    cout << "blacker-cglib/test/text_format_test.cpp" << endl;
+    cout << "***************************************" << endl;
+
+    const std::string xyz_path = "text_format_test.xyz";
+    const std::string obj_path = "text_format_test.obj";
+    const std::string ply_path = "text_format_test.ply";
+    //////////////////////////////////////////////////////////////////////////////////////////////
+    // test number conversion
+    //////////////////////////////////////////////////////////////////////////////////////////////
+    cout << "======================" << endl;
+    cout << "test number conversion" << endl;
+    cout << "======================" << endl;
+    {
+        cout << "parsed(\"3.25\") [should be 3.25] = " << parsed("3.25") << endl;
+        cout << "parsed(\"-1.5e-3\") [should be -0.0015] = " << parsed("-1.5e-3") << endl;
+        cout << "parsed(\".5E2\") [should be 50] = " << parsed(".5E2") << endl;
+        cout << "parsed(\"7e\") [should be 7] = " << parsed("7e") << endl;
+        cout << "parsed(\"-inf\") [should be -inf] = " << parsed("-inf") << endl;
+        cout << "parsed(\"x1\") [should be -12345] = " << parsed("x1") << endl;
+        cout << "formatted(0.1f) [should be 0.100000001] = " << formatted(0.1f) << endl;
+        cout << "formatted(0.1f, 7) [should be 0.1] = " << formatted(0.1f, 7) << endl;
+        cout << "formatted(-2.5e-7f, 6) [should be -2.5e-07] = " << formatted(-2.5e-7f, 6) << endl;
+        cout << "formatted(1e10f) [should be 1e+10] = " << formatted(1e10f) << endl;
+        cout << "formatted(123456.5f) [should be 123456.5] = " << formatted(123456.5f) << endl;
+        cout << "formatted(1024.0f) [should be 1024] = " << formatted(1024.0f) << endl;
+
+        // random bit patterns cover every exponent and denormals
+        const size_t n = 2000000;
+        std::mt19937 rng(21);
+        std::vector<float> values;
+        while (values.size() < n) {
+            std::uint32_t bits = static_cast<std::uint32_t>(rng());
+            float v;
+            std::memcpy(&v, &bits, sizeof(v));
+            if (std::isfinite(v)) values.push_back(v);
+        }
+        std::vector<char> text(n * 25);
+        std::vector<char*> ends(n);
+        auto start = std::chrono::steady_clock::now();
+        char* p = text.data();
+        for (size_t i = 0; i < n; ++i) {
+            p = format_float(values[i], p);
+            ends[i] = p;
+            *p++ = ' ';
+        }
+        double format_ms = elapsed_ms(start);
+
+        size_t mismatch_count = 0;
+        start = std::chrono::steady_clock::now();
+        const char* q = text.data();
+        for (size_t i = 0; i < n; ++i) {
+            float v;
+            q = parse_float(q, ends[i], v);
+            if (v != values[i]) ++mismatch_count;
+            ++q;
+        }
+        double parse_ms = elapsed_ms(start);
+        cout << "floats not surviving format and parse [should be 0] = " << mismatch_count << endl;
+
+        char buffer[32];
+        start = std::chrono::steady_clock::now();
+        for (size_t i = 0; i < n; ++i) std::snprintf(buffer, sizeof(buffer), "%.9g", values[i]);
+        double snprintf_ms = elapsed_ms(start);
+        start = std::chrono::steady_clock::now();
+        float sink = 0;
+        q = text.data();
+        for (size_t i = 0; i < n; ++i) {
+            char* end = nullptr;
+            sink += std::strtof(q, &end);
+            q = ends[i] + 1;
+        }
+        double strtof_ms = elapsed_ms(start);
+        cout << n << " floats, format_float: " << format_ms << " ms, snprintf: " << snprintf_ms
+             << " ms, parse_float: " << parse_ms << " ms, strtof: " << strtof_ms << " ms" << (sink == 0 ? " " : "") << endl;
+    }
+    //////////////////////////////////////////////////////////////////////////////////////////////
+    // test xyz
+    //////////////////////////////////////////////////////////////////////////////////////////////
+    cout << "========" << endl;
+    cout << "test xyz" << endl;
+    cout << "========" << endl;
+    {
+        write_text(xyz_path, "# scanner export\n1 2 3\n  -4.5\t0.25 7 255 0 0\r\n\n8,9,10\n");
+        std::vector<float> coords;
+        cout << "read_xyz() [should be ok] = " << to_string(read_xyz(xyz_path, coords)) << endl;
+        cout << "coords.size() [should be 9] = " << coords.size() << endl;
+        cout << "coords[3], coords[5], coords[8] [should be -4.5 7 10] = "
+             << coords[3] << " " << coords[5] << " " << coords[8] << endl;
+        write_text(xyz_path, "1 2 3\n4 five 6\n");
+        cout << "read_xyz() of a bad line [should be parse failed] = " << to_string(read_xyz(xyz_path, coords)) << endl;
+
+        const size_t n = 2000000;
+        std::mt19937 rng(4);
+        std::uniform_real_distribution<float> uniform(-1000.0f, 1000.0f);
+        std::vector<float> source(n * 3);
+        for (auto& c : source) c = uniform(rng);
+
+        auto start = std::chrono::steady_clock::now();
+        io_status write_status = write_xyz(xyz_path, source.data(), n);
+        double write_ms = elapsed_ms(start);
+        start = std::chrono::steady_clock::now();
+        io_status read_status = read_xyz(xyz_path, coords);
+        double read_ms = elapsed_ms(start);
+
+        size_t mismatch_count = 0;
+        for (size_t i = 0; i < source.size(); ++i) {
+            if (i >= coords.size() || coords[i] != source[i]) ++mismatch_count;
+        }
+        cout << "write_xyz() [should be ok] = " << to_string(write_status) << ", read_xyz() [should be ok] = "
+             << to_string(read_status) << endl;
+        cout << "coordinates differing after a round trip [should be 0] = " << mismatch_count << endl;
+
+        // the iostream path this replaces, on a tenth of the points
+        const size_t stream_n = n / 10;
+        start = std::chrono::steady_clock::now();
+        {
+            std::ofstream out("text_format_test_stream.xyz");
+            out.precision(9);
+            for (size_t i = 0; i < stream_n; ++i) {
+                out << source[i * 3] << ' ' << source[i * 3 + 1] << ' ' << source[i * 3 + 2] << '\n';
+            }
+        }
+        double stream_write_ms = elapsed_ms(start) * 10;
+        start = std::chrono::steady_clock::now();
+        {
+            std::ifstream in("text_format_test_stream.xyz");
+            float v;
+            while (in >> v) {}
+        }
+        double stream_read_ms = elapsed_ms(start) * 10;
+        std::remove("text_format_test_stream.xyz");
+        cout << n << " points, write_xyz: " << write_ms << " ms, read_xyz: " << read_ms
+             << " ms, iostream (extrapolated) write: " << stream_write_ms << " ms, read: " << stream_read_ms << " ms" << endl;
+    }
+    //////////////////////////////////////////////////////////////////////////////////////////////
+    // test obj
+    //////////////////////////////////////////////////////////////////////////////////////////////
+    cout << "========" << endl;
+    cout << "test obj" << endl;
+    cout << "========" << endl;
+    {
+        write_text(obj_path,
+                   "# unit square and a triangle\n"
+                   "mtllib square.mtl\n"
+                   "v 0 0 0\nv 1 0 0\nv 1 1 0\nv 0 1 0\n"
+                   "vt 0 0\nvn 0 0 1\n"
+                   "f 1/1/1 2/1/1 3/1/1 4/1/1\n"
+                   "v 2 0 0\nv 3 0 0\nv 2 1 0\n"
+                   "usemtl red\n"
+                   "f -3//1 -2//1 -1//1\n");
+        std::vector<float> positions;
+        std::vector<std::uint32_t> triangles;
+        cout << "read_obj() [should be ok] = " << to_string(read_obj(obj_path, positions, triangles)) << endl;
+        cout << "vertices [should be 7] = " << positions.size() / 3 << endl;
+        cout << "triangles [should be 0 1 2 0 2 3 4 5 6] =";
+        for (auto idx : triangles) cout << " " << idx;
+        cout << endl;
+
+        write_text(obj_path, "v 0 0 0\nf 1 2 3\n");
+        cout << "read_obj() with an index out of range [should be parse failed] = "
+             << to_string(read_obj(obj_path, positions, triangles)) << endl;
+
+        // grid mesh round trip
+        const std::uint32_t side = 600;
+        std::vector<float> grid;
+        std::vector<std::uint32_t> grid_triangles;
+        for (std::uint32_t y = 0; y < side; ++y) {
+            for (std::uint32_t x = 0; x < side; ++x) {
+                grid.push_back(0.01f * x);
+                grid.push_back(0.01f * y);
+                grid.push_back(std::sin(0.05f * x) * std::cos(0.05f * y));
+                if (x + 1 < side && y + 1 < side) {
+                    std::uint32_t v = y * side + x;
+                    std::uint32_t quad[6] = { v, v + 1, v + side + 1, v, v + side + 1, v + side };
+                    grid_triangles.insert(grid_triangles.end(), quad, quad + 6);
+                }
+            }
+        }
+        auto start = std::chrono::steady_clock::now();
+        write_obj(obj_path, grid.data(), grid.size() / 3, grid_triangles.data(), grid_triangles.size() / 3);
+        double write_ms = elapsed_ms(start);
+        start = std::chrono::steady_clock::now();
+        io_status status = read_obj(obj_path, positions, triangles);
+        double read_ms = elapsed_ms(start);
+        cout << std::boolalpha << "read_obj() [should be ok] = " << to_string(status) << endl;
+        cout << "grid survives a round trip [should be true] = "
+             << (positions == grid && triangles == grid_triangles) << endl;
+        cout << grid.size() / 3 << " vertices, " << grid_triangles.size() / 3 << " triangles, write_obj: "
+             << write_ms << " ms, read_obj: " << read_ms << " ms" << endl;
+    }
+    //////////////////////////////////////////////////////////////////////////////////////////////
+    // test ply
+    //////////////////////////////////////////////////////////////////////////////////////////////
+    cout << "========" << endl;
+    cout << "test ply" << endl;
+    cout << "========" << endl;
+    {
+        write_text(ply_path,
+                   "ply\n"
+                   "format ascii 1.0\n"
+                   "comment exported by a scanner\n"
+                   "element vertex 4\n"
+                   "property float nx\nproperty float x\nproperty float y\nproperty float z\nproperty uchar red\n"
+                   "element face 1\n"
+                   "property list uchar int vertex_indices\n"
+                   "end_header\n"
+                   "0 0 0 0 255\n0 1 0 0 255\n0 1 1 0 255\n0 0 1 0 255\n"
+                   "4 0 1 2 3\n");
+        std::vector<float> positions;
+        std::vector<std::uint32_t> triangles;
+        cout << "read_ply() [should be ok] = " << to_string(read_ply(ply_path, positions, triangles)) << endl;
+        cout << "vertex 2 [should be 1 1 0] = " << positions[6] << " " << positions[7] << " " << positions[8] << endl;
+        cout << "triangles [should be 0 1 2 0 2 3] =";
+        for (auto idx : triangles) cout << " " << idx;
+        cout << endl;
+
+        write_text(ply_path, "ply\nformat\tascii 1.0\nelement  vertex\t3\nproperty float\tx\r\nproperty  float  y\n"
+                             "property\tfloat z\nend_header \n0 0 0\n1 0 0\n0 1 0\n");
+        cout << "read_ply() with tabs and repeated blanks in the header [should be ok] = "
+             << to_string(read_ply(ply_path, positions, triangles)) << endl;
+        cout << "positions.size() [should be 9] = " << positions.size() << endl;
+
+        write_text(ply_path, "ply\nformat ascii 1.0\nelement vertex 4\nproperty float x\nproperty float y\n"
+                             "property float z\nelement face 2\nproperty uchar flags\nproperty list uchar float uv\n"
+                             "property list uchar int vertex_indices\nproperty int material\nend_header\n"
+                             "0 0 0\n1 0 0\n1 1 0\n0 1 0\n7 2 0.5 0.5 3 0 1 2 9\n7 0 3 0 2 3 9\n");
+        cout << "read_ply() with face properties around the list [should be ok] = "
+             << to_string(read_ply(ply_path, positions, triangles)) << endl;
+        cout << "triangles [should be 0 1 2 0 2 3] =";
+        for (auto idx : triangles) cout << " " << idx;
+        cout << endl;
+        write_text(ply_path, "ply\nformat ascii 1.0\nelement vertex 3\nproperty float x\nproperty float y\n"
+                             "property float z\nelement face 1\nproperty list uchar int vertex_indices\nend_header\n"
+                             "0 0 0\n1 0 0\n1 1 0\nthree 0 1 2\n");
+        cout << "read_ply() with a bad corner count [should be parse failed] = "
+             << to_string(read_ply(ply_path, positions, triangles)) << endl;
+
+        write_text(ply_path, "ply\nformat binary_little_endian 1.0\nelement vertex 1\nproperty float x\nend_header\n");
+        cout << "read_ply() of binary ply [should be type mismatch] = "
+             << to_string(read_ply(ply_path, positions, triangles)) << endl;
+        write_text(ply_path, "ply\nformat ascii 1.0\nelement vertex 3\nproperty float x\nproperty float y\n"
+                             "property float z\nend_header\n0 0 0\n1 1 1\n");
+        cout << "read_ply() with missing vertices [should be truncated] = "
+             << to_string(read_ply(ply_path, positions, triangles)) << endl;
+
+        std::vector<float> source = { 0, 0, 0, 1.5f, 0, 0, 0, 2.25f, 0, 0, 0, -3 };
+        std::vector<std::uint32_t> source_triangles = { 0, 1, 2, 0, 2, 3, 0, 3, 1 };
+        write_ply(ply_path, source.data(), 4, source_triangles.data(), 3);
+        cout << "read_ply() [should be ok] = " << to_string(read_ply(ply_path, positions, triangles)) << endl;
+        cout << std::boolalpha << "tetrahedron survives a round trip [should be true] = "
+             << (positions == source && triangles == source_triangles) << endl;
+    }
+
+    std::remove(xyz_path.c_str());
+    std::remove(obj_path.c_str());
+    std::remove(ply_path.c_str());
+}
@@ -0,0 +1,198 @@
+#include "transforms/matrix/matrix.hpp"
+#include "transforms/matrix/packed_matrix.hpp"
+#include "transforms/transform_hierarchy.hpp"
+#include "test_timing.hpp"
+using namespace bcg;
+
+#include <chrono>
+#include <cmath>
+#include <cstring>
+#include <iostream>
+#include <random>
+#include <vector>
+using std::cout;
+using std::endl;
+
+// rotation by [angle] about z, then a translation
+static packed_matrix4<float> rotate_translate(float angle, float tx, float ty, float tz)
+{
+    packed_matrix4<float> m;
+    m(0, 0) = std::cos(angle); m(0, 1) = -std::sin(angle);
+    m(1, 0) = std::sin(angle); m(1, 1) = std::cos(angle);
+    m(0, 3) = tx; m(1, 3) = ty; m(2, 3) = tz;
+    return m;
+}
+
+// random forest of 1000-node trees, node i hangs under any earlier node of its tree
+static transform_hierarchy make_forest(size_t n, std::mt19937& rng, std::vector<packed_matrix4<float>>& locals)
+{
+    std::uniform_real_distribution<float> unit(-1.0f, 1.0f);
+    transform_hierarchy h;
+    locals.clear();
+    for (size_t i = 0; i < n; ++i) {
+        locals.push_back(rotate_translate(unit(rng), unit(rng), unit(rng), unit(rng)));
+        transform_hierarchy::index_type parent = transform_hierarchy::invalid_index;
+        size_t tree_root = i - i % 1000;
+        if (i != tree_root) parent = static_cast<transform_hierarchy::index_type>(tree_root + rng() % (i - tree_root));
+        h.add_node(locals.back(), parent);
+    }
+    return h;
+}
+
+// every world matrix recomputed from scratch by walking up to the root, bitwise compared
+static bool matches_reference(const transform_hierarchy& h, const std::vector<packed_matrix4<float>>& locals)
+{
+    const transform_hierarchy::index_type none = transform_hierarchy::invalid_index;
+    std::vector<packed_matrix4<float>> world(h.size());
+    std::vector<std::uint8_t> done(h.size(), 0);
+    std::vector<transform_hierarchy::index_type> chain;
+    for (transform_hierarchy::index_type id = 0; id < h.size(); ++id) {
+        for (transform_hierarchy::index_type a = id; a != none && !done[a]; a = h.parent(a)) chain.push_back(a);
+        while (!chain.empty()) {
+            transform_hierarchy::index_type a = chain.back();
+            chain.pop_back();
+            world[a] = h.parent(a) == none ? locals[a] : world[h.parent(a)] * locals[a];
+            done[a] = 1;
+        }
+    }
+    for (transform_hierarchy::index_type id = 0; id < h.size(); ++id) {
+        if (std::memcmp(world[id].m, h.world(id).m, sizeof(world[id].m)) != 0) return false;
+    }
+    return true;
+}
+
+int main()
+{
+    cout << "***********************************************" << endl;
+    cout << "blacker-cglib/test/transform_hierarchy_test.cpp" << endl;
+    cout << "***********************************************" << endl;
+
+    cout << std::boolalpha;
+    std::mt19937 rng(41);
+    //////////////////////////////////////////////////////////////////////////////////////////////
+    // test world transforms
+    //////////////////////////////////////////////////////////////////////////////////////////////
+    cout << "=====================" << endl;
+    cout << "test world transforms" << endl;
+    cout << "=====================" << endl;
+    {
+        transform_hierarchy h;
+        matrix<4, 4, float> shift = make_identity_matrix<4, float>();
+        shift[0][3] = 1;
+        transform_hierarchy::index_type arm = h.add_node(shift);
+        transform_hierarchy::index_type elbow = h.add_node(rotate_translate(1.57079633f, 0, 0, 0), arm);
+        transform_hierarchy::index_type hand = h.add_node(shift, elbow);
+        cout << "first update recomputes [should be 3] = " << h.update() << endl;
+        const packed_matrix4<float>& w = h.world(hand);
+        cout << "hand position [should be about (1, 1, 0)] = (" << w(0, 3) << ", " << w(1, 3) << ", " << w(2, 3) << ")"
+             << endl;
+        cout << "nothing changed, update recomputes [should be 0] = " << h.update() << endl;
+
+        h.set_local(hand, rotate_translate(0, 2, 0, 0));
+        cout << "changed leaf, update recomputes [should be 1] = " << h.update() << endl;
+        cout << "hand position [should be about (1, 2, 0)] = (" << h.world(hand)(0, 3) << ", " << h.world(hand)(1, 3)
+             << ", " << h.world(hand)(2, 3) << ")" << endl;
+        h.set_local(arm, shift);
+        h.set_local(hand, shift);
+        cout << "changed root and leaf, update recomputes [should be 3] = " << h.update() << endl;
+
+        std::vector<packed_matrix4<float>> locals;
+        transform_hierarchy forest = make_forest(200000, rng, locals);
+        forest.update();
+        cout << "200000 node forest matches the reference [should be true] = " << matches_reference(forest, locals) << endl;
+
+        size_t changed = 0;
+        for (size_t i = 0; i < 2000; ++i) {
+            transform_hierarchy::index_type id = static_cast<transform_hierarchy::index_type>(rng() % forest.size());
+            locals[id] = rotate_translate(float(i), 0.5f, 0, 0);
+            forest.set_local(id, locals[id]);
+            ++changed;
+        }
+        size_t recomputed = forest.update(1);
+        cout << changed << " locals changed, recomputed " << recomputed << " of " << forest.size() << " nodes" << endl;
+        cout << "incremental update matches the reference [should be true] = " << matches_reference(forest, locals) << endl;
+        forest.invalidate();
+        cout << "full update on 4 threads recomputes [should be 200000] = " << forest.update(4) << endl;
+        cout << "forest on 4 threads matches the reference [should be true] = " << matches_reference(forest, locals) << endl;
+
+        // one deep 100000 node tree, only splitting it at its children gives the threads work
+        transform_hierarchy tree;
+        locals.clear();
+        std::uniform_real_distribution<float> unit(-1.0f, 1.0f);
+        for (size_t i = 0; i < 100000; ++i) {
+            locals.push_back(rotate_translate(unit(rng), unit(rng), unit(rng), unit(rng)));
+            tree.add_node(locals.back(), i == 0 ? transform_hierarchy::invalid_index
+                                                : static_cast<transform_hierarchy::index_type>(rng() % i));
+        }
+        tree.update(4);
+        cout << "split tree on 4 threads matches the reference [should be true] = " << matches_reference(tree, locals)
+             << endl;
+    }
+    //////////////////////////////////////////////////////////////////////////////////////////////
+    // test reparenting
+    //////////////////////////////////////////////////////////////////////////////////////////////
+    cout << "================" << endl;
+    cout << "test reparenting" << endl;
+    cout << "================" << endl;
+    {
+        std::vector<packed_matrix4<float>> locals;
+        transform_hierarchy forest = make_forest(20000, rng, locals);
+        forest.update();
+        cout << "reparent under its own child refused [should be false] = " << forest.reparent(forest.parent(7), 7)
+             << endl;
+        cout << "reparent node 5000 under node 3 [should be true] = " << forest.reparent(5000, 3) << endl;
+        cout << "reparent node 4 to a root [should be true] = "
+             << forest.reparent(4, transform_hierarchy::invalid_index) << endl;
+        forest.update();
+        cout << "forest matches the reference after reparenting [should be true] = " << matches_reference(forest, locals)
+             << endl;
+        bool depth_first = true;
+        for (size_t slot = 0; slot < forest.size(); ++slot) {
+            transform_hierarchy::index_type p = forest.parent(forest.id_of_slot(slot));
+            depth_first = depth_first && (p == transform_hierarchy::invalid_index || forest.slot_of(p) < slot);
+        }
+        cout << "parents before children in slot order [should be true] = " << depth_first << endl;
+    }
+    //////////////////////////////////////////////////////////////////////////////////////////////
+    // test hierarchy update performance
+    //////////////////////////////////////////////////////////////////////////////////////////////
+    cout << "=================================" << endl;
+    cout << "test hierarchy update performance" << endl;
+    cout << "=================================" << endl;
+    {
+        const size_t n = 1000000, frames = 20;
+        std::vector<packed_matrix4<float>> locals;
+        transform_hierarchy forest = make_forest(n, rng, locals);
+        auto start = std::chrono::steady_clock::now();
+        forest.update();
+        double layout_ms = elapsed_ms(start);
+
+        double full_ms = 0, incremental_ms = 0, parallel_ms = 0;
+        size_t recomputed = 0;
+        for (size_t frame = 0; frame < frames; ++frame) {
+            forest.invalidate();
+            start = std::chrono::steady_clock::now();
+            forest.update(1);
+            full_ms += elapsed_ms(start);
+
+            // 0.1% of the nodes move each frame
+            for (size_t i = 0; i < n / 1000; ++i) {
+                transform_hierarchy::index_type id = static_cast<transform_hierarchy::index_type>(rng() % n);
+                locals[id] = rotate_translate(float(frame), 0.5f, 0, 0);
+                forest.set_local(id, locals[id]);
+            }
+            start = std::chrono::steady_clock::now();
+            recomputed += forest.update(1);
+            incremental_ms += elapsed_ms(start);
+
+            forest.invalidate();
+            start = std::chrono::steady_clock::now();
+            forest.update();
+            parallel_ms += elapsed_ms(start);
+        }
+        cout << "matches the reference [should be true] = " << matches_reference(forest, locals) << endl;
+        cout << n << " nodes, first layout and update: " << layout_ms << " ms, per frame: full recompute "
+             << full_ms / frames << " ms, on all threads " << parallel_ms / frames << " ms, incremental with 0.1% moved "
+             << incremental_ms / frames << " ms (" << recomputed / frames << " nodes)" << endl;
+    }
+}
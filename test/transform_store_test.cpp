@@ -0,0 +1,221 @@
+#include "transforms/matrix/matrix.hpp"
+#include "transforms/matrix/packed_matrix.hpp"
+#include "transforms/transform_store.hpp"
+#include "test_timing.hpp"
+using namespace bcg;
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <iostream>
+#include <mutex>
+#include <thread>
+#include <vector>
+using std::cout;
+using std::endl;
+
+// every transform of batch [generation] carries the generation in its translation and its own index
+static void fill_batch(packed_matrix4<float>* out, size_t n, std::uint64_t generation)
+{
+    for (size_t i = 0; i < n; ++i) {
+        out[i] = packed_matrix4<float>();
+        out[i](0, 3) = float(generation);
+        out[i](1, 3) = float(i);
+        out[i](2, 3) = float(generation) * 2;
+    }
+}
+
+// true when every transform belongs to the snapshot's generation
+static bool is_consistent(const transform_store<float>::snapshot& s)
+{
+    float g = float(s.generation());
+    for (size_t i = 0; i < s.size(); ++i) {
+        if (s[i](0, 3) != g || s[i](1, 3) != float(i) || s[i](2, 3) != g * 2) return false;
+    }
+    return true;
+}
+
+// one writer publishing [publish_count] batches against [reader_count] readers checking every snapshot
+static void stress(size_t buffer_count, size_t reader_count, size_t publish_count)
+{
+    const size_t n = 1000;
+    transform_store<float> store(n, buffer_count);
+    fill_batch(store.begin_write(), n, 1);
+    store.publish();
+
+    std::atomic<bool> done(false);
+    std::atomic<size_t> torn(0), backwards(0), snapshots(0);
+    std::vector<std::thread> readers;
+    for (size_t r = 0; r < reader_count; ++r) {
+        readers.emplace_back([&]() {
+            std::uint64_t last = 0;
+            while (!done.load()) {
+                transform_store<float>::snapshot s = store.acquire();
+                if (s.generation() < last) ++backwards;
+                last = s.generation();
+                if (!is_consistent(s)) ++torn;
+                ++snapshots;
+            }
+        });
+    }
+    auto start = std::chrono::steady_clock::now();
+    for (std::uint64_t g = 2; g <= publish_count; ++g) {
+        fill_batch(store.begin_write(), n, g);
+        store.publish();
+    }
+    double ms = elapsed_ms(start);
+    done = true;
+    for (auto& t : readers) t.join();
+
+    transform_store_stats stats = store.stats();
+    cout << buffer_count << " buffers, " << reader_count << " readers, " << publish_count << " publishes in " << ms
+         << " ms, " << snapshots.load() << " snapshots read" << endl;
+    cout << "  torn snapshots [should be 0] = " << torn.load() << ", generations going backwards [should be 0] = "
+         << backwards.load() << endl;
+    cout << "  latest generation [should be " << publish_count << "] = " << store.generation()
+         << " (reader retries " << stats.reader_retries << ", writer waits " << stats.writer_waits << ")" << endl;
+}
+
+int main()
+{
+    cout << "*******************************************" << endl;
+    cout << "blacker-cglib/test/transform_store_test.cpp" << endl;
+    cout << "*******************************************" << endl;
+
+    cout << std::boolalpha;
+    //////////////////////////////////////////////////////////////////////////////////////////////
+    // test publish and acquire
+    //////////////////////////////////////////////////////////////////////////////////////////////
+    cout << "========================" << endl;
+    cout << "test publish and acquire" << endl;
+    cout << "========================" << endl;
+    {
+        transform_store<float> store(4);
+        {
+            transform_store<float>::snapshot s = store.acquire();
+            cout << "initial generation [should be 0] = " << s.generation() << ", first transform is identity "
+                 << "[should be true] = " << (s[0](0, 0) == 1 && s[0](0, 3) == 0) << endl;
+        }
+
+        fill_batch(store.begin_write(), 4, 1);
+        cout << "publish() [should be 1] = " << store.publish() << endl;
+        transform_store<float>::snapshot pinned = store.acquire();
+        for (std::uint64_t g = 2; g <= 5; ++g) {
+            fill_batch(store.begin_write(), 4, g);
+            store.publish();
+        }
+        cout << "pinned snapshot after 4 more publishes, generation [should be 1] = " << pinned.generation()
+             << ", consistent [should be true] = " << is_consistent(pinned) << endl;
+        cout << "latest generation [should be 5] = " << store.generation() << endl;
+        pinned.release();
+        cout << "released snapshot is empty [should be true] = " << pinned.empty() << endl;
+
+        // a partial update on top of the latest batch
+        packed_matrix4<float>* out = store.begin_write(true);
+        out[2](0, 3) = 42;
+        store.publish();
+        transform_store<float>::snapshot s = store.acquire();
+        cout << "keep_latest partial update, transform 1 x [should be 5] = " << s[1](0, 3) << ", transform 2 x "
+             << "[should be 42] = " << s[2](0, 3) << endl;
+        s.release();
+
+        std::vector<matrix<4, 4, float>> batch(4, make_identity_matrix<4, float>());
+        batch[3][1][3] = 7;
+        store.publish(batch.data());
+        s = store.acquire();
+        cout << "publish(matrix batch), generation [should be 7] = " << s.generation() << ", transform 3 y "
+             << "[should be 7] = " << s[3](1, 3) << endl;
+    }
+    //////////////////////////////////////////////////////////////////////////////////////////////
+    // test concurrent readers
+    //////////////////////////////////////////////////////////////////////////////////////////////
+    cout << "=======================" << endl;
+    cout << "test concurrent readers" << endl;
+    cout << "=======================" << endl;
+    {
+        stress(3, 3, 5000);
+        // double buffering makes the writer wait for stragglers, fewer rounds
+        stress(2, 3, 500);
+        stress(4, 8, 5000);
+    }
+    //////////////////////////////////////////////////////////////////////////////////////////////
+    // test transform store latency
+    //////////////////////////////////////////////////////////////////////////////////////////////
+    cout << "============================" << endl;
+    cout << "test transform store latency" << endl;
+    cout << "============================" << endl;
+    {
+        const size_t n = 10000;
+        const int rounds = 1000000;
+        transform_store<float> store(n);
+        auto start = std::chrono::steady_clock::now();
+        std::uint64_t checksum = 0;
+        for (int i = 0; i < rounds; ++i) {
+            transform_store<float>::snapshot s = store.acquire();
+            checksum += s.generation() + size_t(s[0](0, 0));
+        }
+        double acquire_ms = elapsed_ms(start);
+
+        // the mutex alternative: a reader copies the batch under the lock
+        std::mutex guard;
+        std::vector<packed_matrix4<float>> shared(n), copy(n);
+        const int copy_rounds = 10000;
+        start = std::chrono::steady_clock::now();
+        for (int i = 0; i < copy_rounds; ++i) {
+            std::lock_guard<std::mutex> lock(guard);
+            std::copy(shared.begin(), shared.end(), copy.begin());
+            checksum += size_t(copy[i % n](0, 0));
+        }
+        double copy_ms = elapsed_ms(start);
+        cout << n << " transforms, acquire + release: " << acquire_ms * 1e6 / rounds << " ns, locked copy: "
+             << copy_ms * 1e6 / copy_rounds << " ns (checksum " << checksum << ")" << endl;
+
+        std::vector<packed_matrix4<float>> batch(n);
+        fill_batch(batch.data(), n, 0);
+        const int publish_rounds = 1000;
+        start = std::chrono::steady_clock::now();
+        for (int i = 0; i < publish_rounds; ++i) store.publish(batch.data());
+        cout << n << " transforms, publish of a whole batch: " << elapsed_ms(start) * 1000 / publish_rounds << " us"
+             << endl;
+
+        // publish to observe: the writer stamps each generation, readers poll and note how long
+        // it took them to see it
+        const std::uint64_t publish_count = 2000;
+        std::vector<std::chrono::steady_clock::time_point> stamps(publish_count + 2);
+        transform_store<float> live(n);
+        std::atomic<bool> done(false);
+        std::vector<double> worst(2, 0), total(2, 0);
+        std::vector<size_t> seen(2, 0);
+        std::vector<std::thread> readers;
+        for (size_t r = 0; r < 2; ++r) {
+            readers.emplace_back([&, r]() {
+                std::uint64_t last = 0;
+                while (!done.load()) {
+                    std::uint64_t g = live.generation();
+                    if (g != last) {
+                        double us = std::chrono::duration<double, std::micro>(std::chrono::steady_clock::now() -
+                                                                              stamps[g]).count();
+                        worst[r] = std::max(worst[r], us);
+                        total[r] += us;
+                        ++seen[r];
+                        last = g;
+                    }
+                    else {
+                        std::this_thread::yield();
+                    }
+                }
+            });
+        }
+        for (std::uint64_t g = 1; g <= publish_count; ++g) {
+            fill_batch(live.begin_write(), n, g);
+            stamps[g] = std::chrono::steady_clock::now();
+            live.publish();
+            std::this_thread::yield();
+        }
+        done = true;
+        for (auto& t : readers) t.join();
+        cout << "publish to observe, 2 polling readers: mean " << (total[0] + total[1]) / (seen[0] + seen[1])
+             << " us, worst " << std::max(worst[0], worst[1]) << " us (" << seen[0] + seen[1] << " observations)"
+             << endl;
+    }
+}